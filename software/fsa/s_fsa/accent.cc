@@ -20,7 +20,7 @@
  * Remarks:     Only to launch fsa contructor.
  */
 accent_fsa::accent_fsa(word_list *dict_list, const char *language_file = NULL)
-: fsa(dict_list, language_file)
+: fsa(dict_list, language_file, TRUE)
 {
 }//accent_fsa::accent_fsa
  
@@ -80,7 +80,6 @@ int
 accent_fsa::accent_word(const char *word, const accent_tabs *equiv)
 {
   dict_list		*dict;
-  fsa_arc_ptr		*dummy = NULL;
 #ifdef CASECONV
   int			converted = FALSE;
 #endif
@@ -103,19 +102,13 @@ accent_fsa::accent_word(const char *word, const accent_tabs *equiv)
       converted = *word;
     }
 #endif
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-    sparse_word_accents(word, 0, sparse_vect->get_first());
-#else
-    fsa_arc_ptr nxt_node = dummy->first_node(current_dict);
-    word_accents(word, 0, nxt_node.set_next_node(current_dict));
-#endif
+    accent_dictionary(word);
 #ifdef CASECONV
     if (converted) {
       // convert back to uppercase
       myflipcase((char *)word, 1);
       //*((char *)word) = casetab[(unsigned char)*word];
-      fsa_arc_ptr xnt_node = dummy->first_node(current_dict);
-      word_accents(word, 0, xnt_node.set_next_node(current_dict));
+      accent_dictionary(word);
     }
 #endif
   }
@@ -135,6 +128,57 @@ accent_fsa::accent_word(const char *word, const accent_tabs *equiv)
 }//accent_fsa::accent_word
 
 
+#ifdef MULTI_FORMAT
+/* Class name:	accent_kernel
+ * Purpose:	Restore accents of a word in an automaton with arcs
+ *		of the class made for its format.
+ * Methods:	accent_kernel	- remembers the restorer and the word;
+ *		operator()	- restores accents from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct accent_kernel {
+  accent_fsa	*restorer;	/* who restores accents */
+  const char	*word;		/* word without accents */
+  accent_kernel(accent_fsa *a, const char *w) { restorer = a; word = w; }
+  template <class A>
+  int operator()(A root) {
+    return restorer->word_accents(word, 0, root.set_next_node());
+  }
+};/* struct accent_kernel */
+#endif
+
+
+/* Name:	accent_dictionary
+ * Class:	accent_fsa
+ * Purpose:	Restore accents of a word using the current dictionary.
+ * Parameters:	word	- (i) word to be checked.
+ * Returns:	Number of words in the list of equivalent words.
+ * Remarks:	With MULTI_FORMAT, the format of the dictionary is looked
+ *		at here (see morph_fsa::morph_dictionary).
+ */
+int
+accent_fsa::accent_dictionary(const char *word)
+{
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  if (sparse_vect == NULL) {
+    accent_kernel kernel(this, word);
+    return with_format(current_format, kernel);
+  }
+#endif
+  return sparse_word_accents(word, 0, sparse_vect->get_first());
+#else
+#ifdef MULTI_FORMAT
+  accent_kernel kernel(this, word);
+  return with_format(current_format, kernel);
+#else
+  fsa_arc_ptr nxt_node = first_node();
+  return word_accents(word, 0, nxt_node.set_next_node());
+#endif
+#endif
+}//accent_fsa::accent_dictionary
+
+
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 /* Name:	sparse_word_accents
  * Class:	accent_fsa
@@ -163,7 +207,6 @@ accent_fsa::sparse_word_accents(const char *word, const int level,
   unsigned char	char_no;
   long current = start;
   long next;
-  fsa_arc_ptr *dummy;
 
   if (level + 1 >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
@@ -224,11 +267,11 @@ accent_fsa::sparse_word_accents(const char *word, const int level,
       sparse_word_accents(word + 1, level + 1, next);
     }
     else {
-      word_accents(word + 1, level + 1, current_dict + next
+      word_accents(word + 1, level + 1, node_at(next
 #ifdef NUMBERS
-		   + dummy->entryl
+		   + current_format->entryl
 #endif
-		   );
+		   ));
     }
   }
   return replacements.how_many();
@@ -252,17 +295,18 @@ accent_fsa::sparse_word_accents(const char *word, const int level,
  *		equivalent to the `word'.
  *		
  */
+template <class A>
 int
 accent_fsa::word_accents_dia(const char *word, const int level,
-			     fsa_arc_ptr start, const unsigned int dia)
+			     A start, const unsigned int dia)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   unsigned char	char_no;
 
-  forallnodes(i) {
+  forallarcs(i) {
     char_no = (unsigned char)next_node.get_letter();
     if (char_eq[dia + char_no].chr == char_no) {
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      A nxt_node = next_node.set_next_node();
       candidate[level] = char_no;
       if (char_eq[dia + char_no].follow == -1) {
 	// There is an arc labeled with one of the equivalent characters
@@ -300,10 +344,11 @@ accent_fsa::word_accents_dia(const char *word, const int level,
  *		Note: this can be used for other forms of equivalencies,
  *		not necessarily with diacritics.
  */
+template <class A>
 int
-accent_fsa::word_accents(const char *word, const int level, fsa_arc_ptr start)
+accent_fsa::word_accents(const char *word, const int level, A start)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
 
   if (level + 1 >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
@@ -323,7 +368,7 @@ accent_fsa::word_accents(const char *word, const int level, fsa_arc_ptr start)
     }
   }
   // Check whether the current character stands for itself
-  forallnodes(i) {
+  forallarcs(i) {
     if (*word == next_node.get_letter()) {
       candidate[level] = next_node.get_letter();
       if (word[1] == '\0' && next_node.is_final()) {
@@ -331,14 +376,14 @@ accent_fsa::word_accents(const char *word, const int level, fsa_arc_ptr start)
 	replacements.insert_sorted(candidate);
       }
       else {
-	fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	A nxt_node = next_node.set_next_node();
 	word_accents(word + 1, level + 1, nxt_node);
       }
     }
   }
 #else
   unsigned char	char_no;
-  forallnodes(i) {
+  forallarcs(i) {
     char_no = (unsigned char)(next_node.get_letter());
     if (*word == char_eq[char_no]) {
       candidate[level] = next_node.get_letter();
@@ -347,7 +392,7 @@ accent_fsa::word_accents(const char *word, const int level, fsa_arc_ptr start)
 	replacements.insert_sorted(candidate);
       }
       else {
-	fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	A nxt_node = next_node.set_next_node();
 	word_accents(word + 1, level + 1, nxt_node);
       }
     }
@@ -57,12 +57,14 @@ public:
   int sparse_word_accents(const char *word, const int level,
 			  const long start);
 #endif
-  int word_accents(const char *word, const int level,
-			  fsa_arc_ptr start);
+  template <class A>
+  int word_accents(const char *word, const int level, A start);
 #if defined(UTF8) && !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
-  int word_accents_dia(const char *word, const int level, fsa_arc_ptr start,
+  template <class A>
+  int word_accents_dia(const char *word, const int level, A start,
 		       const unsigned int dia);
 #endif
+  int accent_dictionary(const char *word);
   int accent_word(const char *word, const accent_tabs *equiv);
   int accent_file(tr_io &io_obj, const accent_tabs *equiv);
 };/*class accent_fsa*/
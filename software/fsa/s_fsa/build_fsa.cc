@@ -26,41 +26,164 @@ the index of the first arc that leads from the node the given arc points to.
 #include	<stdlib.h>
 #include	<new>
 #include	<unistd.h>
+#include	<time.h>
 #include	"fsa.h"
 #include	"nnode.h"
 #include	"nstr.h"
 #include	"nindex.h"
+#include	"ninput.h"
 #include	"build_fsa.h"
+#include	"ncfsa2.h"
 
 const	int	WORD_BUFFER_LENGTH = 128;
 
-char		ANNOT_SEPARATOR = '+';	/* annotation separator */
-
-#ifdef FLEXIBLE
-int		fsa_arc_ptr::gtl = 2;	/* initialization (must be defined) */
-int		fsa_arc_ptr::size = 4;	/* the same */
-#ifdef NUMBERS
-int		fsa_arc_ptr::entryl = 0;	/* the same */
-int		fsa_arc_ptr::aunit = 1;	/* not used here (must be defined) */
-int		node::node_count = 1;	/* number of nodes in the automaton */
-int		node::arc_count = 1;	/* number of arcs in the automaton */
-int		node::entryl=0;		/* must be defined somewhere */
-int		node::a_size=0;		/* must be defined somewhere */
-#endif
-#endif
 #ifdef WEIGHTED
-int		goto_offset = 1;
+int		goto_offset = 1;	/* not used here (must be defined) */
 #endif
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-char *annot_buffer;		// buffer for annotations
-long int ab_ptr;		// index in that buffer
-#endif //FLEXIBLE&STOPBIT&SPARSE
 
 
 #ifdef A_TERGO
 #include	"mkindex.cc"
 #endif //A_TERGO
 
+/* Name:	automaton
+ * Class:	automaton
+ * Purpose:	Creates an empty automaton.
+ * Parameters:	None.
+ * Returns:	Nothing (constructor).
+ * Remarks:	The automaton gets its own build context, so that
+ *		it can be built while other automata are being built.
+ */
+automaton::automaton(void)
+{
+  context = new build_context;
+  build_scope	scope(context);
+  root = new node();
+  FILLER = '_';
+}//automaton::automaton
+
+
+/* Name:	~automaton
+ * Class:	automaton
+ * Purpose:	Releases all memory used by the automaton.
+ * Parameters:	None.
+ * Returns:	Nothing (destructor).
+ * Remarks:	Nodes are not destroyed one by one; the arena
+ *		of the context gives their memory back.
+ */
+automaton::~automaton(void)
+{
+  delete context;
+}//automaton::~automaton
+
+
+/* Name:	set_annot_separator
+ * Class:	automaton
+ * Purpose:	Sets the character that separates words from annotations.
+ * Parameters:	c		- (i) the separator.
+ * Returns:	Nothing.
+ * Remarks:	It must be set before the automaton is built.
+ */
+void
+automaton::set_annot_separator(const char c)
+{
+  context->annot_separator = c;
+}//automaton::set_annot_separator
+
+/* Name:	set_format
+ * Class:	automaton
+ * Purpose:	Sets the version (format) of the automaton to be written.
+ * Parameters:	version		- (i) version of the automaton.
+ * Returns:	TRUE if the version can be written, FALSE otherwise.
+ * Remarks:	It must be set before arcs are shared (share_arcs),
+ *		as only some versions can have shared tails of nodes.
+ *		The default version follows from compile options.
+ */
+int
+automaton::set_format(const int version)
+{
+  if (!format_available(version))
+    return FALSE;
+  context->version = version;
+  return TRUE;
+}//automaton::set_format
+
+
+#ifdef MORE_COMPR
+/* Name:	set_reordering
+ * Class:	automaton
+ * Purpose:	Sets how long the order of nodes may be chosen.
+ * Parameters:	seconds		- (i) time for reorder_states
+ *				  (0 - nodes are not reordered).
+ * Returns:	Nothing.
+ * Remarks:	Only versions with NEXTBIT are reordered.
+ */
+void
+automaton::set_reordering(const int seconds)
+{
+  context->reorder_time = seconds;
+}//automaton::set_reordering
+#endif //MORE_COMPR
+
+
+#ifdef A_TERGO
+/* Name:	make_index
+ * Class:	automaton
+ * Purpose:	Turns the automaton into an index a tergo (for fsa_guess).
+ * Parameters:	prefix_mode	- (i) whether prefixes are to be guessed
+ *				  (with GENERALIZE);
+ *		weighted	- (i) whether arcs should have weights
+ *				  (with WEIGHTED).
+ * Returns:	Nothing.
+ * Remarks:	Nodes get arc_no equal to -1 at the end, so that
+ *		the automaton can be written.
+ */
+void
+automaton::make_index(const int prefix_mode, const int weighted)
+{
+  build_scope	scope(context);
+
+#ifdef PROGRESS
+  cerr << "Pruning arcs" << endl;
+#endif
+  find_or_register(root, PRIM_INDEX, TRUE);
+#ifdef WEIGHTED
+  if (weighted) {
+    weight_arcs(root);
+  }
+#endif //WEIGHTED
+#ifdef GENERALIZE
+  collect_annotations(root, prefix_mode);
+#endif
+  root = reduce_inner(root);
+#ifdef GENERALIZE
+  new_gen(root, prefix_mode);
+  remove_annot_pointers(root); // !!!! some states get 0 hit_count
+#endif
+  // nodes must have arc_no set to -1
+  mark_inner(root, -1);
+}//automaton::make_index
+#endif //A_TERGO
+
+
+/* Name:	share_arcs
+ * Class:	automaton
+ * Purpose:	Makes the automaton smaller by letting nodes share arcs
+ *		(option -O).
+ * Parameters:	level		- (i) effort (-O1, -O2, -O3, see nindex.h);
+ *		jobs		- (i) number of threads.
+ * Returns:	Number of arcs removed.
+ * Remarks:	The automaton does not depend on the number of threads.
+ */
+int
+automaton::share_arcs(const int level, const int jobs)
+{
+  build_scope	scope(context);
+
+  return ::share_arcs(root, level, jobs);
+}//automaton::share_arcs
+
+
 /* Name:	write_fsa
  * Class:	automaton
  * Purpose:	Writes the automaton in a binary form.
@@ -74,57 +197,305 @@ long int ab_ptr;		// index in that buffer
  *
  *		The automaton file begins with the signature.
  *		The signature is followed by transitions of variable length.
+ *
+ *		All nodes and arcs are released (with build_arena) when
+ *		the automaton has been written, so it cannot be used
+ *		afterwards.
 #ifdef SPARSE
  *		The next part contains sparse vector encoding
  *		transitions in the part of the automaton before annotations.
 #endif
+ *		The automaton is written in the version set with set_format
+ *		by write_format instantiated for that version,
+ *		or by write_cfsa2.
 */
 int
 automaton::write_fsa(ostream &outfile, const int make_numbers)
+{
+  switch (context->version) {
+#ifdef CFSA2
+  case CFSA2_VERSION:
+  case RCFSA2_VERSION:
+  case SCFSA2_VERSION:
+    return write_cfsa2(outfile, make_numbers);
+#endif //CFSA2
+#if defined(FLEXIBLE) && !defined(SPARSE) && !defined(WEIGHTED)
+#ifdef STOPBIT
+  case 4:
+    return write_format<arc_encoding<4> >(outfile, make_numbers);
+  case 5:
+    return write_format<arc_encoding<5> >(outfile, make_numbers);
+#ifdef NUMBERS
+  case RANKED_FORMAT | 4:
+    return write_format<arc_encoding<RANKED_FORMAT | 4> >(outfile,
+							 make_numbers);
+  case RANKED_FORMAT | 5:
+    return write_format<arc_encoding<RANKED_FORMAT | 5> >(outfile,
+							 make_numbers);
+#endif //NUMBERS
+  case 6:
+    return write_format<arc_encoding<6> >(outfile, make_numbers);
+  case 7:
+    return write_format<arc_encoding<7> >(outfile, make_numbers);
+#endif //STOPBIT
+  case 1:
+    return write_format<arc_encoding<1> >(outfile, make_numbers);
+  case 2:
+    return write_format<arc_encoding<2> >(outfile, make_numbers);
+#endif //FLEXIBLE&!SPARSE&!WEIGHTED
+  }
+  return write_format<arc_encoding<BUILD_FORMAT> >(outfile, make_numbers);
+}//automaton::write_fsa
+
+/* Name:	number_nodes
+ * Class:	automaton
+ * Purpose:	Assigns addresses to nodes (numbers arcs).
+ * Parameters:	E		- (t) format of arcs (arc_encoding);
+ *		meta_root	- (i) node with one arc leading to the root;
+ *		gtl		- (i) length of the goto field
+ *				  (0 - only count arcs);
+ *		weighted	- (i) whether arcs have weights (WEIGHTED).
+ * Returns:	Nothing.
+ * Remarks:	Nodes that are put only as next nodes (MORE_COMPR, see
+ *		reorder_states) are numbered after all other nodes
+ *		if no node whose last arc leads to them has been numbered
+ *		before them. The counter of arcs in the build context
+ *		must have its initial value.
+ */
+template <class E>
+void
+automaton::number_nodes(node *meta_root, const int gtl, const int weighted)
+{
+#ifdef MORE_COMPR
+  context->deferred.clear();
+#endif
+#ifdef WEIGHTED
+  meta_root->number_arcs<E>(gtl, weighted);
+#else //!WEIGHTED
+  meta_root->number_arcs<E>(gtl);
+#endif //!WEIGHTED
+#ifdef MORE_COMPR
+  // the vector grows while nodes in it are numbered
+  for (unsigned int i = 0; i < context->deferred.size(); i++) {
+    node *n = context->deferred[i];
+    if (n->get_arc_no() == -1) {
+#ifdef WEIGHTED
+      n->number_arcs<E>(gtl, weighted);
+#else //!WEIGHTED
+      n->number_arcs<E>(gtl);
+#endif //!WEIGHTED
+    }
+  }
+#endif //MORE_COMPR
+}//automaton::number_nodes
+
+
+#ifdef MORE_COMPR
+/* Name:	reorder_states
+ * Class:	automaton
+ * Purpose:	Chooses the order of nodes so that more nodes follow
+ *		a node whose last arc leads to them.
+ * Parameters:	E		- (t) format of arcs (arc_encoding);
+ *		meta_root	- (i) node with one arc leading to the root;
+ *		gtl		- (i) length of the goto field;
+ *		weighted	- (i) whether arcs have weights (WEIGHTED).
+ * Returns:	Size of the automaton in bytes (as numbered by number_nodes).
+ * Remarks:	Nodes are numbered in depth-first order, and the target
+ *		of the last arc of a node is numbered first, so that the arc
+ *		needs no address (NEXTBIT) - unless the target has already
+ *		been numbered as a target of another arc. Each node can
+ *		follow only one node, so as many nodes as possible are
+ *		paired with targets of their arcs (a maximum matching
+ *		in a bipartite graph). The arc that leads to the target
+ *		becomes the last one, and the target is numbered only
+ *		after that node (put_after), or after all other nodes.
+ *		Only arcs that can be moved (free_end) are considered,
+ *		in nodes that keep their own arcs (not in big brothers),
+ *		and leading to such nodes (or to the beginning of them).
+ *
+ *		Each pass looks for paths that add a pair for all nodes
+ *		without one; it takes linear time. Passes are repeated
+ *		until no pair can be added, or reorder_time seconds
+ *		have passed. The size of the automaton after each pass
+ *		is reported, and the order is kept only if the automaton
+ *		gets smaller.
+ *
+ *		Arcs must not be numbered when the function is called,
+ *		and they are not numbered when it returns.
+ */
+template <class E>
+long int
+automaton::reorder_states(node *meta_root, const int gtl, const int weighted)
+{
+  build_context	*ctx = context;
+  int		first_arc = ctx->no_of_arcs;	// initial value of the counter
+  clock_t	deadline = clock() + (clock_t)ctx->reorder_time * CLOCKS_PER_SEC;
+  vector<node *> nodes;
+  vector<int>	first_edge;	// first edge of each node, and the end
+				// of edges of the last node
+  vector<int>	target;		// target node of each edge
+  vector<int>	arc;		// the arc of each edge in its node
+  vector<int>	matched;	// edge of each node in pairs (-1 - none)
+  vector<int>	owner;		// node paired with each node (-1 - none)
+  vector<int>	seen;		// last pass in which a node was a target
+  vector<pair<int, int> > path;	// nodes and their current edges
+  long int	first_size, size = 0L;
+  int		pairs = 0;
+  int		found, n, e, t;
+
+  number_nodes<E>(meta_root, gtl, weighted);
+  first_size = ctx->no_of_arcs;
+  cerr << "Reordering states: " << first_size << " bytes" << endl;
+  mark_inner(root, -1);
+  collect_nodes(root, nodes);
+  for (unsigned int i = 0; i < nodes.size(); i++) {
+    node *p = nodes[i];
+    first_edge.push_back(target.size());
+    if (p->get_big_brother() == NULL
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
+	&& p->free_beg == 0
+#endif
+	) {
+      // with numbers of entries (NUMBERS), arcs keep their order
+      for (int a = (ctx->entryl ? p->get_no_of_kids() - 1
+		    : p->get_no_of_kids() - p->free_end);
+	   a < p->get_no_of_kids(); a++) {
+	node *c = p->get_children()[a].child;
+	// the big brother of c is put right after p if c is at its beginning
+	if (c && c->get_big_brother() && c->get_brother_offset() == 0
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
+	    && c->free_beg == 0
+#endif
+	    )
+	  c = c->get_big_brother();
+	if (c && c->get_big_brother() == NULL && c->get_no_of_kids() > 0
+	    && c->get_arc_no() >= 0) {
+	  target.push_back(c->get_arc_no());
+	  arc.push_back(a);
+	}
+      }
+    }
+  }
+  first_edge.push_back(target.size());
+  for (unsigned int i = 0; i < nodes.size(); i++)
+    nodes[i]->set_arc_no(-1);
+  matched.assign(nodes.size(), -1);
+  owner.assign(nodes.size(), -1);
+  seen.assign(nodes.size(), -1);
+
+  for (int pass = 0; clock() < deadline; pass++) {
+    found = 0;
+    for (int s = 0; s < (int)nodes.size(); s++) {
+      if (matched[s] != -1)
+	continue;
+      // Depth-first search for a path from s to a node without a pair;
+      // targets seen in this pass lead to no such node
+      path.clear();
+      path.push_back(make_pair(s, first_edge[s]));
+      while (!path.empty()) {
+	n = path.back().first;
+	e = path.back().second;
+	if (e == first_edge[n + 1]) {
+	  path.pop_back();
+	  if (!path.empty())
+	    path.back().second++;
+	  continue;
+	}
+	t = target[e];
+	if (seen[t] == pass) {
+	  path.back().second++;
+	  continue;
+	}
+	seen[t] = pass;
+	if (owner[t] == -1) {
+	  // each node on the path is paired with the target of its edge
+	  for (unsigned int k = 0; k < path.size(); k++) {
+	    matched[path[k].first] = path[k].second;
+	    owner[target[path[k].second]] = path[k].first;
+	  }
+	  found++;
+	  break;
+	}
+	path.push_back(make_pair(owner[t], first_edge[owner[t]]));
+      }
+    }
+    if (found == 0)
+      break;
+    pairs += found;
+
+    // Put the arcs to the paired nodes last, and number the nodes
+    for (unsigned int i = 0; i < nodes.size(); i++)
+      nodes[i]->put_after = NULL;
+    for (int s = 0; s < (int)nodes.size(); s++) {
+      if ((e = matched[s]) == -1)
+	continue;
+      node *p = nodes[s];
+      int last = p->get_no_of_kids() - 1;
+      if (arc[e] != last) {
+	arc_node tmp_arc = p->get_children()[last];
+	p->get_children()[last] = p->get_children()[arc[e]];
+	p->get_children()[arc[e]] = tmp_arc;
+	for (int e2 = first_edge[s]; e2 < first_edge[s + 1]; e2++)
+	  if (arc[e2] == last)
+	    arc[e2] = arc[e];
+	arc[e] = last;
+      }
+      nodes[target[e]]->put_after = p;
+    }
+    ctx->no_of_arcs = first_arc;
+    number_nodes<E>(meta_root, gtl, weighted);
+    size = ctx->no_of_arcs;
+    cerr << "Reordering pass " << pass + 1 << ": " << pairs
+	 << " pairs of states, " << size << " bytes, "
+	 << first_size - size << " saved" << endl;
+    for (unsigned int i = 0; i < nodes.size(); i++)
+      nodes[i]->set_arc_no(-1);
+  }
+  if (pairs == 0 || size >= first_size) {
+    for (unsigned int i = 0; i < nodes.size(); i++)
+      nodes[i]->put_after = NULL;
+    size = first_size;
+  }
+  ctx->no_of_arcs = first_arc;
+  return size;
+}//automaton::reorder_states
+#endif //MORE_COMPR
+
+
+/* Name:	write_format
+ * Class:	automaton
+ * Purpose:	Writes the automaton in a binary form in the given format.
+ * Parameters:	E		- (t) format of arcs (arc_encoding);
+ *		outfile		- (o) file to be written;
+ *		make_numbers	- (i) whether to assign numbers to entries.
+ * Returns:	TRUE if automaton written, FALSE otherwise.
+ * Remarks:	See write_fsa.
+ */
+template <class E>
+int
+automaton::write_format(ostream &outfile, const int make_numbers)
 {
 #ifdef FLEXIBLE
   char		bytes[8];	/* output buffer for fsa arc */
-  fsa_arc_ptr	*dummy;
+  int		arc_size = 0;	/* size of an arc (without entries) */
 #else //!FLEXIBLE
   fsa_arc	output_arc;
 #endif //!FLEXIBLE
   node		*meta_root;
   signature	sig_arc;
   int		result;
+  int		gtl = 0;
 #ifdef FLEXIBLE
   int		gtl_calculated = FALSE;
-  int		gtl;
 #endif //FLEXIBLE
 #ifdef WEIGHTED
   int		weighted = (root->get_children()->weight ? 1 : 0);
-#endif
-  int		flag_bits =
-#ifdef NEXTBIT
-#ifdef STOPBIT
-#ifdef TAILS
-	     4			// 4 bits from go_to taken by flags
-#else //!TAILS
-	     3			// 3 bits from go_to taken by flags
-#endif //!TAILS
-#else //!STOPBIT
-	     1			// 1 bit from go_to taken by a flag
-#endif //!STOPBIT
-#else //!NEXTBIT
-#ifdef STOPBIT
-#ifdef TAILS
-	     3			// 3 bits from go_to taken by flags
-#else //!TAILS
-	     2			// 2 bits from go_to taken by flags
-#endif //!TAILS
-#else //!STOPBIT
-	     0			// the final flag in the counter
-#endif //!STOPBIT
-#endif //!NEXTBIT
-    ;
-
-#ifdef WEIGHTED
-  goto_offset = 1 + weighted;
-#endif //WEIGHTED
+  int		goto_offset = 1 + weighted;
+#else //!WEIGHTED
+  const int	goto_offset = E::goto_offset;
+#endif //!WEIGHTED
+  build_scope	scope(context);
+  build_context	*ctx = context;
 
   meta_root = new node;
   meta_root->add_child(START_CHAR, root);
@@ -157,32 +528,32 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
     number_entries(meta_root);
   }
 // pending: FLEXIBLE & NUMBERS
-  dummy->entryl = 0;
+  ctx->entryl = 0;
   gtl = 0;
   int as;
   if (make_numbers) {
     // calculate the length (in bytes) of the number of words in the fsa
     for (int ni = root->get_entries(); ni; ni >>= 8)
-      dummy->entryl++;
+      ctx->entryl++;
     // calculate the length (in bytes) of the goto field
     do {
       gtl++;
-      as = root->get_node_count() * dummy->entryl
+      as = root->get_node_count() * ctx->entryl
 	+ root->get_arc_count() * 
-	(gtl + goto_offset);
-    } while (as >> (8 * gtl - flag_bits));
+	(gtl + goto_offset + (E::ranked ? ctx->entryl : 0));
+    } while (as >> (8 * gtl - E::flag_bits));
   }
-  root->set_entryl(dummy->entryl);
+  root->set_entryl(ctx->entryl);
   root->set_a_size(goto_offset + gtl);
-  if (dummy->entryl)
+  if (ctx->entryl)
     // because we have the option NUMBERS, and -N, so the addresses
     // are in bytes; therefore, we must reculaculate the first address
     // (the initial value of no_of_arcs, which used to be 1)
-    root->no_of_arcs = gtl + dummy->entryl + goto_offset;
+    ctx->no_of_arcs = gtl + ctx->entryl + goto_offset;
 #else //!NUMBERS
 #endif //!NUMBERS
 #if defined(STOPBIT) && defined(SPARSE)
-  meta_root->in_annotations = false;
+  ctx->in_annotations = false;
 #endif //SPARSE
 #endif //FLEXIBLE
   // No conditionals here
@@ -190,78 +561,74 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
   cerr << "Counting arcs" << endl;
 #endif //PROGRESS
 #ifdef FLEXIBLE
-#if (defined(STOPBIT) && defined(TAILS)) || defined(NEXTBIT)
+  if (E::in_bytes) {
+    // Addresses are in bytes, so arcs are counted first
 #ifdef WEIGHTED
-  meta_root->number_arcs(0, weighted);	// only count arcs
+    number_nodes<E>(meta_root, 0, weighted);	// only count arcs
 #else //!WEIGHTED
-  meta_root->number_arcs(0);	// only count arcs
+    number_nodes<E>(meta_root, 0, FALSE);	// only count arcs
 #endif //!WEIGHTED
 #if defined(SPARSE)
-  meta_root->in_annotations = false;
+    ctx->in_annotations = false;
 #endif //SPARSE
-  // we need to calcuate gtl first, as it is used in numbering arcs
-  gtl = 1;
-//  cerr << "no_of_arcs = " << meta_root->no_of_arcs << endl;
-//  cerr << "tails = " << meta_root->tails << endl;
-  for (int r = meta_root->no_of_arcs;(
+    // we need to calcuate gtl first, as it is used in numbering arcs
+    gtl = 1;
+    for (int r = ctx->no_of_arcs;(
 #ifdef NUMBERS
-       (root->get_node_count() * dummy->entryl) +
+	 (root->get_node_count() * ctx->entryl) +
 #endif //NUMBERS
-       (r * (goto_offset+gtl)
-#ifdef NEXTBIT
-	- (meta_root->next_nodes * (gtl - 1))
-#endif //NEXTBIT
-#if defined(STOPBIT) && defined(TAILS)
-	+ (meta_root->tails * gtl)
-#endif //STOPBIT&TAILS
-	))
-	 >> ((8 * gtl) - flag_bits); ) {
-//    cerr << "Increasing gtl from " << gtl << " to " << gtl + 1 << endl;
-//    cerr << "Expression is " << ((r * (goto_offset+gtl)+ meta_root->tails * gtl) >> ((8 * gtl) -3)) << endl;
-    gtl++;
-  }
-  dummy->gtl = sig_arc.gtl = gtl;
-  dummy->size = gtl + goto_offset;
+	 (r * (goto_offset+gtl)
+	  + (E::ranked ? r * ctx->entryl : 0)
+	  - (E::nextbit ? ctx->next_nodes * (gtl - 1) : 0)
+	  + (E::tails ? ctx->tails * gtl : 0)
+	  ))
+	   >> ((8 * gtl) - E::flag_bits); ) {
+      gtl++;
+    }
+    ctx->gtl = sig_arc.gtl = gtl;
+    arc_size = gtl + goto_offset;
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-  sparse_vector.reset();
+    sparse_vector.reset();
 #endif
-  mark_inner(root, -1);		// pretend arcs were not numbered
+    mark_inner(root, -1);	// pretend arcs were not numbered
 				// otherwise number_arcs() would not work again
-  root->no_of_arcs = goto_offset + gtl
+    ctx->no_of_arcs = goto_offset + gtl
 #ifdef NUMBERS
-    + dummy->entryl
+      + ctx->entryl
 #endif //NUMBERS
-    ;
-  gtl_calculated = TRUE;
+      ;
+    gtl_calculated = TRUE;
 
 #ifdef NUMBERS
-  sig_arc.gtl |= (dummy->entryl << 4);
+    sig_arc.gtl |= (ctx->entryl << 4);
 #endif //NUMBERS
-#endif //STOPBIT&TAILS || NEXTBIT
+#ifdef MORE_COMPR
+    // the automaton can only get smaller, so gtl does not change
+    if (E::nextbit && ctx->reorder_time > 0) {
+#ifdef WEIGHTED
+      reorder_states<E>(meta_root, gtl, weighted);
+#else //!WEIGHTED
+      reorder_states<E>(meta_root, gtl, FALSE);
+#endif //!WEIGHTED
+    }
+#endif //MORE_COMPR
+  }//if E::in_bytes
 #endif //FLEXIBLE
 
 // no conditionals here
 
-#if defined(FLEXIBLE) && ((defined(STOPBIT) && defined(TAILS)) || defined(NEXTBIT))
 #ifdef STATISTICS
-  meta_root->print_statistics(meta_root);
-#endif
+  if (E::in_bytes)
+    meta_root->print_statistics(meta_root);
 #endif
-  meta_root->number_arcs(
-#if defined(FLEXIBLE) && ((defined(STOPBIT) && defined(TAILS)) || defined(NEXTBIT))
-			 gtl
-#ifdef WEIGHTED
-			 ,
-#endif //WEIGHTED
-#endif //(FLEXIBLE,((STOPBIT,TAILS)|NEXTBIT))
 #ifdef WEIGHTED
-			 weighted
-#endif //WEIGHTED
-			 );	// assign addresses to nodes
+  number_nodes<E>(meta_root, gtl, weighted); // assign addresses to nodes
+#else //!WEIGHTED
+  number_nodes<E>(meta_root, gtl, FALSE);	// assign addresses to nodes
+#endif //!WEIGHTED
 #ifdef STATISTICS
-#if !(defined(FLEXIBLE) && ((defined(STOPBIT) && defined(TAILS)) || defined(NEXTBIT)))
-  meta_root->print_statistics(meta_root);
-#endif
+  if (!E::in_bytes)
+    meta_root->print_statistics(meta_root);
 #endif
 
 
@@ -275,47 +642,19 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
   sig_arc.sig[2] = 's';
   sig_arc.sig[3] = 'a';
   // No conditionals here
-#ifdef FLEXIBLE
-#ifdef STOPBIT
-#ifdef NEXTBIT
-#ifdef TAILS
-  sig_arc.ver = 7;
-#else //!TAILS
-#ifdef WEIGHTED
-  if (weighted)
+  sig_arc.ver = E::version;
+#if defined(FLEXIBLE) && defined(WEIGHTED)
+  if (weighted && E::version == 5)
     sig_arc.ver = 8;
-  else
-    sig_arc.ver = 5;
-#else //!WEIGHTED
-  sig_arc.ver = 5;
-#endif //!WEIGHTED
-#endif //!TAILS
-#else // !NEXTBIT
-#ifdef TAILS
-  sig_arc.ver = 6;
-#else
-  sig_arc.ver = 4;
-#endif
-#endif // !NEXTBIT
-#else // !STOPBIT
-#ifdef SPARSE
-  sig_arc.ver += 5;
-#endif
-#ifdef NEXTBIT
-  sig_arc.ver = 2;
-#else
-  sig_arc.ver = 1;
-#endif
-#endif // STOPBIT pending: FLEXIBLE
-#else
-  sig_arc.ver = 0;
+#endif //FLEXIBLE&WEIGHTED
+#ifndef FLEXIBLE
 #ifdef LARGE_DICTIONARIES
   sig_arc.ver += 0x80;
 #endif
-#endif // FLEXIBLE
+#endif //!FLEXIBLE
   // No conditionals here
   sig_arc.filler = FILLER;
-  sig_arc.annot_sep = ANNOT_SEPARATOR;
+  sig_arc.annot_sep = ctx->annot_separator;
 #ifdef FLEXIBLE
   long int arc_bytes = 0L;
   if (!gtl_calculated) {
@@ -323,33 +662,14 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
     // initially, r is the highest value in the go_to field with flags cleared,
     // but counted as part of the go_to field
     sig_arc.gtl = 0;
-    arc_bytes = meta_root->no_of_arcs
-#ifdef STOPBIT
-#ifdef NEXTBIT
-#ifdef TAILS
-      * 16			// 4 bits from go_to taken by flags
-#else //!TAILS
-      * 8			// 3 bits from go_to taken by flags
-#endif //!TAILS
-#else // !NEXTBIT
-#ifdef TAILS
-      * 8			// 3 bits from go_to taken by flags
-#else //!TAILS
-      * 4			// 2 bits from go_to taken by flags
-#endif //!TAILS
-#endif //!NEXTBIT
-#else //!STOPBIT
-#ifdef NEXTBIT
-      * 2			// 1 bit from go_to taken by a flag
-#endif //NEXTBIT
-#endif //!STOPBIT
-      ;
+    arc_bytes = ctx->no_of_arcs
+      * (1 << E::flag_bits);	// bits from go_to taken by flags
     for (int r = arc_bytes; r; r >>= 8)
       sig_arc.gtl++;
-    gtl = dummy->gtl = sig_arc.gtl;
-    dummy->size = dummy->gtl + goto_offset;
+    gtl = ctx->gtl = sig_arc.gtl;
+    arc_size = ctx->gtl + goto_offset;
 #ifdef NUMBERS
-    sig_arc.gtl |= (dummy->entryl << 4);
+    sig_arc.gtl |= (ctx->entryl << 4);
 #endif // NUMBERS
   }
 #if defined(STOPBIT) && defined(SPARSE)
@@ -365,8 +685,8 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
        sp_gtl++) {
     sp_size >>= 8;
   }
-//  sp_gtl = min(dummy->gtl, sp_gtl);
-  sp_gtl = max(dummy->gtl, sp_gtl); // the pointer also points to annotations
+//  sp_gtl = min(ctx->gtl, sp_gtl);
+  sp_gtl = max(ctx->gtl, sp_gtl); // the pointer also points to annotations
 
   // Write the size of the sparse vector (in entries)
   char sbuf[32];
@@ -386,9 +706,9 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
     return FALSE;
 
   // Write the size of annotations (in bytes)
-  arc_bytes = sp_size1 = meta_root->no_of_arcs + ((gtl + 1))
+  arc_bytes = sp_size1 = ctx->no_of_arcs + ((gtl + 1))
 #ifdef NUMBERS
-    + dummy->entryl
+    + ctx->entryl
 #endif
     ;
 //  for (int sbj = 0; sbj < gtl; sbj++) {
@@ -399,44 +719,71 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
 //    return FALSE;
 #endif //FLEXIBLE&STOPBIT&SPARSE
 
+  // The arcs have been numbered, so we know how large the image is.
+  // It is put together in memory, and written with a single call.
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+  // Only annotations go to the image, the rest is in the sparse vector
+  long int image_size = arc_bytes;
+#else //!(FLEXIBLE&STOPBIT&SPARSE)
+  long int image_size = ctx->no_of_arcs;	// the sink is #0
+#ifdef FLEXIBLE
+  if (!E::in_bytes
+#ifdef NUMBERS
+      && ctx->entryl == 0	// otherwise addresses are in bytes
+#endif //NUMBERS
+      )
+    image_size *= arc_size;	// addresses are arc numbers
+#else //!FLEXIBLE
+  image_size *= sizeof output_arc;
+#endif //!FLEXIBLE
+#endif //!(FLEXIBLE&STOPBIT&SPARSE)
+  fsa_image	image(image_size);
+
   // write the sink node  
 #ifdef FLEXIBLE
-  for (int i = 0; i < dummy->size; i++)
+  for (int i = 0; i < arc_size; i++)
     bytes[i] = 0;
 #if defined(STOPBIT) && defined(SPARSE)
-  meta_root->in_annotations = false;
-  annot_buffer = new char[arc_bytes];
-  ab_ptr = 0L;
-  memcpy(annot_buffer + ab_ptr, bytes, dummy->size);
-  ab_ptr += dummy->size;
-#ifdef NUMBERS
-  if (make_numbers) {
-    memcpy(annot_buffer + ab_ptr, bytes, dummy->entryl);
-    ab_ptr += dummy->entryl;
-  }
-#endif //NUMBERS
-#else //!(STOPBIT&&SPARSE)
-  if (!(outfile.write(bytes, dummy->size)))
-    return FALSE;
+  ctx->in_annotations = false;
+#endif //STOPBIT&SPARSE
+  image.put(bytes, arc_size);
 #ifdef NUMBERS
-  if (make_numbers && !(outfile.write(bytes, dummy->entryl)))
-    return FALSE;
+  if (make_numbers)
+    image.put(bytes, ctx->entryl);
 #endif // NUMBERS
-#endif //!(STOPBIT&&SPARSE)
 #else // !FLEXIBLE
   output_arc.go_to = 0;
   output_arc.letter = 0;
   output_arc.counter = 0;
-  if (!(outfile.write((char *)&output_arc, sizeof output_arc)))
-    return FALSE;
+  image.put((char *)&output_arc, sizeof output_arc);
 #endif // FLEXIBLE
 
   // write the rest of the automaton
 #ifdef WEIGHTED
-  result = meta_root->write_arcs(outfile, weighted);
+  result = meta_root->write_arcs<E>(image, weighted);
+#else //!WEIGHTED
+  result = meta_root->write_arcs<E>(image);
+#endif
+#ifdef MORE_COMPR
+  // nodes numbered after all others are written in the same order
+  for (unsigned int di = 0; result && di < ctx->deferred.size(); di++) {
+    node *dn = ctx->deferred[di];
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
+    if (dn->free_beg == 0)
+#endif
+      // as in write_arcs
+      for (int bi = 0; bi < 2 && dn->get_big_brother(); bi++)
+	dn = dn->get_big_brother();
+#ifdef WEIGHTED
+    result = dn->write_arcs<E>(image, weighted);
 #else //!WEIGHTED
-  result = meta_root->write_arcs(outfile);
+    result = dn->write_arcs<E>(image);
 #endif
+  }
+#endif //MORE_COMPR
+  if (!result)
+    cerr << "Internal error: the automaton is larger than "
+	 << image_size << " bytes" << endl;
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   // Write the automaton
   // First, write additional information: the size of pointers in the sparse
@@ -444,17 +791,62 @@ automaton::write_fsa(ostream &outfile, const int make_numbers)
   // Something missing?
   // Write the sparse table
 #ifdef NUMBERS
-  sparse_vector.write(outfile,dummy->entryl,sp_gtl);
+  sparse_vector.write(outfile,ctx->entryl,sp_gtl);
 #else //!NUMBERS
   sparse_vector.write(outfile,sp_gtl);
 #endif //!NUMBERS
   // Write the annotations
-  if (!(outfile.write(annot_buffer, ab_ptr)))
-    return FALSE;
 #endif //FLEXIBLE&STOPBIT&SPARSE
+  if (result && !image.write(outfile))
+    result = FALSE;
   delete meta_root;
+  // Nodes and arcs are no longer needed; give them back all at once
+#ifdef PROGRESS
+  build_arena->show_stats(cerr);
+#endif
+  build_arena->release();
+  root = NULL;
   return result;
-}//automaton::write_fsa
+}//automaton::write_format
+
+#ifdef CFSA2
+/* Name:	write_cfsa2
+ * Class:	automaton
+ * Purpose:	Writes the automaton in the CFSA2 format of morfologik,
+ *		or in RCFSA2 or SCFSA2.
+ * Parameters:	outfile		- (o) file to be written;
+ *		make_numbers	- (i) whether to write numbers of entries.
+ * Returns:	TRUE if automaton written, FALSE otherwise.
+ * Remarks:	See cfsa2_writer. States are reordered before they are
+ *		written, so that more arcs need no target address,
+ *		and other addresses are short.
+ *		Nodes and arcs are released as in write_format.
+ */
+int
+automaton::write_cfsa2(ostream &outfile, const int make_numbers)
+{
+  int		result;
+  build_scope	scope(context);
+
+  {
+#ifdef PROGRESS
+    cerr << "Reordering states" << endl;
+#endif
+    cfsa2_writer	writer(root, make_numbers, context->version);
+    writer.linearize();
+#ifdef PROGRESS
+    cerr << "Writing the automaton" << endl;
+#endif
+    result = writer.write(outfile);
+  }
+#ifdef PROGRESS
+  build_arena->show_stats(cerr);
+#endif
+  build_arena->release();
+  root = NULL;
+  return result;
+}//automaton::write_cfsa2
+#endif //CFSA2
 
 #ifdef SUBAUT
 /* Name:	number_on_height
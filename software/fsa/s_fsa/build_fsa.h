@@ -6,8 +6,7 @@ not_enough_memory(void);
 
 extern const	int	WORD_BUFFER_LENGTH;
 
-extern char		FILLER;			/* for compatibility */
-extern char		ANNOT_SEPARATOR;	/* annotation separator */
+class build_context;
 
 using namespace std;
 
@@ -35,22 +34,71 @@ int collect_annotations(node *n, const int prefix);
 
 /* Class name:	automaton
  * Purpose:	Provide methods and common variables for building an automaton.
- * Methods:	automaton	- initiates roots of automaton and index;
+ * Methods:	automaton	- creates the build context and the root;
+ *		~automaton	- releases all memory;
  *		get_root	- returns root node of the automaton;
+ *		get_context	- returns the build context;
+ *		set_annot_separator
+ *				- sets the annotation separator;
+ *		set_format	- sets the version of the automaton to write;
+ *		set_reordering	- sets the time for choosing the order
+ *				  of nodes;
  *		build_fsa	- build the automaton;
- *		write_fsa	- writes the automaton to a file.
- * Variables:	root		- root of the automaton.
+ *		build_fsa_parts	- build the automaton with many threads;
+ *		make_index	- make an index a tergo;
+ *		share_arcs	- let nodes share arcs (-O);
+ *		write_fsa	- writes the automaton to a file
+ *				  (and releases all its nodes);
+ *		write_format	- writes it in the given format;
+ *		number_nodes	- assigns addresses to nodes;
+ *		reorder_states	- chooses the order of nodes;
+ *		write_cfsa2	- writes it in the CFSA2 format.
+ * Variables:	root		- root of the automaton;
+ *		context		- registers, counters, and memory
+ *				  of the automaton.
+ * Remarks:	Each automaton has its own build context, so that several
+ *		automata can be built in one process, one after another
+ *		or at the same time by different threads. The methods
+ *		make the context current (see build_scope) for the thread
+ *		that calls them. Functions that operate on nodes of the
+ *		automaton outside its methods must be called within
+ *		a build_scope of its context.
  */
 class automaton {
 private:
   node		*root;
+  build_context	*context;
+  template <class E> int write_format(ostream &out_file,
+				      const int make_numbers);
+  template <class E> void number_nodes(node *meta_root, const int gtl,
+				      const int weighted);
+#ifdef MORE_COMPR
+  template <class E> long int reorder_states(node *meta_root, const int gtl,
+					     const int weighted);
+#endif
+#ifdef CFSA2
+  int write_cfsa2(ostream &out_file, const int make_numbers);
+#endif
 public:
   char		FILLER;		/* character to be ignored (for fsa_guess) */
-  automaton(void) { root = new node();
-  }
+  automaton(void);
+  ~automaton(void);
   node *get_root() const { return root; }
   node *set_root(node *new_root) { return (root = new_root); }
-  int build_fsa(istream &infile);
+  build_context *get_context(void) const { return context; }
+  void set_annot_separator(const char c);
+  int set_format(const int version);
+#ifdef MORE_COMPR
+  void set_reordering(const int seconds);
+#endif
+  int build_fsa(word_reader &input);
+#ifdef THREADS
+  int build_fsa_parts(word_reader &input, const int jobs);
+#endif
+#ifdef A_TERGO
+  void make_index(const int prefix_mode, const int weighted);
+#endif
+  int share_arcs(const int level = SHARE_SUBSETS, const int jobs = 1);
   int write_fsa(ostream &out_file, const int make_numbers = FALSE);
 };/* automaton */
 
@@ -17,153 +17,452 @@
 #include	"nnode.h"
 #include	"nstr.h"
 #include	"nindex.h"
+#include	"ninput.h"
 #include	"fsa_version.h"
 #include	"build_fsa.h"
 
 
-/* holds information about prefix of word already in automaton */
-struct prefix {
-  node		*end_node;	// last node of automaton constaining word
-  int		length;		// length of prefix
-  int		arc_exists;	// if there is an arc from end_node to empty
-                                // node labelled with appropriate letter
-};/*prefix*/
-
-/* Name:	find_common_prefix
+/* Name:	add_words
  * Class:	None.
- * Purpose:	Find how many letters of the word just read are already in
- *		the automaton. Find the node that contains the last letter.
- * Parameter:	start_node	- (i) where to start in the automaton;
- *		word		- (i) word whose common prefix is sought;
- *		common_prefix	- (o) information about the prefix;
- *		length		- (i) how many characters of word were
- *					already considered.
- * Returns:	common_prefix length.
- * Remarks:	I had to add `length' parameter, beacuse that was the only
- *		way to avoid using a global variable (I hate doing that).
+ * Purpose:	Reads a list of sorted words and adds them to an automaton.
+ * Parameters:	root		- (i/o) root of the automaton;
+ *		input		- (i) lines of the file to be read;
+ *		show_progress	- (i) whether to print the number of lines;
+ *		left		- (i) length of the common prefix
+ *				  of the first word with the word before
+ *				  the input (0 if none);
+ *		right		- (i) the same for the last word
+ *				  and the word after the input.
+ * Returns:	TRUE if words added, FALSE otherwise.
+ * Remarks:	Words need to be sorted. Duplicates are not allowed.
+ *
+ *		The nodes on the path of the previous word are kept
+ *		in an array, so the automaton is not searched for the common
+ *		prefix. The length of the common prefix with the previous
+ *		word is computed by the reader. The part of the path below it
+ *		is registered from the deepest node up, and the rest
+ *		of the word is appended as a chain of new nodes.
+ *		All nodes except for the root are registered at the end.
+ *		Nodes on the paths of the first and the last word that
+ *		lie within the prefixes shared with words outside
+ *		the input are not registered; they are joined with nodes
+ *		of other parts of the input (see build_fsa_parts).
+ *
+ *		Any order of words is fine as long as words with the same
+ *		prefix are kept together. This is checked only for words
+ *		that are not in ascending byte order.
  */
-int
-find_common_prefix(node *start_node,
-		   const char *word,
-		   prefix *common_prefix,
-		   const int length)
+static int
+add_words(node *root, word_reader &input, const int show_progress,
+	  const int left, const int right)
 {
-  int		modif = 0;
-  arc_node	*offspr;
-
-  for (int i = 0; i < start_node->get_no_of_kids(); i++) {
-    offspr = start_node->get_children() + i;
-    if (offspr->letter == *word) {
-      if (offspr->child) {
-	return find_common_prefix(offspr->child, word + 1, common_prefix,
-				  length + 1);
-      }
-      else {
-	modif = 1;
-	break;
+  input_line	line;
+  const char	*word;
+  int		word_len;
+  int		prev_len = 0;		// length of previous word
+  node		**path;			// nodes on the path of previous word
+  int		path_allocated = WORD_BUFFER_LENGTH;
+  int		lcp;			// length of common prefix
+  int		end;			// depth where the new word branches off
+  int		spine = left;		// nodes of first word not to register
+  int		d;
+  node		*new_node;
+#ifdef PROGRESS
+  int		line_no = 0;
+#endif
+
+  path = new node *[path_allocated];
+  path[0] = root;
+  while (input.next(line)) {
+    word = line.text;
+    word_len = line.length;
+    lcp = line.lcp;
+#ifdef DEBUG
+    cerr << "`";
+    cerr.write(word, word_len);
+    cerr << "'\n";
+#endif
+#ifdef PROGRESS
+    if ((line_no++ & 0x03FF) == 0 && show_progress)
+      cerr << (line_no - 1) << " lines processed" << endl;
+#endif
+
+    // If the previous word is a prefix of this one, its last arc
+    // (leading nowhere yet) gets the new chain
+    end = (lcp < prev_len || prev_len == 0) ? lcp : prev_len - 1;
+#ifdef DEBUG
+    cerr << "Prefix len: " << lcp << "\n";
+#endif
+
+    if (!line.ascending) {
+      // The word may not follow the previous one
+      int found = (lcp == word_len);
+      for (d = 0; !found && d < path[lcp]->get_no_of_kids(); d++)
+	found = (path[lcp]->get_children()[d].letter == word[lcp]);
+      if (found) {
+	cerr << "Words with the same prefix are not together (not sorted): `";
+	cerr.write(word, word_len);
+	cerr << "'" << endl;
+	delete [] path;
+	return FALSE;
       }
     }
+
+    // We are retreating in the graph. The last children of the nodes
+    // on the path below the common prefix are to be either registered
+    // (if there is no isomorphic subgraph in the automaton), or deleted
+    // (i.e. replaced by pointers to subgraphs already registered).
+    for (d = prev_len - 1; d > end && d > spine; --d)
+      path[d - 1]->replace_or_register();
+    if (end < spine && prev_len > 0)
+      spine = end;
+
+    // Make a chain of nodes with the remaining letters of the word,
+    // and attach it to the last node of the prefix.
+    if (word_len > path_allocated) {
+      node **new_path = new node *[word_len + WORD_BUFFER_LENGTH];
+      memcpy(new_path, path, (end + 1) * sizeof(node *));
+      delete [] path;
+      path = new_path;
+      path_allocated = word_len + WORD_BUFFER_LENGTH;
+    }
+    for (d = end; d < word_len - 1; d++) {
+      new_node = new node;
+      path[d]->add_child(word[d], new_node);
+      path[d + 1] = new_node;
+    }
+    path[word_len - 1]->add_child(word[word_len - 1], NULL);
+    prev_len = word_len;
+  }//while
+
+  for (d = prev_len - 1; d > right && d > spine; --d)
+    path[d - 1]->replace_or_register();
+  delete [] path;
+  if (input.io_error()) {
+    cerr << "Error reading input" << endl;
+    return FALSE;
   }
-  common_prefix->end_node = start_node;
-  return common_prefix->length = length /*+ modif*/;
-}//find_common_prefix
+#ifdef PROGRESS
+  if (show_progress)
+    cerr << line_no << " lines processed. Input read." << endl;
+#endif
+  return TRUE;
+}//add_words
 
 
 /* Name:	build_fsa
  * Class:	automaton
  * Purpose:	Reads a list of sorted words and builds a final state
  *		automaton that recognizes them.
- * Parameters:	infile	- (i) file to be read.
+ * Parameters:	input	- (i) lines of the file to be read.
  * Returns:	TRUE if automaton built, FALSE otherwise.
  * Remarks:	Words need to be sorted. Duplicates are not allowed.
  */
 int
-automaton::build_fsa(istream &infile)
+automaton::build_fsa(word_reader &input)
 {
-  static char	*word_buffer;
-  int		allocated = WORD_BUFFER_LENGTH;
-  char		*word;
-  char		*rest;
-  prefix	common_prefix;
-  node		*last_node = NULL;
-  node		*new_node;
-  char		junk;
-#ifdef PROGRESS
-  int		line_no = 0;
-#endif
+  build_scope	scope(context);
 
-  word_buffer = new char[WORD_BUFFER_LENGTH];
-  word = &word_buffer[0];
-  while (infile.get(word, allocated, '\n')) {
-    infile.get(junk);				// eat '\n'
-    while (junk != '\n') {
-      // line was too long, allocate more space
-      word = grow_string(word_buffer, allocated, WORD_BUFFER_LENGTH);
-      word[allocated - WORD_BUFFER_LENGTH - 1] = junk;
-      if (!(infile.get(word + allocated - WORD_BUFFER_LENGTH,
-		       WORD_BUFFER_LENGTH, '\n'))) {
+  if (!add_words(root, input, TRUE, 0, 0))
+    return FALSE;
 #ifdef DEBUG
-	cerr << "get() failed! good()=" << infile.good()
-	     << ", fail()=" << infile.fail()
-	     << ", bad()=" << infile.bad()
-	     << ", eof()=" << infile.eof() << "\n";
-#endif
-	// This horrible code is provided as an attempt to counteract recent
-	// absurd I/O library behaviour
-	if (!(infile.bad()) && !(infile.eof())) {
-	  // Last "junk" was probably the last character of the line.
-	  // Were we to omit this, the next get() would fail!!!
-	  infile.clear();
-	  infile.get(junk);	// There should still be EOLN in the buffer!
-	}
-	break;
-      }
-      infile.get(junk);
-    }
-#ifdef DEBUG
-    cerr << "`" << word << "'\n";
+  show_index(PRIM_INDEX);
 #endif
+  return TRUE;
+}//build_fsa
+
+
+#ifdef THREADS
+/* A part of the input built by a separate thread */
+struct input_part {
+  const char	*text;		// the lines
+  size_t	size;		// their size in bytes
+  node		*root;		// root of the automaton for them
+  build_context	*context;	// context of the whole automaton
+  node_register	reg;		// register of that automaton
+  int		left;		// common prefix with the previous part
+  int		right;		// common prefix with the next part
+  int		ok;		// whether the automaton has been built
+  pthread_t	thread;
+  int		running;	// whether the thread has been started
+};/*input_part*/
+
+/* Name:	build_part
+ * Class:	None.
+ * Purpose:	Body of a thread that builds an automaton for a part
+ *		of the input.
+ * Parameters:	part		- (i/o) the part.
+ * Returns:	NULL.
+ * Remarks:	The thread has its own register and allocation state.
+ */
+static void *
+build_part(void *part)
+{
+  input_part	*p = (input_part *)part;
+  word_reader	input;
+  build_scope	scope(p->context);
+
+  build_arena->attach_thread();
+  set_thread_register(&p->reg);
+  input.open_text(p->text, p->size);
+  p->ok = add_words(p->root, input, FALSE, p->left, p->right);
+  set_thread_register(NULL);
+  build_arena->detach_thread();
+  return NULL;
+}//build_part
+
+/* Name:	merge_part
+ * Class:	None.
+ * Purpose:	Body of a thread that puts the nodes of an automaton
+ *		for a part of the input into the common register.
+ * Parameters:	part		- (i/o) the part.
+ * Returns:	NULL.
+ * Remarks:	Nodes are not allocated or deleted here.
+ */
+static void *
+merge_part(void *part)
+{
+  build_scope	scope(((input_part *)part)->context);
+
+  ((input_part *)part)->root->merge_kids();
+  return NULL;
+}//merge_part
+
+/* Name:	part_end
+ * Class:	None.
+ * Purpose:	Finds where a part of the input should end.
+ * Parameters:	text		- (i) the input;
+ *		size		- (i) its size;
+ *		pos		- (i) where it would end if sizes of parts
+ *				  were equal.
+ * Returns:	The end of the part.
+ * Remarks:	The part ends at the beginning of a line that is not empty.
+ */
+static size_t
+part_end(const char *text, const size_t size, size_t pos)
+{
+  const char	*p;
+
+  if (pos == 0)
+    return 0;
+  // go to the beginning of the next line
+  if ((p = (const char *)memchr(text + pos - 1, '\n', size - pos + 1))
+      == NULL)
+    return size;
+  pos = p - text + 1;
+  // skip empty lines
+  while (pos < size && text[pos] == '\n')
+    pos++;
+  return pos;
+}//part_end
+
+
+/* Name:	shared_prefix
+ * Class:	None.
+ * Purpose:	Finds the length of the common prefix of the lines
+ *		on both sides of the end of a part of the input.
+ * Parameters:	text		- (i) the input;
+ *		size		- (i) its size;
+ *		pos		- (i) the end of the part (as from part_end).
+ * Returns:	The length of the common prefix of the last line
+ *		of the part and the first line of the next one.
+ * Remarks:	None.
+ */
+static int
+shared_prefix(const char *text, const size_t size, const size_t pos)
+{
+  size_t	e = pos;		// end of the previous line
+  size_t	b;			// its beginning
+  size_t	i;
+
+  while (e > 0 && text[e - 1] == '\n')
+    e--;
+  for (b = e; b > 0 && text[b - 1] != '\n'; b--)
+    ;
+  for (i = 0; b + i < e && pos + i < size && text[b + i] == text[pos + i]
+	 && text[pos + i] != '\n'; i++)
+    ;
+  return (int)i;
+}//shared_prefix
+
+
+/* Name:	join_part
+ * Class:	None.
+ * Purpose:	Adds the arcs of a node of the automaton for a part
+ *		of the input to the corresponding node of the automaton
+ *		for the preceding parts.
+ * Parameters:	left		- (i/o) the node for the preceding parts;
+ *		right		- (i/o) the node for the part (deleted).
+ * Returns:	TRUE if OK, FALSE if the input is not sorted.
+ * Remarks:	The last arc of left is on the path of the last word
+ *		before the part, and the first arc of right is on the path
+ *		of its first word. If they have the same label, the prefix
+ *		is shared, and they become one arc. Their targets
+ *		have not been registered, and they are joined in the same way.
+ *		The remaining arcs of right follow the arcs of left.
+ */
+static int
+join_part(node *left, node *right)
+{
+  arc_node	*l_kids = left->get_children();
+  arc_node	*r_kids = right->get_children();
+  int		l_no = left->get_no_of_kids();
+  int		r_no = right->get_no_of_kids();
+  int		first = 0;		// first arc of right to be copied
+  arc_node	*kids;
+  int		ok = TRUE;
+  int		i, j;
+
+  if (l_no > 0 && r_no > 0 && l_kids[l_no - 1].letter == r_kids[0].letter) {
+    if (r_kids[0].is_final && l_kids[l_no - 1].child != NULL)
+      ok = FALSE;		// a word follows a longer one with that prefix
+    else if (r_kids[0].child == NULL)
+      ;				// the same word
+    else if (l_kids[l_no - 1].child == NULL)
+      l_kids[l_no - 1].child = r_kids[0].child;
+    else
+      ok = join_part(l_kids[l_no - 1].child, r_kids[0].child);
+    first = 1;
+  }
+  for (i = first; i < r_no; i++)
+    for (j = 0; j < l_no; j++)
+      if (l_kids[j].letter == r_kids[i].letter)
+	ok = FALSE;		// words with the same prefix not together
+  if (r_no > first) {
+    kids = new arc_node[l_no + r_no - first];
+    for (i = 0; i < l_no; i++)
+      kids[i] = l_kids[i];
+    for (j = first; j < r_no; j++)
+      kids[i++] = r_kids[j];
+    delete [] left->set_children(kids, i);
+  }
+  delete right;
+  return ok;
+}//join_part
+
+
+/* Name:	build_fsa_parts
+ * Class:	automaton
+ * Purpose:	Builds the automaton using several threads.
+ * Parameters:	input	- (i) the file to be read;
+ *		jobs	- (i) number of threads.
+ * Returns:	TRUE if automaton built, FALSE otherwise.
+ * Remarks:	The input is divided into parts of equal size. Each thread
+ *		builds a minimal automaton for its part with its own register,
+ *		except for the nodes on the paths of the words shared
+ *		with neighbouring parts, which are not registered. Then
+ *		the threads put the other nodes of those automata into
+ *		the common register, so that nodes isomorphic to nodes
+ *		from other parts are replaced. Finally, the automata
+ *		are joined along the shared paths, and the nodes
+ *		on those paths are registered. The result is the same
+ *		automaton as the one built by one thread.
+ *
+ *		The input must be mapped into memory; otherwise
+ *		build_fsa is used.
+ */
+int
+automaton::build_fsa_parts(word_reader &input, const int jobs)
+{
+  const char	*text;
+  size_t	size;
+  size_t	start, end;
+  input_part	*parts;
+  int		no_of_parts;
+  unsigned long	registered;
+  int		k;
+  int		ok = TRUE;
+  build_scope	scope(context);
+
+  if ((text = input.get_text(size)) == NULL) {
 #ifdef PROGRESS
-    if ((line_no++ & 0x03FF) == 0)
-      cerr << (line_no - 1) << " lines processed" << endl;
+    cerr << "Input not in a file. Using one thread." << endl;
 #endif
-    // the rest is word - common_prefix
-    rest = word + find_common_prefix(root, word, &common_prefix, 0);
-    last_node = common_prefix.end_node;
-#ifdef DEBUG
-    cerr << "Prefix len: " << common_prefix.length << ", rest: `" << rest
-         << "'\n";
+    return build_fsa(input);
+  }
+
+  parts = new input_part[jobs];
+  start = 0;
+  for (no_of_parts = 0; no_of_parts < jobs && start < size; no_of_parts++) {
+    end = size / jobs * (no_of_parts + 1);
+    end = (no_of_parts == jobs - 1 ? size
+	   : part_end(text, size, end < start ? start : end));
+    parts[no_of_parts].text = text + start;
+    parts[no_of_parts].size = end - start;
+    parts[no_of_parts].root = new node;
+    parts[no_of_parts].context = context;
+    parts[no_of_parts].left =
+      (no_of_parts == 0 ? 0 : parts[no_of_parts - 1].right);
+    parts[no_of_parts].right =
+      (end < size ? shared_prefix(text, size, end) : 0);
+    start = end;
+  }
+#ifdef PROGRESS
+  cerr << "Building " << no_of_parts << " parts" << endl;
 #endif
 
-    if (last_node->fertile()) {
-      // We are retreating in the graph. This means that the last child
-      // and possibly its children of the last node in prefix are
-      // to be either registered (if there is no isomorphic subgraph
-      // in the automaton, or deleted (i.e. replaced by pointers to
-      // subgraphs already registered).
-#ifdef DEBUG
-      cerr << "About to call compress_or_register\n";
+  // Build automata for the parts
+  for (k = 0; k < no_of_parts; k++) {
+    parts[k].running =
+      (pthread_create(&parts[k].thread, NULL, build_part, parts + k) == 0);
+    if (!parts[k].running)
+      build_part(parts + k);
+  }
+  for (k = 0; k < no_of_parts; k++)
+    if (parts[k].running)
+      pthread_join(parts[k].thread, NULL);
+  registered = get_register()->get_counter();
+  for (k = 0; k < no_of_parts; k++) {
+    ok = ok && parts[k].ok;
+    registered += parts[k].reg.get_counter();
+  }
+  if (!ok) {
+    delete [] parts;
+    return FALSE;
+  }
+#ifdef PROGRESS
+  cerr << "Merging " << no_of_parts << " parts" << endl;
 #endif
-      common_prefix.end_node->compress_or_register();
-    }
 
-    // If the rest of word (after prefix) exists make a chain of nodes
-    // with its consecutive letters, and attach it to the last node
-    // found in prefix.
-    if (*rest) {
-      new_node = common_prefix.end_node->add_postfix(rest);
+  // Put their nodes into the common register
+  get_register()->reserve(registered);
+  for (k = 0; k < no_of_parts; k++) {
+    parts[k].running =
+      (pthread_create(&parts[k].thread, NULL, merge_part, parts + k) == 0);
+    if (!parts[k].running)
+      merge_part(parts + k);
+  }
+  for (k = 0; k < no_of_parts; k++)
+    if (parts[k].running)
+      pthread_join(parts[k].thread, NULL);
+
+  // Join the automata, and register nodes on the shared paths
+  for (k = 0; k < no_of_parts; k++)
+    if (!join_part(root, parts[k].root)) {
+      cerr << "Words with the same prefix are not together (not sorted)"
+	   << endl;
+      ok = FALSE;
     }
-  }//while
+  if (ok)
+    root->register_kids();
 
-  root->compress_or_register();
+  // Delete nodes replaced by those from other parts
+  for (k = 0; k < no_of_parts; k++) {
+    const reg_slot *rs = parts[k].reg.get_slots();
+    for (unsigned long j = 0; j < parts[k].reg.get_capacity(); j++)
+      if (rs[j].used() && rs[j].n->end_merge())
+	delete (node *)rs[j].n;
+  }
+  delete [] parts;
 #ifdef PROGRESS
-  cerr << line_no << " lines processed. Input read." << endl;
+  cerr << size << " bytes processed. Input read." << endl;
 #endif
 #ifdef DEBUG
   show_index(PRIM_INDEX);
 #endif
-  return TRUE;
-}//build_fsa
+  return ok;
+}//build_fsa_parts
+#endif //THREADS
 
 
 /* Name:	usage
@@ -178,13 +477,23 @@ usage(const char *prog_name)
 {
   cerr << prog_name
        << " builds an automaton. Synopsis:\n"
-       << prog_name << " [options]\nOptions:\n-O\toptimization\n"
+       << prog_name << " [options]\nOptions:\n-O\toptimization (same as -O2)\n"
+       << "-O1\tfaster optimization, only tails of states are shared\n"
+       << "-O2\toptimization, transitions are also reordered\n"
+       << "-O3\tslower optimization, more reordering is tried\n"
        << "-i input_file\t input file name (or else use stdin)\n"
        << "-o output_file\t output file name (or else use stdout)\n"
        << "-A as\tannotation separator character (use with -X)\n"
        << "\t\t[default:+]\n"
        << "-F fc\tfiller character (use with -X)\n"
        << "\t\t[default:_]\n"
+       << "-f ver\tversion (format) of the automaton\n"
+       << "\t\t[default:" << BUILD_FORMAT << "]\n"
+#ifdef CFSA2
+       << "\t\t(cfsa2 - the CFSA2 format of morfologik,\n"
+       << "\t\t rcfsa2 - CFSA2 with relative addresses,\n"
+       << "\t\t scfsa2 - RCFSA2 with strings of labels on arcs)\n"
+#endif
 #ifdef A_TERGO
        << "-X\tmake index a tergo (for guessing)\n"
 #ifdef GENERALIZE
@@ -193,9 +502,21 @@ usage(const char *prog_name)
 #endif //A_TERGO
 #ifdef NUMBERS
        << "-N\tnumber entries (perfect hashing)\n"
+#if defined(FLEXIBLE) && defined(STOPBIT)
+       << "-r\tnumber entries, with ranks of arcs\n"
+       << "\t\t(faster perfect hashing, versions 4 and 5)\n"
+#endif
+#endif
+#ifdef MORE_COMPR
+       << "-R sec\treorder states for at most sec seconds\n"
+       << "\t\t(versions with NEXTBIT)\n"
 #endif
 #ifdef WEIGHTED
        << "-W\tweight arcs (for probabilities in guessing)\n"
+#endif
+#ifdef THREADS
+       << "-j n\tbuild and optimize with n threads\n"
+       << "\t\t(input must be a file to build with threads)\n"
 #endif
        << "-v\tversion details\n"
        << "Example:\nsort -u word_list | "
@@ -217,32 +538,44 @@ usage(const char *prog_name)
 int
 main(const int argc, const char *argv[])
 {
-  int	optimize = FALSE;
+  int	optimize = FALSE;	// effort of optimization (-O1..-O3)
   int	make_index = FALSE;	// whether to create an index a tergo
   const char *input_file_name = NULL;
   const char *output_file_name = NULL;
 #ifdef NUMBERS
   int	make_numbers = FALSE;
+  int	ranked = FALSE;		// whether arcs have ranks (-r)
 #endif
-#ifdef WEIGHTED
-  int	weighted = FALSE;
-#endif //WEIGHTED
-#ifdef GENERALIZE
-  int 	prefix_mode = FALSE;
-#endif //GENERALIZE
+  int	weighted = FALSE;	// with WEIGHTED
+  int 	prefix_mode = FALSE;	// with GENERALIZE
   char	FILLER = '_';
+  char	annot_separator = '+';
+  int	format = BUILD_FORMAT;	// version of the automaton (-f)
+#ifdef MORE_COMPR
+  int	reorder_time = 0;	// seconds for reordering states (-R)
+#endif
+  int	jobs = 1;		// number of threads building the automaton
   
   if (argc >= 2) {
     for (int i = 1; i < argc; i++) {
       if (strcmp(argv[i], "-O") == 0) {
-	optimize = TRUE;
+	optimize = SHARE_SUBSETS;
+      }
+      else if (strcmp(argv[i], "-O1") == 0) {
+	optimize = SHARE_TAILS;
+      }
+      else if (strcmp(argv[i], "-O2") == 0) {
+	optimize = SHARE_SUBSETS;
+      }
+      else if (strcmp(argv[i], "-O3") == 0) {
+	optimize = SHARE_MORE_SUBSETS;
       }
       else if (strcmp(argv[i], "-X") == 0) {
 	make_index = TRUE;
       }
       else if (strcmp(argv[i], "-A") == 0) {
 	if (++i < argc)
-	  ANNOT_SEPARATOR = *argv[i];
+	  annot_separator = *argv[i];
 	else {
 	  cerr << "Invalid annotation separator\n";
 	  usage(argv[0]);
@@ -285,10 +618,49 @@ main(const int argc, const char *argv[])
 	  return 1;
 	}
       }
+      else if (strcmp(argv[i], "-f") == 0) {
+	if (++i < argc)
+	  format = atoi(argv[i]);
+#ifdef CFSA2
+	if (i < argc && strcmp(argv[i], "cfsa2") == 0)
+	  format = CFSA2_VERSION;
+	if (i < argc && strcmp(argv[i], "rcfsa2") == 0)
+	  format = RCFSA2_VERSION;
+	if (i < argc && strcmp(argv[i], "scfsa2") == 0)
+	  format = SCFSA2_VERSION;
+#endif
+	if (i >= argc || !format_available(format)) {
+	  cerr << argv[0] << ": -f without a version that can be written"
+	       << endl;
+	  usage(argv[0]);
+	  return 1;
+	}
+      }
 #ifdef NUMBERS
       else if (strcmp(argv[i], "-N") == 0) {
 	make_numbers = TRUE;
       }
+      else if (strcmp(argv[i], "-r") == 0) {
+	ranked = TRUE;
+      }
+#endif
+#ifdef MORE_COMPR
+      else if (strcmp(argv[i], "-R") == 0) {
+	if (++i >= argc || (reorder_time = atoi(argv[i])) < 1) {
+	  cerr << argv[0] << ": -R without a number of seconds" << endl;
+	  usage(argv[0]);
+	  return 1;
+	}
+      }
+#endif
+#ifdef THREADS
+      else if (strcmp(argv[i], "-j") == 0) {
+	if (++i >= argc || (jobs = atoi(argv[i])) < 1) {
+	  cerr << argv[0] << ": -j without a number of threads" << endl;
+	  usage(argv[0]);
+	  return 1;
+	}
+      }
 #endif
 #ifdef WEIGHTED
       else if (strcmp(argv[i], "-W") == 0) {
@@ -312,59 +684,77 @@ main(const int argc, const char *argv[])
   }//if
 
 #ifdef NUMBERS
+  if (ranked) {
+    // ranks are added to the numbers of entries of the version
+    if (!format_available(format | RANKED_FORMAT)) {
+      cerr << argv[0] << ": -r cannot be used with version " << format
+	   << endl;
+      usage(argv[0]);
+      return 1;
+    }
+    format |= RANKED_FORMAT;
+  }
+  if (format == (RANKED_FORMAT | 4) || format == (RANKED_FORMAT | 5))
+    make_numbers = TRUE;
   if (make_numbers && optimize) {
     cerr << "-N and -O cannot be specified together. Turning -O off" << endl;
     optimize = FALSE;
   }
+#endif
+#ifdef CFSA2
+  if (cfsa2_format(format) && optimize) {
+    cerr << "States cannot share arcs in CFSA2. Turning -O off" << endl;
+    optimize = FALSE;
+  }
+#endif
+#ifdef SPARSE
+  if (jobs > 1) {
+    cerr << "-j cannot be used with SPARSE. Using one thread" << endl;
+    jobs = 1;
+  }
+#endif
+#if defined(MORE_COMPR) && defined(SPARSE)
+  if (reorder_time) {
+    cerr << "-R cannot be used with SPARSE. States are not reordered" << endl;
+    reorder_time = 0;
+  }
 #endif
   set_new_handler(&not_enough_memory);
 
   automaton autom;
   autom.FILLER = FILLER;
-  if (input_file_name) {
-    ifstream inpf(input_file_name);
-    if (!inpf) {
+  autom.set_annot_separator(annot_separator);
+  autom.set_format(format);
+#ifdef MORE_COMPR
+  autom.set_reordering(reorder_time);
+#endif
+  {
+    // standard input is read if there is no file name
+    word_reader input;
+    if (!input.open(input_file_name)) {
       cerr << argv[0] << ": Could not open input file " << input_file_name
 	   << endl;
       usage(argv[0]);
       exit(1);
     }
-    if (!autom.build_fsa(inpf)) {
+#ifdef THREADS
+    if (!(jobs > 1 ? autom.build_fsa_parts(input, jobs)
+	  : autom.build_fsa(input))) {
+#else
+    if (!autom.build_fsa(input)) {
+#endif
       cerr << argv[0] << ": Could not build the automaton" << endl;
       return 2;
     }
   }
-  else if (!autom.build_fsa(cin)) {
-    cerr << argv[0] << ": Could not build the automaton\n";
-    return 2;
-  }
 
 #ifdef A_TERGO
-  if (make_index) {
-#ifdef PROGRESS
-    cerr << "Pruning arcs" << endl;
-#endif
-    find_or_register(autom.get_root(), PRIM_INDEX, TRUE);
-#ifdef WEIGHTED
-    if (weighted) {
-      weight_arcs(autom.get_root());
-    }
-#endif //WEIGHTED
-#ifdef GENERALIZE
-    collect_annotations(autom.get_root(), prefix_mode);
-#endif
-    autom.set_root(reduce_inner(autom.get_root()));
-#ifdef GENERALIZE
-    new_gen(autom.get_root(), prefix_mode);
-    remove_annot_pointers(autom.get_root());
-#endif
-    // nodes must have arc_no set to -1
-    mark_inner(autom.get_root(), -1);
-  }
+  if (make_index)
+    autom.make_index(prefix_mode, weighted);
 #endif
 
   if (optimize)
-    share_arcs(autom.get_root());
+    autom.share_arcs(optimize, jobs);
 
   if (output_file_name) {
     ofstream outf(output_file_name, ios::binary); // the flag for M$ bug
@@ -18,6 +18,7 @@
 #include	"unode.h"
 #include	"nstr.h"
 #include	"nindex.h"
+#include	"ninput.h"
 #include	"fsa_version.h"
 #include	"build_fsa.h"
 
@@ -138,15 +139,16 @@ clone(node *n)
  * Class:	automaton
  * Purpose:	Reads a list of words and builds a final state
  *		automaton that recognizes them.
- * Parameters:	infile	- (i) file to be read.
+ * Parameters:	input	- (i) lines of the file to be read.
  * Returns:	TRUE if automaton built, FALSE otherwise.
  * Remarks:	Words do not need to be sorted. Duplicates are allowed.
  */
 int
-automaton::build_fsa(istream &infile)
+automaton::build_fsa(word_reader &input)
 {
-  static char	*word_buffer;
+  char		*word_buffer;
   int		allocated = WORD_BUFFER_LENGTH;
+  input_line	line;
   char		*word;
   char		*rest;
   prefix	common_prefix;
@@ -156,42 +158,23 @@ automaton::build_fsa(istream &infile)
   node		*next_node;
   int		node_modified;
   int		i;
-  char		junk;
 #ifdef PROGRESS
   int		line_no = 0;
 #endif
+  build_scope	scope(context);
 
   word_buffer = new char[WORD_BUFFER_LENGTH];
   word = &word_buffer[0];
   common_prefix.max_length = 0;
-  while (infile.get(word, allocated, '\n')) {
-    infile.get(junk);				// eat '\n'
-    while (junk != '\n') {
-      // line was too long, allocate more space
-      word = grow_string(word_buffer, allocated, WORD_BUFFER_LENGTH);
-      word[allocated - WORD_BUFFER_LENGTH - 1] = junk;
-      if (!(infile.get(word + allocated - WORD_BUFFER_LENGTH,
-		       WORD_BUFFER_LENGTH, '\n'))) {
-#ifdef DEBUG
-	cerr << "get() failed! good()=" << infile.good()
-	     << ", fail()=" << infile.fail()
-	     << ", bad()=" << infile.bad()
-	     << ", eof()=" << infile.eof() << "\n";
-#endif
-	// This horrible code is provided as an attempt to counteract recent
-	// absurd I/O library behaviour
-	if (!(infile.bad()) && !(infile.eof())) {
-	  // Last "junk" was probably the last character of the line.
-	  // Were we to omit this, the next get() would fail!!!
-	  infile.clear();
-	  infile.get(junk);	// There should still be EOLN in the buffer!
-	}
-	break;
-      }
-      infile.get(junk);
+  while (input.next(line)) {
+    // the word is needed as a C string
+    if (line.length >= allocated) {
+      delete [] word_buffer;
+      allocated = line.length + WORD_BUFFER_LENGTH;
+      word = word_buffer = new char[allocated];
     }
-    if (*word == '\0')
-      continue;
+    memcpy(word, line.text, line.length);
+    word[line.length] = '\0';
 
 #ifdef DEBUG
     cerr << "`" << word << "'\n";
@@ -346,7 +329,12 @@ automaton::build_fsa(istream &infile)
 		new_node != next_node);
     }
   }//while
+  delete [] word_buffer;
 
+  if (input.io_error()) {
+    cerr << "Error reading input" << endl;
+    return FALSE;
+  }
 #ifdef PROGRESS
   cerr << line_no << " lines processed. Input read." << endl;
 #endif
@@ -369,18 +357,36 @@ usage(const char *prog_name)
 {
   cerr << prog_name
        << " builds an automaton. Synopsis:\n"
-       << prog_name << " [options]\nOptions:\n-O\toptimization\n"
+       << prog_name << " [options]\nOptions:\n-O\toptimization (same as -O2)\n"
+       << "-O1\tfaster optimization, only tails of states are shared\n"
+       << "-O2\toptimization, transitions are also reordered\n"
+       << "-O3\tslower optimization, more reordering is tried\n"
        << "-i input_file\t input file name (or else use stdin)\n"
        << "-o output_file\t output file name (or else use stdout)\n"
        << "-A as\tannotation separator character (use with -X)\n"
        << "\t\t[default:+]\n"
        << "-F fc\tfiller character (use with -X)\n"
        << "\t\t[default:_]\n"
+       << "-f ver\tversion (format) of the automaton\n"
+       << "\t\t[default:" << BUILD_FORMAT << "]\n"
+#ifdef CFSA2
+       << "\t\t(cfsa2 - the CFSA2 format of morfologik,\n"
+       << "\t\t rcfsa2 - CFSA2 with relative addresses,\n"
+       << "\t\t scfsa2 - RCFSA2 with strings of labels on arcs)\n"
+#endif
 #ifdef A_TERGO
        << "-X\tmake index a tergo (for category guessing)\n"
 #endif
 #ifdef NUMBERS
        << "-N\tnumber entries (perfect hashing)\n"
+#if defined(FLEXIBLE) && defined(STOPBIT)
+       << "-r\tnumber entries, with ranks of arcs\n"
+       << "\t\t(faster perfect hashing, versions 4 and 5)\n"
+#endif
+#endif
+#ifdef MORE_COMPR
+       << "-R sec\treorder states for at most sec seconds\n"
+       << "\t\t(versions with NEXTBIT)\n"
 #endif
 #ifdef WEIGHTED
        << "-W\tweight arcs (for probabilities in guessing)\n"
@@ -404,32 +410,43 @@ usage(const char *prog_name)
 int
 main(const int argc, const char *argv[])
 {
-  int	optimize = FALSE;
+  int	optimize = FALSE;	// effort of optimization (-O1..-O3)
   int	make_index = FALSE;	// whether to create an index a tergo
   const char *input_file_name = NULL;
   const char *output_file_name = NULL;
 #ifdef NUMBERS
   int	make_numbers = FALSE;
+  int	ranked = FALSE;		// whether arcs have ranks (-r)
 #endif
-#ifdef WEIGHTED
-  int	weighted = FALSE;
-#endif //WEIGHTED
-#ifdef GENERALIZE
-  int 	prefix_mode = FALSE;
-#endif //GENERALIZE
+  int	weighted = FALSE;	// with WEIGHTED
+  int 	prefix_mode = FALSE;	// with GENERALIZE
   char  FILLER = '_';
+  char	annot_separator = '+';
+  int	format = BUILD_FORMAT;	// version of the automaton (-f)
+#ifdef MORE_COMPR
+  int	reorder_time = 0;	// seconds for reordering states (-R)
+#endif
   
   if (argc >= 2) {
     for (int i = 1; i < argc; i++) {
       if (strcmp(argv[i], "-O") == 0) {
-	optimize = TRUE;
+	optimize = SHARE_SUBSETS;
+      }
+      else if (strcmp(argv[i], "-O1") == 0) {
+	optimize = SHARE_TAILS;
+      }
+      else if (strcmp(argv[i], "-O2") == 0) {
+	optimize = SHARE_SUBSETS;
+      }
+      else if (strcmp(argv[i], "-O3") == 0) {
+	optimize = SHARE_MORE_SUBSETS;
       }
       else if (strcmp(argv[i], "-X") == 0) {
 	make_index = TRUE;
       }
       else if (strcmp(argv[i], "-A") == 0) {
 	if (++i < argc)
-	  ANNOT_SEPARATOR = *argv[i];
+	  annot_separator = *argv[i];
 	else {
 	  cerr << "Invalid annotation separator\n";
 	  usage(argv[0]);
@@ -472,10 +489,40 @@ main(const int argc, const char *argv[])
           return 1;
         }
       }
+      else if (strcmp(argv[i], "-f") == 0) {
+	if (++i < argc)
+	  format = atoi(argv[i]);
+#ifdef CFSA2
+	if (i < argc && strcmp(argv[i], "cfsa2") == 0)
+	  format = CFSA2_VERSION;
+	if (i < argc && strcmp(argv[i], "rcfsa2") == 0)
+	  format = RCFSA2_VERSION;
+	if (i < argc && strcmp(argv[i], "scfsa2") == 0)
+	  format = SCFSA2_VERSION;
+#endif
+	if (i >= argc || !format_available(format)) {
+	  cerr << argv[0] << ": -f without a version that can be written"
+	       << endl;
+	  usage(argv[0]);
+	  return 1;
+	}
+      }
 #ifdef NUMBERS
       else if (strcmp(argv[i], "-N") == 0) {
 	make_numbers = TRUE;
       }
+      else if (strcmp(argv[i], "-r") == 0) {
+	ranked = TRUE;
+      }
+#endif
+#ifdef MORE_COMPR
+      else if (strcmp(argv[i], "-R") == 0) {
+	if (++i >= argc || (reorder_time = atoi(argv[i])) < 1) {
+	  cerr << argv[0] << ": -R without a number of seconds" << endl;
+	  usage(argv[0]);
+	  return 1;
+	}
+      }
 #endif
 #ifdef WEIGHTED
       else if (strcmp(argv[i], "-W") == 0) {
@@ -499,59 +546,66 @@ main(const int argc, const char *argv[])
   }//if
 
 #ifdef NUMBERS
+  if (ranked) {
+    // ranks are added to the numbers of entries of the version
+    if (!format_available(format | RANKED_FORMAT)) {
+      cerr << argv[0] << ": -r cannot be used with version " << format
+	   << endl;
+      usage(argv[0]);
+      return 1;
+    }
+    format |= RANKED_FORMAT;
+  }
+  if (format == (RANKED_FORMAT | 4) || format == (RANKED_FORMAT | 5))
+    make_numbers = TRUE;
   if (make_numbers && optimize) {
     cerr << "-N and -O cannot be specified together. Turning -O off" << endl;
     optimize = FALSE;
   }
+#endif
+#ifdef CFSA2
+  if (cfsa2_format(format) && optimize) {
+    cerr << "States cannot share arcs in CFSA2. Turning -O off" << endl;
+    optimize = FALSE;
+  }
+#endif
+#if defined(MORE_COMPR) && defined(SPARSE)
+  if (reorder_time) {
+    cerr << "-R cannot be used with SPARSE. States are not reordered" << endl;
+    reorder_time = 0;
+  }
 #endif
   set_new_handler(&not_enough_memory);
 
   automaton autom;
   autom.FILLER = FILLER;
-  if (input_file_name) {
-    ifstream inpf(input_file_name);
-    if (!inpf) {
+  autom.set_annot_separator(annot_separator);
+  autom.set_format(format);
+#ifdef MORE_COMPR
+  autom.set_reordering(reorder_time);
+#endif
+  {
+    // standard input is read if there is no file name
+    word_reader input;
+    if (!input.open(input_file_name)) {
       cerr << argv[0] << ": Could not open input file " << input_file_name
 	   << endl;
       usage(argv[0]);
       exit(1);
     }
-    if (!autom.build_fsa(inpf)) {
+    if (!autom.build_fsa(input)) {
       cerr << argv[0] << ": Could not build the automaton" << endl;
       return 2;
     }
   }
-  else if (!autom.build_fsa(cin)) {
-    cerr << argv[0] << ": Could not build the automaton\n";
-    return 2;
-  }
 
 #ifdef A_TERGO
-  if (make_index) {
-#ifdef PROGRESS
-    cerr << "Pruning arcs" << endl;
-#endif
-    find_or_register(autom.get_root(), PRIM_INDEX, TRUE);
-#ifdef WEIGHTED
-    if (weighted) {
-      weight_arcs(autom.get_root());
-    }
-#endif //WEIGHTED
-#ifdef GENERALIZE
-    collect_annotations(autom.get_root(), prefix_mode);
-#endif
-    autom.set_root(reduce_inner(autom.get_root()));
-#ifdef GENERALIZE
-    new_gen(autom.get_root(), prefix_mode);
-    remove_annot_pointers(autom.get_root()); // !!!! some states get 0 hit_count
-#endif
-    // nodes must have arc_no set to -1
-    mark_inner(autom.get_root(), -1);
-  }
+  if (make_index)
+    autom.make_index(prefix_mode, weighted);
 #endif //A_TERGO
 
   if (optimize)
-    share_arcs(autom.get_root());
+    autom.share_arcs(optimize);
 
   if (output_file_name) {
     ofstream outf(output_file_name, ios::binary); // the flag for M$ bug
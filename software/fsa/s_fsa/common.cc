@@ -9,6 +9,12 @@
 #include	<stdlib.h>
 #include	<new>
 #include	<ctype.h>
+#include	<string.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	<sys/mman.h>
 #ifdef UTF8
 #include	<wctype.h>
 #include	<iconv.h>
@@ -22,87 +28,61 @@
 #include	"nstr.h"
 #include	"common.h"
 
-#ifdef FLEXIBLE
-int fsa_arc_ptr::gtl = 2;	// initialization: this must be defined somewhere
-int fsa_arc_ptr::size = 4;	// the same
-#ifdef NUMBERS
-int fsa_arc_ptr::entryl = 0; // the same
-int fsa_arc_ptr::aunit = 0; // the same
-#endif
-#endif
-#ifdef WEIGHTED
-int goto_offset = 1;
-#endif
-
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
-arc_pointer curr_dict_address;
-#endif
-
 using namespace std;
 
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 /* Name:	SparseVector
  * Class:	SparseVector
- * Purpose:	Constructor - reads in the sparse vector.
- * Parameters:	dict		- (i) dictionary file;
+ * Purpose:	Constructor - finds the parts of the sparse vector.
+ * Parameters:	data		- (i/o) dictionary file contents after
+ *				  the signature, then after the vector;
+ *		data_size	- (i/o) size of those contents;
  *		entry_l		- (i) size of numbering info;
  *		gtl		- (i) max size of a pointer;
  *		dict_file_name	- (i) name of the dictionary file.
  * Returns:	Nothing.
  * Remarks:	The sparse vector forms a part of the dictionary file.
- *		When the function is called, the signature of the dictionary
- *		has already been read, and the file pointer is over
- *		sparse gtl.
+ *		The file is already in memory (see fsa::read_fsa), so
+ *		the vector and the alphabet are not copied; they point
+ *		into the file contents.
  */
-SparseVector::SparseVector(ifstream &dict, const int entry_l, const int gtl,
+SparseVector::SparseVector(const char *&data, long int &data_size,
+			   const int entry_l, const int gtl,
 			   const char *dict_file_name)
 {
-  char sparse_inf[32];
-  vectOK = true;
-  if (!(dict.read(sparse_inf, 1))) {
+  long int	needed;
+  vectOK = false;
+  if (data_size < 1) {
     cerr << "Cannot read dictionary file " << dict_file_name << "\n";
-    vectOK = false;
     return;
   }
-  sparse_gtl = sparse_inf[0];
-  //  minchar = sparse_inf[1];
-  //  maxchar = sparse_inf[2];
+  sparse_gtl = data[0];
+  //  minchar = data[1];
+  //  maxchar = data[2];
   entryl = entry_l;
   goto_off = 1 + entryl;
   trans_size = goto_off + sparse_gtl;
-  // Read the number of transitions
-  if (!(dict.read(sparse_inf, sparse_gtl + 1))) {
-    cerr << "Cannot read dictionary file " << dict_file_name << "\n";
-    vectOK = false;
-    return;
-  }
-  no_of_trans = bytes2int((unsigned char *)sparse_inf, sparse_gtl + 1);
-  // Read the alphabet
-  if (!(dict.read(sparse_inf, 1))) {
-    cerr << "Cannot read dictionary file " << dict_file_name << "\n";
-    vectOK = false;
-    return;
-  }
-  alphabet_size = (unsigned char)(sparse_inf[0]);
-  alphabet = new char[alphabet_size];
-  if (!(dict.read(alphabet, alphabet_size))) {
-    cerr << "Cannot read dictionary file " << dict_file_name << "\n";
-    vectOK = false;
-    return;
-  }
-  // Read the symbol to symbol number conversion table
-  if (!(dict.read((char *)char_num, 256))) {
+  // Find the number of transitions, and the size of the alphabet
+  if (data_size < sparse_gtl + 3) {
     cerr << "Cannot read dictionary file " << dict_file_name << "\n";
-    vectOK = false;
     return;
   }
-  // Read the vector
-  vect = new char[no_of_trans * trans_size];
-  if (!(dict.read(vect, no_of_trans * trans_size))) {
+  no_of_trans = bytes2int((const unsigned char *)data + 1, sparse_gtl + 1);
+  alphabet_size = (unsigned char)(data[sparse_gtl + 2]);
+  needed = sparse_gtl + 3 + alphabet_size + 256
+    + (long int)no_of_trans * trans_size;
+  if (data_size < needed) {
     cerr << "Cannot read dictionary file " << dict_file_name << "\n";
-    vectOK = false;
     return;
   }
+  // The alphabet, the symbol to symbol number conversion table,
+  // and the vector follow
+  alphabet = data + sparse_gtl + 3;
+  memcpy(char_num, alphabet + alphabet_size, 256);
+  vect = alphabet + alphabet_size + 256;
+  data += needed;
+  data_size -= needed;
+  vectOK = true;
 }//SparseVector::SparseVector
 #endif
 
@@ -110,13 +90,22 @@ SparseVector::SparseVector(ifstream &dict, const int entry_l, const int gtl,
  * Class:	fsa (constructor).
  * Purpose:	Open dictionary files and read automata from them.
  * Parameters:	dict_names	- (i) dictionary file names;
+ *		language_file	- (i) language file name;
+ *		any_format	- (i) TRUE if the program can use automata
+ *				  in formats other than the one
+ *				  it has been compiled for (MULTI_FORMAT).
  * Returns:	Nothing.
  * Remarks:	At least one dictionary file must be read.
  */
-fsa::fsa(word_list *dict_names, const char *language_file)
+fsa::fsa(word_list *dict_names, const char *language_file,
+	 const int any_format)
 {
   int	at_least_one_good = FALSE;
 
+  other_formats = any_format;
+  sorted_input = FALSE;
+  current_path = NULL;
+
   candidate = new char[cand_alloc = Max_word_len];
   dict_names->reset();
   for (word_list *p = dict_names; p->item() != NULL; p->next())
@@ -135,6 +124,22 @@ fsa::fsa(word_list *dict_names, const char *language_file)
 #endif
 }//fsa::fsa
 
+/* Name:	~fsa
+ * Class:	fsa (destructor).
+ * Purpose:	Deallocate memory.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	Automata stay where they were read (or mapped).
+ */
+fsa::~fsa(void)
+{
+  dictionary.reset();
+  for (dict_list *p = &dictionary; p->item() != NULL; p->next())
+    delete p->item()->path;
+  delete [] word_syntax;
+  delete [] candidate;
+}//fsa::~fsa
+
 /* Name:	is_downcaseable
  * Class:	fsa
  * Purpose:	Checks whether the first character of a string is uppercase
@@ -714,13 +719,83 @@ fsa::read_language_file(const char *file_name)
   return TRUE;
 }//fsa::read_language_file
 
+/* Name:	map_dictionary
+ * Class:	None.
+ * Purpose:	Maps a dictionary file into memory.
+ * Parameters:	dict_file_name	- (i) dictionary file name;
+ *		file_size	- (i) size of the file.
+ * Returns:	Address of the file contents, or NULL if the file cannot
+ *		be mapped.
+ * Remarks:	The mapping is read-only and shared, so all processes
+ *		that use the same dictionary share one copy of it
+ *		in the page cache, and pages are read when they are
+ *		used for the first time. With PRELOAD_DICT, the file is
+ *		read when it is mapped, and huge pages are asked for.
+ *		The file need not be kept open.
+ *		With FLEXIBLE, GOTO_LOAD_SLACK bytes after the end
+ *		of the file must be readable (see load_goto). They are
+ *		in the last page of the mapping (filled with zeros),
+ *		unless the file ends too close to the end of a page;
+ *		such files are not mapped.
+ */
+static const char *
+map_dictionary(const char *dict_file_name, const long int file_size)
+{
+  struct stat	st;
+  void		*m;
+  int		fd;
+  int		flags = MAP_SHARED;
+#ifdef FLEXIBLE
+  long int	page_size = sysconf(_SC_PAGESIZE);
+
+  if (page_size <= 0 ||
+      (page_size - file_size % page_size) % page_size < GOTO_LOAD_SLACK)
+    return NULL;
+#endif
+
+  if ((fd = open(dict_file_name, O_RDONLY)) < 0)
+    return NULL;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      (long int)st.st_size != file_size || file_size <= 0) {
+    close(fd);
+    return NULL;
+  }
+#if defined(PRELOAD_DICT) && defined(MAP_POPULATE)
+  flags |= MAP_POPULATE;
+#endif
+  m = mmap(NULL, (size_t)file_size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED)
+    return NULL;
+#ifdef PRELOAD_DICT
+#ifdef MADV_HUGEPAGE
+  madvise(m, (size_t)file_size, MADV_HUGEPAGE);
+#endif
+  madvise(m, (size_t)file_size, MADV_WILLNEED);
+#else
+  madvise(m, (size_t)file_size, MADV_RANDOM);
+#endif
+  return (const char *)m;
+}//map_dictionary
+
 /* Name:	read_fsa
  * Class:	fsa
  * Purpose:	Reads an automaton from a specified file and places it
  *		on a list of dictionaries.
  * Parameters:	dict_file_name	- (i) dictionary file name.
  * Returns:	TRUE if success, FALSE if failed.
- * Remarks:	None.
+ * Remarks:	The file is mapped into memory (see map_dictionary),
+ *		so the automaton is not copied. If that is not possible,
+ *		it is read into memory allocated for it.
+ *		With MULTI_FORMAT, programs that traverse automata
+ *		with fsa_cursor (other_formats) also accept the formats
+ *		supported by it; the version is kept in arc_format.
+ *		With CFSA2, they also accept automata in the CFSA2,
+ *		RCFSA2, and SCFSA2 formats (see fsa.h). Their flags
+ *		and the size of their label table are where the filler,
+ *		the annotation separator, and gtl are in the signature
+ *		of other formats, so the default filler and separator
+ *		are used.
  */
 int
 fsa::read_fsa(const char *dict_file_name)
@@ -776,11 +851,28 @@ fsa::read_fsa(const char *dict_file_name)
 #endif
   streampos	file_ptr;
   long int	file_size;
+  const char	*data;		/* file contents after the signature */
+  long int	data_size;	/* their size */
   int		no_of_arcs;
-  fsa_arc_ptr	new_fsa;
+  arc_format	*format;	/* how arcs of the automaton are stored */
   signature	sig_arc;	/* magic number at the beginning of fsa */
   dict_desc	dd;
   int		arc_size;
+  int		gtl;		/* length of go_to field */
+  int		entryl;		/* length of numbering info */
+#if defined(MULTI_FORMAT) && defined(CFSA2)
+  int		cfsa2_flags;	/* flags of a CFSA2 automaton */
+  int		labels_size = 0; /* size of its label table */
+#endif
+#ifdef WEIGHTED
+  int		goto_off = 1;
+#else
+#ifdef MULTI_FORMAT
+  int		goto_off = goto_offset;
+#else
+  const int	goto_off = goto_offset;
+#endif
+#endif
 
   // open dictionary file
   ifstream dict(dict_file_name, ios::in /*| ios::nocreate*/ | ios::ate |
@@ -821,7 +913,14 @@ fsa::read_fsa(const char *dict_file_name)
       << endl;
     return(FALSE);
   }
-  if (sig_arc.ver != version && !(sig_arc.ver == 5 && version == 8)) {
+  if (sig_arc.ver != version && !(sig_arc.ver == 5 && version == 8)
+#ifdef MULTI_FORMAT
+      && !(other_formats && format_supported(sig_arc.ver))
+#ifdef CFSA2
+      && !(other_formats && cfsa2_format(sig_arc.ver))
+#endif
+#endif
+      ) {
     cerr << "Invalid dictionary version in file: " << dict_file_name << endl
 	 << "Version number is " << int(sig_arc.ver)
 	 << " which indicates dictionary was build:" << endl;
@@ -874,6 +973,19 @@ fsa::read_fsa(const char *dict_file_name)
       cerr << "with FLEXIBLE,  without LARGE_DICTIONARIES, "
 	   << "with STOPBIT, with NEXTBIT, with TAILS, with SPARSE" << endl;
       break;
+    case RANKED_FORMAT | 4:
+    case RANKED_FORMAT | 5:
+      cerr << "with ranks of arcs (fsa_build -r)" << endl;
+      break;
+    case '\xc6':
+      cerr << "in the CFSA2 format (fsa_build -f cfsa2)" << endl;
+      break;
+    case '\xc7':
+      cerr << "in the RCFSA2 format (fsa_build -f rcfsa2)" << endl;
+      break;
+    case '\xc8':
+      cerr << "in the SCFSA2 format (fsa_build -f scfsa2)" << endl;
+      break;
     default:
       cerr << "with yet unknown compile options (upgrade your software)"
 	   << endl;
@@ -882,79 +994,125 @@ fsa::read_fsa(const char *dict_file_name)
   }
 
 #ifdef WEIGHTED
-  goto_offset = 1;
   if (sig_arc.ver == 8)
-    goto_offset++;
+    goto_off++;
+#endif
+#ifdef MULTI_FORMAT
+  if (format_supported(sig_arc.ver))
+    goto_off = format_goto_offset(sig_arc.ver);
+#endif
+#if defined(MULTI_FORMAT) && defined(CFSA2)
+  if (cfsa2_format(sig_arc.ver)) {
+    cfsa2_flags = ((unsigned char)sig_arc.filler << 8)
+      | (unsigned char)sig_arc.annot_sep;
+    if ((cfsa2_flags & ~CFSA2_NUMBERS) !=
+	(CFSA2_FLEXIBLE | CFSA2_STOPBIT | CFSA2_NEXTBIT)) {
+      cerr << "Unsupported flags (" << cfsa2_flags
+	   << ") of the CFSA2 automaton in file " << dict_file_name << endl;
+      return FALSE;
+    }
+    labels_size = (unsigned char)sig_arc.gtl;
+    sig_arc.filler = '_';
+    sig_arc.annot_sep = '+';
+    // numbers of strings are v-coded; entryl only says they are there
+    sig_arc.gtl = (cfsa2_flags & CFSA2_NUMBERS) ? 0x10 : 0;
+  }
 #endif
   FILLER = sig_arc.filler;
   ANNOT_SEPARATOR = sig_arc.annot_sep;
+  gtl = sig_arc.gtl & 0x0f;
+  entryl = (sig_arc.gtl >> 4) & 0x0f;
+
+  // get the rest of the file into memory
+  data_size = file_size - (long)sizeof(sig_arc);
+  if ((data = map_dictionary(dict_file_name, file_size)) != NULL)
+    data += sizeof(sig_arc);
+  else {
 #ifdef FLEXIBLE
-  new_fsa.gtl = sig_arc.gtl & 0x0f;
-  new_fsa.size = new_fsa.gtl + goto_offset;
-#ifdef NUMBERS
-  new_fsa.entryl = (sig_arc.gtl >> 4) & 0x0f;
-  new_fsa.aunit = (new_fsa.entryl ? 1 : new_fsa.size);
-#endif //NUMBERS
-#endif //FLEXIBLE
+    // the bytes after the automaton may be read by load_goto
+    long int slack = GOTO_LOAD_SLACK;
+#else
+    long int slack = 0;
+#endif
+    long int alloc_size = (data_size > 0 ? data_size : 1) + slack;
+    char *contents = new char[alloc_size];
+    memset(contents, 0, alloc_size);
+    if (!(dict.read(contents, data_size))) {
+      cerr << "Cannot read dictionary file " << dict_file_name << "\n";
+      delete [] contents;
+      return(FALSE);
+    }
+    data = contents;
+  }
 
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  dd.sparse_vect = NULL;
+  if (sig_arc.ver == version) {
+#endif
   dd.sparse_vect =
-    new SparseVector(dict, new_fsa.entryl, new_fsa.gtl, dict_file_name);
+    new SparseVector(data, data_size, entryl, gtl, dict_file_name);
   if (dd.sparse_vect->bad()) {
     return FALSE;
   }
-  file_size = (long)file_ptr - (long)(dict.tellg()) + sizeof(sig_arc);
+#ifdef MULTI_FORMAT
+  }
+#endif
 #endif
 
 
-  // allocate memory and read the automaton
+  // find the automaton
 #ifdef FLEXIBLE
 #ifdef NEXTBIT
   arc_size = 1;
-  no_of_arcs = (long)file_size - sizeof(sig_arc);
-  new_fsa = new char[no_of_arcs];
+  no_of_arcs = data_size;
 #else
 #ifdef NUMBERS
-  if (new_fsa.entryl) {
-    no_of_arcs = (long)file_size - sizeof(sig_arc);
-    new_fsa = new char[no_of_arcs];
-    arc_size = 1; // for use in reading later on to specify how much to read
+  if (entryl) {
+    no_of_arcs = data_size;
+    arc_size = 1;
   }
   else {
 #endif //NUMBERS
-  arc_size = goto_offset + sig_arc.gtl;
-  no_of_arcs = ((long)file_size - sizeof(sig_arc)) / arc_size;
-  if ((long)arc_size * no_of_arcs != ((long)file_size - (long)sizeof(sig_arc)))
+  arc_size = goto_off + sig_arc.gtl;
+  no_of_arcs = data_size / arc_size;
+  if ((long)arc_size * no_of_arcs != data_size)
     no_of_arcs++;
-  new_fsa = new char[((long)file_size - sizeof(sig_arc))];
 #ifdef NUMBERS
   }
 #endif //NUMBERS
 #endif //!NEXTBIT
 #else //!FLEXIBLE
   arc_size = sizeof(fsa_arc);
-  no_of_arcs = ((long)file_size - sizeof(sig_arc)) / arc_size;
-  new_fsa = new fsa_arc[no_of_arcs];
+  no_of_arcs = data_size / arc_size;
 #endif //!FLEXIBLE
-  if (!(dict.read((char *)(new_fsa.arc), ((long)file_size-sizeof(sig_arc))))) {
-    cerr << "Cannot read dictionary file " << dict_file_name << "\n";
-    return(FALSE);
+#if defined(MULTI_FORMAT) && defined(CFSA2)
+  if (cfsa2_format(sig_arc.ver)) {
+    // arcs follow the label table
+    if (data_size <= labels_size) {
+      cerr << "Invalid dictionary file (truncated): " << dict_file_name
+	   << endl;
+      return FALSE;
+    }
+    format = new arc_format((arc_pointer)data + labels_size,
+			    (unsigned char)sig_arc.ver, gtl, entryl, goto_off);
+    format->labels = (const unsigned char *)data;
+    no_of_arcs = data_size - labels_size;
   }
+  else
+#endif
+  // the format is shared by all arcs of the automaton,
+  // so it must stay where it is as long as they are used
+  format = new arc_format((arc_pointer)data, sig_arc.ver, gtl, entryl,
+			  goto_off);
 
   // put the automaton on the list of dictionaries
   dd.filler = FILLER;
   dd.annot_sep = ANNOT_SEPARATOR;
-#ifdef FLEXIBLE
-  dd.gtl = new_fsa.gtl;
-#ifdef NUMBERS
-  dd.entryl = new_fsa.entryl;
-#endif
-#endif
-#ifdef WEIGHTED
-  dd.goto_offset = goto_offset;
-#endif
-  dd.dict = new_fsa;
+  dd.dict = fsa_arc_ptr(format->dict, format);
   dd.no_of_arcs = no_of_arcs;
+  dd.dict_size = data_size;
+  dd.path = NULL;
   dictionary.insert(&dd);
   return TRUE;
 }//fsa::read_fsa
@@ -971,7 +1129,6 @@ fsa::read_fsa(const char *dict_file_name)
 int
 fsa::sparse_word_in_dictionary(const char *word, const long start)
 {
-  fsa_arc_ptr *dummy;
   long current = start;
   for (;;) {
     long int next;
@@ -980,11 +1137,11 @@ fsa::sparse_word_in_dictionary(const char *word, const long start)
 	return TRUE;
       }
       else if (*word == ANNOT_SEPARATOR) {
-	return word_in_dictionary(word + 1, current_dict + next
+	return word_in_dictionary(word + 1, node_at(next
 #ifdef NUMBERS
-				  + dummy->entryl
+				  + current_format->entryl
 #endif
-				  );
+				  ));
       }
       else {
 	word++;
@@ -1005,17 +1162,21 @@ fsa::sparse_word_in_dictionary(const char *word, const long start)
  * Parameters:	word	- (i) word to check;
  *		start	- (i) look at children of this node.
  * Returns:	TRUE if word found, FALSE otherwise.
- * Remarks:	None.
+ * Remarks:	A is the class of arcs (see forallarcs).
+ *		Labels of a string arc (SCFSA2) are compared at once.
  */
+template <class A>
 int
-fsa::word_in_dictionary(const char *word, fsa_arc_ptr start)
+fsa::word_in_dictionary(const char *word, A start)
 {
   bool found = false;
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   do {
     found = false;
-    forallnodes(i) {
+    forallarcs(i) {
       if (*word == next_node.get_letter()) {
+	if (!match_run(word, next_node))
+	  return FALSE;
 	if (word[1] == '\0' && next_node.is_final())
 	  return TRUE;
 	else {
@@ -1026,45 +1187,219 @@ fsa::word_in_dictionary(const char *word, fsa_arc_ptr start)
 	}
       }
     }
-    next_node = start.set_next_node(current_dict);
+    next_node = start.set_next_node();
   } while (found);
   return FALSE;
 }//fsa::word_in_dictionary
 
+#ifdef MULTI_FORMAT
+/* Class name:	lookup_kernel
+ * Purpose:	Find if a word is in an automaton with arcs of the class
+ *		made for its format.
+ * Methods:	lookup_kernel	- remembers the automaton and the word;
+ *		operator()	- looks for the word from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct lookup_kernel {
+  fsa		*automaton;	/* where to look */
+  const char	*word;		/* word to look for */
+  lookup_kernel(fsa *a, const char *w) { automaton = a; word = w; }
+  template <class A>
+  int operator()(A root) {
+    return automaton->word_in_dictionary(word, root.set_next_node());
+  }
+};/* struct lookup_kernel */
+#endif
+
+/* Name:	word_in_current_dict
+ * Class:	fsa
+ * Purpose:	Find if a word is in the current dictionary.
+ * Parameters:	word	- (i) word to check.
+ * Returns:	TRUE if word found, FALSE otherwise.
+ * Remarks:	With MULTI_FORMAT, the format of the dictionary is looked
+ *		at here (see morph_fsa::morph_dictionary).
+ */
+int
+fsa::word_in_current_dict(const char *word)
+{
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  if (sparse_vect == NULL) {
+    lookup_kernel kernel(this, word);
+    return with_format(current_format, kernel);
+  }
+#endif
+  return sparse_word_in_dictionary(word, sparse_vect->get_first());
+#else
+#ifdef MULTI_FORMAT
+  lookup_kernel kernel(this, word);
+  return with_format(current_format, kernel);
+#else
+  fsa_arc_ptr nxtnode = first_node();
+  return word_in_dictionary(word, nxtnode.set_next_node());
+#endif
+#endif
+}//fsa::word_in_current_dict
+
+/* Name:	walk_step
+ * Class:	fsa
+ * Purpose:	Goes one node further in looking for a word of a batch.
+ * Parameters:	w	- (i/o) the state of the word.
+ * Returns:	Nothing.
+ * Remarks:	A is the class of arcs (see forallarcs). The same as one
+ *		iteration of the loop in word_in_dictionary, but the target
+ *		node is not looked at: it is only asked for (prefetch_target),
+ *		so that it can come into the cache while other words
+ *		are looked for.
+ */
+template <class A>
+void
+fsa::walk_step(walk_state<A> &w)
+{
+  A start = w.arc.set_next_node();
+  A next_node = start;
+  const char *word = w.word;
+
+  forallarcs(i) {
+    if (*word == next_node.get_letter()) {
+      if (!match_run(word, next_node)) {
+	w.found = FALSE;
+	return;
+      }
+      if (word[1] == '\0') {
+	w.found = next_node.is_final();
+	return;
+      }
+      w.word = word + 1;
+      w.arc = next_node;
+      next_node.prefetch_target();
+      return;
+    }
+  }
+  w.found = FALSE;
+}//fsa::walk_step
+
+/* Name:	walk_batch
+ * Class:	fsa
+ * Purpose:	Finds which words of a batch are in a dictionary.
+ * Parameters:	w	- (i/o) states of the words (found is set);
+ *		n	- (i) number of words.
+ * Returns:	Nothing.
+ * Remarks:	A is the class of arcs (see forallarcs).
+ *		Words are looked for in turns, one node of each word
+ *		at a time, so that the processor reads nodes for many words
+ *		at once instead of waiting for each one in turn.
+ *		This pays only when the automaton does not fit
+ *		in the cache (BATCH_MIN_SIZE).
+ */
+template <class A>
+void
+fsa::walk_batch(walk_state<A> *w, const int n)
+{
+  int left = 0;
+  for (int i = 0; i < n; i++)
+    if (w[i].found < 0)
+      left++;
+  while (left > 0) {
+    for (int i = 0; i < n; i++)
+      if (w[i].found < 0) {
+	walk_step(w[i]);
+	if (w[i].found >= 0)
+	  left--;
+      }
+  }
+}//fsa::walk_batch
+
+#ifdef MULTI_FORMAT
+/* Class name:	batch_kernel
+ * Purpose:	Find which words of a batch are in an automaton with arcs
+ *		of the class made for its format.
+ * Methods:	batch_kernel	- remembers the automaton and the words;
+ *		operator()	- looks for the words from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct batch_kernel {
+  fsa		*automaton;	/* where to look */
+  const char	**words;	/* words to look for */
+  int		n;		/* how many */
+  int		*found;		/* which ones are there */
+  batch_kernel(fsa *a, const char **w, const int k, int *f) {
+    automaton = a; words = w; n = k; found = f;
+  }
+  template <class A>
+  int operator()(A root) {
+    walk_state<A> w[LOOKUP_BATCH];
+    for (int i = 0; i < n; i++) {
+      w[i].word = words[i]; w[i].arc = root; w[i].found = -1;
+    }
+    automaton->walk_batch(w, n);
+    for (int i = 0; i < n; i++)
+      found[i] = w[i].found;
+    return 0;
+  }
+};/* struct batch_kernel */
+#endif
+
+/* Name:	words_in_current_dict
+ * Class:	fsa
+ * Purpose:	Finds which words of a batch are in the current dictionary.
+ * Parameters:	words	- (i) words to check;
+ *		n	- (i) how many (at most LOOKUP_BATCH);
+ *		found	- (o) TRUE for words found, FALSE for others.
+ * Returns:	Nothing.
+ * Remarks:	Automata with a sparse vector are looked at word by word.
+ */
+void
+fsa::words_in_current_dict(const char **words, const int n, int *found)
+{
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  if (sparse_vect == NULL) {
+    batch_kernel kernel(this, words, n, found);
+    with_format(current_format, kernel);
+    return;
+  }
+#endif
+  for (int i = 0; i < n; i++)
+    found[i] = sparse_word_in_dictionary(words[i], sparse_vect->get_first());
+#else
+#ifdef MULTI_FORMAT
+  batch_kernel kernel(this, words, n, found);
+  with_format(current_format, kernel);
+#else
+  walk_state<fsa_arc_ptr> w[LOOKUP_BATCH];
+  for (int i = 0; i < n; i++) {
+    w[i].word = words[i]; w[i].arc = first_node(); w[i].found = -1;
+  }
+  walk_batch(w, n);
+  for (int i = 0; i < n; i++)
+    found[i] = w[i].found;
+#endif
+#endif
+}//fsa::words_in_current_dict
+
 /* Name:	set_dictionary
  * Class:	fsa
  * Purpose:	Sets variables associated with the current dictionary
  * Parameters:	dict	- (i) current dictionary description.
  * Returns:	Nothing.
- * Remarks:	None.
+ * Remarks:	Only variables of this object are set. The format
+ *		of arcs goes with the arcs (fsa_arc_ptr), so objects
+ *		in different threads may use different dictionaries.
  */
 void
 fsa::set_dictionary(dict_desc *dict)
 {
-#ifdef FLEXIBLE
-  fsa_arc_ptr	dummy(NULL);
-#endif
-
   current_dict = dict->dict.arc;
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
-  set_curr_dict_address(current_dict);
-#endif
+  current_format = dict->dict.format;
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   sparse_vect = dict->sparse_vect;
 #endif
   FILLER = dict->filler;
-#ifdef FLEXIBLE
-#ifdef WEIGHTED
-  goto_offset =  dict->goto_offset;
+  current_path = &dict->path;
+#if defined(FLEXIBLE) && defined(WEIGHTED)
   weighted = dict->weighted;
-#endif //WEIGHTED
-  dummy.gtl = dict->gtl;
-  dummy.size = dummy.gtl + goto_offset;
-#ifdef NUMBERS
-  dummy.entryl = dict->entryl;
-  dummy.aunit = dummy.entryl ? 1 : (goto_offset + dummy.gtl);
-#endif
-#endif
+#endif //FLEXIBLE&WEIGHTED
 }//fsa::set_dictionary
 
 /* Name:	word_in_dictionaries
@@ -1078,30 +1413,17 @@ int
 fsa::word_in_dictionaries(const char *word)
 {
   dict_list		*dict;
-#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
-  fsa_arc_ptr		*dummy = NULL;
-#endif
 
   dictionary.reset();
   for (dict = &dictionary; dict->item(); dict->next()) {
     set_dictionary(dict->item());
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-    if (sparse_word_in_dictionary(word, sparse_vect->get_first()))
-#else
-    fsa_arc_ptr nxtnode = dummy->first_node(current_dict);
-    if (word_in_dictionary(word, nxtnode.set_next_node(current_dict)))
-#endif
+    if (word_in_current_dict(word))
       return TRUE;
 #ifdef CASECONV
     else if (is_downcaseable(word)) {
       // word is uppercase - try lowercase
       *((char *)word) = casetab[(unsigned char)*word];
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-      if (sparse_word_in_dictionary(word, sparse_vect->get_first()))
-#else
-      fsa_arc_ptr nxtnode = dummy->first_node(current_dict);
-      if (word_in_dictionary(word, nxtnode.set_next_node(current_dict)))
-#endif
+      if (word_in_current_dict(word))
 	return TRUE;
       *((char *)word) = casetab[(unsigned char)*word];
     }
@@ -1110,6 +1432,102 @@ fsa::word_in_dictionaries(const char *word)
   return FALSE;
 }//fsa::word_in_dictionaries
 
+/* Name:	words_in_dictionaries
+ * Class:	fsa
+ * Purpose:	Finds which words of a batch are in any dictionary.
+ * Parameters:	words	- (i) words to check;
+ *		n	- (i) how many (at most LOOKUP_BATCH);
+ *		found	- (o) TRUE for words found, FALSE for others.
+ * Returns:	Nothing.
+ * Remarks:	The same as word_in_dictionaries for each word.
+ *		Words are looked for in batches only where that pays
+ *		(batch_pays); elsewhere, they are looked for one by one.
+ */
+void
+fsa::words_in_dictionaries(const char **words, const int n, int *found)
+{
+  dict_list		*dict;
+  const char		*left[LOOKUP_BATCH];	/* words not found yet */
+  int			where[LOOKUP_BATCH];	/* their indices in words */
+  int			in_dict[LOOKUP_BATCH];
+  int			k;
+
+  for (int i = 0; i < n; i++)
+    found[i] = FALSE;
+  dictionary.reset();
+  for (dict = &dictionary; dict->item(); dict->next()) {
+    set_dictionary(dict->item());
+    k = 0;
+    for (int i = 0; i < n; i++)
+      if (!found[i]) {
+	where[k] = i;
+	left[k++] = words[i];
+      }
+    if (k == 0)
+      break;
+    if (batch_pays(dict->item()))
+      words_in_current_dict(left, k, in_dict);
+    else
+      for (int j = 0; j < k; j++)
+	in_dict[j] = word_in_current_dict(left[j]);
+    for (int j = 0; j < k; j++) {
+      const char *word = left[j];
+      found[where[j]] = in_dict[j];
+#ifdef CASECONV
+      if (!in_dict[j] && is_downcaseable(word)) {
+	// word is uppercase - try lowercase
+	*((char *)word) = casetab[(unsigned char)*word];
+	if (word_in_current_dict(word))
+	  found[where[j]] = TRUE;
+	else
+	  *((char *)word) = casetab[(unsigned char)*word];
+      }
+#endif
+    }
+  }
+}//fsa::words_in_dictionaries
+
+/* Name:	batch_pays
+ * Class:	fsa
+ * Purpose:	Tells whether words should be looked for in batches
+ *		in a dictionary.
+ * Parameters:	d	- (i) the dictionary.
+ * Returns:	TRUE if they should, FALSE otherwise.
+ * Remarks:	In smaller automata (BATCH_MIN_SIZE), the nodes are
+ *		in the cache anyway, and looking for a few words at once
+ *		only costs more. In CFSA2, more time is spent on decoding arcs
+ *		than on waiting for memory, and batches were slower.
+ */
+int
+fsa::batch_pays(const dict_desc *d) const
+{
+#if defined(MULTI_FORMAT) && defined(CFSA2)
+  if (cfsa2_format(d->dict.format->version))
+    return FALSE;
+#endif
+  return (d->dict_size >= BATCH_MIN_SIZE);
+}//fsa::batch_pays
+
+/* Name:	batch_pays
+ * Class:	fsa
+ * Purpose:	Tells whether words should be read in batches.
+ * Parameters:	None.
+ * Returns:	TRUE if words should be looked for in batches
+ *		in any dictionary, FALSE otherwise.
+ * Remarks:	None.
+ */
+int
+fsa::batch_pays(void)
+{
+  dict_list		*dict;
+
+  dictionary.reset();
+  for (dict = &dictionary; dict->item(); dict->next())
+    if (batch_pays(dict->item()))
+      return TRUE;
+  return FALSE;
+}//fsa::batch_pays
+
 /* Name:	get_word
  * Class:	None.
  * Purpose:	Read a word from input, allocating more memory if necessary.
@@ -1133,10 +1551,11 @@ get_word(tr_io &io_obj, char *&word, int &allocated,
     if (io_obj.get_junk() != '\n') {
       io_obj.set_buf_len(alloc_step);
       do {
-	int junk_size = (io_obj.get_junk() == '\0' ? 0 : 1);
+	char junk = io_obj.get_junk();
 	w = grow_string(word, allocated, alloc_step);
-	w += allocated - alloc_step - 1 + junk_size;
-	word[allocated - alloc_step - junk_size] = io_obj.get_junk();
+	w += strlen(w);		// the next piece goes right after the last one
+	if (junk != '\0')
+	  *w++ = junk;
 	if (!(io_obj >> w)) {
 	  break;
 	}
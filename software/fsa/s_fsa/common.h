@@ -179,25 +179,536 @@ const int	LIST_INIT_SIZE = 16;	/* initial list capacity */
 const int	LIST_STEP_SIZE = 8;	/* list size increment */
 const int	MAX_NOT_CYCLE = 1024;   /* max length of candidate (if
 					 greater, treated as cycle) */
+const int	LOOKUP_BATCH = 16;	/* words looked for at once */
+const long int	BATCH_MIN_SIZE = 4L << 20; /* smaller automata stay in the
+					   cache, so batches do not pay */
+const int	CURSOR_INIT_DEPTH = 16;	/* initial stack size of word_cursor */
 using namespace std;
 
 /* Defines a dictionary with its inherent properties */
 struct dict_desc {
-  fsa_arc_ptr	dict;		/* dictionary itself (fsa) */
+  fsa_arc_ptr	dict;		/* dictionary itself (fsa), with the format
+				   of its arcs */
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   SparseVector	*sparse_vect;	/* sparse vector part of the dictionary */
 #endif
   int		no_of_arcs;	/* number of arcs */
+  long int	dict_size;	/* size of the automaton in bytes */
   char          filler;		/* filler ("empty") character */
   char		annot_sep;	/* separates words from annotations */
-  char		gtl;		/* size of goto field */
-  char		entryl;		/* size of entries field */
 #ifdef WEIGHTED
-  int		goto_offset;	/* offset of the goto field in arcs */
   int		weighted;	/* TRUE if arcs weighted */
 #endif
+  struct path_base *path;	/* arcs followed by the last word (or NULL) */
 };/*dict_desc*/
 
+/* Class name:	walk_state
+ * Purpose:	Keep the state of a word looked for in a batch
+ *		(see fsa::walk_batch).
+ * Remarks:	A is the class of arcs (see forallarcs). The rest of the word
+ *		is looked for in the target node of arc; found is -1
+ *		as long as it is not known whether the word is there.
+ */
+template <class A>
+struct walk_state {
+  const char	*word;		/* the rest of the word */
+  A		arc;		/* arc leading to the node to look at */
+  int		found;		/* -1, FALSE, or TRUE */
+  int		word_no;	/* number of words before it (fsa_hash) */
+};/* struct walk_state */
+
+/* Class name:	path_base
+ * Purpose:	Let paths with arcs of any class be kept with dictionaries
+ *		(see arc_path).
+ */
+struct path_base {
+  virtual ~path_base(void) {}
+};/* struct path_base */
+
+/* Class name:	arc_path
+ * Purpose:	Keep states of the last word looked for after each arc,
+ *		so that the next word is looked for from where it differs
+ *		from the last one (fsa_hash -s, fsa_morph -s).
+ * Methods:	arc_path	- starts with the root;
+ *		~arc_path	- frees memory;
+ *		resume		- forgets states past the prefix shared
+ *				  by a word and the last one, and returns
+ *				  the state the word is to be looked for from;
+ *		push		- remembers the next state of the word.
+ * Remarks:	A is the class of arcs (see forallarcs). steps[0] is the root,
+ *		levels[i] is the number of characters matched in steps[i].
+ *		With sorted words, most states are shared, so the automaton
+ *		is walked as in one pass.
+ */
+template <class A>
+struct arc_path : public path_base {
+  walk_state<A>	*steps;		/* states after each arc followed */
+  int		*levels;	/* characters matched in them */
+  int		depth;		/* number of states kept */
+  int		allocated;	/* size of steps and levels */
+  char		*last;		/* the last word */
+  int		last_alloc;	/* size of last */
+
+  arc_path(A root) {
+    steps = new walk_state<A>[allocated = Max_word_len];
+    levels = new int[allocated];
+    last = new char[last_alloc = Max_word_len];
+    last[0] = '\0';
+    steps[0].arc = root; steps[0].word_no = 0; levels[0] = 0; depth = 1;
+  }
+  ~arc_path(void) { delete [] steps; delete [] levels; delete [] last; }
+  walk_state<A> resume(const char *word) {
+    int lcp = 0;
+    while (word[lcp] != '\0' && word[lcp] == last[lcp])
+      lcp++;
+    int l = lcp + strlen(word + lcp);
+    // whether a word ends is known at its last arc, so that arc stays
+    while (depth > 1 && (levels[depth - 1] > lcp || levels[depth - 1] >= l))
+      depth--;
+    if (l >= last_alloc) {
+      delete [] last;
+      last = new char[last_alloc = l + Max_word_len];
+    }
+    strcpy(last, word);
+    walk_state<A> w = steps[depth - 1];
+    w.word = word + levels[depth - 1];
+    w.found = -1;
+    return w;
+  }
+  void push(const walk_state<A> &w, const int level) {
+    if (depth == allocated) {
+      walk_state<A> *s = new walk_state<A>[2 * allocated];
+      int *l = new int[2 * allocated];
+      for (int i = 0; i < depth; i++) {
+	s[i] = steps[i]; l[i] = levels[i];
+      }
+      delete [] steps; delete [] levels;
+      steps = s; levels = l; allocated *= 2;
+    }
+    steps[depth] = w; levels[depth++] = level;
+  }
+private:
+  // not implemented: a copy would free steps, levels and last twice
+  arc_path(const arc_path &);
+  arc_path &operator=(const arc_path &);
+};/* struct arc_path */
+
+/* Name:	words_in_node
+ * Class:	None.
+ * Purpose:	Returns the number of different words (word suffixes)
+ *		in the target node of an arc.
+ * Parameters:	start		- (i) parent of the node to be examined.
+ * Returns:	Number of different word suffixes in the given node.
+ * Remarks:	The number is put before the node (fsa_build -N);
+ *		0 is returned when automata have no numbers.
+ */
+template <class A>
+inline int
+words_in_node(A start)
+{
+#if defined(FLEXIBLE) && (defined(NUMBERS) || defined(MULTI_FORMAT))
+  A next_node = start.set_next_node();
+
+  return (start.get_goto() ?
+	  bytes2int((unsigned char *)next_node.arc - next_node.format->entryl,
+		    next_node.format->entryl)
+	  : 0);
+#else
+  return 0;
+#endif
+}//words_in_node
+
+#if defined(MULTI_FORMAT) && defined(CFSA2)
+/* Name:	words_in_node
+ * Class:	None.
+ * Purpose:	Returns the number of different words (word suffixes)
+ *		in the given node of a CFSA2 (RCFSA2, SCFSA2) automaton.
+ * Parameters:	R		- (t) 1 if addresses are relative;
+ *		S		- (t) 1 if arcs can have strings of labels;
+ *		start		- (i) parent of the node to be examined.
+ * Returns:	Number of different word suffixes in the given node.
+ * Remarks:	The number is v-coded at the address of the node.
+ *		Nodes inside a string arc have no number; their words
+ *		are the words of the node after the string, and the string
+ *		itself if its last label is final.
+ */
+template <int R, int S>
+inline int
+words_in_node(cfsa2_cursor<1, R, S> start)
+{
+  int words = 0;
+
+  if (S && start.run_left()) {
+    start = start.skip_labels(start.run_left());
+    words = start.is_final();
+  }
+  const unsigned char *p = (const unsigned char *)start.format->dict
+    + start.get_goto();
+
+  return words
+    + (p == (const unsigned char *)start.format->dict ? 0 : get_vint(p));
+}//words_in_node
+#endif
+
+/* Name:	match_run
+ * Class:	None.
+ * Purpose:	Compares the labels that follow the current one in a string
+ *		arc (SCFSA2) with the rest of a word.
+ * Parameters:	word		- (i/o) the word at the current label;
+ *				  it is moved to the last label matched;
+ *		node		- (i/o) the arc; it is moved to the last
+ *				  label matched.
+ * Returns:	TRUE if the labels match, FALSE otherwise.
+ * Remarks:	The word may end before the string. The arc is then left
+ *		inside the string, where it is not final, and its target
+ *		is the next label (see cfsa2_cursor).
+ *		Other arcs have no such labels, and the function does nothing.
+ */
+template <class A>
+inline int
+match_run(const char *&word, A &node)
+{
+  const int r = node.run_left();
+  if (r == 0)
+    return TRUE;
+  const char *labels = node.run_labels();
+  int n = 0;
+  for (; n < r && word[n + 1] != '\0'; n++)
+    if (word[n + 1] != labels[n])
+      return FALSE;
+  word += n;
+  node = node.skip_labels(n);
+  return TRUE;
+}//match_run
+
+/* Name:	copy_run
+ * Class:	None.
+ * Purpose:	Copies the labels that follow the current one in a string
+ *		arc (SCFSA2).
+ * Parameters:	to		- (o) where the labels are to be put;
+ *		node		- (i/o) the arc; it is moved to its last label.
+ * Returns:	The number of labels copied.
+ * Remarks:	There must be room for run_left() labels at to.
+ */
+template <class A>
+inline int
+copy_run(char *to, A &node)
+{
+  const int r = node.run_left();
+  if (r) {
+    memcpy(to, node.run_labels(), r);
+    node = node.skip_labels(r);
+  }
+  return r;
+}//copy_run
+
+/* Class name:	cursor_step
+ * Purpose:	Keep an arc on the path of the current word of a word_cursor.
+ */
+template <class A>
+struct cursor_step {
+  A		node;		/* the first arc of the node */
+  A		arc;		/* the arc followed in the node */
+  int		left;		/* for more_arcs (see forallarcs) */
+  int		level;		/* length of the word before the arc */
+};/* struct cursor_step */
+
+/* Class name:	word_cursor
+ * Purpose:	Go through words of a node of an automaton one at a time,
+ *		so that the walk can be stopped, resumed, and moved.
+ * Methods:	word_cursor	- goes to the first word of the node;
+ *		~word_cursor	- releases memory;
+ *		word		- returns the current word (NULL at the end);
+ *		length		- returns the length of the current word;
+ *		first		- goes to the first word;
+ *		next		- goes to the next word;
+ *		seek		- goes to the first word not less than a key;
+ *		skip		- goes past a number of words;
+ *		count		- counts words from the current one
+ *				  to the end;
+ *		grow, push, find, above, next_arc, put_labels, settle,
+ *		forward		- (private) steps of the walk.
+ * Remarks:	A is the class of arcs (see forallarcs). Arcs followed
+ *		to the current word are kept on a stack (cursor_step),
+ *		one for each node on the path, and the word ends with labels
+ *		of the arc on top. Words come in the order of arcs in nodes
+ *		(the order of numbers in fsa_hash), or, if lexical is set,
+ *		in the order of bytes: arcs of a node are then visited
+ *		in the order of labels, which costs a scan of the node
+ *		for each arc. Seek goes by the order of bytes; without
+ *		lexical, it is right only if arcs are sorted on labels.
+ *		Count and skip use numbers of words in nodes (fsa_build -N)
+ *		if they are present; otherwise words are passed one by one,
+ *		and count returns -1.
+ *		Words begin with the prefix given to the constructor.
+ *		Labels equal to filler (unless it is '\0') are not put
+ *		into words (they are still compared with keys in seek).
+ *		The node must not be the sink.
+ */
+template <class A>
+class word_cursor {
+  cursor_step<A> *path;		/* arcs followed to the current word */
+  int		depth;		/* how many (0 at the end) */
+  int		allocated;	/* size of path */
+  A		start;		/* the node whose words are visited */
+  A		last;		/* the arc on top, at its last label */
+  char		*current;	/* the current word */
+  int		cur_alloc;	/* size of current */
+  int		cur_len;	/* length of the current word */
+  int		base;		/* length of the prefix */
+  int		lexical;	/* TRUE if words are in the order of bytes */
+  char		filler;		/* label not put into words */
+  int		counted;	/* TRUE if nodes have numbers of words */
+
+  // not implemented: a copy would free path and current twice
+  word_cursor(const word_cursor &);
+  word_cursor &operator=(const word_cursor &);
+
+  void grow(void) {
+    const int n = (allocated > 0 ? 2 * allocated : CURSOR_INIT_DEPTH);
+    cursor_step<A> *p = new cursor_step<A>[n];
+    for (int i = 0; i < depth; i++)
+      p[i] = path[i];
+    delete [] path;
+    path = p; allocated = n;
+  }
+
+  void push(A node) {
+    if (depth == allocated)
+      grow();
+    cursor_step<A> &s = path[depth++];
+    s.node = s.arc = node; s.level = cur_len;
+    s.left = node.arcs_to_visit();
+    if (lexical)
+      above(s, -1);
+  }
+
+  // finds the arc with label c in the node
+  int find(cursor_step<A> &s, const int c) {
+    A a = s.node;
+    for (int left = a.arcs_to_visit(); left; left = a.more_arcs(left), ++a)
+      if ((unsigned char)a.get_letter() == c) {
+	s.arc = a; s.left = left;
+	return TRUE;
+      }
+    return FALSE;
+  }
+
+  // finds the first arc with label greater than c (-1 - any label)
+  // in the node, in the order of words
+  int above(cursor_step<A> &s, const int c) {
+    int found = FALSE;
+    A a = s.node;
+    for (int left = a.arcs_to_visit(); left; left = a.more_arcs(left), ++a)
+      if ((unsigned char)a.get_letter() > c &&
+	  (!found ||
+	   (unsigned char)a.get_letter() < (unsigned char)s.arc.get_letter())) {
+	s.arc = a; s.left = left; found = TRUE;
+	if (!lexical)
+	  break;
+      }
+    return found;
+  }
+
+  // goes to the next arc in the node, in the order of words
+  int next_arc(cursor_step<A> &s) {
+    if (lexical)
+      return above(s, (unsigned char)s.arc.get_letter());
+    if (!(s.left = s.arc.more_arcs(s.left)))
+      return FALSE;
+    ++(s.arc);
+    return TRUE;
+  }
+
+  // puts labels of the arc on top into the current word
+  A put_labels(const cursor_step<A> &s) {
+    const A a = s.arc;
+    const int r = a.run_left();
+    while (s.level + r + 2 >= cur_alloc)
+      grow_string(current, cur_alloc, Max_word_len);
+    // locals, as stores into the word could change any member
+    const char fill = filler;
+    char *p = current + s.level;
+    if (fill == '\0' || a.get_letter() != fill)
+      *p++ = a.get_letter();
+    if (r == 0) {
+      *p = '\0';
+      cur_len = p - current;
+      return a;
+    }
+    const char *run = a.run_labels();
+    for (int i = 0; i < r; i++)
+      if (fill == '\0' || run[i] != fill)
+	*p++ = run[i];
+    *p = '\0';
+    cur_len = p - current;
+    return a.skip_labels(r);
+  }
+
+  // goes to the first word through the arc on top
+  int settle(void) {
+    last = put_labels(path[depth - 1]);
+    return last.is_final() || forward(TRUE);
+  }
+
+  // goes to the next word, first into the target of the arc on top
+  // if into is set, or else past it
+  int forward(int into) {
+    A a = last;			// locals, as they are looked at often
+    cursor_step<A> *s = path + depth - 1;
+    for (;;) {
+      if (into && a.get_goto() != 0) {
+	push(a.set_next_node());
+	s = path + depth - 1;
+      }
+      else {
+	while (!next_arc(*s)) {
+	  if (--depth == 0) {
+	    current[cur_len = base] = '\0';
+	    return FALSE;
+	  }
+	  s--;
+	}
+      }
+      a = put_labels(*s);
+      if (a.is_final()) {
+	last = a;
+	return TRUE;
+      }
+      into = TRUE;
+    }
+  }
+
+public:
+  word_cursor(A node, const int lex = FALSE, const char *prefix = "",
+	      const int prefix_len = 0, const char fill = '\0') {
+    path = new cursor_step<A>[allocated = CURSOR_INIT_DEPTH];
+    current = new char[cur_alloc = prefix_len + Max_word_len];
+    memcpy(current, prefix, prefix_len);
+    cur_len = base = prefix_len;
+    current[base] = '\0';
+    start = node; lexical = lex; filler = fill;
+#if defined(FLEXIBLE) && (defined(NUMBERS) || defined(MULTI_FORMAT))
+    counted = (node.format->entryl != 0);
+#else
+    counted = FALSE;
+#endif
+    first();
+  }
+  ~word_cursor(void) { delete [] path; delete [] current; }
+
+  const char *word(void) const { return (depth ? current : NULL); }
+  int length(void) const { return cur_len; }
+
+  int first(void) {
+    depth = 0; cur_len = base;
+    push(start);
+    return settle();
+  }
+
+  int next(void) { return depth > 0 && forward(TRUE); }
+
+  int seek(const char *key) {
+    depth = 0; cur_len = base;
+    push(start);
+    for (;;) {
+      cursor_step<A> &s = path[depth - 1];
+      if (*key == '\0')
+	return settle();
+      if (!find(s, (unsigned char)*key)) {
+	// the words are between those through two arcs
+	if (above(s, (unsigned char)*key))
+	  return settle();
+	if (--depth == 0) {
+	  current[cur_len = base] = '\0';
+	  return FALSE;
+	}
+	return forward(FALSE);
+      }
+      last = put_labels(s);
+      const int r = s.arc.run_left();
+      const char *run = s.arc.run_labels();
+      int i = 0;
+      while (i < r && key[i + 1] == run[i])
+	i++;
+      if (i < r) {
+	// the key ends or differs in the middle of a string arc
+	if (key[i + 1] == '\0'
+	    || (unsigned char)run[i] > (unsigned char)key[i + 1])
+	  return last.is_final() || forward(TRUE);
+	return forward(FALSE);
+      }
+      key += r + 1;
+      if (*key == '\0')
+	return last.is_final() || forward(TRUE);
+      if (last.get_goto() == 0)
+	return forward(FALSE);
+      push(last.set_next_node());
+    }
+  }
+
+  int skip(const int n) {
+    if (depth == 0 || n <= 0)
+      return 0;
+    if (!counted) {
+      int passed = 0;
+      while (passed < n && depth > 0) {
+	next();
+	passed++;
+      }
+      return passed;
+    }
+    // words in targets of arcs are passed at once
+    int m = n;			// the m-th word from here
+    for (;;) {
+      int below = words_in_node(last);
+      if (m <= below)
+	break;
+      m -= below;
+      while (!next_arc(path[depth - 1]))
+	if (--depth == 0) {
+	  current[cur_len = base] = '\0';
+	  return n - m + 1;
+	}
+      last = put_labels(path[depth - 1]);
+      if (last.is_final() && --m == 0)
+	return n;
+    }
+    // the word is below the arc on top
+    for (;;) {
+      push(last.set_next_node());
+      for (;;) {
+	last = put_labels(path[depth - 1]);
+	if (last.is_final() && --m == 0)
+	  return n;
+	int below = words_in_node(last);
+	if (m <= below)
+	  break;
+	m -= below;
+	if (!next_arc(path[depth - 1])) {
+	  depth = 0;		// the numbers do not match the arcs
+	  current[cur_len = base] = '\0';
+	  return n - m + 1;
+	}
+      }
+    }
+  }
+
+  int count(void) {
+    if (depth == 0)
+      return 0;
+    if (!counted)
+      return -1;
+    int c = 1 + words_in_node(last);
+    for (int d = depth - 1; d >= 0; d--) {
+      cursor_step<A> t = path[d];
+      while (next_arc(t))
+	c += t.arc.is_final() + words_in_node(t.arc);
+    }
+    return c;
+  }
+};/* class word_cursor */
+
 /* Name:	comp
  * Class:	None.
  * Purpose:	Compare two list items.
@@ -332,6 +843,12 @@ public:
       return (T *)NULL;
   }
   int how_many(void) const { return no_of_items; }
+  void swap(list<T> &l) {	/* exchange items with another list */
+    T **i = items; items = l.items; l.items = i;
+    i = next_item; next_item = l.next_item; l.next_item = i;
+    c = no_of_items; no_of_items = l.no_of_items; l.no_of_items = c;
+    c = allocated; allocated = l.allocated; l.allocated = c;
+  }
 };/*class list*/
 
 
@@ -358,6 +875,8 @@ struct word_syntax_type {
  *					not found;
  *		print_repls	- print replacements for the word;
  *		print_morph	- print word morphology;
+ *		set_echo	- say whether words are echoed when read;
+ *		print_word	- echo a word read before;
  *		int		- return state of the last stream used;
  * Fields:	input		- input stream;
  *		output		- output stream;
@@ -365,9 +884,12 @@ struct word_syntax_type {
  *		stream_state	- state of i/o;
  *		buffer		- input buffer;
  *		word_syntax	- which characters constitute a part of word;
- *		Max_line_len	- max length of input lines.
+ *		Max_line_len	- max length of input lines;
+ *		echo		- whether operator>> echoes words.
  * Remarks:	Operator>> must make sure that the returned string does not
  *		exceed Max_word_len.
+ *		Words are echoed later (print_word) when a few words
+ *		are read before any of them is processed (LOOKUP_BATCH).
  */
 class tr_io {
 protected:
@@ -392,6 +914,7 @@ protected:
   int		inp_word_len;		/* input word length */
   char		junk;			/* last character read (normally
 					   '\n') */
+  int		echo;			/* whether >> echoes words */
 
 #ifdef UTF8
   int is_word_char(unsigned char *s) {
@@ -426,6 +949,8 @@ public:
   tr_io &print_repls(word_list *r);
   tr_io &print_morph(word_list *s);
   tr_io &print_line(const char *s);
+  int set_echo(const int e);
+  tr_io &print_word(const char *s, const int whole = TRUE);
   operator int(void) const { return stream_state; }
 };/*tr_io*/
 
@@ -443,11 +968,29 @@ public:
  *				  replacements if needed);
  *		word_in_dictionary
  *				- finds if a word is in dictionary;
+ *		word_in_current_dict
+ *				- finds if a word is in the current
+ *				  dictionary (whatever its format);
+ *		walk_batch	- looks for a few words at once;
+ *		walk_step	- goes one node further for one of them;
+ *		words_in_current_dict
+ *				- finds which words of a batch are
+ *				  in the current dictionary;
+ *		words_in_dictionaries
+ *				- finds which words of a batch are
+ *				  in any dictionary;
+ *		batch_pays	- whether batches are worth the trouble;
+ *		set_sorted	- whether words are looked for from where
+ *				  they differ from the last one;
  *		find_replacements
  *				- find correct words similar to the misspelled;
- *		rank_repl	- sort the list of replacements.
+ *		rank_repl	- sort the list of replacements;
+ *		first_node	- first arc of the current dictionary;
+ *		node_at		- arc at an offset in the current dictionary.
  * Variables:	dictionary	- list of dictionaries (FSAs);
  *		current_dict	- current dictionary (from the list);
+ *		current_format	- how arcs of the current dictionary
+ *				  are stored;
  *		results		- unsorted list of replacements for a
  *				  misspelled word with additional information;
  *		replacements	- sorted list of replacements for a
@@ -458,12 +1001,19 @@ public:
  *		state		- state of the spelling process;
  *		word_ff		- word read from file (current word);
  *		word_length	- length of current word;
- *		char_eq		- table of character equivalences.
+ *		char_eq		- table of character equivalences;
+ *		other_formats	- whether automata in formats other than
+ *				  the one set by compile options can be read;
+ *		sorted_input	- whether words are looked for from where
+ *				  they differ from the last one (arc_path);
+ *		current_path	- where the path of the last word
+ *				  in the current dictionary is kept.
  */
 class fsa {
 protected:
   dict_list		dictionary;	/* list of dictionaries */
   arc_pointer	 	current_dict;	/* current dictionary */
+  const arc_format	*current_format;/* how its arcs are stored */
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   SparseVector		*sparse_vect; 	/* sparse vector part */
 #endif
@@ -482,16 +1032,38 @@ protected:
 #endif
   char			FILLER;		/* character to be ignored */
   char			ANNOT_SEPARATOR;/* separates parts of entries */
+  int			other_formats;	/* TRUE if automata in other formats
+					   can be read (MULTI_FORMAT) */
 #ifdef WEIGHTED
   int			weighted; 	/* whether the automaton is weighted */
 #endif //WEIGHTED
+  int			sorted_input;	/* TRUE if words are looked for
+					   from where they differ from
+					   the last one (arc_path) */
+  path_base		**current_path;	/* path of the current dictionary */
 
   int read_fsa(const char *dict_file_name);
-  int word_in_dictionary(const char *word, fsa_arc_ptr start);
+  template <class A>
+  int word_in_dictionary(const char *word, A start);
+  int word_in_current_dict(const char *word);
+  template <class A>
+  void walk_batch(walk_state<A> *w, const int n);
+  template <class A>
+  void walk_step(walk_state<A> &w);
+  void words_in_current_dict(const char **words, const int n, int *found);
+  void words_in_dictionaries(const char **words, const int n, int *found);
+  int batch_pays(const dict_desc *d) const;
+  int batch_pays(void);
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   int sparse_word_in_dictionary(const char *word, long int start);
 #endif
   void set_dictionary(dict_desc *dict);
+  fsa_arc_ptr first_node(void) const {	/* first arc of current dict. */
+    return fsa_arc_ptr(current_dict, current_format).first_node();
+  }
+  fsa_arc_ptr node_at(const long int offset) const { /* node at offset */
+    return fsa_arc_ptr(current_dict + offset, current_format);
+  }
   int word_in_dictionaries(const char *word);
   int read_language_file(const char *file_name);
   void invent_language(void);
@@ -502,14 +1074,20 @@ protected:
 		     unsigned int char_index, unsigned int &origin);
 #endif
   bool myflipcase(char *s, const int direction);
+#ifdef MULTI_FORMAT
+  friend struct lookup_kernel;
+  friend struct batch_kernel;
+#endif
 public:
-  fsa(word_list *dict_names, const char *language_file = NULL);
+  fsa(word_list *dict_names, const char *language_file = NULL,
+      const int any_format = FALSE);
 #ifdef UTF8
   const word_syntax_type *get_syntax(void) const { return word_syntax; }
 #else
   const char *get_syntax(void) const { return word_syntax; }
 #endif
-  virtual ~fsa(void) { delete [] word_syntax; delete [] candidate; }
+  virtual ~fsa(void);
+  void set_sorted(const int s) { sorted_input = s; }
   operator int(void) const {return state; }
 };/*fsa*/
 
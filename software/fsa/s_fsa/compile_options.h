@@ -38,6 +38,14 @@
 #ifdef NUMBERS
       cout << "Compiled with NUMBERS (perfect hashing possible)" << endl;
 #endif
+#ifdef NODE_INDICES
+      cout << "Compiled with NODE_INDICES (less memory needed by fsa_build)"
+	<< endl;
+#endif
+#ifdef THREADS
+      cout << "Compiled with THREADS (fsa_build reads input in parallel)"
+	<< endl;
+#endif
 #ifdef DESCENDING
       cout << "Compiled with DESCENDING (arcs sorted in descending order)"
 	<< endl;
@@ -53,6 +61,10 @@
       cout << "Compiled with A_TERGO (building guessing automata possible)"
 	<< endl;
 #endif
+#ifdef PRELOAD_DICT
+      cout << "Compiled with PRELOAD_DICT (dictionaries read when mapped)"
+	<< endl;
+#endif
 #ifdef PROGRESS
       cout << "Compiled with PROGRESS (progress indicator during building)"
 	<< endl;
@@ -80,6 +92,12 @@
 #ifdef MORPH_INFIX
     cout << "Compiled with MORPH_INFIXES (fsa_guess accepts -I)" << endl;
 #endif
+#ifdef MULTI_FORMAT
+    cout << "Compiled with MULTI_FORMAT (programs read all formats)" << endl;
+#endif
+#ifdef CFSA2
+    cout << "Compiled with CFSA2 (the CFSA2 format of morfologik)" << endl;
+#endif
 #ifdef POOR_MORPH
     cout << "Compiled with POOR_MORPH (fsa_guess accepts -A)" << endl;
 #endif
@@ -9,6 +9,8 @@
 
 #include	<iostream>
 #include	<fstream>
+#include	<string.h>
+#include	<stdint.h>
 
 #define		START_CHAR	'^'
 
@@ -23,8 +25,57 @@ bytes2int(const unsigned char *bytes, const int n)
   }
   return r;
 }
+
+/* Bytes that must be readable after the end of an automaton
+   for load_goto */
+const int	GOTO_LOAD_SLACK = sizeof(uint32_t) - 1;
+
+/* Name:	load_goto
+ * Class:	None.
+ * Purpose:	Reads a little-endian number (a go_to field) of n bytes.
+ * Parameters:	bytes	- (i) the number;
+ *		n	- (i) its length (1-4);
+ *		mask	- (i) mask of n bytes (arc_format::goto_mask).
+ * Returns:	The number.
+ * Remarks:	On little-endian machines, 4 bytes are read with one
+ *		(unaligned) load, and the bytes that do not belong
+ *		to the number are masked out, so there is no loop over
+ *		the bytes, and no test on n. The mask is computed once
+ *		for each automaton. The load may read GOTO_LOAD_SLACK
+ *		bytes after the end of the automaton, so read_fsa
+ *		makes sure they can be read.
+ *		On other machines, bytes2int is used.
+ */
+inline int
+load_goto(const unsigned char *bytes, const int n, const uint32_t mask)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  uint32_t	w;
+  memcpy(&w, bytes, sizeof w);
+  return (int)(w & mask);
+#else
+  return bytes2int(bytes, n);
+#endif
+}
 #endif
 
+/* Name:	prefetch_node
+ * Class:	None.
+ * Purpose:	Asks the processor to start reading a node into the cache.
+ * Parameters:	p	- (i) address of the node.
+ * Returns:	Nothing.
+ * Remarks:	Used when words are looked for in batches (fsa::walk_batch),
+ *		so that other words are looked for while the node is read.
+ *		Does nothing when the compiler cannot tell the processor.
+ */
+inline void
+prefetch_node(const void *p)
+{
+#ifdef __GNUC__
+  __builtin_prefetch(p);
+#endif
+}
+
 /* This constant depends on the representation of the # of children per node.
  * It MUST BE a power of 2 minus 1.
  * If not compiled with STOPBIT, 127 is max, because there are 7 bits
@@ -74,6 +125,14 @@ struct fsa_arc {
 };
 #endif
 
+#if defined(MULTI_FORMAT) && !defined(FLEXIBLE)
+#undef MULTI_FORMAT		/* only FLEXIBLE formats can be read */
+#endif
+
+#if defined(CFSA2) && (!defined(FLEXIBLE) || defined(SPARSE) || defined(WEIGHTED))
+#undef CFSA2			/* arcs of CFSA2 have no sparse vector */
+#endif				/* and no weights */
+
 #ifdef FLEXIBLE
 typedef char		*mod_arc_ptr; /* modifiable arc pointer */
 typedef	const char	*arc_pointer;
@@ -82,17 +141,6 @@ typedef fsa_arc		*mod_arc_ptr; /* modifiable arc pointer */
 typedef const fsa_arc	*arc_pointer;
 #endif
 
-#if defined (FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
-extern arc_pointer curr_dict_address;
-
-inline arc_pointer get_curr_dict_address(void) {
-  return curr_dict_address;
-}
-
-inline void set_curr_dict_address(arc_pointer p) {
-  curr_dict_address = p;
-}
-#endif
 
 /*
 
@@ -620,10 +668,26 @@ A node is a vector of arcs
 #endif //!BIG_DICTIONARIES
 #endif //!FLEXIBLE
 
+Ranked versions 0x14 and 0x15 (fsa_build -r, only with NUMBERS)
+
+The same as versions 4 and 5 with numbers of entries, but each arc
+except the last one in a node is followed by the number of strings
+recognized through that arc and the arcs before it in the node
+(entryl bytes, LSB first). The number of strings before an arc is then
+read right before it (or is 0 for the first arc), so the numbers
+of strings in nodes that the other arcs lead to are not needed
+in perfect hashing. Only the last arc of a node can be shortened
+(NEXTBIT), and states do not share arcs (no -O with -N), so these
+numbers never change when arcs are shared.
+
 */
 
+const int	RANKED_FORMAT = 0x10;	/* added to the version for ranks
+					   of arcs (versions 4 and 5) */
+
 #ifdef WEIGHTED
-  extern int goto_offset;
+  extern int goto_offset;	/* used by fsa_build; readers take it from
+				   arc_format (it depends on the dictionary) */
 #else //!WEIGHTED
 #ifdef STOPBIT
   const int goto_offset = 1;
@@ -632,41 +696,103 @@ A node is a vector of arcs
 #endif //!STOPBIT
 #endif //!WEIGHTED
 
+/* Class name:	arc_format
+ * Purpose:	Describe how arcs of one automaton are stored.
+ * Methods:	arc_format	- computes the description from the fields
+ *				  of the signature of the automaton.
+ * Remarks:	Each dictionary has its own description, and arcs
+ *		(fsa_arc_ptr) point to it, so that dictionaries with
+ *		different lengths of fields can be used at the same time,
+ *		also by different threads. The description does not change
+ *		after the dictionary has been read.
+ */
+struct arc_format {
+  arc_pointer	dict;		/* the automaton (the sink arc) */
+  int		version;	/* version of the format (signature) */
+#ifdef FLEXIBLE
+  int		gtl;		/* length of go_to field */
+  uint32_t	goto_mask;	/* gtl bytes (for load_goto) */
+  int		size;		/* size of the arc */
+#if defined(NUMBERS) || defined(MULTI_FORMAT)
+  int		entryl;		/* size of number of entries field */
+  int		aunit;		/* how many bytes arc number represents */
+#endif
+#ifdef WEIGHTED
+  int		goto_offset;	/* offset of the go_to field in the arc */
+#endif
+#endif
+#if defined(CFSA2) && defined(MULTI_FORMAT)
+  const unsigned char *labels;	/* label table of CFSA2 (cfsa2_cursor) */
+#endif
+
+  arc_format(const arc_pointer d, const int ver, const int goto_length,
+	     const int entry_length, const int goto_off) {
+    dict = d;
+    version = ver;
+#ifdef FLEXIBLE
+    gtl = goto_length;
+    goto_mask = (gtl >= 4 ? 0xffffffffU : (1U << (8 * gtl)) - 1);
+    size = goto_off + gtl;
+#if defined(NUMBERS) || defined(MULTI_FORMAT)
+    entryl = entry_length;
+    aunit = (entryl ? 1 : size);
+#endif
+#ifdef WEIGHTED
+    goto_offset = goto_off;
+#endif
+#endif
+#if defined(CFSA2) && defined(MULTI_FORMAT)
+    labels = NULL;
+#endif
+  }
+};/* struct arc_format */
+
 /* Class name:	fsa_arc_ptr
  * Purpose:	Provide a structure for an arc (a transition)
  *		of a finite-state automaton. This representation
  *		is used by application programs.
- * Remarks:	None.
+ * Remarks:	The arc knows the automaton it belongs to (format),
+ *		so following arcs does not depend on any global variables.
+ *		Arcs of the same automaton share one arc_format.
  */
 class fsa_arc_ptr {
 public:
   arc_pointer	arc;		/* the arc itself */
-#ifdef FLEXIBLE
-  static int	gtl;		/* length of go_to field */
-  static int	size;		/* size of the arc */
-#ifdef NUMBERS
-  static int	entryl;		/* size of number of entries field */
-  static int	aunit;		/* how many bytes arc number represents */
+  const arc_format *format;	/* how arcs of the automaton are stored */
+#ifndef STOPBIT
+  int		kids;		/* number of arcs in the node */
 #endif
+
+  fsa_arc_ptr(void) { arc = NULL; format = NULL; } /* constructor */
+  fsa_arc_ptr(const arc_pointer a, const arc_format *f) { /* constructor */
+    arc = a; format = f;
+#ifndef STOPBIT
+    kids = 1;
 #endif
+  }
 
-  fsa_arc_ptr(void) { arc = NULL; } /* constructor */
-  fsa_arc_ptr(const arc_pointer a) { arc = a; } /* constructor */
-  fsa_arc_ptr & operator=(arc_pointer a) { arc = a; return *this;}
+#ifdef FLEXIBLE
+  /* offset of the go_to field in the arc */
+#ifdef WEIGHTED
+  int goto_off(void) const { return format->goto_offset; }
+#else
+  int goto_off(void) const { return goto_offset; }
+#endif
+#endif
 
 #ifdef STOPBIT
 #ifdef FLEXIBLE
   int is_last(void) const { /* returns TRUE if the arc is the last in node */
-    return ((arc[goto_offset] & 2) == 2);
+    return ((arc[goto_off()] & 2) == 2);
   }
 
   int tail_present(void) const { /* returns TRUE if the next arc is
 				    at a location pointed to by additional
 				    pointer following the arc */
 #ifdef NEXTBIT
-    return ((arc[goto_offset] & 8) == 8);
+    return ((arc[goto_off()] & 8) == 8);
 #else
-    return ((arc[goto_offset] & 4) == 4);
+    return ((arc[goto_off()] & 4) == 4);
 #endif
   }
 #endif
@@ -685,7 +811,7 @@ public:
   int is_final(void) const {	/* return TRUE iff the arc is final */
 #ifdef FLEXIBLE
 #ifdef STOPBIT
-    return (arc[goto_offset] & 1);
+    return (arc[goto_off()] & 1);
 #else
     return (((*arc) & 0x80) != 0);
 #endif
@@ -712,25 +838,31 @@ public:
 #ifdef NEXTBIT
 #ifdef TAILS
     /* FLEXIBLE, STOPBIT, NEXTBIT, TAILS */
-    return bytes2int((const unsigned char *)arc + goto_offset, gtl) >> 4;
+    return load_goto((const unsigned char *)arc + goto_off(),
+		     format->gtl, format->goto_mask) >> 4;
 #else
     /* FLEXIBLE, STOPBIT, NEXTBIT, !TAILS */
-    return bytes2int((const unsigned char *)arc + goto_offset, gtl) >> 3;
+    return load_goto((const unsigned char *)arc + goto_off(),
+		     format->gtl, format->goto_mask) >> 3;
 #endif
 #else // !NEXTBIT
 #ifdef TAILS
     /* FLEXIBLE, STOPBIT, !NEXTBIT, TAILS */
-    return bytes2int((const unsigned char *)arc + goto_offset, gtl) >> 3;
+    return load_goto((const unsigned char *)arc + goto_off(),
+		     format->gtl, format->goto_mask) >> 3;
 #else
     /* FLEXIBLE, STOPBIT, !NEXTBIT, !TAILS */
-    return bytes2int((const unsigned char *)arc + goto_offset, gtl) >> 2;
+    return load_goto((const unsigned char *)arc + goto_off(),
+		     format->gtl, format->goto_mask) >> 2;
 #endif // !TAILS
 #endif // !NEXTBIT
 #else // !STOPBIT
 #ifdef NEXTBIT
-    return bytes2int((const unsigned char *)arc + goto_offset, gtl) >> 1;
+    return load_goto((const unsigned char *)arc + goto_off(),
+		     format->gtl, format->goto_mask) >> 1;
 #else
-    return bytes2int((const unsigned char *)arc + goto_offset, gtl);
+    return load_goto((const unsigned char *)arc + goto_off(),
+		     format->gtl, format->goto_mask);
 #endif
 #endif
 #else
@@ -738,9 +870,7 @@ public:
 #endif
   }
 
-  arc_pointer set_next_node(const arc_pointer curr_dict) { /* get address
-							      of  target
-							      node */
+  arc_pointer target(void) const { /* get address of target node */
 #ifdef NEXTBIT
 #ifdef FLEXIBLE
 #ifdef STOPBIT
@@ -748,27 +878,27 @@ public:
     /* NEXTBIT,FLEXIBLE,STOPBIT,TAILS */
     /* if nextbit set, then it is the next address, but if the tail bit
        is also set, then we must skip the tail pointer */
-  return (arc[goto_offset] & 4) ?
-    ((arc[goto_offset] & 8) ? arc + goto_offset + 1 + gtl
-     : arc + goto_offset + 1)
+  return (arc[goto_off()] & 4) ?
+    ((arc[goto_off()] & 8) ? arc + goto_off() + 1 + format->gtl
+     : arc + goto_off() + 1)
 #else
     /* NEXTBIT,FLEXIBLE,STOPBIT */
-  return (arc[goto_offset] & 4) ? arc + goto_offset + 1
+  return (arc[goto_off()] & 4) ? arc + goto_off() + 1
 #endif
 #else
     /* NEXTBIT,FLEXIBLE,!STOPBIT */
-  return (arc[goto_offset] & 1) ? arc + goto_offset + 1
+  return (arc[goto_off()] & 1) ? arc + goto_off() + 1
 #endif
     /* NEXTBIT,FLEXIBLE */
 #ifdef NUMBERS
     /* NEXTBIT,FLEXIBLE,NUMBERS */
-    + entryl
+    + format->entryl
 #endif
     /* NEXTBIT,FLEXIBLE */
-     : curr_dict + 
+     : format->dict +
 #ifdef NUMBERS
     /* NEXTBIT,FLEXIBLE,NUMBERS */
-    entryl +
+    format->entryl +
 #endif
     /* NEXTBIT,FLEXIBLE */
     get_goto();
@@ -778,23 +908,37 @@ public:
   /* NEXTBIT */
 #else //!NEXTBIT
   /* !NEXTBIT */
-  return (curr_dict +
+  return (format->dict +
 #ifdef FLEXIBLE
 #if defined(STOPBIT) && defined(TAILS)
+#ifdef NUMBERS
+	  /* !NEXTBIT,FLEXIBLE,NUMBERS,STOPBIT,TAILS */
+	    format->entryl +
+#endif //NUMBERS
 #else
 #ifdef NUMBERS
 	  /* !NEXTBIT,FLEXIBLE,NUMBERS,!(STOPBIT,TAILS) */
-	    entryl + aunit *
+	    format->entryl + format->aunit *
 #else
 	  /* !NEXTBIT,FLEXIBLE,!NUMBERS,!(STOPBIT,TAILS) */
-	    size *
+	    format->size *
 #endif //!NUMBERS
 #endif //!STOPBIT&TAILS
 #endif //FLEXIBLE
 	  /* !NEXTBIT */
 	    get_goto());
 #endif
-}
+  }
+
+  fsa_arc_ptr set_next_node(void) const { /* get target node */
+    fsa_arc_ptr n(target(), format);
+#ifndef STOPBIT
+    n.kids = children();	/* the counter is in the arc, not in the node */
+#endif
+    return n;
+  }
+
+  void prefetch_target(void) const { prefetch_node(target()); }
 
 
   fsa_arc_ptr & operator++(void) { /* get next arc */
@@ -802,41 +946,53 @@ public:
 #ifdef STOPBIT
 #ifdef TAILS
 #ifdef NEXTBIT
-    if (arc[goto_offset] & 8) {
+    if (arc[goto_off()] & 8) {
       /* The rest of arcs (the tail) is in another node, whose address
 	 is after this node */
-      if (arc[goto_offset] & 4) {
+      if (arc[goto_off()] & 4) {
 	/* This node points to another node that is the next one
 	   in the automaton */
-	arc = get_curr_dict_address() +
-	  (bytes2int((const unsigned char *)arc + goto_offset + 1, gtl)>>4);
+	arc = format->dict +
+#ifdef NUMBERS
+	  format->entryl +
+#endif
+	  (load_goto((const unsigned char *)arc + goto_off() + 1,
+		     format->gtl, format->goto_mask)>>4);
       }
       else {
 	/* This arc has a normal goto field length */
-	arc = get_curr_dict_address() +
-	  (bytes2int((const unsigned char *)arc + goto_offset + gtl, gtl)>>4);
+	arc = format->dict +
+#ifdef NUMBERS
+	  format->entryl +
+#endif
+	  (load_goto((const unsigned char *)arc + goto_off() + format->gtl,
+		     format->gtl, format->goto_mask)>>4);
       }
     }
     else {
       /* There is no tail pointer */
-      arc += size;
+      arc += format->size;
     }
 #else // !NEXTBIT
-    if (arc[goto_offset] & 4) {
+    if (arc[goto_off()] & 4) {
       /* The rest of arcs (the tail) is in another node, whose address
 	 is after this node */
-      arc = get_curr_dict_address() +
-	(bytes2int((const unsigned char *)arc + goto_offset + gtl, gtl)>>3);
+      arc = format->dict +
+#ifdef NUMBERS
+	format->entryl +
+#endif
+	(load_goto((const unsigned char *)arc + goto_off() + format->gtl,
+		   format->gtl, format->goto_mask)>>3);
     }
     else {
-      arc += size;
+      arc += format->size;
     }
 #endif // !NEXTBIT
 #else // !TAILS
-    arc += size;
+    arc += format->size;
 #endif // !TAILS
 #else
-    arc += size;
+    arc += format->size;
 #endif
 #else
     arc++;
@@ -844,24 +1000,605 @@ public:
     return *this;
   }
 
-  arc_pointer first_node(arc_pointer curr_dict) { /* get address of first arc*/
+  fsa_arc_ptr first_node(void) const { /* get first arc of automaton */
 #ifdef FLEXIBLE
-    return (curr_dict
+    return fsa_arc_ptr(format->dict
 #ifdef NUMBERS
-	    + entryl * 2
+		       + format->entryl * 2
+#endif
+		       + format->size, format);
+#else
+    return fsa_arc_ptr(format->dict + 1, format);
+#endif
+  }
+
+  int arcs_to_visit(void) const { /* nonzero if the node has arcs */
+#ifdef STOPBIT
+    return 1;
+#else
+    return kids;
 #endif
-	    + size);
+  }
+
+  int more_arcs(const int left) const { /* nonzero if arcs follow this one */
+#ifdef STOPBIT
+#ifdef TAILS
+    return (!is_last() || tail_present());
 #else
-    return (curr_dict + 1);
+    return !is_last();
+#endif
+#else
+    return left - 1;
 #endif
   }
 
+  /* Labels of one arc (string arcs of SCFSA2, see cfsa2_cursor) */
+  int run_left(void) const { return 0; } /* labels after this one */
+  const char *run_labels(void) const { return NULL; } /* those labels */
+  fsa_arc_ptr skip_labels(const int) const { return *this; } /* skip them */
+
+  /* Ranks of arcs (ranked versions, see fsa_cursor) */
+  int ranked(void) const { return 0; }	/* whether arcs have ranks */
+  int rank(void) const { return 0; }	/* strings up to this arc */
+  int rank_before(void) const { return 0; } /* strings before it */
+
 #if defined(WEIGHTED) && defined(FLEXIBLE) && defined(STOPBIT)
-  int get_weight(void) { return arc[goto_offset - 1]; }
+  int get_weight(void) { return arc[goto_off() - 1]; }
 #endif
 };/* class fsa_arc_ptr */
 
 
+#ifdef CFSA2
+/*
+
+CFSA2 - the compact format of morfologik (version 0xc6)
+
+The signature is followed by two bytes of flags (MSB first):
+1 - FLEXIBLE, 2 - STOPBIT, 4 - NEXTBIT (all set), 0x100 - NUMBERS.
+Then comes the size of the label table (1 byte), and the label table.
+Byte 0 of the table is not used. Bytes 1 to 31 are the most frequent
+labels, the most frequent one is the last.
+
+Then comes a vector of nodes. Each node is:
+
+(only with NUMBERS) v-coded number of strings recognized by the automaton
+starting from this node, and a vector of arcs:
+
+                +--------------- node pointed to is next
+                | +------------- the last arc of the node
+                | | +----------- the arc is final
+                | | |
+                | | |  +-------- index of the label in the label table
+                | | | _+_        (0 - the label follows)
+                | | |/   \
+       MSB           LSB
+    	7 6 5 4 3 2 1 0
+       +-+-+-+-+-+-+-+-+
+    0  | | | | | | | | |
+       +-+-+-+-+-+-+-+-+
+       +-+-+-+-+-+-+-+-+
+       | | | | | | | | |   label (present only when the index is 0)
+       +-+-+-+-+-+-+-+-+
+       +-+-+-+-+-+-+-+-+
+       | | | | | | | | |   v-coded target node address (in bytes),
+       +-+-+-+-+-+-+-+-+   0 if there is no target node
+       : : : : : : : : :   (not present if the node pointed to is next)
+       +-+-+-+-+-+-+-+-+
+
+Only the last arc of a node can point to the next node.
+V-coded numbers are stored 7 bits in a byte, LSB first; the MSB is set
+in all bytes but the last one. The node at address 0 has one arc
+labelled with START_CHAR that leads to the root. There is no filler
+and no annotation separator in the file.
+
+RCFSA2 - CFSA2 with relative addresses (version 0xc7, not in morfologik)
+
+The same as CFSA2, but the target node address v-coded in an arc is
+either 2*a, where a is the address of the target node (0 means that
+there is no target node), or 4*d+1 (d >= 0) or -4*d-1 (d < 0), where d
+is the distance of the target node from the first byte of the arc
+(the byte with flags). The smaller one is written. Most targets are
+close to the arcs that lead to them, and nodes with many incoming arcs
+are at the beginning of the file, so addresses take fewer bytes.
+
+SCFSA2 - RCFSA2 with string arcs (version 0xc8, not in morfologik)
+
+The same as RCFSA2, but a chain of states that have one arc each,
+and one incoming arc each, is replaced with one arc that has a string
+of labels (a string arc). Only the last label of the string can be
+final. The label table has at most 30 labels, and the label index
+CFSA2_STRING_ARC (31) in flags means a string arc:
+
+       +-+-+-+-+-+-+-+-+
+    0  | | | |1 1 1 1 1|   flags (as above)
+       +-+-+-+-+-+-+-+-+
+       +-+-+-+-+-+-+-+-+
+       | | | | | | | | |   length of the string n (2 to 255)
+       +-+-+-+-+-+-+-+-+
+       +-+-+-+-+-+-+-+-+
+       | | | | | | | | |   n labels
+       +-+-+-+-+-+-+-+-+
+       : : : : : : : : :
+       +-+-+-+-+-+-+-+-+
+       +-+-+-+-+-+-+-+-+
+       | | | | | | | | |   v-coded target node address (as in RCFSA2)
+       +-+-+-+-+-+-+-+-+
+       : : : : : : : : :
+       +-+-+-+-+-+-+-+-+
+
+Such a string is followed with one comparison of bytes instead
+of a node for each label (see cfsa2_cursor::run_left).
+
+*/
+const int	CFSA2_VERSION = 0xc6;	/* version in the signature */
+const int	RCFSA2_VERSION = 0xc7;	/* the same with relative addresses */
+const int	SCFSA2_VERSION = 0xc8;	/* RCFSA2 with string arcs */
+const int	CFSA2_FLEXIBLE = 0x1;	/* flags after the signature */
+const int	CFSA2_STOPBIT = 0x2;
+const int	CFSA2_NEXTBIT = 0x4;
+const int	CFSA2_NUMBERS = 0x100;
+const int	CFSA2_TARGET_NEXT = 0x80; /* flags of an arc */
+const int	CFSA2_LAST_ARC = 0x40;
+const int	CFSA2_FINAL_ARC = 0x20;
+const int	CFSA2_LABEL_MASK = 0x1f;  /* label index in flags */
+const int	CFSA2_LABELS = 31;	/* max size of the label table - 1 */
+const int	CFSA2_STRING_ARC = 0x1f;  /* label index of string arcs */
+const int	CFSA2_MAX_STRING = 255;	/* max number of labels in a string */
+const int	CFSA2_VINT_MAX = 5;	/* max length of a v-coded number */
+
+/* Name:	cfsa2_format
+ * Class:	None.
+ * Purpose:	Tells whether a version is CFSA2, RCFSA2, or SCFSA2.
+ * Parameters:	ver	- (i) version of the format (from the signature).
+ * Returns:	TRUE if it is, FALSE otherwise.
+ * Remarks:	The version is treated as unsigned.
+ */
+inline int
+cfsa2_format(const int ver)
+{
+  return ((ver & 0xff) == CFSA2_VERSION || (ver & 0xff) == RCFSA2_VERSION
+	  || (ver & 0xff) == SCFSA2_VERSION);
+}
+
+/* Name:	put_vint
+ * Class:	None.
+ * Purpose:	Writes a v-coded number.
+ * Parameters:	bytes	- (o) where to put the number;
+ *		n	- (i) the number.
+ * Returns:	Length of the v-coded number in bytes.
+ * Remarks:	See CFSA2 above.
+ */
+inline int
+put_vint(unsigned char *bytes, unsigned int n)
+{
+  int		i = 0;
+
+  for (; n > 0x7f; n >>= 7)
+    bytes[i++] = (unsigned char)(0x80 | (n & 0x7f));
+  bytes[i++] = (unsigned char)n;
+  return i;
+}
+
+/* Name:	get_vint
+ * Class:	None.
+ * Purpose:	Reads a v-coded number.
+ * Parameters:	bytes	- (i/o) the number; on return, the byte after it.
+ * Returns:	The number.
+ * Remarks:	See CFSA2 above.
+ */
+inline int
+get_vint(const unsigned char *&bytes)
+{
+  unsigned int	n = *bytes & 0x7f;
+
+  for (int shift = 7; *bytes++ & 0x80; shift += 7)
+    n |= (unsigned int)(*bytes & 0x7f) << shift;
+  return (int)n;
+}
+#endif //CFSA2
+
+
+#ifdef MULTI_FORMAT
+/* Class name:	arc_counter
+ * Purpose:	Keep the number of arcs of the node an arc belongs to
+ *		in formats where it is stored in the arc leading to the node
+ *		(versions 1 and 2).
+ * Methods:	node_arcs	- returns the number;
+ *		set_node_arcs	- sets it.
+ * Remarks:	COUNTED is 0 for other formats. Then nothing is kept,
+ *		so that fsa_cursor is not larger, and node_arcs returns 1
+ *		(see forallarcs).
+ */
+template <int COUNTED>
+struct arc_counter {
+  int		kids;		/* number of arcs in the node */
+  arc_counter(void) { kids = 1; }
+  int node_arcs(void) const { return kids; }
+  void set_node_arcs(const int n) { kids = n; }
+};/* struct arc_counter */
+
+template <>
+struct arc_counter<0> {
+  int node_arcs(void) const { return 1; }
+  void set_node_arcs(const int) {}
+};/* struct arc_counter<0> */
+
+/* Class name:	fsa_cursor
+ * Purpose:	Provide an arc of an automaton in a format given
+ *		by template parameters rather than by compile options.
+ * Methods:	The same as in fsa_arc_ptr.
+ * Remarks:	VER is the version of the format (from the signature),
+ *		NUMBERED is 1 if nodes are preceded by the numbers
+ *		of entries (fsa_build -N), 0 otherwise. In ranked
+ *		versions (VER has RANKED_FORMAT), arcs but the last one
+ *		are followed by their ranks: rank is the number of strings
+ *		through the arc and the arcs before it, and rank_before
+ *		is rank of the previous arc (only if there is one;
+ *		for the first arc, it is the number of strings
+ *		in the node).
+ *		All tests on the format are tests on constants, so that
+ *		the compiler removes them, and an instance is as fast
+ *		as fsa_arc_ptr compiled for that format.
+ *		Only FLEXIBLE formats without a sparse vector
+ *		(versions 1, 2, and 4 to 8) are supported.
+ *		In versions 1 and 2, the number of arcs of a node is kept
+ *		in the arc that leads to it, so a cursor got with
+ *		set_next_node remembers it (see arc_counter).
+ *		Traversal code that should work with all formats
+ *		is written as templates on the arc class (see forallarcs
+ *		and with_format).
+ */
+template <int VER, int NUMBERED>
+class fsa_cursor : public arc_counter<((VER & ~RANKED_FORMAT) < 4)> {
+public:
+  enum {
+    base = (VER & ~RANKED_FORMAT),	/* version without ranks */
+    with_ranks = ((VER & RANKED_FORMAT) != 0),
+    stopbit = (base >= 4),
+    nextbit = (base == 2 || base == 5 || base == 7 || base == 8),
+    tails = (base == 6 || base == 7),
+    goto_off = (base >= 4 && base != 8 ? 1 : 2),
+    goto_shift = (stopbit ? 2 + nextbit + tails : nextbit),
+    next_flag = (stopbit ? 4 : 1),
+    tail_flag = (nextbit ? 8 : 4)
+  };
+  arc_pointer	arc;		/* the arc itself */
+  const arc_format *format;	/* how arcs of the automaton are stored */
+
+  fsa_cursor(void) { arc = NULL; format = NULL; } /* constructor */
+  fsa_cursor(const arc_pointer a, const arc_format *f) { /* constructor */
+    arc = a; format = f;
+  }
+
+  int is_last(void) const { return ((arc[goto_off] & 2) == 2); }
+
+  int tail_present(void) const {
+    return (tails && (arc[goto_off] & tail_flag) == tail_flag);
+  }
+
+  int children(void) const { return ((*arc) & 0x7f); }
+
+  int is_final(void) const {
+    return (stopbit ? (arc[goto_off] & 1) : (((*arc) & 0x80) != 0));
+  }
+
+  char get_letter(void) const { return (stopbit ? *arc : arc[1]); }
+
+  fas_pointer get_goto(void) const {
+    return load_goto((const unsigned char *)arc + goto_off,
+		     format->gtl, format->goto_mask) >> goto_shift;
+  }
+
+  arc_pointer target(void) const {
+    if (nextbit && (arc[goto_off] & next_flag))
+      return arc + goto_off + 1
+	+ (tails && (arc[goto_off] & tail_flag) ? format->gtl : 0)
+	+ (NUMBERED ? format->entryl : 0);
+    if (nextbit)
+      return format->dict + (NUMBERED ? format->entryl : 0) + get_goto();
+    if (stopbit && tails)
+      return format->dict + (NUMBERED ? format->entryl : 0) + get_goto();
+    return format->dict + (NUMBERED ? format->entryl + get_goto()
+			   : format->size * get_goto());
+  }
+
+  fsa_cursor set_next_node(void) const {
+    fsa_cursor n(target(), format);
+    n.set_node_arcs(children());
+    return n;
+  }
+
+  void prefetch_target(void) const { prefetch_node(target()); }
+
+  fsa_cursor & operator++(void) {
+    if (tails && (arc[goto_off] & tail_flag)) {
+      /* the rest of arcs is in another node */
+      arc = format->dict + (NUMBERED ? format->entryl : 0) +
+	(load_goto((const unsigned char *)arc + goto_off +
+		   (nextbit && (arc[goto_off] & next_flag) ? 1 : format->gtl),
+		   format->gtl, format->goto_mask) >> goto_shift);
+    }
+    else
+      arc += format->size + (with_ranks ? format->entryl : 0);
+    return *this;
+  }
+
+  fsa_cursor first_node(void) const {
+    return fsa_cursor(format->dict + (NUMBERED ? format->entryl * 2 : 0)
+		      + format->size, format);
+  }
+
+  int arcs_to_visit(void) const { return this->node_arcs(); }
+
+  int more_arcs(const int left) const {
+    return (stopbit ? (!is_last() || tail_present()) : left - 1);
+  }
+
+  int run_left(void) const { return 0; }
+
+  const char *run_labels(void) const { return NULL; }
+
+  fsa_cursor skip_labels(const int) const { return *this; }
+
+  int ranked(void) const { return with_ranks; }
+
+  int rank(void) const {
+    return bytes2int((const unsigned char *)arc + format->size,
+		     format->entryl);
+  }
+
+  int rank_before(void) const {
+    return bytes2int((const unsigned char *)arc - format->entryl,
+		     format->entryl);
+  }
+
+#ifdef WEIGHTED
+  int get_weight(void) const { return (VER == 8 ? arc[goto_off - 1] : 0); }
+#endif
+};/* class fsa_cursor */
+
+#ifdef CFSA2
+/* Class name:	cfsa2_cursor
+ * Purpose:	Provide an arc of an automaton in the CFSA2 format.
+ * Methods:	The same as in fsa_cursor.
+ * Remarks:	NUMBERED is 1 if nodes are preceded by the numbers
+ *		of strings (CFSA2_NUMBERS), 0 otherwise. RELATIVE is 1
+ *		for RCFSA2 and SCFSA2, where addresses are relative to arcs.
+ *		STRINGS is 1 for SCFSA2, where arcs can have strings
+ *		of labels.
+ *		Arcs have different sizes, so the size of an arc is found
+ *		from its flags when the next arc is needed.
+ *		The go_to field is the address of the target node,
+ *		0 if there is none; for arcs with CFSA2_TARGET_NEXT
+ *		it is the address of the byte that follows the arc.
+ *		The target of an arc without a target node is the node
+ *		at dict + entryl (entryl is 1 if NUMBERED), as for
+ *		fsa_cursor, and that is where the arc leading
+ *		to the root is (first_node). There are no tails,
+ *		and no counters of children.
+ *
+ *		A string arc is seen as a chain of nodes with one arc
+ *		each: run is the index of the current label in the string
+ *		(shifted by 8 bits, with CFSA2_LAST_ARC added when it is
+ *		not 0, so that is_last needs no test), and the next node
+ *		of a label that is not the last one is the same arc
+ *		with the next label. Its go_to field
+ *		is the address of the arc, and its target is the arc
+ *		itself (use set_next_node). run_left says how many labels
+ *		follow the current one in the string, so that they can be
+ *		compared at once (run_labels), and skipped (skip_labels).
+ */
+template <int NUMBERED, int RELATIVE, int STRINGS>
+class cfsa2_cursor {
+public:
+  arc_pointer	arc;		/* the arc itself */
+  const arc_format *format;	/* how arcs of the automaton are stored */
+  int		run;		/* index of the label in a string arc */
+
+  cfsa2_cursor(void) { arc = NULL; format = NULL; run = 0; } /* constructor */
+  cfsa2_cursor(const arc_pointer a, const arc_format *f) { /* constructor */
+    arc = a; format = f; run = 0;
+  }
+
+  int is_string(void) const {
+    return (STRINGS && (*arc & CFSA2_LABEL_MASK) == CFSA2_STRING_ARC);
+  }
+
+  int run_left(void) const {
+    return (is_string() ? (unsigned char)arc[1] - 1 - (run >> 8) : 0);
+  }
+
+  const char *run_labels(void) const { return arc + 3 + (run >> 8); }
+
+  cfsa2_cursor skip_labels(const int n) const {
+    cfsa2_cursor c = *this;
+    int i = (run >> 8) + n;
+    c.run = (i ? (i << 8) | CFSA2_LAST_ARC : 0);
+    return c;
+  }
+
+  int ranked(void) const { return 0; }	/* no ranks of arcs */
+  int rank(void) const { return 0; }
+  int rank_before(void) const { return 0; }
+
+  int is_last(void) const {
+    return (((STRINGS ? *arc | run : *arc) & CFSA2_LAST_ARC) != 0);
+  }
+
+  int tail_present(void) const { return 0; }
+
+  int is_final(void) const {
+    return ((*arc & CFSA2_FINAL_ARC) != 0 && !(STRINGS && run_left()));
+  }
+
+  char get_letter(void) const {
+    int index = *arc & CFSA2_LABEL_MASK;
+    if (index == 0)
+      return arc[1];
+    if (STRINGS && index == CFSA2_STRING_ARC)
+      return arc[2 + (run >> 8)];
+    return (char)format->labels[index];
+  }
+
+  fas_pointer get_goto(void) const {
+    const unsigned char *p = (const unsigned char *)arc + 1;
+    int index = *arc & CFSA2_LABEL_MASK;
+    if (index == 0)
+      p++;
+    else if (STRINGS && index == CFSA2_STRING_ARC) {
+      if (run_left())
+	return arc - format->dict;
+      p += 1 + *p;
+    }
+    if (*arc & CFSA2_TARGET_NEXT)
+      return p - (const unsigned char *)format->dict;
+    if (RELATIVE) {
+      int d = get_vint(p);
+      if ((d & 1) == 0)
+	return d >> 1;
+      d >>= 1;
+      return ((const unsigned char *)arc - (const unsigned char *)format->dict)
+	+ ((d & 1) ? -((d + 1) >> 1) : (d >> 1));
+    }
+    return get_vint(p);
+  }
+
+  arc_pointer target(void) const {
+    if (STRINGS && run_left())
+      return arc;
+    const unsigned char *p = (const unsigned char *)format->dict + get_goto();
+    if (NUMBERED)
+      get_vint(p);		/* skip the number of strings */
+    return (arc_pointer)p;
+  }
+
+  cfsa2_cursor set_next_node(void) const {
+    if (STRINGS && run_left())
+      return skip_labels(1);
+    return cfsa2_cursor(target(), format);
+  }
+
+  void prefetch_target(void) const { /* the number is not read here */
+    prefetch_node(format->dict + get_goto());
+  }
+
+  cfsa2_cursor & operator++(void) {
+    const unsigned char *p = (const unsigned char *)arc;
+    int arc_flags = *p++;
+    if (STRINGS && (arc_flags & CFSA2_LABEL_MASK) == CFSA2_STRING_ARC)
+      p += 1 + *p;
+    else if ((arc_flags & CFSA2_LABEL_MASK) == 0)
+      p++;
+    if ((arc_flags & CFSA2_TARGET_NEXT) == 0)
+      while (*p++ & 0x80)
+	;
+    arc = (arc_pointer)p;
+    if (STRINGS)
+      run = 0;
+    return *this;
+  }
+
+  cfsa2_cursor first_node(void) const {
+    return cfsa2_cursor(format->dict + (NUMBERED ? format->entryl : 0),
+			format);
+  }
+
+  int arcs_to_visit(void) const { return 1; }
+
+  int more_arcs(const int) const { return !is_last(); }
+};/* class cfsa2_cursor */
+#endif //CFSA2
+
+/* Name:	format_supported
+ * Class:	None.
+ * Purpose:	Tells whether automata of a given version can be traversed
+ *		with fsa_cursor.
+ * Parameters:	ver	- (i) version of the format (from the signature).
+ * Returns:	TRUE if they can, FALSE otherwise.
+ * Remarks:	None.
+ */
+inline int
+format_supported(const int ver)
+{
+  return ((ver >= 1 && ver <= 2) || (ver >= 4 && ver <= 8) ||
+	  ver == (RANKED_FORMAT | 4) || ver == (RANKED_FORMAT | 5));
+}
+
+/* Name:	format_goto_offset
+ * Class:	None.
+ * Purpose:	Returns the offset of the go_to field in arcs of a given
+ *		version.
+ * Parameters:	ver	- (i) version of the format (from the signature).
+ * Returns:	The offset.
+ * Remarks:	Version 8 has weights before the go_to field, and formats
+ *		without STOPBIT have counters.
+ */
+inline int
+format_goto_offset(const int ver)
+{
+  return (ver >= 4 && ver != 8 ? 1 : 2);
+}
+
+/* Name:	with_format
+ * Class:	None.
+ * Purpose:	Calls a traversal function for the root of an automaton
+ *		with arcs of the class made for its format.
+ * Parameters:	format	- (i) format of the automaton;
+ *		f	- (i/o) an object with a template operator(),
+ *				  that takes the first arc of the automaton.
+ * Returns:	What f returns.
+ * Remarks:	This is the only place where the format is looked at;
+ *		it is done once for each automaton (and each word),
+ *		not for each arc. Formats not supported by fsa_cursor
+ *		(or cfsa2_cursor) must be rejected when the automaton
+ *		is read.
+ */
+template <class F>
+int
+with_format(const arc_format *format, F &f)
+{
+  const int numbered = (format->entryl != 0);
+  switch (format->version * 2 + numbered) {
+  case  2: return f(fsa_cursor<1, 0>(format->dict, format).first_node());
+  case  3: return f(fsa_cursor<1, 1>(format->dict, format).first_node());
+  case  4: return f(fsa_cursor<2, 0>(format->dict, format).first_node());
+  case  5: return f(fsa_cursor<2, 1>(format->dict, format).first_node());
+  case  8: return f(fsa_cursor<4, 0>(format->dict, format).first_node());
+  case  9: return f(fsa_cursor<4, 1>(format->dict, format).first_node());
+  case 10: return f(fsa_cursor<5, 0>(format->dict, format).first_node());
+  case 11: return f(fsa_cursor<5, 1>(format->dict, format).first_node());
+  case 12: return f(fsa_cursor<6, 0>(format->dict, format).first_node());
+  case 13: return f(fsa_cursor<6, 1>(format->dict, format).first_node());
+  case 14: return f(fsa_cursor<7, 0>(format->dict, format).first_node());
+  case 15: return f(fsa_cursor<7, 1>(format->dict, format).first_node());
+  case 16: return f(fsa_cursor<8, 0>(format->dict, format).first_node());
+  case 17: return f(fsa_cursor<8, 1>(format->dict, format).first_node());
+  case (RANKED_FORMAT | 4) * 2 + 1:
+    return f(fsa_cursor<RANKED_FORMAT | 4, 1>(format->dict, format)
+	     .first_node());
+  case (RANKED_FORMAT | 5) * 2 + 1:
+    return f(fsa_cursor<RANKED_FORMAT | 5, 1>(format->dict, format)
+	     .first_node());
+#ifdef CFSA2
+  case CFSA2_VERSION * 2:
+    return f(cfsa2_cursor<0, 0, 0>(format->dict, format).first_node());
+  case CFSA2_VERSION * 2 + 1:
+    return f(cfsa2_cursor<1, 0, 0>(format->dict, format).first_node());
+  case RCFSA2_VERSION * 2:
+    return f(cfsa2_cursor<0, 1, 0>(format->dict, format).first_node());
+  case RCFSA2_VERSION * 2 + 1:
+    return f(cfsa2_cursor<1, 1, 0>(format->dict, format).first_node());
+  case SCFSA2_VERSION * 2:
+    return f(cfsa2_cursor<0, 1, 1>(format->dict, format).first_node());
+  case SCFSA2_VERSION * 2 + 1:
+    return f(cfsa2_cursor<1, 1, 1>(format->dict, format).first_node());
+#endif
+  }
+  return 0;
+}//with_format
+#endif //MULTI_FORMAT
+
+
 
 #ifdef STOPBIT
 #ifdef FLEXIBLE
@@ -936,15 +1673,23 @@ fsa_set_tail(mod_arc_ptr arc, const int t) {/* set tail flag */
 #endif
 #else
 #define forallnodes(i) \
-          int i##kids = start.children(); \
+          int i##kids = next_node.arcs_to_visit(); \
           for (int i = 0; i < i##kids; i++, ++next_node)
 #endif
 
+/* The same as forallnodes, but the format of arcs is not taken
+   from compile options, but from the class of next_node
+   (fsa_arc_ptr or fsa_cursor), so it can be used in templates. */
+#define forallarcs(i) \
+          for (int i##left = next_node.arcs_to_visit();\
+		 i##left;\
+		 i##left = next_node.more_arcs(i##left), ++next_node)
+
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 class SparseVector {
  private:
-  char		*vect;		/* sparse vector itself - the data */
-  char		*alphabet;	/* symbols on transitions */
+  const char	*vect;		/* sparse vector itself - the data */
+  const char	*alphabet;	/* symbols on transitions */
   int		alphabet_size;	/* number of those symbols + 1 */
   unsigned char	char_num[256];	/* character -> index in alphabet conversion */
   int		sparse_gtl;	/* length of a pointer */
@@ -962,7 +1707,7 @@ class SparseVector {
   long int get_target(const int stateno, const char letter) const {
     unsigned char symbol = (unsigned char)letter;
     //char *tp = vect + (stateno + symbol - minchar) * trans_size;
-    char *tp = vect + (stateno + char_num[(unsigned char)symbol] - 1)
+    const char *tp = vect + (stateno + char_num[(unsigned char)symbol] - 1)
       * trans_size;
     return (*tp == letter ?
 	    (bytes2int((unsigned char *)tp + goto_off, sparse_gtl) >> 1)
@@ -973,13 +1718,13 @@ class SparseVector {
   long int get_hash_v(const int stateno, const char letter) {
     unsigned char symbol = (unsigned char)letter;
     //char *tp = vect + (stateno + symbol - minchar) * trans_size;
-    char *tp = vect + (stateno + char_num[(unsigned char)symbol] - 1)
+    const char *tp = vect + (stateno + char_num[(unsigned char)symbol] - 1)
       * trans_size;
     return bytes2int((unsigned char *)tp + 1, entryl);
   }
 
-  SparseVector(std::ifstream &dict, const int entry_l, const int gtl,
-	     const char *dict_file_name);	/* constructor */
+  SparseVector(const char *&data, long int &data_size, const int entry_l,
+	       const int gtl, const char *dict_file_name); /* constructor */
 
   /* check finality of a transition */
   bool is_final(const int stateno, const char letter) {
@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# goto_bench.sh - compares reading go_to fields with one masked load
+# (load_goto in fsa.h) with reading them byte by byte (bytes2int).
+#
+# Usage: make goto_bench; sh goto_bench.sh word_list...
+#
+# fsa_spell_b2i and fsa_prefix_b2i (made by make goto_bench) are
+# fsa_spell and fsa_prefix compiled with -U__BYTE_ORDER__, so that load_goto
+# falls back to bytes2int. For each sorted word list (one word per line),
+# an automaton is built with fsa_build, and the best time of RUNS runs
+# (default 7) is printed for each version of:
+#	fsa_spell -e 0	- word_in_dictionary, on the whole list;
+#	fsa_spell -e 1	- find_repl, on about 20000 words of the list,
+#			  each followed by the word without its first letter;
+#	fsa_prefix -a	- compl_rest, all words of the automaton.
+# Runs of the two versions take turns, so that other load on the machine
+# does not fall on one of them only.
+# Files are made in TMPDIR (default /tmp). See Times for the results.
+
+RUNS=${RUNS:-7}
+TMP=${TMPDIR:-/tmp}/goto_bench.$$
+mkdir -p $TMP || exit 1
+trap 'rm -rf $TMP' 0
+
+# time of a command, in seconds
+run() {
+  s=`date +%s.%N`
+  sh -c "$1" > /dev/null 2>&1
+  e=`date +%s.%N`
+  echo "$s $e" | awk '{ printf "%.3f", $2 - $1 }'
+}
+
+# best times of RUNS runs of two commands; the commands take turns,
+# so that other load on the machine slows both of them alike
+best() {
+  i=0
+  b1=""
+  b2=""
+  while [ $i -lt $RUNS ] ; do
+    t=`run "$1"`
+    b1=`echo "$t $b1" | awk '{ print ($2 != "" && $2 < $1) ? $2 : $1 }'`
+    t=`run "$2"`
+    b2=`echo "$t $b2" | awk '{ print ($2 != "" && $2 < $1) ? $2 : $1 }'`
+    i=`expr $i + 1`
+  done
+  echo " $b1	 $b2"
+}
+
+echo "bytes2int load_goto	Command"
+for l in "$@" ; do
+  n=`basename $l`
+  cp $l $TMP/$n || exit 1
+  ./fsa_build -i $l -o $TMP/$n.fsa 2> /dev/null || exit 1
+  awk -v n=`wc -l < $l` 'BEGIN { srand(1) }
+    rand() < 20000 / n { print; print substr($0, 2) }' $l > $TMP/q_$n
+  for c in "fsa_spell -e 0 -i $TMP/$n -d $TMP/$n.fsa" \
+	   "fsa_spell -e 1 -i $TMP/q_$n -d $TMP/$n.fsa" \
+	   "fsa_prefix -a -d $TMP/$n.fsa" ; do
+    p=`echo $c | sed 's/ .*//'`
+    a=`echo $c | sed 's/^[^ ]* //'`
+    echo "`best "echo | ./${p}_b2i $a" "echo | ./$p $a"`	\
+`echo $c | sed "s|$TMP/||g"`"
+  done
+done
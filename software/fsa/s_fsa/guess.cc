@@ -90,7 +90,7 @@ invert(char *word)
 guess_fsa::guess_fsa(word_list *dict_list, const int lexemes_in_dict,
 		     const int prefixes_in_dict, const int infixes_in_dict,
 		     const int mmorph_in_dict, const char *language_file)
-    : fsa(dict_list, language_file)
+    : fsa(dict_list, language_file, TRUE)
 {
   guess_lexemes = lexemes_in_dict;
   guess_prefix = prefixes_in_dict;
@@ -144,6 +144,24 @@ guess_fsa::guess_file(tr_io &io_obj)
 
 
 
+#ifdef MULTI_FORMAT
+/* Class name:	guess_kernel
+ * Purpose:	Guess categories of a word with an automaton with arcs
+ *		of the class made for its format.
+ * Methods:	guess_kernel	- remembers the guesser and the word;
+ *		operator()	- guesses from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct guess_kernel {
+  guess_fsa	*guesser;	/* who guesses */
+  const char	*word;		/* inverted word, with a filler in front */
+  guess_kernel(guess_fsa *g, const char *w) { guesser = g; word = w; }
+  template <class A>
+  int operator()(A root) { return guesser->guess(word, root, 0); }
+};/* struct guess_kernel */
+#endif
+
+
 /* Name:	guess_word
  * Class:	guess_fsa
  * Purpose:	guess word category using all available dictionaries.
@@ -160,9 +178,6 @@ int
 guess_fsa::guess_word(const char *word)
 {
   dict_list		*dict;
-#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
-  fsa_arc_ptr		*dummy = NULL;
-#endif
 
   word_ff = (char *)word;
   dictionary.reset();
@@ -170,9 +185,21 @@ guess_fsa::guess_word(const char *word)
     set_dictionary(dict->item());
     ANNOT_SEPARATOR = dict->item()->annot_sep;
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+    if (sparse_vect == NULL) {
+      guess_kernel kernel(this, word);
+      with_format(current_format, kernel);
+      continue;
+    }
+#endif
     sparse_guess(word, sparse_vect->get_first(), 0);
 #else
-    guess(word, dummy->first_node(current_dict), 0);
+#ifdef MULTI_FORMAT
+    guess_kernel kernel(this, word);
+    with_format(current_format, kernel);
+#else
+    guess(word, first_node(), 0);
+#endif
 #endif
   }
 
@@ -199,7 +226,6 @@ guess_fsa::sparse_guess(const char *word, long int start,
   int		to_be_completed = TRUE;
   long		current = start;
   long		next;
-  fsa_arc_ptr	*dummy;
 
 
   // See if we are searching too deep in vain
@@ -217,28 +243,28 @@ guess_fsa::sparse_guess(const char *word, long int start,
     if ((next = sparse_vect->get_target(current, ANNOT_SEPARATOR)) != -1L) {
 #ifdef GUESS_PREFIX
       if (guess_prefix || guess_infix)
-	check_prefix(current_dict + next
+	check_prefix(node_at(next
 #ifdef NUMBERS
-		     + dummy->entryl
+		     + current_format->entryl
 #endif
-		     , 0);
+		     ), 0);
       else
 #endif
 #ifdef GUESS_LEXEMES
 	if (guess_lexemes) {
-	  guess_stem(current_dict + next
+	  guess_stem(node_at(next
 #ifdef NUMBERS
-		     + dummy->entryl
+		     + current_format->entryl
 #endif
-		     , 0, 0);
+		     ), 0, 0);
 	}
 	else
 #endif
-	  print_rest(current_dict + next
+	  print_rest(node_at(next
 #ifdef NUMBERS
-		     + dummy->entryl
+		     + current_format->entryl
 #endif
-		     , 0);
+		     ), 0);
       to_be_completed = FALSE;
     }
 
@@ -258,7 +284,8 @@ guess_fsa::sparse_guess(const char *word, long int start,
   }
   return replacements.how_many();
 }//guess_fsa::sparse_guess
-#else //!(FLEXIBLE&STOPBIT&SPARSE)
+#endif //FLEXIBLE&STOPBIT&SPARSE
+
 /* Name:	guess
  * Class:	guess_fsa
  * Purpose:	Find categories the word might belong to.
@@ -269,10 +296,11 @@ guess_fsa::sparse_guess(const char *word, long int start,
  *		might belong to.
  * Remarks:	The word is inverted, with a filler in front
  */
+template <class A>
 int
-guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
+guess_fsa::guess(const char *word, A start, const int vanity_level)
 {
-  fsa_arc_ptr next_node = start.set_next_node(current_dict);
+  A next_node = start.set_next_node();
   int		to_be_completed = TRUE;
 
 
@@ -281,7 +309,7 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
     return replacements.how_many();
 
   // Look at children
-  forallnodes(i) {
+  forallarcs(i) {
     if (*word == next_node.get_letter()) {
       guess(word + 1, next_node, 0);
       to_be_completed = FALSE;
@@ -291,10 +319,10 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
 
   // No appropriate children found - look for annotation separator
   if (to_be_completed || replacements.how_many() == 0) {
-    next_node = start.set_next_node(current_dict);
-    forallnodes(j) {
+    next_node = start.set_next_node();
+    forallarcs(j) {
       if (next_node.get_letter() == ANNOT_SEPARATOR) {
-	fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	A nxt_node = next_node.set_next_node();
 #ifdef GUESS_PREFIX
 	if (guess_prefix || guess_infix)
 	  check_prefix(nxt_node, 0);
@@ -316,15 +344,15 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
     if (to_be_completed) {
 #ifdef WEIGHTED
       if (weighted) {
-	next_node = start.set_next_node(current_dict);
-	fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	next_node = start.set_next_node();
+	A nxt_node = next_node.set_next_node();
 	if (next_node.is_last()) {
 	  // the node has only one child
 	  to_be_completed = handle_annot_arc(next_node, vanity_level);
 	}
 	else {
-	  fsa_arc_ptr prev_node = next_node;
-	  fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	  A prev_node = next_node;
+	  A nxt_node = next_node.set_next_node();
 	  ++next_node;
 	  if (next_node.is_last()) {
 	    // the node has two children
@@ -350,9 +378,9 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
 	    }
 	    int *arc_indx = new int[no_of_arcs];
 	    int *weights = new int[no_of_arcs];
-	    next_node = start.set_next_node(current_dict);
+	    next_node = start.set_next_node();
 	    int kk = 0;
-	    forallnodes(kk) {
+	    forallarcs(kk) {
 	      weights[kk] = next_node.get_weight();
 	      arc_indx[kk] = kk;
 	      kk++;
@@ -371,9 +399,11 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
 	      }
 	    }
 	    // now process the arcs in the order specified by arc_indx
-	    next_node = start.set_next_node(current_dict);
+	    next_node = start.set_next_node();
 	    for (int kk = 0; kk < no_of_arcs; kk++) {
-	      prev_node = next_node.arc + arc_indx[kk] * next_node.size;
+	      prev_node = A(next_node.arc
+				      + arc_indx[kk] * next_node.format->size,
+				      next_node.format);
 	      handle_annot_arc(prev_node, vanity_level);
 	    }
 	    delete [] weights;
@@ -383,8 +413,8 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
       }
       else {
 #endif //!WEIGHTED
-      next_node = start.set_next_node(current_dict);
-      forallnodes(l) {
+      next_node = start.set_next_node();
+      forallarcs(l) {
 	// Now it is possible that there is an arc with annotation separator
 	// at this node, and it should be taken into account!
 	if (next_node.get_letter() == ANNOT_SEPARATOR) {
@@ -393,8 +423,8 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
 	}
       }
       if (to_be_completed) {
-	next_node = start.set_next_node(current_dict);
-	forallnodes(k) {
+	next_node = start.set_next_node();
+	forallarcs(k) {
 	  guess("", next_node, vanity_level + 1);
 	}
       }
@@ -405,7 +435,6 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
   }
   return replacements.how_many();
 }//guess_fsa::guess
-#endif //!(FLEXIBLE&STOPBIT&SPARSE)
   
 
 /* Name:	print_rest
@@ -431,10 +460,11 @@ guess_fsa::guess(const char *word, fsa_arc_ptr start, const int vanity_level)
  *		The contents of the mmorph_buffer should be:
  *		categories "lexical_form" = "canonical form"
  */
+template <class A>
 int
-guess_fsa::print_rest(fsa_arc_ptr start, const int level)
+guess_fsa::print_rest(A start, const int level)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   int already_found = replacements.how_many();
 #ifdef GUESS_MMORPH
   char *morph_desc_index;	// position of descriptions in candidate
@@ -452,7 +482,7 @@ guess_fsa::print_rest(fsa_arc_ptr start, const int level)
   if (replacements.how_many() <= MAX_GUESSES) {
     if (level + 1 >= cand_alloc)
       grow_string(candidate, cand_alloc, Max_word_len);
-    forallnodes(i) {
+    forallarcs(i) {
       candidate[level] = next_node.get_letter();
       if (next_node.is_final()) {
 	candidate[level + 1] = '\0';
@@ -585,7 +615,7 @@ guess_fsa::print_rest(fsa_arc_ptr start, const int level)
 #endif
       }
       if (next_node.get_goto() != 0)
-	print_rest(next_node.set_next_node(current_dict), level + 1);
+	print_rest(next_node.set_next_node(), level + 1);
     }
   }
   return replacements.how_many() - already_found;
@@ -614,17 +644,18 @@ guess_fsa::print_rest(fsa_arc_ptr start, const int level)
  *		choices, but it prevents the function from recognizing
  *		correctly some irregular words.
  */
+template <class A>
 int
-guess_fsa::guess_stem(fsa_arc_ptr start, const int start_char,
+guess_fsa::guess_stem(A start, const int start_char,
 		      const int infix_length)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   int reject_from_word;
   int already_found = replacements.how_many();
 
   if (word_length + 1 >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
-  forallnodes(i) {
+  forallarcs(i) {
     if ((reject_from_word = (next_node.get_letter() - 'A')) >= 0 &&
 	reject_from_word + start_char < word_length) {
       strncpy(candidate, word_ff + reject_from_word, word_length - start_char);
@@ -638,7 +669,7 @@ guess_fsa::guess_stem(fsa_arc_ptr start, const int start_char,
       else
 	candidate[word_length - reject_from_word - start_char] = '\0';
       invert(candidate);
-      print_rest(next_node.set_next_node(current_dict),
+      print_rest(next_node.set_next_node(),
 		 word_length - reject_from_word -
 		 (infix_length ? infix_length : start_char));
     }
@@ -668,18 +699,19 @@ guess_fsa::guess_stem(fsa_arc_ptr start, const int start_char,
  *		All prefixes must be recognized in full. The filler character
  *		serves as the end marker for the prefix.
  */
+template <class A>
 int
-guess_fsa::check_prefix(fsa_arc_ptr start, const int char_no)
+guess_fsa::check_prefix(A start, const int char_no)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   int prefixes_found = 0;
   int already_found = replacements.how_many();
 
-  forallnodes(i) {
+  forallarcs(i) {
     if (char_no >= word_length)
       break;
     if (next_node.get_letter() == word_ff[word_length - char_no - 1]) {
-      prefixes_found = check_prefix(next_node.set_next_node(current_dict),
+      prefixes_found = check_prefix(next_node.set_next_node(),
 				    char_no + 1);
       break;
     }
@@ -689,20 +721,20 @@ guess_fsa::check_prefix(fsa_arc_ptr start, const int char_no)
     // We got here, because no character on arcs leaving this node
     // can be found in prefix
     next_node = start;
-    forallnodes(j) {
+    forallarcs(j) {
       if (next_node.get_letter() == ANNOT_SEPARATOR) {
 	// this is either an annotation separator at the end of a prefix
 	// or an annotation separator instead of a prefix
 	if (guess_infix)
-	  prefixes_found += check_infix(next_node.set_next_node(current_dict),
+	  prefixes_found += check_infix(next_node.set_next_node(),
 					char_no);
 #ifdef GUESS_LEXEMES
 	else if (guess_lexemes)
-	  prefixes_found += guess_stem(next_node.set_next_node(current_dict),
+	  prefixes_found += guess_stem(next_node.set_next_node(),
 				       char_no, 0);
 #endif
 	else
-	  prefixes_found += print_rest(next_node.set_next_node(current_dict),
+	  prefixes_found += print_rest(next_node.set_next_node(),
 				       0);
       }
     }
@@ -721,17 +753,18 @@ guess_fsa::check_prefix(fsa_arc_ptr start, const int char_no)
  *		Otherwise the word has an infix, and its length can be
  *		calculated as the character code - the character code of `A'.
  */
+template <class A>
 int
-guess_fsa::check_infix(fsa_arc_ptr start, const int char_no)
+guess_fsa::check_infix(A start, const int char_no)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   int infix_length;
   int infixes_found = 0;
 
-  forallnodes(i) {
+  forallarcs(i) {
     if ((infix_length = (next_node.get_letter() - 'A')) >= 0 &&
 	infix_length < word_length - char_no){
-      infixes_found += guess_stem(next_node.set_next_node(current_dict),
+      infixes_found += guess_stem(next_node.set_next_node(),
 				  char_no, infix_length);
     }
   }
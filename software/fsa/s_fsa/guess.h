@@ -24,23 +24,28 @@ public:
   int guess_word(const char *word);
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   int sparse_guess(const char *word, const long start, const int vanity_level);
-#else
-  int guess(const char *word, fsa_arc_ptr start, const int vanity_level);
 #endif
-  int print_rest(fsa_arc_ptr start, const int level);
+  template <class A>
+  int guess(const char *word, A start, const int vanity_level);
+  template <class A>
+  int print_rest(A start, const int level);
 #ifdef GUESS_LEXEMES
-  int guess_stem(fsa_arc_ptr start, const int start_char,
+  template <class A>
+  int guess_stem(A start, const int start_char,
 		 const int infix_length);
 #endif
 #ifdef GUESS_PREFIX
-  int check_prefix(fsa_arc_ptr start, const int char_no);
-  int check_infix(fsa_arc_ptr start, const int char_no);
+  template <class A>
+  int check_prefix(A start, const int char_no);
+  template <class A>
+  int check_infix(A start, const int char_no);
 #endif
-  int handle_arc(fsa_arc_ptr next_node, const int vanity_level);
-  int handle_annot_arc(fsa_arc_ptr next_node, const int vanity_level);
+  template <class A>
+  int handle_arc(A next_node, const int vanity_level);
+  template <class A>
+  int handle_annot_arc(A next_node, const int vanity_level);
 };/*class guess_fsa*/
 
-#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
 /* Name:	handle_arc
  * Class:	guess_fsa
  * Purpose:	Decides what to do with an arc in guess when no matching
@@ -49,8 +54,9 @@ public:
  * Returns:	TRUE if arc has an annotation separator, FALSE otherwise.
  * Remarks:	None.
  */
+template <class A>
 inline int
-guess_fsa::handle_arc(fsa_arc_ptr next_node, const int vanity_level)
+guess_fsa::handle_arc(A next_node, const int vanity_level)
 {
   if (next_node.get_letter() == ANNOT_SEPARATOR) {
     handle_annot_arc(next_node, vanity_level);
@@ -70,11 +76,12 @@ guess_fsa::handle_arc(fsa_arc_ptr next_node, const int vanity_level)
  * Returns:	TRUE if arc has an annotation separator, FALSE otherwise.
  * Remarks:	None.
  */
+template <class A>
 inline int
-guess_fsa::handle_annot_arc(fsa_arc_ptr next_node, const int vanity_level)
+guess_fsa::handle_annot_arc(A next_node, const int vanity_level)
 {
   if (next_node.get_letter() == ANNOT_SEPARATOR) {
-    fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+    A nxt_node = next_node.set_next_node();
 #ifdef GUESS_PREFIX
     if (guess_prefix || guess_infix)
       check_prefix(nxt_node, 0);
@@ -89,11 +96,10 @@ guess_fsa::handle_annot_arc(fsa_arc_ptr next_node, const int vanity_level)
     return FALSE;
   }
   else {
-    fsa_arc_ptr xnt_node = next_node.set_next_node(current_dict);
+    A xnt_node = next_node.set_next_node();
     guess("", xnt_node, vanity_level + 1);
     return TRUE;
   }
 }/*handle_annot_arc*/
-#endif //!(FLEXIBLE&STOPBIT&SPARSE)
 
 /***	EOF guess.fsa	***/
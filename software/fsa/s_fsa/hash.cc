@@ -22,15 +22,17 @@ using namespace std;
  * Remarks:     Only to launch fsa contructor.
  */
 hash_fsa::hash_fsa(word_list *dict_names, const char *language_file)
-: fsa(dict_names, language_file)
+: fsa(dict_names, language_file, TRUE)
 {
+#if defined(FLEXIBLE) && defined(NUMBERS)
   dictionary.reset();
   for (dict_list *p = &dictionary; p->item() != NULL; p->next()) {
-    if (p->item()->entryl <= 0) {
+    if (p->item()->dict.format->entryl <= 0) {
       state = 2;		// the dictionary has not been built with -N
       std::cerr << "fsa_hash: the dictionary has not been built with -N\n";
     }
   }
+#endif //FLEXIBLE&NUMBERS
 }//hash_fsa::hash_fsa
 
 
@@ -42,19 +44,18 @@ hash_fsa::hash_fsa(word_list *dict_names, const char *language_file)
  *		direction	- whether translate words to numbers, or
  *				  numbers to words.
  * Returns:     Exit code.
- * Remarks:     
+ * Remarks:     Words are translated in batches (number_file)
+ *		when the automaton is large, unless they are translated
+ *		from where they differ from the last one (set_sorted).
  */
 int
 hash_fsa::hash_file(tr_io &io_obj, const direction_t direction)
 {
 #ifdef FLEXIBLE
 #ifdef NUMBERS
-  const int	Num_buf_len = 20;
   char          *word;
   int		allocated;
   int		n;
-  char		number_buffer[Num_buf_len];
-  fsa_arc_ptr	*dummy = NULL;
   const char	*w;
 #endif
 #endif
@@ -69,59 +70,15 @@ hash_fsa::hash_file(tr_io &io_obj, const direction_t direction)
 #else
   dictionary.reset();
   dict_list *dict = &dictionary;
-  current_dict = dict->item()->dict.arc;
-#if defined(STOPBIT) && defined(SPARSE)
-  sparse_vect = dict->item()->sparse_vect;
-#endif
-  FILLER = dict->item()->filler;
-  dummy->gtl = dict->item()->gtl;
-  dummy->size = dummy->gtl + goto_offset;
-  dummy->entryl = dict->item()->entryl;
-  dummy->aunit = dummy->entryl ? 1 : (2 + dummy->gtl);
+  set_dictionary(dict->item());
+  if (direction == words_to_numbers && !sorted_input &&
+      batch_pays(dict->item()) && io_obj.set_echo(FALSE))
+    return number_file(io_obj);
 
   word = new char[allocated = Max_word_len];
   while (get_word(io_obj, word, allocated, Max_word_len)) {
     if (direction == words_to_numbers) {
-      // This is a queer way of converting an integer to string
-      // Is there a simpler way?
-//	ostringstream os(number_buffer, Num_buf_len, ios::out);
-//	os.seekp(ios::beg);
-//	os << find_number(word, dummy->first_node(current_dict), 0) << ends;
-//	replacements.insert(os.str());
-      // Update: Stroustrup no longer permits even the code above.
-      // I had to write my own conversion!!!
-#if defined(STOPBIT) && defined(SPARSE)
-      long osn = sparse_find_number(word, sparse_vect->get_first(), 0);
-#else
-      fsa_arc_ptr nxt_node = dummy->first_node(current_dict);
-      long osn = find_number(word, nxt_node.set_next_node(current_dict), 0);
-#endif
-      int osnp = 0;
-      if (osn == -1L) {
-	number_buffer[0] = '-';
-	number_buffer[1] = '1';
-	number_buffer[2] = '\0';
-      }
-      else {
-	do {
-	  number_buffer[osnp] = (osn % 10) + '0';
-	  osn /= 10;
-	  if (++osnp == Num_buf_len - 1) {
-	    break;    // our numbers are less than 20 digits long, aren't they?
-	  }
-	} while (osn > 0);
-	// reverse the number
-	number_buffer[osnp] = 0;
-	int middle = (osnp / 2);
-	--osnp;
-	for (int i = 0; i < middle; i++) {
-	  char temp = number_buffer[i];
-	  number_buffer[i] = number_buffer[osnp - i];
-	  number_buffer[osnp - i] = temp;
-	}
-      }
-      replacements.insert(number_buffer);
-      io_obj.print_repls(&replacements);
+      print_number(io_obj, find_number_in_dict(word));
     }
     else {
       // Sorry, I give up, I will not use istrstream for this
@@ -129,12 +86,7 @@ hash_fsa::hash_file(tr_io &io_obj, const direction_t direction)
 	cerr << "Number out of range. Ignored" << endl;
 	continue;
       }
-#if defined(STOPBIT) && defined(SPARSE)
-      w = sparse_find_word(n, 0, sparse_vect->get_first(), 0);
-#else
-      fsa_arc_ptr xnt_node = dummy->first_node(current_dict);
-      w = find_word(n, 0, xnt_node.set_next_node(current_dict), 0);
-#endif
+      w = find_word_in_dict(n);
       if (w) {
 	replacements.insert(w);
 	io_obj.print_repls(&replacements);
@@ -149,9 +101,348 @@ hash_fsa::hash_file(tr_io &io_obj, const direction_t direction)
 #endif
 }//hash_fsa::hash_file
 
+/* Name:	number_file
+ * Class:	hash_fsa
+ * Purpose:	Translates words to numbers in a file in batches.
+ * Parameters:	io_obj		- (i/o) where to read words,
+ *					and where to print them.
+ * Returns:	Exit code.
+ * Remarks:	Up to LOOKUP_BATCH words are read, and translated at once
+ *		(find_numbers_in_dict). Then they are echoed
+ *		with their numbers in the order they were read,
+ *		as in hash_file. io_obj must not echo words
+ *		when they are read (set_echo).
+ */
+int
+hash_fsa::number_file(tr_io &io_obj)
+{
+#if defined(FLEXIBLE) && defined(NUMBERS)
+  char		*words[LOOKUP_BATCH];
+  int		allocated[LOOKUP_BATCH];
+  int		numbers[LOOKUP_BATCH];
+  int		n;
+  int		more = TRUE;
+
+  for (int i = 0; i < LOOKUP_BATCH; i++)
+    words[i] = new char[allocated[i] = Max_word_len];
+  while (more) {
+    for (n = 0; n < LOOKUP_BATCH; n++)
+      if (!(more = get_word(io_obj, words[n], allocated[n], Max_word_len)))
+	break;
+    find_numbers_in_dict((const char **)words, n, numbers);
+    for (int i = 0; i < n; i++) {
+      io_obj.print_word(words[i]);
+      print_number(io_obj, numbers[i]);
+    }
+  }
+  for (int i = 0; i < LOOKUP_BATCH; i++)
+    delete [] words[i];
+#endif
+  return state;
+}//hash_fsa::number_file
+
+#if defined(FLEXIBLE) && defined(NUMBERS) && defined(MULTI_FORMAT)
+/* Class name:	hash_range_kernel
+ * Purpose:	List words with a range of numbers in an automaton
+ *		with arcs of the class made for its format.
+ * Methods:	hash_range_kernel
+ *				- remembers the range and where to print;
+ *		operator()	- lists the words from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct hash_range_kernel {
+  hash_fsa	*hasher;	/* who lists the words */
+  int		from;		/* number of the first word */
+  int		to;		/* number of the last word */
+  tr_io		*io_obj;	/* where to print them */
+  hash_range_kernel(hash_fsa *h, const int f, const int t, tr_io &io) {
+    hasher = h; from = f; to = t; io_obj = &io;
+  }
+  template <class A>
+  int operator()(A root) {
+    return hasher->list_words(from, to, root.set_next_node(), *io_obj);
+  }
+};/* struct hash_range_kernel */
+#endif
+
+/* Name:	hash_range
+ * Class:	hash_fsa
+ * Purpose:	Prints words with numbers from a range, with their numbers.
+ * Parameters:	io_obj		- (o) where to print them;
+ *		from		- (i) number of the first word;
+ *		to		- (i) number of the last word.
+ * Returns:	Exit code.
+ * Remarks:	Only the first dictionary is used, as in numbers_to_words.
+ *		The output is the same as for numbers from `from' to `to'
+ *		translated into words (numbers past the last word
+ *		are not printed). The first word is found once
+ *		(list_words), and the rest follow in order.
+ */
+int
+hash_fsa::hash_range(tr_io &io_obj, const int from, const int to)
+{
+#if defined(FLEXIBLE) && defined(NUMBERS)
+  dictionary.reset();
+  set_dictionary(dictionary.item());
+#if defined(STOPBIT) && defined(SPARSE)
+  if (sparse_vect != NULL) {
+    cerr << "Ranges of numbers cannot be listed in automata with"
+	 << " a sparse vector" << endl;
+    return 1;
+  }
+#endif
+#ifdef MULTI_FORMAT
+  hash_range_kernel kernel(this, from, to, io_obj);
+  with_format(current_format, kernel);
+#else
+  fsa_arc_ptr nxt_node = first_node();
+  list_words(from, to, nxt_node.set_next_node(), io_obj);
+#endif
+#endif
+  return state;
+}//hash_fsa::hash_range
+
+/* Name:	print_number
+ * Class:	hash_fsa
+ * Purpose:	Prints the number of a word.
+ * Parameters:	io_obj		- (i/o) where to print it;
+ *		osn		- (i) the number (-1 if the word
+ *					was not found).
+ * Returns:	Nothing.
+ */
+void
+hash_fsa::print_number(tr_io &io_obj, long int osn)
+{
+  const int	Num_buf_len = 20;
+  char		number_buffer[Num_buf_len];
+
+  replacements.insert(number_string(osn, number_buffer, Num_buf_len));
+  io_obj.print_repls(&replacements);
+  replacements.empty_list();
+}//hash_fsa::print_number
+
+/* Name:	number_string
+ * Class:	hash_fsa
+ * Purpose:	Converts a number of a word to a string.
+ * Parameters:	osn		- (i) the number (-1 if the word
+ *					was not found);
+ *		number_buffer	- (o) where to put the string;
+ *		Num_buf_len	- (i) size of number_buffer.
+ * Returns:	number_buffer.
+ */
+const char *
+hash_fsa::number_string(long int osn, char *number_buffer,
+			const int Num_buf_len)
+{
+  // This is a queer way of converting an integer to string
+  // Is there a simpler way?
+//	ostringstream os(number_buffer, Num_buf_len, ios::out);
+//	os.seekp(ios::beg);
+//	os << find_number(word, first_node(), 0) << ends;
+//	replacements.insert(os.str());
+  // Update: Stroustrup no longer permits even the code above.
+  // I had to write my own conversion!!!
+  int osnp = 0;
+  if (osn == -1L) {
+    number_buffer[0] = '-';
+    number_buffer[1] = '1';
+    number_buffer[2] = '\0';
+  }
+  else {
+    do {
+      number_buffer[osnp] = (osn % 10) + '0';
+      osn /= 10;
+      if (++osnp == Num_buf_len - 1) {
+	break;    // our numbers are less than 20 digits long, aren't they?
+      }
+    } while (osn > 0);
+    // reverse the number
+    number_buffer[osnp] = 0;
+    int middle = (osnp / 2);
+    --osnp;
+    for (int i = 0; i < middle; i++) {
+      char temp = number_buffer[i];
+      number_buffer[i] = number_buffer[osnp - i];
+      number_buffer[osnp - i] = temp;
+    }
+  }
+  return number_buffer;
+}//hash_fsa::number_string
+
 #ifdef FLEXIBLE
 #ifdef NUMBERS
 
+#ifdef MULTI_FORMAT
+/* Class name:	hash_kernel
+ * Purpose:	Translate a word into a number, or a number into a word,
+ *		in an automaton with arcs of the class made for its format.
+ * Methods:	hash_kernel	- remembers the word or the number;
+ *		operator()	- translates it from the root
+ *				  (or from the path of the last word).
+ * Remarks:	Passed to with_format. When word is NULL, the number
+ *		is translated, and the word is put into result.
+ */
+struct hash_kernel {
+  hash_fsa	*hasher;	/* who translates */
+  const char	*word;		/* word to be translated (or NULL) */
+  int		word_no;	/* number to be translated */
+  const char	*result;	/* the word with that number */
+  int		on_path;	/* TRUE if the path of the last word is used */
+  hash_kernel(hash_fsa *h, const char *w, const int n, const int p = FALSE) {
+    hasher = h; word = w; word_no = n; result = NULL; on_path = p;
+  }
+  template <class A>
+  int operator()(A root) {
+    if (word != NULL && on_path)
+      return hasher->find_number_on_path(word, root);
+    if (word != NULL)
+      return hasher->find_number(word, root.set_next_node(), 0);
+    result = hasher->find_word(word_no, 0, root.set_next_node(), 0);
+    return 0;
+  }
+};/* struct hash_kernel */
+#endif
+
+/* Name:	find_number_in_dict
+ * Class:	hash_fsa
+ * Purpose:	Translates word into a corresponding number
+ *		in the current dictionary.
+ * Parameters:	word		- (i) word to be found.
+ * Returns:	The number assigned to the word or -1 if not found.
+ * Remarks:	With MULTI_FORMAT, the format of the dictionary is looked
+ *		at here (see morph_fsa::morph_dictionary).
+ *		With sorted_input, the word is translated from where
+ *		it differs from the last one (find_number_on_path).
+ */
+int
+hash_fsa::find_number_in_dict(const char *word)
+{
+#if defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  if (sparse_vect == NULL) {
+    hash_kernel kernel(this, word, 0, sorted_input);
+    return with_format(current_format, kernel);
+  }
+#endif
+  return sparse_find_number(word, sparse_vect->get_first(), 0);
+#else
+#ifdef MULTI_FORMAT
+  hash_kernel kernel(this, word, 0, sorted_input);
+  return with_format(current_format, kernel);
+#else
+  if (sorted_input)
+    return find_number_on_path(word, first_node());
+  fsa_arc_ptr nxt_node = first_node();
+  return find_number(word, nxt_node.set_next_node(), 0);
+#endif
+#endif
+}//hash_fsa::find_number_in_dict
+
+#ifdef MULTI_FORMAT
+/* Class name:	hash_batch_kernel
+ * Purpose:	Translate words of a batch into numbers in an automaton
+ *		with arcs of the class made for its format.
+ * Methods:	hash_batch_kernel
+ *				- remembers the words;
+ *		operator()	- translates them from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct hash_batch_kernel {
+  hash_fsa	*hasher;	/* who translates */
+  const char	**words;	/* words to be translated */
+  int		n;		/* how many */
+  int		*numbers;	/* their numbers */
+  hash_batch_kernel(hash_fsa *h, const char **w, const int k, int *nums) {
+    hasher = h; words = w; n = k; numbers = nums;
+  }
+  template <class A>
+  int operator()(A root) {
+    walk_state<A> w[LOOKUP_BATCH];
+    for (int i = 0; i < n; i++) {
+      w[i].word = words[i]; w[i].arc = root; w[i].found = -1;
+      w[i].word_no = 0;
+    }
+    hasher->find_numbers(w, n);
+    for (int i = 0; i < n; i++)
+      numbers[i] = (w[i].found ? w[i].word_no : -1);
+    return 0;
+  }
+};/* struct hash_batch_kernel */
+#endif
+
+/* Name:	find_numbers_in_dict
+ * Class:	hash_fsa
+ * Purpose:	Translates words of a batch into numbers
+ *		in the current dictionary.
+ * Parameters:	words		- (i) words to be found;
+ *		n		- (i) how many (at most LOOKUP_BATCH);
+ *		numbers		- (o) their numbers (-1 if not found).
+ * Returns:	Nothing.
+ * Remarks:	Automata with a sparse vector are looked at word by word.
+ */
+void
+hash_fsa::find_numbers_in_dict(const char **words, const int n, int *numbers)
+{
+#if defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  if (sparse_vect == NULL) {
+    hash_batch_kernel kernel(this, words, n, numbers);
+    with_format(current_format, kernel);
+    return;
+  }
+#endif
+  for (int i = 0; i < n; i++)
+    numbers[i] = sparse_find_number(words[i], sparse_vect->get_first(), 0);
+#else
+#ifdef MULTI_FORMAT
+  hash_batch_kernel kernel(this, words, n, numbers);
+  with_format(current_format, kernel);
+#else
+  walk_state<fsa_arc_ptr> w[LOOKUP_BATCH];
+  for (int i = 0; i < n; i++) {
+    w[i].word = words[i]; w[i].arc = first_node(); w[i].found = -1;
+    w[i].word_no = 0;
+  }
+  find_numbers(w, n);
+  for (int i = 0; i < n; i++)
+    numbers[i] = (w[i].found ? w[i].word_no : -1);
+#endif
+#endif
+}//hash_fsa::find_numbers_in_dict
+
+/* Name:	find_word_in_dict
+ * Class:	hash_fsa
+ * Purpose:	Finds a word whose number in the current dictionary
+ *		is given as argument.
+ * Parameters:	word_no		- (i) number of the word to be found.
+ * Returns:	The word, or NULL if not found.
+ * Remarks:	With MULTI_FORMAT, the format of the dictionary is looked
+ *		at here (see morph_fsa::morph_dictionary).
+ */
+const char *
+hash_fsa::find_word_in_dict(const int word_no)
+{
+#if defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  if (sparse_vect == NULL) {
+    hash_kernel kernel(this, NULL, word_no);
+    with_format(current_format, kernel);
+    return kernel.result;
+  }
+#endif
+  return sparse_find_word(word_no, 0, sparse_vect->get_first(), 0);
+#else
+#ifdef MULTI_FORMAT
+  hash_kernel kernel(this, NULL, word_no);
+  with_format(current_format, kernel);
+  return kernel.result;
+#else
+  fsa_arc_ptr xnt_node = first_node();
+  return find_word(word_no, 0, xnt_node.set_next_node(), 0);
+#endif
+#endif
+}//hash_fsa::find_word_in_dict
+
 #if defined(STOPBIT) && defined(SPARSE)
 /* Name:	sparse_find_number
  * Class:	hash_fsa
@@ -176,7 +467,6 @@ hash_fsa::sparse_find_number(const char *word, const long start, int word_no)
   bool found = false;
   long current = start;
   long next = current;
-  fsa_arc_ptr *dummy;
   do {
     found = false;
     current = next;
@@ -195,11 +485,11 @@ hash_fsa::sparse_find_number(const char *word, const long start, int word_no)
 	current = next;
 	if (*word++ == ANNOT_SEPARATOR) {
 	  // Move to annotations (out of sparse matrix)
-	  return find_number(word, current_dict + next
+	  return find_number(word, node_at(next
 #ifdef NUMBERS
-			     + dummy->entryl
+			     + current_format->entryl
 #endif
-			     , word_no);
+			     ), word_no);
 	}
 	else {
 	  found = true;
@@ -226,17 +516,24 @@ hash_fsa::sparse_find_number(const char *word, const long start, int word_no)
  *
  *		All nodes contain information about the number of different
  *		words (more precisely: word suffixes) contained in this node
- *		and all nodes below.
+ *		and all nodes below. With ranked arcs (fsa_build -r),
+ *		the number of words before the matching arc is read
+ *		in front of it, so nodes of the other arcs are not touched.
  */
+template <class A>
 int
-hash_fsa::find_number(const char *word, fsa_arc_ptr start, int word_no)
+hash_fsa::find_number(const char *word, A start, int word_no)
 {
   bool found = false;
   do {
     found = false;
-    fsa_arc_ptr next_node = start;
-    forallnodes(i) {
+    A next_node = start;
+    forallarcs(i) {
       if (*word == next_node.get_letter()) {
+	if (next_node.ranked() && next_node.arc != start.arc)
+	  word_no += next_node.rank_before();
+	if (!match_run(word, next_node))
+	  return -1;
 	if (word[1] == '\0' && next_node.is_final()) {
 	  // This is the end of the word, and the word has been found
 	  return word_no;
@@ -246,14 +543,14 @@ hash_fsa::find_number(const char *word, fsa_arc_ptr start, int word_no)
 	    // end of the string in the automaton
 	    return -1;
 	  }
-	  start = next_node.set_next_node(current_dict);
+	  start = next_node.set_next_node();
 	  word++;
 	  word_no += next_node.is_final();
 	  found = true;
 	  break;
 	}
       }
-      else {
+      else if (!next_node.ranked()) {
 	if (next_node.is_final())
 	  word_no++;
 	word_no += words_in_node(next_node);
@@ -263,25 +560,111 @@ hash_fsa::find_number(const char *word, fsa_arc_ptr start, int word_no)
   return -1;
 }//hash_fsa::find_number
 
-
-/* Name:	words_in_node
+/* Name:	find_number_on_path
  * Class:	hash_fsa
- * Purpose:	Returns the number of different words (word suffixes)
- *		in the given node.
- * Parameters:	start		- (i) parent of the node to be examined.
- * Returns:	Number of different word suffixes in the given node.
- * Remarks:	None.
+ * Purpose:	Translates word into a corresponding number, starting
+ *		from where it differs from the last word translated.
+ * Parameters:	word		- (i) word to be found;
+ *		root		- (i) the root of the current dictionary.
+ * Returns:	The number assigned to the word or -1 if not found.
+ * Remarks:	The path of the last word (arc_path) is kept
+ *		with the dictionary; states on it hold numbers of words
+ *		before them, so for sorted words most nodes are looked at
+ *		only once. The word goes the same way as in find_number
+ *		(number_step).
  */
+template <class A>
 int
-hash_fsa::words_in_node(fsa_arc_ptr start)
+hash_fsa::find_number_on_path(const char *word, A root)
 {
-  fsa_arc_ptr next_node = start.set_next_node(current_dict);
+  arc_path<A> *path = (arc_path<A> *)*current_path;
+  if (path == NULL)
+    *current_path = path = new arc_path<A>(root);
+  walk_state<A> w = path->resume(word);
+  for (;;) {
+    number_step(w);
+    if (w.found >= 0)
+      break;
+    path->push(w, w.word - word);
+  }
+  return (w.found ? w.word_no : -1);
+}//hash_fsa::find_number_on_path
 
-  return (start.get_goto() ?
-	  bytes2int((unsigned char *)next_node.arc - next_node.entryl,
-		    next_node.entryl)
-	  : 0);
-}//hash_fsa::words_in_node
+/* Name:	find_numbers
+ * Class:	hash_fsa
+ * Purpose:	Translates words of a batch into numbers.
+ * Parameters:	w		- (i/o) states of the words
+ *					(found and word_no are set).
+ * 		n		- (i) number of words.
+ * Returns:	Nothing.
+ * Remarks:	As in fsa::walk_batch, words are looked for in turns,
+ *		one node of each word at a time.
+ */
+template <class A>
+void
+hash_fsa::find_numbers(walk_state<A> *w, const int n)
+{
+  int left = 0;
+  for (int i = 0; i < n; i++)
+    if (w[i].found < 0)
+      left++;
+  while (left > 0) {
+    for (int i = 0; i < n; i++)
+      if (w[i].found < 0) {
+	number_step(w[i]);
+	if (w[i].found >= 0)
+	  left--;
+      }
+  }
+}//hash_fsa::find_numbers
+
+/* Name:	number_step
+ * Class:	hash_fsa
+ * Purpose:	Goes one node further in translating a word of a batch
+ *		into a number.
+ * Parameters:	w		- (i/o) the state of the word.
+ * Returns:	Nothing.
+ * Remarks:	The same as one iteration of the loop in find_number;
+ *		the target node is only asked for (prefetch_target).
+ */
+template <class A>
+void
+hash_fsa::number_step(walk_state<A> &w)
+{
+  A start = w.arc.set_next_node();
+  A next_node = start;
+  const char *word = w.word;
+
+  forallarcs(i) {
+    if (*word == next_node.get_letter()) {
+      if (next_node.ranked() && next_node.arc != start.arc)
+	w.word_no += next_node.rank_before();
+      if (!match_run(word, next_node)) {
+	w.found = FALSE;
+	return;
+      }
+      if (word[1] == '\0' && next_node.is_final()) {
+	w.found = TRUE;
+	return;
+      }
+      if (word[1] == '\0' || next_node.get_goto() == 0) {
+	w.found = FALSE;
+	return;
+      }
+      w.word_no += next_node.is_final();
+      w.word = word + 1;
+      w.arc = next_node;
+      next_node.prefetch_target();
+      return;
+    }
+    else if (!next_node.ranked()) {
+      if (next_node.is_final())
+	w.word_no++;
+      w.word_no += words_in_node(next_node);
+    }
+  }
+  w.found = FALSE;
+}//hash_fsa::number_step
 
 
 #if defined(STOPBIT) && defined(SPARSE)
@@ -312,7 +695,6 @@ hash_fsa::sparse_find_word(const int word_no, int n, const long start,
   long next = start;
   long last_target = 0L;
   char last_label = '\0';
-  fsa_arc_ptr *dummy;
 
   do {
     if (current == 0L) {
@@ -344,12 +726,12 @@ hash_fsa::sparse_find_word(const int word_no, int n, const long start,
 	  if (cc == ANNOT_SEPARATOR) {
 	    return find_word(word_no, n + sparse_vect->is_final(current,
 								last_label),
-			     current_dict + last_target
+			     node_at(last_target
 			     
 #ifdef NUMBERS
-			     + dummy->entryl
+			     + current_format->entryl
 #endif
-			     , l);
+			     ), l);
 	  }
 	  n += sparse_vect->get_hash_v(current, last_label) +
 	    sparse_vect->is_final(current, last_label);
@@ -369,12 +751,12 @@ hash_fsa::sparse_find_word(const int word_no, int n, const long start,
       if (last_label == ANNOT_SEPARATOR) {
 	return find_word(word_no, n + sparse_vect->is_final(current,
 							    last_label),
-			 current_dict + last_target
+			 node_at(last_target
 			 
 #ifdef NUMBERS
-			 + dummy->entryl
+			 + current_format->entryl
 #endif
-			 , l);
+			 ), l);
       }//if transition labeled with annotation separator
       n += sparse_vect->get_hash_v(current, last_label) +
 	sparse_vect->is_final(current, last_label);
@@ -401,9 +783,12 @@ hash_fsa::sparse_find_word(const int word_no, int n, const long start,
  *		on the left, and leaves on the right sorted from top to bottom,
  *		then the number of words analysed means the number of words
  *		that are in branches top of the search path in the automaton.
+ *		With ranked arcs (fsa_build -r), ranks of arcs are compared
+ *		instead of adding numbers of words in their nodes.
  */
+template <class A>
 const char *
-hash_fsa::find_word(const int word_no, int n, fsa_arc_ptr start,
+hash_fsa::find_word(const int word_no, int n, A start,
 		    const int level)
 {
   
@@ -413,10 +798,11 @@ hash_fsa::find_word(const int word_no, int n, fsa_arc_ptr start,
 
   do {
     found = false;
-    fsa_arc_ptr next_node = start;
+    A next_node = start;
+    const int base = n;		// words before the node (ranked arcs)
     if (l + 1 >= cand_alloc)
       grow_string(candidate, cand_alloc, Max_word_len);
-    forallnodes(i) {
+    forallarcs(i) {
       if (next_node.is_final()) {
 	if (n == word_no) {
 	  candidate[l] = next_node.get_letter();
@@ -427,10 +813,29 @@ hash_fsa::find_word(const int word_no, int n, fsa_arc_ptr start,
 	  n++;
       }
 
-      if ((m = n + words_in_node(next_node)) > word_no) {
+      if (next_node.ranked())
+	// words through this arc and the ones before it, or in the node
+	m = base + (next_node.more_arcs(ileft) ? next_node.rank()
+		    : start.rank_before());
+      else
+	m = n + words_in_node(next_node);
+      if (m > word_no) {
 	candidate[l] = next_node.get_letter();
 	l++;
-	start = next_node.set_next_node(current_dict);
+	if (next_node.run_left()) {
+	  // the following labels are in the same arc
+	  while (l + next_node.run_left() + 1 >= cand_alloc)
+	    grow_string(candidate, cand_alloc, Max_word_len);
+	  l += copy_run(candidate + l, next_node);
+	  if (next_node.is_final()) {
+	    if (n == word_no) {
+	      candidate[l] = '\0';
+	      return candidate;
+	    }
+	    n++;
+	  }
+	}
+	start = next_node.set_next_node();
 	found = true;
 	break;
       }
@@ -442,6 +847,38 @@ hash_fsa::find_word(const int word_no, int n, fsa_arc_ptr start,
   return NULL;
 }//hash_fsa::find_word
 
+/* Name:	list_words
+ * Class:	hash_fsa
+ * Purpose:	Prints words with numbers from a range, with their numbers.
+ * Parameters:	from		- (i) number of the first word;
+ *		to		- (i) number of the last word;
+ *		start		- (i) the root node;
+ *		io_obj		- (o) where to print them.
+ * Returns:	Number of words printed.
+ * Remarks:	A cursor (word_cursor) skips the words before the first one
+ *		using numbers of words in nodes, and then goes from one word
+ *		to the next in the order of numbers.
+ */
+template <class A>
+int
+hash_fsa::list_words(const int from, const int to, A start, tr_io &io_obj)
+{
+  const int	Num_buf_len = 20;
+  char		number_buffer[Num_buf_len];
+  word_cursor<A> cursor(start);
+  int		n;
+
+  if (cursor.skip(from) < from)
+    return 0;
+  for (n = from; n <= to && cursor.word() != NULL; n++, cursor.next()) {
+    io_obj.print_word(number_string(n, number_buffer, Num_buf_len));
+    replacements.insert(cursor.word());
+    io_obj.print_repls(&replacements);
+    replacements.empty_list();
+  }
+  return n - from;
+}//hash_fsa::list_words
+
 #endif
 #endif
 
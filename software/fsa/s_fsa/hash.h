@@ -9,17 +9,34 @@ public:
   hash_fsa(word_list *dict_names, const char *language_file = NULL);
   virtual ~hash_fsa(void) {}
   int hash_file(tr_io &io_obj, const direction_t direction);
+  int number_file(tr_io &io_obj);
+  int hash_range(tr_io &io_obj, const int from, const int to);
+  void print_number(tr_io &io_obj, long int osn);
+  const char *number_string(long int osn, char *number_buffer,
+			    const int Num_buf_len);
 #if defined(FLEXIBLE) && defined(STOPBIT) & defined(SPARSE)
   int sparse_find_number(const char *word, const long start, int word_no);
 #endif
-  int find_number(const char *word, fsa_arc_ptr start, int word_no);
-  int words_in_node(fsa_arc_ptr start);
+  int find_number_in_dict(const char *word);
+  const char *find_word_in_dict(const int word_no);
+  template <class A>
+  int find_number(const char *word, A start, int word_no);
+  template <class A>
+  int find_number_on_path(const char *word, A root);
+  void find_numbers_in_dict(const char **words, const int n, int *numbers);
+  template <class A>
+  void find_numbers(walk_state<A> *w, const int n);
+  template <class A>
+  void number_step(walk_state<A> &w);
 #if defined(FLEXIBLE) && defined(STOPBIT) & defined(SPARSE)
   const char *sparse_find_word(const int word_no, int n, const long start,
 			       const int level);
 #endif
-  const char *find_word(const int word_no, int n, fsa_arc_ptr start,
+  template <class A>
+  const char *find_word(const int word_no, int n, A start,
 			const int level);
+  template <class A>
+  int list_words(const int from, const int to, A start, tr_io &io_obj);
 };/*class hash_fsa*/
 
 
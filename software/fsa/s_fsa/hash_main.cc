@@ -18,6 +18,7 @@ output if not specified otherwise.
 #include	<fstream>
 #include	<string.h>
 #include	<stdlib.h>
+#include	<limits.h>
 #include	<new>
 #include	<unistd.h>
 #include	"fsa.h"
@@ -34,6 +35,8 @@ int
 usage(const char *prog_name);
 void
 not_enough_memory(void);
+const char *
+get_number(const char *s, int &n);
 
 
 
@@ -52,6 +55,28 @@ not_enough_memory(void)
   exit(4);
 }//not_enough_memory
 
+/* Name:	get_number
+ * Class:	None.
+ * Purpose:	Reads a non-negative decimal number.
+ * Parameters:	s		- (i) the number;
+ *		n		- (o) its value.
+ * Returns:	The first character after the number, or NULL if there
+ *		are no digits, or if the number does not fit in an int.
+ * Remarks:	Used for ranges of numbers of words (-r).
+ */
+const char *
+get_number(const char *s, int &n)
+{
+  if (*s < '0' || *s > '9')
+    return NULL;
+  for (n = 0; *s >= '0' && *s <= '9'; s++) {
+    if (n > (INT_MAX - (*s - '0')) / 10)
+      return NULL;		// too big
+    n = 10 * n + (*s - '0');
+  }
+  return s;
+}//get_number
+
 /* Name:	main
  * Class:	None.
  * Purpose:	Launches the program.
@@ -73,6 +98,9 @@ main(const int argc, const char *argv[])
   int		arg_index;	// current argument number
   const char	*lang_file = NULL; // name of file with character set
   direction_t	direction = unspecified;
+  int		sorted = FALSE;	// TRUE if words share paths (-s)
+  int		range_from = -1; // number of the first word listed (-r)
+  int		range_to = INT_MAX; // number of the last one
 #endif
 #endif
 
@@ -111,6 +139,23 @@ main(const int argc, const char *argv[])
     else if (argv[arg_index][1] == 'W') {
       direction = numbers_to_words;
     }
+    else if (argv[arg_index][1] == 's') {
+      sorted = TRUE;
+    }
+    else if (argv[arg_index][1] == 'r') {
+      // range of numbers of words to be listed
+      if (++arg_index >= argc)
+	return usage(argv[0]);
+      const char *p = get_number(argv[arg_index], range_from);
+      if (p != NULL && *p != ':')
+	p = NULL;		// no colon
+      else if (p != NULL && *++p != '\0')
+	p = get_number(p, range_to);
+      if (p == NULL || *p != '\0' || range_to < range_from) {
+	cerr << argv[0] << ": -r needs a range of numbers from:to" << endl;
+	return usage(argv[0]);
+      }
+    }
     else if (argv[arg_index][1] == 'v') {
       // details of version
 #include "compile_options.h"
@@ -127,13 +172,23 @@ main(const int argc, const char *argv[])
     return usage(argv[0]);
   }
 
-  if (direction == unspecified) {
+  if (direction == unspecified && range_from < 0) {
     cerr << "Either -N or -W must be specified" << endl;
     return usage(argv[0]);
   }
 
   hash_fsa fsa_dict(&dict, lang_file);
+  fsa_dict.set_sorted(sorted);
   if (!fsa_dict) {
+    if (range_from >= 0) {
+      // nothing is read
+      tr_io io_obj(&cin, cout, MAX_LINE_LEN, "",
+#ifdef UTF8
+		   (word_syntax_type *)
+#endif
+		   fsa_dict.get_syntax());
+      return fsa_dict.hash_range(io_obj, range_from, range_to);
+    }
     if (inputs.how_many()) {
       inputs.reset();
       do {
@@ -185,6 +240,10 @@ usage(const char *prog_name)
        << "\t[default: ASCII letters, standard conversions]\n"
        << "-N\ttranslate words to numbers (either this or -W must be given)\n"
        << "-W\ttranslate numbers to words (either this or -N must be given)\n"
+       << "-s\ttranslate words from where they differ from the previous one\n"
+       << "\t(fast for sorted input)\n"
+       << "-r from:to\tlist words with numbers from `from' to `to'\n"
+       << "\t(to the last word if `to' is omitted; nothing is read)\n"
        << "-v\tversion details\n"
        << "Standard output used for displaying results.\n"
        << "At least one dictionary must be present.\n";
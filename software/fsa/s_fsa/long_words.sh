@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# long_words.sh - checks that automata can be built from very long words.
+#
+# Usage: make check
+#
+# Builders call themselves for each letter of a word (node::number_arcs,
+# node::write_arcs), so each call must take little of the stack.
+# An automaton is built with fsa_build from words of LENGTH letters
+# (default 20000) in each version it can write, with and without -O,
+# and then its short words must be found by fsa_spell (the query tools
+# read words of at most Max_word_len letters, see common.h).
+# Files are made in TMPDIR (default /tmp).
+
+LENGTH=${LENGTH:-20000}
+TMP=${TMPDIR:-/tmp}/long_words.$$
+mkdir -p $TMP || exit 1
+trap 'rm -rf $TMP' 0
+
+awk -v n=$LENGTH 'BEGIN {
+  w = ""; for (i = 0; i < n; i++) w = w "a"
+  print "a"; print w "b"; print w "c"; gsub(/a/, "b", w); print w; print "c"
+}' > $TMP/words
+printf 'a\nc\n' > $TMP/short
+
+failed=0
+for v in 1 2 4 5 6 7 ; do
+  for o in "" -O ; do
+    if ./fsa_build $o -f $v -i $TMP/words -o $TMP/words.fsa 2> /dev/null &&
+       [ `./fsa_spell -d $TMP/words.fsa -i $TMP/short | \
+	  grep -c '\*OK\*$'` -eq 2 ] ; then
+      echo "ok	fsa_build $o -f $v"
+    else
+      echo "FAILED	fsa_build $o -f $v"
+      failed=1
+    fi
+  done
+done
+exit $failed
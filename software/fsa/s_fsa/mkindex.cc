@@ -100,7 +100,7 @@ reduce_inner(node *n)
     an = n->get_children();
     for (int i = 0; i < n->get_no_of_kids(); i++, an++) {
 
-      if (an->letter != ANNOT_SEPARATOR) {
+      if (an->letter != build_ctx->annot_separator) {
 
 	new_child = reduce_inner(an->child);
 	if (new_child != an->child) {
@@ -282,7 +282,7 @@ int
 is_annotated(const node *n)
 {
   return (n->get_no_of_kids() == 1 &&
-	  n->get_children()->letter == ANNOT_SEPARATOR);
+	  n->get_children()->letter == build_ctx->annot_separator);
 }//is_annotated
 
 #ifdef PRUNE_ARCS
@@ -407,7 +407,7 @@ count_diff_dests(const node *n, int &different_dests, arc_count_str *arcs,
   // Count arcs leading to different nodes
   an = n->get_children();
   for (int i = 0; i < n->get_no_of_kids(); i++, an++) {
-    if (an->letter == ANNOT_SEPARATOR)
+    if (an->letter == build_ctx->annot_separator)
       // Nothing to be pruned here - ANNOT_SEPARATOR prohibits pruning
       return 0;
 
@@ -968,7 +968,7 @@ collect_annotations(node *n, const int prefix)
     // node not visited yet
     arc_node *an = n->get_children();
     for (int i = 0; i < n->get_no_of_kids(); i++, an++) {
-      if (an->letter == ANNOT_SEPARATOR) {
+      if (an->letter == build_ctx->annot_separator) {
 	// It's an annotation, and n is an annotated node
 	child.annot = an->child;
 #ifdef WEIGHTED
@@ -1046,14 +1046,14 @@ new_gen(node *n, const int pref)
     // This node cannot be generalized, so move downwards
     an = n->get_children();
     for (int i = 0; i < n->get_no_of_kids(); i++, an++) {
-      if (an->letter != ANNOT_SEPARATOR) {
+      if (an->letter != build_ctx->annot_separator) {
 	new_gen(an->child, pref);
       }
     }
     return 0;			// too many annotations
   }
   if (n->nannots == 1) {
-    if (n->get_children()->letter == ANNOT_SEPARATOR) {
+    if (n->get_children()->letter == build_ctx->annot_separator) {
       // We got to the annotated nodes.
       // Nothing can be done here.
       return 0;
@@ -1065,7 +1065,7 @@ new_gen(node *n, const int pref)
       unregister_node(n);	// we are changing its children
       n->annots[0].annot->hit_node();
       delete_old_branch(n->get_children()->child);
-      n->get_children()->letter = ANNOT_SEPARATOR;
+      n->get_children()->letter = build_ctx->annot_separator;
       n->get_children()->child = n->annots[0].annot;
       return 1;
     }
@@ -1087,7 +1087,7 @@ new_gen(node *n, const int pref)
       delete [] n->get_children();
       arc_node *new_kids = new arc_node[1];
       new_kids->child = n->annots[0].annot;
-      new_kids->letter = ANNOT_SEPARATOR;
+      new_kids->letter = build_ctx->annot_separator;
 #ifdef WEIGHTED
       new_kids->weight = sum;
 #endif
@@ -1134,7 +1134,7 @@ new_gen(node *n, const int pref)
       arc_node *new_kids = new arc_node[1];
       new_kids->child = merged_node;
       new_kids->is_final = 0;
-      new_kids->letter = ANNOT_SEPARATOR;
+      new_kids->letter = build_ctx->annot_separator;
 #ifdef WEIGHTED
       new_kids->weight = sum;
 #endif
@@ -1162,7 +1162,7 @@ new_gen(node *n, const int pref)
 	}
 	delete [] n->get_children();
 	an = new arc_node[1];
-	an->letter = ANNOT_SEPARATOR;
+	an->letter = build_ctx->annot_separator;
 	an->child = n->annots[z].annot;
 	an->weight = n->annots[z].weight;
 	an->is_final = FALSE;
@@ -1184,7 +1184,7 @@ new_gen(node *n, const int pref)
       }
       delete [] n->get_children();
       an = new arc_node[1];
-      an->letter = ANNOT_SEPARATOR;
+      an->letter = build_ctx->annot_separator;
       an->child = merged_node;
       an->weight = sum1;
       an->is_final = FALSE;
@@ -1197,7 +1197,7 @@ new_gen(node *n, const int pref)
     // This node cannot be generalized, so move downwards
     an = n->get_children();
     for (int j = 0; j < n->get_no_of_kids(); j++, an++) {
-      if (an->letter != ANNOT_SEPARATOR) {
+      if (an->letter != build_ctx->annot_separator) {
 	new_gen(an->child, pref);
       }
     }
@@ -1206,7 +1206,7 @@ new_gen(node *n, const int pref)
   // here we should also move downwards
   an = n->get_children();
   for (int r = 0; r < n->get_no_of_kids(); r++, an++) {
-    if (an->letter != ANNOT_SEPARATOR) {
+    if (an->letter != build_ctx->annot_separator) {
       new_gen(an->child, pref);
     }
   }
@@ -1544,7 +1544,7 @@ collect_secondary(const node *n, node *v[], const int m)
   int		vp = 0;
   arc_node	*an = n->get_children();
   for (int i = 0; i < n->get_no_of_kids(); i++, an++) {
-    if (an->letter == ANNOT_SEPARATOR) {
+    if (an->letter == build_ctx->annot_separator) {
       for (vp = 0; vp < vn; vp++)
 	if (v[vp] == an->child)
 	  break;
@@ -1580,7 +1580,7 @@ remove_annot_pointers(node *n)
   n->annots = NULL;
   arc_node *an = n->get_children();
   for (int j = 0; j < n->get_no_of_kids(); j++, an++) {
-    if (an->letter != ANNOT_SEPARATOR) {
+    if (an->letter != build_ctx->annot_separator) {
       remove_annot_pointers(an->child);
     }
   }
@@ -40,7 +40,7 @@ morph_fsa::morph_fsa(const int ignorefiller,
 		     word_list *dict_list, const char *language_file = NULL)
 #endif
 #endif
-: fsa(dict_list, language_file)
+: fsa(dict_list, language_file, TRUE)
 {
 #ifdef MORPH_INFIX
   morph_infixes = file_has_infixes;
@@ -60,7 +60,9 @@ morph_fsa::morph_fsa(const int ignorefiller,
  * Parameters:	io_obj		- (i/o) where to read words,
  *					and where to print analyses;
  * Returns:	Exit code.
- * Remarks:	None.
+ * Remarks:	Words are read in batches (morph_batches)
+ *		when an automaton is large, unless they are looked for
+ *		from where they differ from the last one (set_sorted).
  */
 int
 morph_fsa::morph_file(tr_io &io_obj)
@@ -68,6 +70,8 @@ morph_fsa::morph_file(tr_io &io_obj)
   int		allocated;
   char		*word;
 
+  if (!sorted_input && batch_pays() && io_obj.set_echo(FALSE))
+    return morph_batches(io_obj);
   word = new char[allocated = Max_word_len];
   while (get_word(io_obj, word, allocated, Max_word_len)) {
     word_length = strlen(word); word_ff = word;
@@ -81,6 +85,149 @@ morph_fsa::morph_file(tr_io &io_obj)
   return state;
 }//morph_fsa::morph_file
 
+/* Name:	morph_batches
+ * Class:	morph_fsa
+ * Purpose:	Perform morphological analysis on all words in a file,
+ *		reading them in batches.
+ * Parameters:	io_obj		- (i/o) where to read words,
+ *					and where to print analyses;
+ * Returns:	Exit code.
+ * Remarks:	Up to LOOKUP_BATCH words are read, and analysed
+ *		in one dictionary after another (morph_batch_dict), so that
+ *		in large automata, the words are followed together.
+ *		Analyses of each word are kept in results until all
+ *		dictionaries have been looked at. Then the words are echoed
+ *		with their analyses, as in morph_file. io_obj must not echo
+ *		words when they are read (set_echo).
+ */
+int
+morph_fsa::morph_batches(tr_io &io_obj)
+{
+  char		*words[LOOKUP_BATCH];
+  int		allocated[LOOKUP_BATCH];
+  word_list	results[LOOKUP_BATCH];
+  dict_list	*dict;
+  int		n;
+  int		more = TRUE;
+
+  for (int i = 0; i < LOOKUP_BATCH; i++)
+    words[i] = new char[allocated[i] = Max_word_len];
+  while (more) {
+    for (n = 0; n < LOOKUP_BATCH; n++)
+      if (!(more = get_word(io_obj, words[n], allocated[n], Max_word_len)))
+	break;
+    dictionary.reset();
+    for (dict = &dictionary; dict->item(); dict->next()) {
+      ANNOT_SEPARATOR = dict->item()->annot_sep;
+      set_dictionary(dict->item());
+      morph_batch_dict(words, n, results, batch_pays(dict->item()));
+    }
+    for (int i = 0; i < n; i++) {
+      io_obj.print_word(words[i]);
+      if (results[i].how_many()) {
+	io_obj.print_repls(&results[i]);
+	results[i].empty_list();
+      }
+      else
+	io_obj.print_not_found();
+    }
+  }
+  for (int i = 0; i < LOOKUP_BATCH; i++)
+    delete [] words[i];
+  return state;
+}//morph_fsa::morph_batches
+
+#ifdef MULTI_FORMAT
+/* Class name:	morph_batch_kernel
+ * Purpose:	Analyse a batch of words in an automaton with arcs
+ *		of the class made for its format.
+ * Methods:	morph_batch_kernel	- remembers the analyser and the words;
+ *		operator()		- analyses the words from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct morph_batch_kernel {
+  morph_fsa	*analyser;	/* who does the analysis */
+  char		**words;	/* words to be analysed */
+  int		n;		/* how many */
+  word_list	*results;	/* their analyses */
+  morph_batch_kernel(morph_fsa *a, char **w, const int k, word_list *r) {
+    analyser = a; words = w; n = k; results = r;
+  }
+  template <class A>
+  int operator()(A root) {
+    analyser->morph_batch(words, n, results, root);
+    return 0;
+  }
+};/* struct morph_batch_kernel */
+#endif
+
+/* Name:	morph_batch_dict
+ * Class:	morph_fsa
+ * Purpose:	Perform morphological analysis of a batch of words
+ *		in the current dictionary.
+ * Parameters:	words	- (i) words to be analysed;
+ *		n	- (i) how many (at most LOOKUP_BATCH);
+ *		results	- (i/o) analyses of the words found so far;
+ *		batch	- (i) TRUE if the words are to be followed together
+ *				(batch_pays).
+ * Returns:	Nothing.
+ * Remarks:	The same as morph_dictionary for each word, with case
+ *		conversions done as in morph_word. Words are analysed one
+ *		by one in small automata, and in automata with a sparse vector.
+ *		An uppercase word that can be converted to lowercase
+ *		is followed in lowercase in the batch, and it is analysed
+ *		once more in uppercase afterwards.
+ */
+void
+morph_fsa::morph_batch_dict(char **words, const int n, word_list *results,
+			    const int batch)
+{
+#ifdef CASECONV
+  int		converted[LOOKUP_BATCH];
+
+  for (int i = 0; i < n; i++) {
+    converted[i] = FALSE;
+    if (is_downcaseable(words[i])) {
+      // word is uppercase - convert to lowercase
+      myflipcase(words[i], -1);
+      converted[i] = *words[i];
+    }
+  }
+#endif
+  if (batch
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+      && sparse_vect == NULL
+#endif
+      ) {
+#ifdef MULTI_FORMAT
+    morph_batch_kernel kernel(this, words, n, results);
+    with_format(current_format, kernel);
+#else
+#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
+    morph_batch(words, n, results, first_node());
+#endif
+#endif
+  }
+  else
+    for (int i = 0; i < n; i++) {
+      word_length = strlen(words[i]); word_ff = words[i];
+      replacements.swap(results[i]);
+      morph_dictionary(words[i]);
+      replacements.swap(results[i]);
+    }
+#ifdef CASECONV
+  for (int i = 0; i < n; i++)
+    if (converted[i]) {
+      // convert back to uppercase
+      myflipcase(words[i], 1);
+      word_length = strlen(words[i]); word_ff = words[i];
+      replacements.swap(results[i]);
+      morph_dictionary(words[i]);
+      replacements.swap(results[i]);
+    }
+#endif
+}//morph_fsa::morph_batch_dict
+
 
 
 
@@ -97,9 +244,6 @@ int
 morph_fsa::morph_word(const char *word)
 {
   dict_list		*dict;
-#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
-  fsa_arc_ptr		*dummy = NULL;
-#endif
 #ifdef CASECONV
   int			converted = FALSE;
 #endif
@@ -117,21 +261,13 @@ morph_fsa::morph_word(const char *word)
       converted = *word;
     }
 #endif
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-    sparse_morph_next_char(word, 0, sparse_vect->get_first());
-#else
-    morph_next_char(word, 0, dummy->first_node(current_dict));
-#endif
+    morph_dictionary(word);
 #ifdef CASECONV
     if (converted) {
       // convert back to uppercase
       myflipcase((char *)word, 1);
       //*((char *)word) = casetab[(unsigned char)*word];
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-      sparse_morph_next_char(word, 0, sparse_vect->get_first());
-#else
-      morph_next_char(word, 0, dummy->first_node(current_dict));
-#endif
+      morph_dictionary(word);
     }
 #endif
   }
@@ -151,6 +287,69 @@ morph_fsa::morph_word(const char *word)
 }//morph_fsa::morph_word
 
 
+#ifdef MULTI_FORMAT
+/* Class name:	morph_kernel
+ * Purpose:	Start morphological analysis of a word in an automaton
+ *		with arcs of the class made for its format.
+ * Methods:	morph_kernel	- remembers the analyser and the word;
+ *		operator()	- analyses the word from the root
+ *				  (or from the path of the last word).
+ * Remarks:	Passed to with_format.
+ */
+struct morph_kernel {
+  morph_fsa	*analyser;	/* who does the analysis */
+  const char	*word;		/* word to be analysed */
+  int		on_path;	/* TRUE if the path of the last word is used */
+  morph_kernel(morph_fsa *a, const char *w, const int p) {
+    analyser = a; word = w; on_path = p;
+  }
+  template <class A>
+  int operator()(A root) {
+    if (on_path)
+      return analyser->morph_on_path(word, root);
+    return analyser->morph_next_char(word, 0, root);
+  }
+};/* struct morph_kernel */
+#endif
+
+
+/* Name:	morph_dictionary
+ * Class:	morph_fsa
+ * Purpose:	Perform morphological analysis of a word
+ *		in the current dictionary.
+ * Parameters:	word	- (i) word to be checked.
+ * Returns:	Number of different analyses of the word.
+ * Remarks:	With MULTI_FORMAT, the format of the dictionary is looked
+ *		at here, and the analysis is done by an instance
+ *		of the templates for that format, so that the format
+ *		is not checked for each arc.
+ *		With sorted_input, the word is looked for from where
+ *		it differs from the last one (morph_on_path).
+ */
+int
+morph_fsa::morph_dictionary(const char *word)
+{
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+  if (sparse_vect == NULL) {
+    morph_kernel kernel(this, word, sorted_input);
+    return with_format(current_format, kernel);
+  }
+#endif
+  return sparse_morph_next_char(word, 0, sparse_vect->get_first());
+#else
+#ifdef MULTI_FORMAT
+  morph_kernel kernel(this, word, sorted_input);
+  return with_format(current_format, kernel);
+#else
+  if (sorted_input)
+    return morph_on_path(word, first_node());
+  return morph_next_char(word, 0, first_node());
+#endif
+#endif
+}//morph_fsa::morph_dictionary
+
+
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 /* Name:	sparse_morph_next_char
  * Class:	morph_fsa
@@ -183,7 +382,6 @@ morph_fsa::sparse_morph_next_char(const char *word, const int level,
   int lev = level;
   long current = start;
   long next;
-  fsa_arc_ptr *dummy;
   do {
     found = false;
     if (*word == '\0') {
@@ -196,32 +394,32 @@ morph_fsa::sparse_morph_next_char(const char *word, const int level,
 	  strcpy(candidate, word_ff);
 	  candidate[lev] = ANNOT_SEPARATOR;
 	  candidate[lev + 1] = '\0';
-	  morph_rest(lev + 1, current_dict + next
+	  morph_rest(lev + 1, node_at(next
 #ifdef NUMBERS
-		     + dummy->entryl
+		     + current_format->entryl
 #endif
-		     );
+		     ));
 	}
 	else
 #endif
 	  if (morph_infixes)
-	    morph_infix(lev, current_dict + next
+	    morph_infix(lev, node_at(next
 #ifdef NUMBERS
-			+ dummy->entryl
+			+ current_format->entryl
 #endif
-			);
+			));
 	  else if (morph_prefixes)
-	    morph_prefix(0, lev, current_dict + next
+	    morph_prefix(0, lev, node_at(next
 #ifdef NUMBERS
-			 + dummy->entryl
+			 + current_format->entryl
 #endif
-			 );
+			 ));
 	  else
-	    morph_stem(0, 0, lev, current_dict + next
+	    morph_stem(0, 0, lev, node_at(next
 #ifdef NUMBERS
-			+ dummy->entryl
+			+ current_format->entryl
 #endif
-		       );
+		       ));
 #else
 #ifdef POOR_MORPH
 	if (only categories) {
@@ -230,19 +428,19 @@ morph_fsa::sparse_morph_next_char(const char *word, const int level,
 	  strcpy(candidate, word_ff);
 	  candidate[lev] = ANNOT_SEPARATOR;
 	  candidate[lev + 1] = '\0';
-	  morph_rest(lev, current_dict + next
+	  morph_rest(lev, node_at(next
 #ifdef NUMBERS
-		     + dummy->entryl
+		     + current_format->entryl
 #endif
-		     );
+		     ));
 	}
 	else {
 #endif
-	  morph_stem(lev, current_dict + next
+	  morph_stem(lev, node_at(next
 #ifdef NUMBERS
-		     + dummy->entryl
+		     + current_format->entryl
 #endif
-		     );
+		     ));
 #ifdef POOR_MORPH
 	}
 #endif
@@ -262,8 +460,10 @@ morph_fsa::sparse_morph_next_char(const char *word, const int level,
   } while (found);
   return replacements.how_many();
 }//morph_fsa::sparse_morph_next_char
+#endif //FLEXIBLE&STOPBIT&SPARSE
 
-#else //!(FLEXIBLE&STOPBIT&NEXTBIT)
+#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)) \
+    || defined(MULTI_FORMAT)
 
 /* Name:	morph_next_char
  * Class:	morph_fsa
@@ -288,19 +488,19 @@ morph_fsa::sparse_morph_next_char(const char *word, const int level,
  *		cried+Dy+Vpp means that lexeme is cry, and tags are Vpp
  *		('D' - 'A' = 3, "cried" - 3 letters at end = "cr")
  */
+template <class A>
 int
-morph_fsa::morph_next_char(const char *word, const int level,
-			   fsa_arc_ptr start)
+morph_fsa::morph_next_char(const char *word, const int level, A start)
 {
   bool found = false;
   int lev = level;
   do {
     found = false;
-    fsa_arc_ptr next_node = start.set_next_node(current_dict);
+    A next_node = start.set_next_node();
     if (*word == '\0') {
-      forallnodes(i) {
+      forallarcs(i) {
 	if (next_node.get_letter() == ANNOT_SEPARATOR) {
-	  fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	  A nxt_node = next_node.set_next_node();
 #ifdef MORPH_INFIX
 #ifdef POOR_MORPH
 	  if (only_categories) {
@@ -341,9 +541,13 @@ morph_fsa::morph_next_char(const char *word, const int level,
       }
     }
     else {
-      forallnodes(j) {
+      forallarcs(j) {
 	if (*word == next_node.get_letter()) {
-	  if (lev >= cand_alloc)
+	  const char *w0 = word;
+	  if (!match_run(word, next_node))
+	    break;
+	  lev += word - w0;
+	  while (lev >= cand_alloc)
 	    grow_string(candidate, cand_alloc, Max_word_len);
 	  word++;
 	  lev++;
@@ -356,7 +560,119 @@ morph_fsa::morph_next_char(const char *word, const int level,
   } while (found);
   return replacements.how_many();
 }//morph_fsa::morph_next_char
-#endif //!(FLEXIBLE&STOPBIT&NEXTBIT)
+
+/* Name:	morph_on_path
+ * Class:	morph_fsa
+ * Purpose:	Perform morphological analysis of a word starting from where
+ *		it differs from the last word analysed.
+ * Parameters:	word	- (i) word to look for;
+ *		root	- (i) the root of the current dictionary.
+ * Returns:	Number of different analyses of the word.
+ * Remarks:	The path of the last word (arc_path) is kept with
+ *		the dictionary, so for sorted words most nodes are looked at
+ *		only once. The word is followed as far as it goes
+ *		(morph_step), and the rest is done by morph_next_char.
+ */
+template <class A>
+int
+morph_fsa::morph_on_path(const char *word, A root)
+{
+  arc_path<A> *path = (arc_path<A> *)*current_path;
+  if (path == NULL)
+    *current_path = path = new arc_path<A>(root);
+  walk_state<A> w = path->resume(word);
+  while (morph_step(w, w.word - word))
+    path->push(w, w.word - word);
+  return morph_next_char(w.word, w.word - word, w.arc);
+}//morph_fsa::morph_on_path
+
+/* Name:	morph_step
+ * Class:	morph_fsa
+ * Purpose:	Follow the next character of a word.
+ * Parameters:	w	- (i/o) the state of the word;
+ *		level	- (i) how many characters of the word have been
+ *				followed so far.
+ * Returns:	TRUE if the character has been followed, FALSE at the end
+ *		of the word, or if there is no arc for it.
+ * Remarks:	The same as one iteration of the loop in morph_next_char
+ *		for a character of the word.
+ */
+template <class A>
+int
+morph_fsa::morph_step(walk_state<A> &w, const int level)
+{
+  const char *word = w.word;
+  int lev = level;
+
+  if (*word == '\0')
+    return FALSE;
+  A start = w.arc.set_next_node();
+  A next_node = start;
+  forallarcs(j) {
+    if (*word == next_node.get_letter()) {
+      const char *w0 = word;
+      if (!match_run(word, next_node))
+	return FALSE;
+      lev += word - w0;
+      while (lev >= cand_alloc)
+	grow_string(candidate, cand_alloc, Max_word_len);
+      w.word = word + 1;
+      w.arc = next_node;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}//morph_fsa::morph_step
+
+/* Name:	morph_batch
+ * Class:	morph_fsa
+ * Purpose:	Perform morphological analysis of a batch of words
+ *		in the current dictionary.
+ * Parameters:	words	- (i) words to be analysed;
+ *		n	- (i) how many (at most LOOKUP_BATCH);
+ *		results	- (i/o) analyses of the words found so far;
+ *		root	- (i) the root of the current dictionary.
+ * Returns:	Nothing.
+ * Remarks:	A is the class of arcs (see forallarcs). The words are
+ *		followed in turns, one node of each word at a time
+ *		(morph_step), and the target of each arc followed is asked for
+ *		(prefetch_target), as in fsa::walk_batch. Then each word
+ *		whose letters have all been followed is analysed
+ *		from where it stopped (morph_next_char), and the analyses
+ *		are added to its results. Words that left the automaton
+ *		before their end are not looked at again.
+ */
+template <class A>
+void
+morph_fsa::morph_batch(char **words, const int n, word_list *results,
+		       A root)
+{
+  walk_state<A> w[LOOKUP_BATCH];
+  int left = n;
+
+  for (int i = 0; i < n; i++) {
+    w[i].word = words[i]; w[i].arc = root; w[i].found = -1;
+  }
+  while (left > 0) {
+    for (int i = 0; i < n; i++)
+      if (w[i].found < 0) {
+	if (morph_step(w[i], w[i].word - words[i]))
+	  w[i].arc.prefetch_target();
+	else {
+	  w[i].found = (*w[i].word == '\0');
+	  left--;
+	}
+      }
+  }
+  for (int i = 0; i < n; i++)
+    if (w[i].found) {
+      word_length = strlen(words[i]); word_ff = words[i];
+      replacements.swap(results[i]);
+      morph_next_char(w[i].word, w[i].word - words[i], w[i].arc);
+      replacements.swap(results[i]);
+    }
+}//morph_fsa::morph_batch
+#endif //!(FLEXIBLE&STOPBIT&SPARSE)||MULTI_FORMAT
 
 #ifdef MORPH_INFIX
 
@@ -390,20 +706,21 @@ morph_fsa::morph_next_char(const char *word, const int level,
  *		Example:
  *		to come.
  */
+template <class A>
 int
-morph_fsa::morph_infix(const int level, fsa_arc_ptr start)
+morph_fsa::morph_infix(const int level, A start)
 {
-//  fsa_arc_ptr next_node = start.set_next_node(current_dict);
-  fsa_arc_ptr next_node = start;
+//  A next_node = start.set_next_node();
+  A next_node = start;
   int	delete_position;
 
   if (level >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
 
-  forallnodes(i) {
+  forallarcs(i) {
     if ((delete_position = (next_node.get_letter() - 'A')) >= 0 &&
 	delete_position < word_length) {
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      A nxt_node = next_node.set_next_node();
       morph_prefix(delete_position, level, nxt_node);
     }
   }
@@ -424,20 +741,21 @@ morph_fsa::morph_infix(const int level, fsa_arc_ptr start)
  * Remarks:	Class variable `replacements' is set to the list
  *		of different analyses of the word.
  */
+template <class A>
 int
 morph_fsa::morph_prefix(const int delete_position, const int level,
-			fsa_arc_ptr start)
+			A start)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   int	delete_length;
 
   if (level >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
 
-  forallnodes(i) {
+  forallarcs(i) {
     if ((delete_length = (next_node.get_letter() - 'A')) >= 0 &&
 	delete_length < word_length) {
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      A nxt_node = next_node.set_next_node();
       morph_stem(delete_length, delete_position, level, nxt_node);
     }
   }
@@ -473,21 +791,23 @@ morph_fsa::morph_prefix(const int delete_position, const int level,
  *		('D' - 'A' = 3, "cried" - 3 letters at end = "cr")
  */
 #ifdef MORPH_INFIX
+template <class A>
 int
 morph_fsa::morph_stem(const int delete_length, const int delete_position,
-		      const int level, fsa_arc_ptr start)
+		      const int level, A start)
 #else
+template <class A>
 int
-morph_fsa::morph_stem(const int level, fsa_arc_ptr start)
+morph_fsa::morph_stem(const int level, A start)
 #endif
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
   int reject_from_word;
 
   if (level >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
 
-  forallnodes(i) {
+  forallarcs(i) {
     if ((reject_from_word = (next_node.get_letter() - 'A')) >= 0 &&
 	reject_from_word <= word_length) {
 #ifdef MORPH_INFIX
@@ -520,7 +840,7 @@ morph_fsa::morph_stem(const int level, fsa_arc_ptr start)
 //	candidate[level + 1] = '\0';
 	replacements.insert_sorted(candidate);
       }
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      A nxt_node = next_node.set_next_node();
 #ifdef MORPH_INFIX
       morph_rest(level - reject_from_word - delete_length, nxt_node);
 #else
@@ -556,25 +876,41 @@ morph_fsa::morph_stem(const int level, fsa_arc_ptr start)
  *		cried+Dy+Vpp means that lexeme is cry, and tags are Vpp
  *		('D' - 'A' = 3, "cried" - 3 letters at end = "cr")
  */
+template <class A>
 int
-morph_fsa::morph_rest(const int level, fsa_arc_ptr start)
+morph_fsa::morph_rest(const int level, A start)
 {
-  fsa_arc_ptr next_node = start;
+  A next_node = start;
 
   if (level >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
 
-  if (start.arc != current_dict) {
-    forallnodes(i) {
+  if (start.arc != current_dict
+#if defined(NUMBERS) || defined(MULTI_FORMAT)
+      + current_format->entryl	// the NULL state
+#endif
+      ) {
+    forallarcs(i) {
+      int lev = level;
+      A last = next_node;
       if (!ignore_filler || next_node.get_letter() != FILLER) {
 	candidate[level] = next_node.get_letter();
       }
-      if (next_node.is_final()) {
-	candidate[level + 1] = '\0';
+      if (next_node.run_left()
+	  && (!ignore_filler
+	      || memchr(next_node.run_labels(), FILLER,
+			next_node.run_left()) == NULL)) {
+	// the following labels are in the same arc
+	while (level + next_node.run_left() + 1 >= cand_alloc)
+	  grow_string(candidate, cand_alloc, Max_word_len);
+	lev += copy_run(candidate + level + 1, last);
+      }
+      if (last.is_final()) {
+	candidate[lev + 1] = '\0';
 	replacements.insert_sorted(candidate);
       }
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
-      morph_rest(level + 1, nxt_node);
+      A nxt_node = last.set_next_node();
+      morph_rest(lev + 1, nxt_node);
     }
   }
   return replacements.how_many();
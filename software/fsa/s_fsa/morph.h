@@ -36,23 +36,40 @@ public:
 #endif /*MORPH_INFIX*/
   virtual ~morph_fsa(void) {}
   int morph_file(tr_io &io_obj);
+  int morph_batches(tr_io &io_obj);
+  void morph_batch_dict(char **words, const int n, word_list *results,
+			const int batch);
   int morph_word(const char *word);
+  int morph_dictionary(const char *word);
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   int sparse_morph_next_char(const char *word, const int level,
 			     const long start);
-#else
-  int morph_next_char(const char *word, const int level, fsa_arc_ptr start);
+#endif
+#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)) \
+    || defined(MULTI_FORMAT)
+  template <class A>
+  int morph_next_char(const char *word, const int level, A start);
+  template <class A>
+  int morph_on_path(const char *word, A root);
+  template <class A>
+  int morph_step(walk_state<A> &w, const int level);
+  template <class A>
+  void morph_batch(char **words, const int n, word_list *results, A root);
 #endif
 #ifdef MORPH_INFIX
-  int morph_infix(const int level, fsa_arc_ptr start);
-  int morph_prefix(const int delete_position, const int level,
-		   fsa_arc_ptr start);
+  template <class A>
+  int morph_infix(const int level, A start);
+  template <class A>
+  int morph_prefix(const int delete_position, const int level, A start);
+  template <class A>
   int morph_stem(const int delete_length, const int delete_position,
-		 const int level, fsa_arc_ptr start);
+		 const int level, A start);
 #else
-  int morph_stem(const int level, fsa_arc_ptr start);
+  template <class A>
+  int morph_stem(const int level, A start);
 #endif
-  int morph_rest(const int level, fsa_arc_ptr start);
+  template <class A>
+  int morph_rest(const int level, A start);
 };/*class morph_fsa*/
 
 /***	EOF morph.fsa	***/
@@ -73,6 +73,7 @@ main(const int argc, const char *argv[])
   int		only_categories = FALSE;
 #endif
   int		ignore_filler = FALSE;
+  int		sorted = FALSE;	// TRUE if words share paths (-s)
 
   set_new_handler(&not_enough_memory);
 
@@ -113,6 +114,10 @@ main(const int argc, const char *argv[])
       // dictionary contains coded prefixes
       ignore_filler = TRUE;
     }
+    else if (argv[arg_index][1] == 's') {
+      // look for words from where they differ from the previous one
+      sorted = TRUE;
+    }
 #ifdef POOR_MORPH
     else if (argv[arg_index][1] == 'A') {
       // dictionary contains no information on base forms
@@ -150,6 +155,7 @@ main(const int argc, const char *argv[])
   morph_fsa fsa_dict(ignore_filler, &dict, lang_file);
 #endif
 #endif
+  fsa_dict.set_sorted(sorted);
   if (!fsa_dict) {
     if (inputs.how_many()) {
       inputs.reset();
@@ -197,6 +203,8 @@ usage(const char *prog_name)
        << "\tand case conversions\n"
        << "\t[default: ASCII letters, standard conversions]\n"
        << "-F\t- ignore filler character (default: don't ignore)\n"
+       << "-s\t- look for words from where they differ from the previous one\n"
+       << "\t(fast for sorted input)\n"
 #ifdef MORPH_INFIX
        << "-I\t- use when dictionary contains coded infixes\n"
        << "-P\t- use when dictionary contains coded prefixes\n"
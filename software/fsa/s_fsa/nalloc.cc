@@ -0,0 +1,298 @@
+/***	nalloc.cc	***/
+
+/*	Copyright (C) Jan Daciuk, 1996-2011	*/
+
+#include	<iostream>
+#include	<stddef.h>
+#include	<stdlib.h>
+#include	<new>
+#include	"nalloc.h"
+
+using namespace std;
+
+THREAD_LOCAL node_arena	*build_arena = NULL;
+#ifdef THREADS
+__thread node_arena::arena_cache *node_arena::thread_cache = NULL;
+#endif
+
+/* Name:	node_arena
+ * Class:	node_arena
+ * Purpose:	Initializes an empty arena.
+ * Parameters:	None.
+ * Returns:	Nothing (constructor).
+ * Remarks:	No blocks are allocated until they are needed.
+ */
+node_arena::node_arena(void)
+{
+  blocks = NULL; released = false;
+  block_table[0] = NULL;
+  no_of_blocks = 1;
+  peak = 0; reserved = 0;
+  init_cache(&main_cache);
+#ifdef THREADS
+  pthread_mutex_init(&lock, NULL);
+#endif
+}//node_arena::node_arena
+
+
+/* Name:	~node_arena
+ * Class:	node_arena
+ * Purpose:	Gives all memory back to the system.
+ * Parameters:	None.
+ * Returns:	Nothing (destructor).
+ * Remarks:	Nodes and arcs still in the arena are not destroyed.
+ */
+node_arena::~node_arena(void)
+{
+  release();
+#ifdef THREADS
+  pthread_mutex_destroy(&lock);
+#endif
+}//node_arena::~node_arena
+
+
+/* Name:	init_cache
+ * Class:	node_arena
+ * Purpose:	Prepares allocation state of a thread.
+ * Parameters:	c		- (o) the state.
+ * Returns:	Nothing.
+ * Remarks:	None.
+ */
+void
+node_arena::init_cache(arena_cache *c)
+{
+  c->bump = NULL; c->left = 0;
+  for (size_t i = 0; i <= ARENA_MAX_BYTES / ARENA_UNIT; i++)
+    c->free_lists[i] = NULL;
+  for (int k = 0; k < ARENA_KINDS; k++)
+    c->allocs[k] = c->reused[k] = 0;
+  c->big_allocs = 0;
+  c->in_use = 0;
+  c->owner = this;
+}//node_arena::init_cache
+
+
+/* Name:	allocate
+ * Class:	node_arena
+ * Purpose:	Delivers memory for an object.
+ * Parameters:	size		- (i) size of the object in bytes;
+ *		kind		- (i) ARENA_NODES or ARENA_ARCS.
+ * Returns:	Pointer to memory.
+ * Remarks:	The free list for the size is tried first. If it is empty,
+ *		memory is taken from the current block. If the block
+ *		is too small, a new one is obtained; the remainder of
+ *		the old one is wasted (it is always less than ARENA_MAX_BYTES).
+ */
+void *
+node_arena::allocate(const size_t size, const int kind)
+{
+  size_t	bytes = (size + ARENA_UNIT - 1) & ~(ARENA_UNIT - 1);
+  arena_cache	*c = get_cache();
+  void		*p;
+
+  c->allocs[kind]++;
+  if (bytes > ARENA_MAX_BYTES || released) {
+    c->big_allocs++;
+    return ::operator new(size);
+  }
+  if (bytes == 0)
+    bytes = ARENA_UNIT;
+  c->in_use += bytes;
+  if (c == &main_cache && c->in_use > peak)
+    peak = c->in_use;
+
+  free_obj *f = c->free_lists[bytes / ARENA_UNIT];
+  if (f) {
+    c->reused[kind]++;
+    c->free_lists[bytes / ARENA_UNIT] = f->next;
+    return f;
+  }
+
+  if (bytes > c->left)
+    new_block(c);
+  p = c->bump;
+  c->bump += bytes;
+  c->left -= bytes;
+  return p;
+}//node_arena::allocate
+
+
+/* Name:	new_block
+ * Class:	node_arena
+ * Purpose:	Obtains a new block of memory from the system.
+ * Parameters:	c		- (i/o) allocation state of the thread.
+ * Returns:	Nothing.
+ * Remarks:	The block is aligned on its size, and it gets the next
+ *		number. The program stops if the indices would not fit
+ *		in 32 bits.
+ */
+void
+node_arena::new_block(arena_cache *c)
+{
+  void		*m;
+  block_hdr	*b;
+
+  if (posix_memalign(&m, ARENA_BLOCK_SIZE, ARENA_BLOCK_SIZE) != 0)
+    throw bad_alloc();
+  b = (block_hdr *)m;
+#ifdef THREADS
+  pthread_mutex_lock(&lock);
+#endif
+  if (no_of_blocks >= ARENA_MAX_BLOCKS) {
+    cerr << "Too many nodes: more than " << ARENA_MAX_BLOCKS - 1
+	 << " blocks of " << ARENA_BLOCK_SIZE << " bytes needed" << endl;
+    exit(23);
+  }
+  b->number = no_of_blocks;
+  block_table[no_of_blocks++] = (char *)b;
+  b->next = blocks;
+  blocks = b;
+  reserved += ARENA_BLOCK_SIZE;
+#ifdef THREADS
+  pthread_mutex_unlock(&lock);
+#endif
+  c->bump = (char *)b + sizeof(block_hdr);
+  c->left = ARENA_BLOCK_SIZE - sizeof(block_hdr);
+}//node_arena::new_block
+
+
+/* Name:	deallocate
+ * Class:	node_arena
+ * Purpose:	Takes back memory of an object.
+ * Parameters:	p		- (i) the object;
+ *		size		- (i) its size in bytes (as given to allocate);
+ *		kind		- (i) ARENA_NODES or ARENA_ARCS.
+ * Returns:	Nothing.
+ * Remarks:	The memory is put on the free list for its size.
+ *		After release(), nothing is done, as the object may lie
+ *		in a block that has already been given back.
+ */
+void
+node_arena::deallocate(void *p, const size_t size, const int kind)
+{
+  size_t	bytes = (size + ARENA_UNIT - 1) & ~(ARENA_UNIT - 1);
+  arena_cache	*c;
+
+  if (p == NULL || released)
+    return;
+  if (bytes > ARENA_MAX_BYTES) {
+    ::operator delete(p);
+    return;
+  }
+  if (bytes == 0)
+    bytes = ARENA_UNIT;
+  c = get_cache();
+  c->in_use -= bytes;
+  free_obj *f = (free_obj *)p;
+  f->next = c->free_lists[bytes / ARENA_UNIT];
+  c->free_lists[bytes / ARENA_UNIT] = f;
+}//node_arena::deallocate
+
+
+/* Name:	release
+ * Class:	node_arena
+ * Purpose:	Gives all blocks back to the system.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	All nodes and arcs become invalid. No destructors are called.
+ *		No other thread may use the arena at that time.
+ */
+void
+node_arena::release(void)
+{
+  block_hdr	*b;
+
+  while ((b = blocks) != NULL) {
+    blocks = b->next;
+    free(b);
+  }
+  no_of_blocks = 1;
+  main_cache.bump = NULL; main_cache.left = 0;
+  for (size_t i = 0; i <= ARENA_MAX_BYTES / ARENA_UNIT; i++)
+    main_cache.free_lists[i] = NULL;
+  main_cache.in_use = 0;
+  released = true;
+}//node_arena::release
+
+
+#ifdef THREADS
+/* Name:	attach_thread
+ * Class:	node_arena
+ * Purpose:	Gives the calling thread its own allocation state.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	It must be called by each thread other than the main one
+ *		before it creates any nodes.
+ */
+void
+node_arena::attach_thread(void)
+{
+  thread_cache = new arena_cache;
+  init_cache(thread_cache);
+}//node_arena::attach_thread
+
+
+/* Name:	detach_thread
+ * Class:	node_arena
+ * Purpose:	Gives the allocation state of the calling thread
+ *		to the main thread.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	Free lists are appended to those of the main thread.
+ *		What is left in the current block of the thread is wasted.
+ */
+void
+node_arena::detach_thread(void)
+{
+  arena_cache	*c = thread_cache;
+  free_obj	*f;
+
+  if (c == NULL)
+    return;
+  pthread_mutex_lock(&lock);
+  for (size_t i = 0; i <= ARENA_MAX_BYTES / ARENA_UNIT; i++) {
+    if ((f = c->free_lists[i]) != NULL) {
+      while (f->next)
+	f = f->next;
+      f->next = main_cache.free_lists[i];
+      main_cache.free_lists[i] = c->free_lists[i];
+    }
+  }
+  for (int k = 0; k < ARENA_KINDS; k++) {
+    main_cache.allocs[k] += c->allocs[k];
+    main_cache.reused[k] += c->reused[k];
+  }
+  main_cache.big_allocs += c->big_allocs;
+  main_cache.in_use += c->in_use;
+  if (main_cache.in_use > peak)
+    peak = main_cache.in_use;
+  pthread_mutex_unlock(&lock);
+  thread_cache = NULL;
+  delete c;
+}//node_arena::detach_thread
+#endif
+
+
+/* Name:	show_stats
+ * Class:	node_arena
+ * Purpose:	Prints allocation statistics.
+ * Parameters:	os		- (o) where to print.
+ * Returns:	Nothing.
+ * Remarks:	None.
+ */
+void
+node_arena::show_stats(ostream &os) const
+{
+  os << "Allocated " << main_cache.allocs[ARENA_NODES] << " nodes ("
+     << main_cache.reused[ARENA_NODES] << " reused) and "
+     << main_cache.allocs[ARENA_ARCS] << " arc vectors ("
+     << main_cache.reused[ARENA_ARCS] << " reused)" << endl
+     << "Peak memory in use: " << peak << " bytes in "
+     << reserved / ARENA_BLOCK_SIZE << " blocks of " << ARENA_BLOCK_SIZE
+     << " bytes";
+  if (main_cache.big_allocs)
+    os << ", " << main_cache.big_allocs << " big objects";
+  os << endl;
+}//node_arena::show_stats
+
+/***	EOF nalloc.cc	***/
@@ -0,0 +1,179 @@
+/***	nalloc.h	***/
+
+/*	Copyright (C) Jan Daciuk, 1996-2011	*/
+
+#ifndef		NALLOC_H
+#define		NALLOC_H
+
+#include	<stddef.h>
+#include	<stdint.h>
+#include	<iostream>
+#ifdef THREADS
+#include	<pthread.h>
+#endif
+
+using namespace std;
+
+/* Variables that each thread has its own copy of */
+#ifdef THREADS
+#define	THREAD_LOCAL	__thread
+#else
+#define	THREAD_LOCAL
+#endif
+
+/* Kinds of objects allocated in the arena (for statistics only) */
+enum { ARENA_NODES, ARENA_ARCS, ARENA_KINDS };
+
+/* Size of a block of memory obtained from the system (log2);
+   blocks are aligned on their size */
+const int	ARENA_BLOCK_BITS = 20;
+const size_t	ARENA_BLOCK_SIZE = (size_t)1 << ARENA_BLOCK_BITS;
+/* Allocation granularity (and alignment) (log2) */
+const int	ARENA_UNIT_BITS = 3;
+const size_t	ARENA_UNIT = (size_t)1 << ARENA_UNIT_BITS;
+/* Largest object kept in the arena; bigger ones go to operator new */
+const size_t	ARENA_MAX_BYTES = 8192;
+/* An index of an object has the block number in its upper bits,
+   and the offset in the block (in units) in the lower ones */
+const int	ARENA_OFFSET_BITS = ARENA_BLOCK_BITS - ARENA_UNIT_BITS;
+const unsigned long	ARENA_MAX_BLOCKS = 1UL << (32 - ARENA_OFFSET_BITS);
+
+/* Class name:	node_arena
+ * Purpose:	Provide memory for nodes and vectors of arcs during
+ *		construction of an automaton.
+ * Methods:	node_arena	- initialize an empty arena;
+ *		~node_arena	- give all memory back;
+ *		allocate	- get memory for an object;
+ *		deallocate	- return memory of an object;
+ *		release		- return all memory to the system;
+ *		show_stats	- print allocation statistics;
+ *		index_of	- 32-bit index of an object in the arena;
+ *		address_of	- address of an object with given index;
+ *		attach_thread	- let the calling thread allocate on its own;
+ *		detach_thread	- end that.
+ * Remarks:	Memory is taken from big blocks by moving a pointer.
+ *		Freed objects are kept on lists, one for each size
+ *		(rounded up to ARENA_UNIT), and reused by later allocations
+ *		of the same size. Nodes and vectors of arcs grow one arc
+ *		at a time, so this is much cheaper than the general
+ *		operator new, and it does not fragment the heap.
+ *		Blocks are given back only by release(), which is called
+ *		when the automaton has been written. Memory freed after that
+ *		(e.g. by destructors of static objects) is not touched,
+ *		and objects allocated after that come from operator new
+ *		and are never freed.
+ *
+ *		Blocks are numbered from 1 and aligned on their size,
+ *		so that the number can be found in the header of the block.
+ *		Entry 0 of block_table is NULL, so that index 0 gives NULL
+ *		without a test. Only objects allocated in blocks
+ *		(before release()) have indices.
+ *
+ *		Each automaton being built has its own arena (in its
+ *		build_context). Nodes and arcs are allocated in the arena
+ *		pointed to by build_arena, which is set for the thread
+ *		when it starts working on the automaton.
+ *
+ *		With THREADS, a thread that builds a part of the automaton
+ *		calls attach_thread() first. It then gets its own current
+ *		block and free lists, so that only getting a new block
+ *		needs a lock. The state belongs to the arena the thread
+ *		has been attached to; other arenas use their main state.
+ *		detach_thread() gives its free lists
+ *		and statistics to the main thread. Objects may be freed
+ *		by a different thread than the one that allocated them.
+ */
+class node_arena {
+private:
+  struct free_obj {
+    free_obj	*next;
+  };
+  struct block_hdr {
+    block_hdr	*next;
+    unsigned long number;	// position in block_table
+  };
+  struct arena_cache {		// what a thread allocates from
+    char	*bump;		// free space in the current block
+    size_t	left;		// bytes left in the current block
+    free_obj	*free_lists[ARENA_MAX_BYTES / ARENA_UNIT + 1];
+    long	allocs[ARENA_KINDS];	// number of allocations
+    long	reused[ARENA_KINDS];	// ... satisfied from free lists
+    long	big_allocs;	// allocations outside blocks
+    long	in_use;		// bytes in live objects
+    node_arena	*owner;		// arena the state belongs to
+  };
+  arena_cache	main_cache;	// used by the main thread
+#ifdef THREADS
+  static __thread arena_cache *thread_cache; // used by other threads
+  pthread_mutex_t lock;		// for blocks
+#endif
+  block_hdr	*blocks;	// all blocks obtained so far
+  unsigned long	no_of_blocks;	// number of blocks (+1 for NULL)
+  char		*block_table[ARENA_MAX_BLOCKS]; // block addresses
+  bool		released;	// release() has been called
+  long		peak;		// maximal value of in_use
+  size_t	reserved;	// bytes in blocks
+  void new_block(arena_cache *c);
+  void init_cache(arena_cache *c);
+  arena_cache *get_cache(void) {
+#ifdef THREADS
+    if (thread_cache && thread_cache->owner == this)
+      return thread_cache;
+#endif
+    return &main_cache;
+  }
+public:
+  node_arena(void);
+  ~node_arena(void);
+  void *allocate(const size_t size, const int kind);
+  void deallocate(void *p, const size_t size, const int kind);
+  void release(void);
+  void show_stats(ostream &os) const;
+  uint32_t index_of(const void *p) const {
+    if (p == NULL)
+      return 0;
+    const block_hdr *b =
+      (const block_hdr *)((size_t)p & ~(ARENA_BLOCK_SIZE - 1));
+    return (uint32_t)((b->number << ARENA_OFFSET_BITS) |
+		      (((const char *)p - (const char *)b) >> ARENA_UNIT_BITS));
+  }
+  void *address_of(const uint32_t i) const {
+    return block_table[i >> ARENA_OFFSET_BITS]
+      + ((size_t)(i & ((1U << ARENA_OFFSET_BITS) - 1)) << ARENA_UNIT_BITS);
+  }
+#ifdef THREADS
+  void attach_thread(void);
+  void detach_thread(void);
+#endif
+};//node_arena
+
+/* The arena of the automaton the thread is building */
+extern THREAD_LOCAL node_arena	*build_arena;
+
+#ifdef NODE_INDICES
+/* Class name:	arena_ref
+ * Purpose:	Provide a 32-bit reference to an object in the arena
+ *		of the automaton being built.
+ * Methods:	operator T *	- address of the object;
+ *		operator ->	- member access;
+ *		operator =	- set the reference;
+ *		get_index	- the index itself.
+ * Remarks:	It is used instead of a pointer in nodes and arcs,
+ *		so that arc_node takes 8 bytes instead of 16 on 64-bit
+ *		machines. It has no constructors, so that arc_node
+ *		can be copied with memcpy.
+ */
+template <class T>
+class arena_ref {
+  uint32_t	i;
+public:
+  operator T *() const { return (T *)build_arena->address_of(i); }
+  T *operator->() const { return (T *)build_arena->address_of(i); }
+  arena_ref &operator=(T *p) { i = build_arena->index_of(p); return *this; }
+  uint32_t get_index(void) const { return i; }
+};//arena_ref
+#endif //NODE_INDICES
+
+#endif
+
+/***	EOF nalloc.h	***/
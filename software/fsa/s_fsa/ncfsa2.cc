@@ -0,0 +1,544 @@
+/***	ncfsa2.cc	***/
+
+/*	Copyright (C) Jan Daciuk, 1996-2011	*/
+
+#include	<iostream>
+#include	<vector>
+#include	<algorithm>
+#include	<utility>
+#include	<string.h>
+#include	"fsa.h"
+#include	"nnode.h"
+#include	"ncfsa2.h"
+
+using namespace std;
+
+#ifdef CFSA2
+
+/* Name:	cfsa2_writer
+ * Class:	cfsa2_writer
+ * Purpose:	Collects states and arcs of the automaton.
+ * Parameters:	root		- (i) root of the automaton;
+ *		make_numbers	- (i) whether to write the number of strings
+ *				  recognized from each state (perfect hashing);
+ *		version		- (i) CFSA2_VERSION, RCFSA2_VERSION,
+ *				  or SCFSA2_VERSION.
+ * Returns:	Nothing (constructor).
+ * Remarks:	The automaton must be built and minimal. Nodes get
+ *		numbers of states in arc_no, so it cannot be written
+ *		in another format afterwards.
+ *		String arcs (SCFSA2) are made by linearize.
+ */
+cfsa2_writer::cfsa2_writer(node *root, const int make_numbers,
+			   const int version)
+{
+  with_numbers = make_numbers;
+  relative = (version != CFSA2_VERSION);
+  strings = (version == SCFSA2_VERSION);
+  root_state = (root->get_no_of_kids() ? collect(root) : -1);
+  first_arc.push_back(labels.size());
+  joined.assign(numbers.size(), 0);
+}//cfsa2_writer::cfsa2_writer
+
+
+/* Name:	collect
+ * Class:	cfsa2_writer
+ * Purpose:	Collects states and arcs reachable from a node.
+ * Parameters:	n		- (i) the node.
+ * Returns:	The number of the state of the node.
+ * Remarks:	Children are collected before their parents, so the number
+ *		of strings recognized from a state can be computed
+ *		when it is collected. Nodes without children are not
+ *		states; arcs leading to them have no target.
+ *		Arc_no is -1 for nodes that have not been numbered.
+ */
+int
+cfsa2_writer::collect(node *n)
+{
+  arc_node	*p;
+  node		*c;
+  int		kids = n->get_no_of_kids();
+  int		target;
+  int		number = 0;
+
+  if (n->get_arc_no() != -1)
+    return n->get_arc_no();
+  p = n->get_children();
+  for (int i = 0; i < kids; i++, p++)
+    if ((c = p->child) != NULL && c->get_no_of_kids())
+      collect(c);
+  first_arc.push_back(labels.size());
+  p = n->get_children();
+  for (int i = 0; i < kids; i++, p++) {
+    c = p->child;
+    target = (c != NULL && c->get_no_of_kids() ? c->get_arc_no() : -1);
+    labels.push_back((unsigned char)p->letter);
+    flags.push_back((p->is_final ? CFSA2_FINAL_ARC : 0) |
+		    (i == kids - 1 ? CFSA2_LAST_ARC : 0));
+    targets.push_back(target);
+    number += (p->is_final ? 1 : 0) + (target >= 0 ? numbers[target] : 0);
+  }
+  numbers.push_back(number);
+  n->set_arc_no(numbers.size() - 1);
+  return n->get_arc_no();
+}//cfsa2_writer::collect
+
+
+/* Name:	make_strings
+ * Class:	cfsa2_writer
+ * Purpose:	Joins chains of states into string arcs.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	A state with one arc and one incoming arc can be joined
+ *		with the arc leading to it, unless that arc is final,
+ *		so that arc gets the labels of the state, and its target.
+ *		Such states form chains that begin with arcs of other
+ *		states. Labels of a string are not in the label table,
+ *		and a string arc takes two more bytes than an arc,
+ *		so a chain is joined only when at least two of its labels
+ *		are not in the table, or when states have numbers.
+ *		This does not take into account that the label table
+ *		of SCFSA2 is one label shorter, nor changes of addresses,
+ *		so linearize decides whether string arcs are kept.
+ *		Joined states are no longer targets of arcs,
+ *		so they are not written.
+ */
+void
+cfsa2_writer::make_strings(void)
+{
+  vector<int>	inlinks(numbers.size(), 0);
+  vector<int>	parent(numbers.size(), -1);	// arc leading to a state
+  unsigned char	bytes[CFSA2_VINT_MAX];
+  int		t, b, n, gain;
+
+  run_length.assign(targets.size(), 0);
+  run_first.assign(targets.size(), 0);
+  for (unsigned int s = 0; s < numbers.size(); s++)
+    for (int a = first_arc[s]; a < first_arc[s + 1]; a++)
+      if ((t = targets[a]) >= 0) {
+	inlinks[t]++;
+	parent[t] = a;
+      }
+  for (unsigned int s = 0; s < numbers.size(); s++)
+    if (inlinks[s] != 1 || first_arc[s + 1] - first_arc[s] != 1)
+      parent[s] = -1;		// cannot be joined
+    else if (flags[parent[s]] & CFSA2_FINAL_ARC)
+      parent[s] = -1;
+  for (unsigned int s = 0; s < numbers.size(); s++) {
+    if (parent[s] >= 0)
+      continue;			// in the middle of a chain
+    for (int a = first_arc[s]; a < first_arc[s + 1]; a++) {
+      gain = (label_index[labels[a]] == 0) - 2;
+      n = 0;
+      for (b = a; (t = targets[b]) >= 0 && parent[t] >= 0
+	     && n + 2 <= CFSA2_MAX_STRING; n++) {
+	b = first_arc[t];
+	gain += (label_index[labels[b]] == 0)
+	  + (with_numbers ? put_vint(bytes, numbers[t]) : 0);
+      }
+      if (n == 0 || gain < 0)
+	continue;
+      run_first[a] = run_labels.size();
+      run_length[a] = n;
+      for (b = a; n > 0; n--) {
+	t = targets[b];
+	b = first_arc[t];
+	run_labels.push_back(labels[b]);
+	joined[t] = 1;
+      }
+      flags[a] |= flags[b] & CFSA2_FINAL_ARC;
+      targets[a] = targets[b];
+    }
+  }
+}//cfsa2_writer::make_strings
+
+
+/* Name:	make_label_table
+ * Class:	cfsa2_writer
+ * Purpose:	Chooses labels that are written as indices in flags of arcs.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	Those are the CFSA2_LABELS most frequent labels. The most
+ *		frequent label gets the highest index, and labels
+ *		with the same frequency are taken in the order of codes,
+ *		as in morfologik. In SCFSA2, the last index is kept
+ *		for string arcs, and their labels are not counted.
+ */
+void
+cfsa2_writer::make_label_table(void)
+{
+  int		count[256];
+  vector<pair<int, int> > by_count;	// (-frequency, label)
+
+  memset(count, 0, sizeof count);
+  for (unsigned int s = 0; s < joined.size(); s++)
+    if (!joined[s])
+      for (int a = first_arc[s]; a < first_arc[s + 1]; a++)
+	if (run_length.empty() || run_length[a] == 0)
+	  count[labels[a]]++;
+  for (int l = 0; l < 256; l++) {
+    label_index[l] = 0;
+    if (count[l])
+      by_count.push_back(make_pair(-count[l], l));
+  }
+  sort(by_count.begin(), by_count.end());
+  table_size = 1 + min((int)by_count.size(),
+		       strings ? CFSA2_STRING_ARC - 1 : CFSA2_LABELS);
+  label_table[0] = 0;
+  for (int i = 1; i < table_size; i++) {
+    label_table[table_size - i] = (unsigned char)by_count[i - 1].second;
+    label_index[by_count[i - 1].second] = table_size - i;
+  }
+}//cfsa2_writer::make_label_table
+
+
+/* Name:	order_states
+ * Class:	cfsa2_writer
+ * Purpose:	Puts states in the order in which they are written.
+ * Parameters:	first_states	- (i) states to be put first;
+ *		how_many	- (i) how many of them are put first.
+ * Returns:	Nothing.
+ * Remarks:	The remaining states are put in the order of a depth-first
+ *		traversal that begins in the root. Targets of arcs of a state
+ *		are put on a stack in the order of arcs, so the target
+ *		of the last arc is taken next, and that arc needs no address.
+ *		Targets of states put first wait on the stack below the root.
+ */
+void
+cfsa2_writer::order_states(const vector<int> &first_states,
+			   const int how_many)
+{
+  vector<char>	placed(numbers.size(), 0);
+  vector<int>	stack;
+  int		s;
+
+  order.clear();
+  for (int i = 0; i <= how_many; i++) {
+    if (i < how_many) {
+      if (placed[first_states[i]])
+	continue;
+      stack.push_back(first_states[i]);
+    }
+    else if (root_state >= 0)
+      stack.push_back(root_state);
+    while (!stack.empty()) {
+      s = stack.back();
+      stack.pop_back();
+      if (placed[s])
+	continue;
+      placed[s] = 1;
+      order.push_back(s);
+      for (int a = first_arc[s]; a < first_arc[s + 1]; a++)
+	if (targets[a] >= 0 && !placed[targets[a]])
+	  stack.push_back(targets[a]);
+      if (i < how_many)
+	break;			// only that state is put first
+    }
+  }
+}//cfsa2_writer::order_states
+
+
+/* Name:	set_addresses
+ * Class:	cfsa2_writer
+ * Purpose:	Computes addresses of states in the current order.
+ * Parameters:	None.
+ * Returns:	Size of the automaton (without the header) in bytes.
+ * Remarks:	The length of an address depends on addresses, so addresses
+ *		and their lengths are computed in turn until lengths
+ *		do not change. In CFSA2, lengths start from 1 and only grow.
+ *		In RCFSA2, a target may be reached with a distance
+ *		that gets longer when other addresses get shorter, so lengths
+ *		start from CFSA2_VINT_MAX and only get smaller: when they do,
+ *		no state gets farther from the beginning of the file
+ *		or from another state. The arc leading to the root
+ *		is the last one in addr_len.
+ */
+long int
+cfsa2_writer::set_addresses(void)
+{
+  long int	size;
+
+  address.assign(numbers.size(), 0);
+  addr_len.assign(targets.size() + 1, relative ? CFSA2_VINT_MAX : 1);
+  do {
+    size = put_states(NULL, FALSE);
+    lengths_changed = FALSE;
+    put_states(NULL, TRUE);
+  } while (lengths_changed);
+  return size;
+}//cfsa2_writer::set_addresses
+
+
+/* Name:	put_states
+ * Class:	cfsa2_writer
+ * Purpose:	Computes the size of the automaton, and puts it into
+ *		the image.
+ * Parameters:	image		- (o) where the automaton is put;
+ *				  NULL if it is not put;
+ *		set_lengths	- (i) if the automaton is not put, whether
+ *				  lengths of addresses are set
+ *				  (otherwise addresses of states are set).
+ * Returns:	Size of the automaton (without the header) in bytes.
+ * Remarks:	The first state (at address 0) has one arc to the root.
+ */
+long int
+cfsa2_writer::put_states(fsa_image *image, const int set_lengths)
+{
+  unsigned char	bytes[CFSA2_VINT_MAX];
+  long int	pos = 0L;
+  int		s, next_state, arc_flags, n;
+
+  if (with_numbers) {
+    n = put_vint(bytes, 0);
+    if (image)
+      image->put((char *)bytes, n);
+    pos += n;
+  }
+  pos += put_arc(image, set_lengths, CFSA2_LAST_ARC, START_CHAR,
+		 root_state >= 0 ? address[root_state] : 0, pos, targets.size());
+  for (unsigned int i = 0; i < order.size(); i++) {
+    s = order[i];
+    next_state = (i + 1 < order.size() ? order[i + 1] : -1);
+    if (image == NULL && !set_lengths)
+      address[s] = pos;
+    if (with_numbers) {
+      n = put_vint(bytes, numbers[s]);
+      if (image)
+	image->put((char *)bytes, n);
+      pos += n;
+    }
+    for (int a = first_arc[s]; a < first_arc[s + 1]; a++) {
+      arc_flags = flags[a];
+      if ((arc_flags & CFSA2_LAST_ARC) && targets[a] >= 0
+	  && targets[a] == next_state)
+	arc_flags |= CFSA2_TARGET_NEXT;
+      pos += put_arc(image, set_lengths, arc_flags, labels[a],
+		     targets[a] >= 0 ? address[targets[a]] : 0, pos, a);
+    }
+  }
+  return pos;
+}//cfsa2_writer::put_states
+
+
+/* Name:	put_arc
+ * Class:	cfsa2_writer
+ * Purpose:	Puts an arc into the image.
+ * Parameters:	image		- (o) where the arc is put (or NULL);
+ *		set_length	- (i) if the arc is not put, whether the length
+ *				  of its address is set;
+ *		arc_flags	- (i) flags of the arc;
+ *		label		- (i) label of the arc;
+ *		target_address	- (i) address of the target state
+ *				  (0 if there is none);
+ *		arc_address	- (i) address of the arc;
+ *		a		- (i) number of the arc in addr_len.
+ * Returns:	Size of the arc in bytes (with the length of its address
+ *		in addr_len when the arc is not put).
+ * Remarks:	In RCFSA2, the target address is written as 2*address,
+ *		or the distance d from the arc as 4*d+1 (d >= 0)
+ *		or -4*d-1 (d < 0), whichever is smaller.
+ *		In SCFSA2, the labels of a string arc follow its flags.
+ */
+int
+cfsa2_writer::put_arc(fsa_image *image, const int set_length,
+		      const int arc_flags, const int label,
+		      const int target_address, const int arc_address,
+		      const int a)
+{
+  unsigned char	bytes[2 + CFSA2_MAX_STRING + CFSA2_VINT_MAX];
+  int		n = 1;
+  int		index = label_index[(unsigned char)label];
+  int		distance = target_address - arc_address;
+  unsigned int	code;		// what is written as the address
+  int		len;
+
+  if (strings && a < (int)targets.size() && run_length[a]) {
+    bytes[0] = (unsigned char)(arc_flags | CFSA2_STRING_ARC);
+    bytes[n++] = (unsigned char)(1 + run_length[a]);
+    bytes[n++] = (unsigned char)label;
+    memcpy(bytes + n, &run_labels[run_first[a]], run_length[a]);
+    n += run_length[a];
+  }
+  else {
+    bytes[0] = (unsigned char)(arc_flags | index);
+    if (index == 0)
+      bytes[n++] = (unsigned char)label;
+  }
+  if ((arc_flags & CFSA2_TARGET_NEXT) == 0) {
+    if (image == NULL && !set_length)
+      return n + addr_len[a];
+    if (relative) {
+      code = (distance >= 0 ? 4 * distance + 1 : -4 * distance - 1);
+      if (target_address == 0 || code > 2 * (unsigned int)target_address)
+	code = 2 * target_address;
+    }
+    else
+      code = target_address;
+    len = put_vint(bytes + n, code);
+    if (image == NULL) {
+      // the arc keeps its place until addresses are computed again
+      n += addr_len[a];
+      if (len != addr_len[a]) {
+	addr_len[a] = len;
+	lengths_changed = TRUE;
+      }
+      return n;
+    }
+    n += len;
+  }
+  if (image)
+    image->put((char *)bytes, n);
+  return n;
+}//cfsa2_writer::put_arc
+
+
+/* Name:	linearize
+ * Class:	cfsa2_writer
+ * Purpose:	Chooses the order of states in the file, and in SCFSA2,
+ *		whether arcs have strings.
+ * Parameters:	None.
+ * Returns:	Size of the automaton (without the header) in bytes.
+ * Remarks:	In SCFSA2, states are put in order both without and with
+ *		string arcs (make_strings), and the smaller automaton
+ *		(with its label table) is kept. An automaton without string
+ *		arcs is written as RCFSA2, as its label table is longer.
+ */
+long int
+cfsa2_writer::linearize(void)
+{
+  vector<unsigned char>	plain_flags;
+  vector<int>		plain_targets;
+  vector<int>		plain_order;
+  long int		size, plain_size;
+
+  if (!strings) {
+    make_label_table();
+    return place_states();
+  }
+  strings = FALSE;		// first as RCFSA2
+  make_label_table();
+  plain_size = table_size + place_states();
+  plain_order = order;
+  plain_flags = flags;
+  plain_targets = targets;
+  strings = TRUE;
+  make_label_table();
+  make_strings();
+  make_label_table();		// without labels of strings
+  size = table_size + place_states();
+  if (size <= plain_size)
+    return size - table_size;
+  cerr << "String arcs do not make the automaton smaller. "
+       << "It is written as RCFSA2" << endl;
+  strings = FALSE;
+  flags.swap(plain_flags);
+  targets.swap(plain_targets);
+  joined.assign(numbers.size(), 0);
+  run_length.clear();
+  make_label_table();
+  order.swap(plain_order);
+  return set_addresses();
+}//cfsa2_writer::linearize
+
+
+/* Name:	place_states
+ * Class:	cfsa2_writer
+ * Purpose:	Chooses the order of states in the file.
+ * Parameters:	None.
+ * Returns:	Size of the automaton (without the header) in bytes.
+ * Remarks:	States with at least two incoming arcs are candidates
+ *		for being put first, those with more incoming arcs before
+ *		others. The size of the automaton does not change
+ *		monotonically with the number of such states, so
+ *		the number is doubled while the automaton gets smaller,
+ *		and then the best one found is taken.
+ */
+long int
+cfsa2_writer::place_states(void)
+{
+  vector<int>	inlinks(numbers.size(), 0);
+  vector<pair<int, int> > by_inlinks;	// (-incoming arcs, state)
+  vector<int>	candidates;
+  long int	size, best_size;
+  int		best = 0;
+  int		worse = 0;
+
+  for (unsigned int a = 0; a < targets.size(); a++)
+    if (targets[a] >= 0)
+      inlinks[targets[a]]++;
+  for (unsigned int s = 0; s < inlinks.size(); s++)
+    if (inlinks[s] >= 2)
+      by_inlinks.push_back(make_pair(-inlinks[s], (int)s));
+  sort(by_inlinks.begin(), by_inlinks.end());
+  for (unsigned int c = 0; c < by_inlinks.size(); c++)
+    candidates.push_back(by_inlinks[c].second);
+
+  order_states(candidates, 0);
+  best_size = set_addresses();
+#ifdef PROGRESS
+  cerr << "States put first: 0, size: " << best_size << endl;
+#endif
+  for (int n = 16; worse < 2; n *= 2) {
+    if (n > (int)candidates.size())
+      n = candidates.size();
+    order_states(candidates, n);
+    size = set_addresses();
+#ifdef PROGRESS
+    cerr << "States put first: " << n << ", size: " << size << endl;
+#endif
+    if (size < best_size) {
+      best_size = size;
+      best = n;
+      worse = 0;
+    }
+    else
+      worse++;
+    if (n == (int)candidates.size())
+      break;
+  }
+  order_states(candidates, best);
+  return set_addresses();
+}//cfsa2_writer::place_states
+
+
+/* Name:	write
+ * Class:	cfsa2_writer
+ * Purpose:	Writes the automaton.
+ * Parameters:	outfile		- (o) where to write it.
+ * Returns:	TRUE if the automaton has been written, FALSE otherwise.
+ * Remarks:	States must be put in order first (linearize).
+ *		The automaton is put together in memory, and written
+ *		with a single call.
+ */
+int
+cfsa2_writer::write(ostream &outfile)
+{
+  unsigned char	header[8];
+  int		fsa_flags = CFSA2_FLEXIBLE | CFSA2_STOPBIT | CFSA2_NEXTBIT
+    | (with_numbers ? CFSA2_NUMBERS : 0);
+  long int	size = put_states(NULL, FALSE);	// addresses do not change
+  fsa_image	image(size);
+
+  header[0] = '\\';
+  header[1] = 'f';
+  header[2] = 's';
+  header[3] = 'a';
+  header[4] = (unsigned char)(strings ? SCFSA2_VERSION
+			      : relative ? RCFSA2_VERSION : CFSA2_VERSION);
+  header[5] = (unsigned char)(fsa_flags >> 8);
+  header[6] = (unsigned char)(fsa_flags & 0xff);
+  header[7] = (unsigned char)table_size;
+  if (put_states(&image, FALSE) != size || image.get_size() != size) {
+    cerr << "Internal error: the automaton is larger than "
+	 << size << " bytes" << endl;
+    return FALSE;
+  }
+  if (!outfile.write((char *)header, sizeof header)
+      || !outfile.write((char *)label_table, table_size))
+    return FALSE;
+  return image.write(outfile);
+}//cfsa2_writer::write
+
+#endif //CFSA2
+
+/***	EOF ncfsa2.cc	***/
@@ -0,0 +1,98 @@
+/***	ncfsa2.h	***/
+
+/*	Copyright (C) Jan Daciuk, 1996-2011	*/
+
+#ifndef		NCFSA2_H
+#define		NCFSA2_H
+
+#ifdef CFSA2
+#include	<vector>
+
+using namespace std;
+
+/* Class name:	cfsa2_writer
+ * Purpose:	Write an automaton in the CFSA2 format of morfologik,
+ *		or in RCFSA2 or SCFSA2 (see fsa.h).
+ * Methods:	cfsa2_writer	- collect states and arcs of the automaton;
+ *		linearize	- choose the order of states in the file,
+ *				  and whether arcs have strings;
+ *		write		- write the automaton;
+ *		collect		- collect states reachable from a node;
+ *		make_strings	- join chains of states into string arcs;
+ *		make_label_table
+ *				- choose labels for the label table;
+ *		order_states	- put states in order for given first states;
+ *		place_states	- choose how many states are put first;
+ *		set_addresses	- compute addresses of states in that order;
+ *		put_states	- compute the size of the automaton,
+ *				  and possibly put it into the image;
+ *		put_arc		- put one arc into the image.
+ * Remarks:	Nodes are numbered in postorder (the number is kept
+ *		in arc_no), and their arcs are copied to vectors, so that
+ *		states can be put in many orders without going through nodes.
+ *		Arcs of big brothers (-O) are not used, as all arcs
+ *		of a state follow one another in CFSA2.
+ *
+ *		The target of the last arc of a state need not be stored
+ *		if that target is the next state in the file, and the address
+ *		of a state takes fewer bytes when the state is near
+ *		the beginning of the file. States are put in the order
+ *		of a depth-first traversal in which the target of the last
+ *		arc of a state is taken next, but some states with many
+ *		incoming arcs are put first. How many of them are put first
+ *		is found by trying (linearize), as it is the size
+ *		of the automaton that decides.
+ *
+ *		In RCFSA2, an address is the address of the target
+ *		or its distance from the arc, whichever is shorter,
+ *		so the length of an address can get longer when states
+ *		get closer to the beginning of the file (set_addresses).
+ *
+ *		In SCFSA2, an arc that leads to a chain of states
+ *		that have one arc and one incoming arc each gets the labels
+ *		of the chain (make_strings), and states of the chain
+ *		are not written. When that does not make the automaton
+ *		smaller, it is written as RCFSA2.
+ */
+class cfsa2_writer {
+private:
+  vector<int>		first_arc;	// first arc of each state, and
+					// the end of arcs of the last state
+  vector<unsigned char>	labels;		// labels of arcs
+  vector<unsigned char>	flags;		// CFSA2_FINAL_ARC, CFSA2_LAST_ARC
+  vector<int>		targets;	// target states of arcs (-1 - none)
+  vector<int>		numbers;	// number of strings from each state
+  vector<int>		order;		// states in the order they are written
+  vector<int>		address;	// addresses of states (in bytes)
+  unsigned char		label_table[CFSA2_LABELS + 1];
+  int			table_size;	// size of label_table
+  int			label_index[256]; // index in label_table, or 0
+  int			root_state;	// state of the root (-1 - none)
+  int			with_numbers;	// whether numbers are written
+  int			relative;	// whether addresses are relative (RCFSA2)
+  int			strings;	// whether arcs can have strings (SCFSA2)
+  vector<unsigned char>	run_length;	// labels after the label of an arc
+  vector<int>		run_first;	// where they are in run_labels
+  vector<unsigned char>	run_labels;	// those labels
+  vector<char>		joined;		// states put into string arcs
+  vector<unsigned char>	addr_len;	// lengths of addresses of arcs
+  int			lengths_changed; // whether addr_len has changed
+  int collect(node *n);
+  void make_strings(void);
+  void make_label_table(void);
+  void order_states(const vector<int> &first_states, const int how_many);
+  long int place_states(void);
+  long int set_addresses(void);
+  long int put_states(fsa_image *image, const int set_lengths);
+  int put_arc(fsa_image *image, const int set_length, const int arc_flags,
+	      const int label, const int target_address,
+	      const int arc_address, const int a);
+public:
+  cfsa2_writer(node *root, const int make_numbers, const int version);
+  long int linearize(void);
+  int write(ostream &outfile);
+};//cfsa2_writer
+
+#endif //CFSA2
+#endif
+/***	EOF ncfsa2.h	***/
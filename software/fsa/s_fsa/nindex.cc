@@ -7,13 +7,20 @@
 #include	<stdlib.h>
 #include	<string.h>
 #include	<unistd.h>
+#ifdef THREADS
+#include	<sched.h>
+#endif
 #include	"fsa.h"
 #include	"nnode.h"
 #include	"nindex.h"
 
-static tree_index	primary_index = { {NULL}, 0 };
-static tree_index	secondary_index = { {NULL}, 0 };
+THREAD_LOCAL build_context	*build_ctx = NULL;
+#ifdef THREADS
+static __thread node_register	*thread_register = NULL;
+#endif
 const int	INDEX_SIZE_STEP = 16;	// allocate chunks of 16 pointers
+const unsigned long	REGISTER_INIT_SIZE = 1024; // initial register size
+const uint64_t	PSEUDO_SEED = 0x2545f4914f6cdd1dULL; // hash of no arcs
 
 using namespace std;
 
@@ -21,20 +28,877 @@ using namespace std;
 int match_tails(node *n, const int tail_size);
 
 
+/* Name:	build_context
+ * Class:	build_context
+ * Purpose:	Initializes the context for building an automaton.
+ * Parameters:	None.
+ * Returns:	Nothing (constructor).
+ * Remarks:	Arc #0 is the empty arc, so numbering starts with 1.
+ */
+build_context::build_context(void)
+{
+  secondary.down.indx = NULL;
+  secondary.counter = 0;
+  secondary.allocated = 0;
+  annot_separator = '+';
+  for (int i = 0; i < 256; i++)
+    frequency_table[i] = 0;
+  no_of_arcs = 1;
+  arc_count = 1;
+  node_count = 1;
+  a_size = 0;
+  entryl = 0;
+  gtl = 0;
+  next_nodes = 0;
+  tails = 0;
+  version = BUILD_FORMAT;
+#ifdef SPARSE
+  in_annotations = false;
+#endif
+#ifdef MORE_COMPR
+  reorder_time = 0;
+#endif
+  tail_template = NULL;
+}//build_context::build_context
+
+
+/* Name:	~build_context
+ * Class:	build_context
+ * Purpose:	Releases memory used for building an automaton.
+ * Parameters:	None.
+ * Returns:	Nothing (destructor).
+ * Remarks:	The nodes are not destroyed; the arena gives back
+ *		the memory they occupy.
+ */
+build_context::~build_context(void)
+{
+  destroy_index(secondary);
+}//build_context::~build_context
+
+
 /* Name:	get_index_by_name
  * Class:	None
  * Purpose:	Delivers appropriate index.
  * Parameters:	index_name	- (i) index number.
  * Returns:	Root of required index.
- * Remarks:	Currently two indices available: PRIM_INDEX and SECOND_INDEX.
- *		No parameter checking.
+ * Remarks:	Only SECOND_INDEX is a tree index. PRIM_INDEX is
+ *		a hash table (see get_register()); NULL is returned for it.
  */
 tree_index *
 get_index_by_name(const int index_name)
 {
-  return (index_name ? &secondary_index : &primary_index);
+  return (index_name ? &build_ctx->secondary : (tree_index *)NULL);
 }//get_index_by_name
 
+
+/* Name:	get_register
+ * Class:	None
+ * Purpose:	Delivers the primary register.
+ * Parameters:	None.
+ * Returns:	The primary register.
+ * Remarks:	It is the register of the calling thread if it has been
+ *		set with set_thread_register(), or the register
+ *		of the automaton being built.
+ */
+node_register *
+get_register(void)
+{
+#ifdef THREADS
+  if (thread_register)
+    return thread_register;
+#endif
+  return &build_ctx->primary;
+}//get_register
+
+
+/* Name:	set_thread_register
+ * Class:	None
+ * Purpose:	Makes the calling thread use its own primary register.
+ * Parameters:	r		- (i) the register, or NULL for the common one.
+ * Returns:	The register used before.
+ * Remarks:	Without THREADS, there is only one register.
+ */
+node_register *
+set_thread_register(node_register *r)
+{
+  node_register	*old = get_register();
+#ifdef THREADS
+  thread_register = r;
+#endif
+  return old;
+}//set_thread_register
+
+
+/* Name:	find
+ * Class:	node_register
+ * Purpose:	Finds a node isomorphic to the argument.
+ * Parameters:	n		- (i) node to be found;
+ *		h		- (i) n->struct_hash() (lower 32 bits).
+ * Returns:	Pointer to an isomorphic node, or NULL if not found.
+ * Remarks:	Hash values are compared first, so that cmp_nodes
+ *		is called almost only for nodes that are isomorphic.
+ */
+node *
+node_register::find(const node *n, const uint32_t h) const
+{
+  if (slots == NULL)
+    return NULL;
+  for (unsigned long i = (unsigned long)h & mask; slots[i].used();
+       i = (i + 1) & mask) {
+    if (slots[i].hash == h &&
+	slots[i].n->get_no_of_kids() == n->get_no_of_kids() &&
+	cmp_nodes(n, slots[i].n) == 0)
+      return slots[i].n;
+  }
+  return NULL;
+}//node_register::find
+
+
+/* Name:	find_or_insert
+ * Class:	node_register
+ * Purpose:	Finds a node isomorphic to the argument, or registers it.
+ * Parameters:	n		- (i) node to be found or registered;
+ *		register_it	- (i) if TRUE, register the node if not found.
+ * Returns:	Pointer to an isomorphic node, or NULL if not found
+ *		(and registered if register_it is TRUE).
+ * Remarks:	None.
+ */
+node *
+node_register::find_or_insert(node *n, const int register_it)
+{
+  uint32_t	h = (uint32_t)n->struct_hash();
+  unsigned long	i;
+
+  if (slots) {
+    for (i = (unsigned long)h & mask; slots[i].used(); i = (i + 1) & mask) {
+      if (slots[i].hash == h &&
+	  slots[i].n->get_no_of_kids() == n->get_no_of_kids() &&
+	  cmp_nodes(n, slots[i].n) == 0)
+	return slots[i].n;
+    }
+  }
+  if (!register_it)
+    return NULL;
+
+  if (slots == NULL || 2 * (counter + 1) > mask + 1) {
+    grow();
+  }
+  for (i = (unsigned long)h & mask; slots[i].used(); i = (i + 1) & mask)
+    ;
+  slots[i].hash = h;
+  slots[i].n = n;
+  counter++;
+#ifdef DEBUG
+  cerr << "Node registered\n";
+#endif
+  return NULL;
+}//node_register::find_or_insert
+
+
+/* Name:	remove
+ * Class:	node_register
+ * Purpose:	Removes a node (or a node isomorphic to it) from the register.
+ * Parameters:	n		- (i) the node to be removed.
+ * Returns:	TRUE if the node was removed, FALSE otherwise.
+ * Remarks:	As in the tree index before, the node must not be changed
+ *		between registering and removing it.
+ *		Entries following the removed one in the same cluster
+ *		are moved back if their home position allows it
+ *		(backward shift deletion).
+ */
+int
+node_register::remove(const node *n)
+{
+  uint32_t	h;
+  unsigned long	i, j, home;
+
+  if (slots == NULL)
+    return FALSE;
+  h = (uint32_t)n->struct_hash();
+  for (i = (unsigned long)h & mask; slots[i].used(); i = (i + 1) & mask) {
+    if (slots[i].n == n ||
+	(slots[i].hash == h &&
+	 slots[i].n->get_no_of_kids() == n->get_no_of_kids() &&
+	 cmp_nodes(n, slots[i].n) == 0))
+      break;
+  }
+  if (!slots[i].used())
+    return FALSE;
+
+  // Fill the hole with later entries of the cluster
+  for (j = (i + 1) & mask; slots[j].used(); j = (j + 1) & mask) {
+    home = (unsigned long)slots[j].hash & mask;
+    // move slots[j] to i unless its home lies cyclically in (i, j]
+    if ((j > i && (home <= i || home > j)) ||
+	(j < i && (home <= i && home > j))) {
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i].n = NULL;
+  counter--;
+  return TRUE;
+}//node_register::remove
+
+
+/* Name:	grow
+ * Class:	node_register
+ * Purpose:	Doubles the size of the register.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	Stored hash values are used to place the entries.
+ */
+void
+node_register::grow(void)
+{
+  unsigned long	old_size = get_capacity();
+  unsigned long	new_size = (old_size ? 2 * old_size : REGISTER_INIT_SIZE);
+  reg_slot	*old_slots = slots;
+  unsigned long	i, j;
+
+  slots = new reg_slot[new_size];
+  mask = new_size - 1;
+  for (i = 0; i < new_size; i++)
+    slots[i].n = NULL;
+  for (i = 0; i < old_size; i++) {
+    if (old_slots[i].used()) {
+      for (j = (unsigned long)old_slots[i].hash & mask; slots[j].used();
+	   j = (j + 1) & mask)
+	;
+      slots[j] = old_slots[i];
+    }
+  }
+  delete [] old_slots;
+}//node_register::grow
+
+
+/* Name:	reserve
+ * Class:	node_register
+ * Purpose:	Makes the table big enough for a number of nodes.
+ * Parameters:	n		- (i) number of nodes that should fit
+ *				  without growing the table.
+ * Returns:	Nothing.
+ * Remarks:	None.
+ */
+void
+node_register::reserve(const unsigned long n)
+{
+  while (slots == NULL || 2 * n > mask + 1)
+    grow();
+}//node_register::reserve
+
+
+#ifdef THREADS
+#ifdef NODE_INDICES
+typedef uint32_t	reg_word;	// contents of reg_slot::n
+#else
+typedef node		*reg_word;
+#endif
+#define	BUSY_SLOT	((reg_word)1)	// slot claimed, hash not yet written
+
+/* Name:	find_or_insert_shared
+ * Class:	node_register
+ * Purpose:	Finds a node isomorphic to the argument, or registers it,
+ *		when other threads do the same.
+ * Parameters:	n		- (i) node to be found or registered.
+ * Returns:	Pointer to an isomorphic node, or NULL if the node
+ *		has been registered.
+ * Remarks:	A slot is claimed by putting BUSY_SLOT (not a valid node)
+ *		into it with compare-and-swap. Then the hash is stored,
+ *		and finally the node. Other threads wait for the node
+ *		when they see BUSY_SLOT. The table must have been reserved
+ *		(see reserve()), as it does not grow here.
+ */
+node *
+node_register::find_or_insert_shared(node *n)
+{
+  uint32_t	h = (uint32_t)n->struct_hash();
+  unsigned long	i;
+  reg_word	*w;
+  reg_word	v;
+  reg_slot	mine;
+
+  mine.n = n;
+  for (i = (unsigned long)h & mask; ; i = (i + 1) & mask) {
+    w = (reg_word *)&slots[i].n;
+    while ((v = __atomic_load_n(w, __ATOMIC_ACQUIRE)) == BUSY_SLOT)
+      sched_yield();		// another thread is filling the slot
+    if (v == (reg_word)0) {
+      if (!__atomic_compare_exchange_n(w, &v, BUSY_SLOT, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+	// someone else got it first; look at what has been put there
+	i = (i - 1) & mask;
+	continue;
+      }
+      slots[i].hash = h;
+      __atomic_store_n(w, *(reg_word *)&mine.n, __ATOMIC_RELEASE);
+      __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+    if (slots[i].hash == h &&
+	slots[i].n->get_no_of_kids() == n->get_no_of_kids() &&
+	cmp_nodes(n, slots[i].n) == 0)
+      return slots[i].n;
+  }
+}//node_register::find_or_insert_shared
+#endif
+
+
+/* Name:	cmp_node_addr
+ * Class:	None.
+ * Purpose:	Compares addresses of two nodes (for qsort).
+ * Parameters:	p1		- (i) pointer to the first node pointer;
+ *		p2		- (i) pointer to the second node pointer.
+ * Returns:	<0, 0, >0 as for strcmp.
+ * Remarks:	None.
+ */
+static int
+cmp_node_addr(const void *p1, const void *p2)
+{
+  const node	*n1 = *(node * const *)p1;
+  const node	*n2 = *(node * const *)p2;
+  return (n1 < n2 ? -1 : (n1 > n2 ? 1 : 0));
+}//cmp_node_addr
+
+
+/* Name:	visit_node
+ * Class:	None.
+ * Purpose:	Marks a node as visited.
+ * Parameters:	seen		- (i/o) hash table of addresses of visited
+ *				  nodes (0 - empty entry);
+ *		mask		- (i) size of the table - 1 (size is 2^n);
+ *		n		- (i) the node;
+ *		mark_it		- (i) TRUE if the node is to be marked.
+ * Returns:	TRUE if the node had not been visited, FALSE otherwise.
+ * Remarks:	The table must not get full.
+ */
+static int
+visit_node(unsigned long *seen, const unsigned long mask, const node *n,
+	   const int mark_it)
+{
+  unsigned long	id = (unsigned long)n;
+  unsigned long	i;
+
+  for (i = (id * 0x9e3779b9UL) & mask; seen[i] != 0; i = (i + 1) & mask)
+    if (seen[i] == id)
+      return FALSE;
+  if (mark_it)
+    seen[i] = id;
+  return TRUE;
+}//visit_node
+
+
+/* Name:	list_nodes
+ * Class:	None.
+ * Purpose:	Lists nodes of a subgraph in depth-first order.
+ * Parameters:	n		- (i) the root of the subgraph;
+ *		seen		- (i/o) hash table of visited nodes;
+ *		mask		- (i) size of the table - 1;
+ *		order		- (o) list of nodes;
+ *		filled		- (i/o) number of nodes on the list;
+ *		room		- (i) size of the list.
+ * Returns:	Nothing.
+ * Remarks:	Nodes already visited are skipped.
+ */
+static void
+list_nodes(node *n, unsigned long *seen, const unsigned long mask,
+	   node **order, unsigned long &filled, const unsigned long room)
+{
+  if (filled >= room || !visit_node(seen, mask, n, TRUE))
+    return;
+  order[filled++] = n;
+  arc_node *a = n->get_children();
+  for (int i = 0; i < n->get_no_of_kids(); i++)
+    if (a[i].child)
+      list_nodes(a[i].child, seen, mask, order, filled, room);
+}//list_nodes
+
+
+/* Name:	kids_index
+ * Class:	kids_index
+ * Purpose:	Takes a snapshot of the primary register with nodes
+ *		grouped by their number of children.
+ * Parameters:	root		- (i) root of the automaton, or NULL.
+ * Returns:	Nothing (constructor).
+ * Remarks:	Two passes: the first one counts nodes in each group,
+ *		the second one fills the vectors.
+ *
+ *		If the root is given, nodes in a group are in the order
+ *		of a depth-first traversal of the automaton from the root.
+ *		That order does not depend on where the nodes are in memory,
+ *		so share_arcs gives the same automaton whether the nodes
+ *		have been created by one or by many threads. Registered
+ *		nodes that cannot be reached from the root (if any)
+ *		follow on their addresses.
+ *
+ *		Otherwise, nodes in a group are sorted on their addresses.
+ */
+kids_index::kids_index(node *root)
+{
+  const reg_slot	*rs = build_ctx->primary.get_slots();
+  unsigned long		cap = build_ctx->primary.get_capacity();
+  int			filled[MAX_ARCS_PER_NODE + 1];
+  int			start[MAX_ARCS_PER_NODE + 1];
+  int			k;
+  unsigned long		i;
+
+  for (k = 0; k <= MAX_ARCS_PER_NODE; k++) {
+    counter[k] = 0;
+    filled[k] = 0;
+    nodes[k] = NULL;
+  }
+  for (i = 0; i < cap; i++)
+    if (rs[i].used())
+      counter[rs[i].n->get_no_of_kids()]++;
+  for (k = 0; k <= MAX_ARCS_PER_NODE; k++)
+    if (counter[k])
+      nodes[k] = new node *[counter[k]];
+
+  unsigned long	*seen = NULL;
+  unsigned long	mask = 0;
+  if (root) {
+    // List nodes in depth-first order; keep the registered ones
+    unsigned long	room = build_ctx->primary.get_counter() + 1;
+    unsigned long	listed = 0;
+    node		**order = new node *[room];
+    const node_register	*reg = get_register();
+
+    for (mask = 1023; mask + 1 < 2 * room; mask = 2 * mask + 1)
+      ;
+    seen = new unsigned long[mask + 1];
+    memset(seen, 0, (mask + 1) * sizeof(unsigned long));
+    list_nodes(root, seen, mask, order, listed, room);
+    for (i = 0; i < listed; i++) {
+      node *n = order[i];
+      k = n->get_no_of_kids();
+      if (filled[k] < counter[k] &&
+	  reg->find(n, (uint32_t)n->struct_hash()) == n)
+	nodes[k][filled[k]++] = n;
+    }
+    delete [] order;
+  }
+  for (k = 0; k <= MAX_ARCS_PER_NODE; k++)
+    start[k] = filled[k];
+  for (i = 0; i < cap; i++)
+    if (rs[i].used()) {
+      k = rs[i].n->get_no_of_kids();
+      if (filled[k] < counter[k] &&
+	  (seen == NULL || visit_node(seen, mask, rs[i].n, FALSE)))
+	nodes[k][filled[k]++] = rs[i].n;
+    }
+  delete [] seen;
+  // Make the order independent of the size of the hash table
+  for (k = 0; k <= MAX_ARCS_PER_NODE; k++)
+    if (filled[k] - start[k] > 1)
+      qsort(nodes[k] + start[k], filled[k] - start[k], sizeof(node *),
+	    cmp_node_addr);
+}//kids_index::kids_index
+
+
+/* Name:	~kids_index
+ * Class:	kids_index
+ * Purpose:	Releases memory.
+ * Parameters:	None.
+ * Returns:	Nothing (destructor).
+ * Remarks:	Nodes are not deleted.
+ */
+kids_index::~kids_index(void)
+{
+  for (int k = 0; k <= MAX_ARCS_PER_NODE; k++)
+    delete [] nodes[k];
+}//kids_index::~kids_index
+
+/* Name:	pseudo_step
+ * Class:	None.
+ * Purpose:	Adds an arc to the hash value of a pseudonode.
+ * Parameters:	h		- (i) hash value of the arcs that follow a;
+ *		a		- (i) the arc to be added.
+ * Returns:	Hash value of the arcs from a on.
+ * Remarks:	Arcs are added from the last one backwards, so that the hash
+ *		values of all tails of a node are computed in one pass.
+ *		Labels, finality, and targets of arcs are taken into account,
+ *		as in part_cmp_nodes.
+ */
+static inline uint64_t
+pseudo_step(uint64_t h, const arc_node &a)
+{
+  h ^= ((uint64_t)node_id(a.child) << 9)
+    ^ ((uint64_t)(unsigned char)(a.letter) << 1)
+    ^ (uint64_t)(a.is_final ? 1 : 0);
+  h *= 0x9e3779b97f4a7c15ULL;
+  return h ^ (h >> 29);
+}//pseudo_step
+
+
+/* Name:	pseudo_hash
+ * Class:	None.
+ * Purpose:	Computes the hash value of a sequence of arcs.
+ * Parameters:	arcs		- (i) the first arc;
+ *		size		- (i) number of arcs.
+ * Returns:	The hash value (pseudo_step applied to the arcs from the last
+ *		one to the first one).
+ * Remarks:	The hash value of a node and of a pseudonode with the same arcs
+ *		are equal.
+ */
+static uint64_t
+pseudo_hash(const arc_node *arcs, const int size)
+{
+  uint64_t	h = (uint64_t)PSEUDO_SEED;
+  for (int k = size - 1; k >= 0; --k)
+    h = pseudo_step(h, arcs[k]);
+  return h;
+}//pseudo_hash
+
+
+/* Name:	same_arcs
+ * Class:	None.
+ * Purpose:	Checks whether two sequences of arcs are equal.
+ * Parameters:	a1		- (i) the first sequence;
+ *		a2		- (i) the second sequence;
+ *		size		- (i) number of arcs.
+ * Returns:	TRUE if the arcs have the same targets, labels, and finality,
+ *		FALSE otherwise.
+ * Remarks:	None.
+ */
+static int
+same_arcs(const arc_node *a1, const arc_node *a2, const int size)
+{
+  for (int i = 0; i < size; i++)
+    if (a1[i].child != a2[i].child || a1[i].letter != a2[i].letter ||
+	a1[i].is_final != a2[i].is_final)
+      return FALSE;
+  return TRUE;
+}//same_arcs
+
+
+/* Name:	pseudo_key
+ * Class:	None.
+ * Purpose:	Folds a hash value of arcs to the key of the register.
+ * Parameters:	h		- (i) pseudo_hash() or pseudo_step() value.
+ * Returns:	32-bit key.
+ * Remarks:	None.
+ */
+static inline uint32_t
+pseudo_key(const uint64_t h)
+{
+  return (uint32_t)(h ^ (h >> 32));
+}//pseudo_key
+
+
+/* Name:	find
+ * Class:	pseudo_register
+ * Purpose:	Finds a pseudonode with the same arcs as a node.
+ * Parameters:	n		- (i) node to be found;
+ *		h		- (i) key of its arcs (pseudo_key);
+ *		offset		- (o) number of the first arc of the pseudonode
+ *				  in the node it belongs to.
+ * Returns:	The node the pseudonode belongs to, or NULL if not found.
+ * Remarks:	The register is not changed, so many threads may look
+ *		for nodes at the same time.
+ */
+node *
+pseudo_register::find(const node *n, const uint32_t h, int &offset) const
+{
+  int		size = n->get_no_of_kids();
+
+  if (slots == NULL)
+    return NULL;
+  for (unsigned long i = (unsigned long)h & mask; slots[i].used();
+       i = (i + 1) & mask) {
+    if (slots[i].hash == h && slots[i].size == size &&
+	same_arcs(n->get_children(),
+		  slots[i].n->get_children() + slots[i].offset, size)) {
+      offset = slots[i].offset;
+      return slots[i].n;
+    }
+  }
+  return NULL;
+}//pseudo_register::find
+
+
+/* Name:	insert
+ * Class:	pseudo_register
+ * Purpose:	Registers a pseudonode, unless there is one with the same arcs.
+ * Parameters:	p		- (i) the pseudonode (see pseudo_entries).
+ * Returns:	Nothing.
+ * Remarks:	The pseudonode registered first is kept, as it was
+ *		in the secondary index.
+ */
+void
+pseudo_register::insert(const pseudo_slot &p)
+{
+  unsigned long	i;
+
+  if (slots == NULL || 2 * (counter + 1) > mask + 1) {
+    grow();
+  }
+  for (i = (unsigned long)p.hash & mask; slots[i].used(); i = (i + 1) & mask) {
+    if (slots[i].hash == p.hash && slots[i].size == p.size &&
+	same_arcs(p.n->get_children() + p.offset,
+		  slots[i].n->get_children() + slots[i].offset, p.size))
+      return;
+  }
+  slots[i] = p;
+  counter++;
+}//pseudo_register::insert
+
+
+/* Name:	pseudo_count
+ * Class:	None.
+ * Purpose:	Computes the number of pseudonodes of a node.
+ * Parameters:	nk		- (i) number of children of the node;
+ *		sizes		- (i) sizes[k] is nonzero if pseudonodes
+ *				  of k arcs are to be registered.
+ * Returns:	The number of pseudonodes pseudo_entries() would produce.
+ * Remarks:	None.
+ */
+static int
+pseudo_count(const int nk, const char *sizes)
+{
+  int	count = 0;
+  for (int k = 1; k < nk; k++)
+    if (sizes[k])
+#ifdef STOPBIT
+      count++;
+#else
+      count += nk - k + 1;
+#endif
+  return count;
+}//pseudo_count
+
+
+/* Name:	pseudo_entries
+ * Class:	None.
+ * Purpose:	Lists pseudonodes of a node.
+ * Parameters:	n		- (i) the node;
+ *		sizes		- (i) sizes[k] is nonzero if pseudonodes
+ *				  of k arcs are to be registered;
+ *		e		- (o) where to put the pseudonodes.
+ * Returns:	Nothing.
+ * Remarks:	With STOPBIT, only the last k arcs form a pseudonode
+ *		of size k (see register_subnodes). Hash values of all
+ *		tails are computed in one pass. Otherwise, all sequences
+ *		of k consecutive arcs are pseudonodes. There are
+ *		pseudo_count() of them.
+ */
+static void
+pseudo_entries(node *n, const char *sizes, pseudo_slot *e)
+{
+  const arc_node	*arcs = n->get_children();
+  int			nk = n->get_no_of_kids();
+  uint64_t		h;
+
+#ifdef STOPBIT
+  h = (uint64_t)PSEUDO_SEED;
+  for (int k = 1; k < nk; k++) {
+    h = pseudo_step(h, arcs[nk - k]);
+    if (sizes[k]) {
+      e->hash = pseudo_key(h);
+      e->n = n;
+      e->size = (unsigned char)k;
+      e->offset = (unsigned char)(nk - k);
+      e++;
+    }
+  }
+#else
+  for (int k = 1; k < nk; k++)
+    if (sizes[k])
+      for (int offset = 0; offset <= nk - k; offset++) {
+	h = pseudo_hash(arcs + offset, k);
+	e->hash = pseudo_key(h);
+	e->n = n;
+	e->size = (unsigned char)k;
+	e->offset = (unsigned char)offset;
+	e++;
+      }
+#endif
+}//pseudo_entries
+
+
+/* Name:	grow
+ * Class:	pseudo_register
+ * Purpose:	Doubles the size of the register.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	Stored hash values are used to place the entries.
+ */
+void
+pseudo_register::grow(void)
+{
+  unsigned long	old_size = (slots ? mask + 1 : 0);
+  unsigned long	new_size = (old_size ? 2 * old_size : REGISTER_INIT_SIZE);
+  pseudo_slot	*old_slots = slots;
+  unsigned long	i, j;
+
+  slots = new pseudo_slot[new_size];
+  mask = new_size - 1;
+  for (i = 0; i < new_size; i++)
+    slots[i].n = NULL;
+  for (i = 0; i < old_size; i++) {
+    if (old_slots[i].used()) {
+      for (j = (unsigned long)old_slots[i].hash & mask; slots[j].used();
+	   j = (j + 1) & mask)
+	;
+      slots[j] = old_slots[i];
+    }
+  }
+  delete [] old_slots;
+}//pseudo_register::grow
+
+
+/* Name:	share_pool
+ * Class:	share_pool
+ * Purpose:	Starts threads for share_arcs.
+ * Parameters:	n		- (i) number of threads (with the calling one).
+ * Returns:	Nothing (constructor).
+ * Remarks:	If a thread cannot be started, fewer threads are used.
+ */
+share_pool::share_pool(const int n)
+{
+  jobs = (n < 1 ? 1 : n);
+#ifdef THREADS
+  context = build_ctx;
+  threads = NULL;
+  started = 0;
+  fn = NULL;
+  job = NULL;
+  count = chunk = next = 0;
+  generation = 0;
+  busy = 0;
+  quit = FALSE;
+  if (jobs > 1) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&work_ready, NULL);
+    pthread_cond_init(&work_done, NULL);
+    threads = new pthread_t[jobs - 1];
+    while (started < jobs - 1 &&
+	   pthread_create(threads + started, NULL, worker, this) == 0)
+      started++;
+    jobs = started + 1;
+  }
+#else
+  jobs = 1;
+#endif
+}//share_pool::share_pool
+
+
+/* Name:	~share_pool
+ * Class:	share_pool
+ * Purpose:	Stops the threads.
+ * Parameters:	None.
+ * Returns:	Nothing (destructor).
+ * Remarks:	None.
+ */
+share_pool::~share_pool(void)
+{
+#ifdef THREADS
+  if (threads) {
+    pthread_mutex_lock(&lock);
+    quit = TRUE;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+    delete [] threads;
+    pthread_cond_destroy(&work_done);
+    pthread_cond_destroy(&work_ready);
+    pthread_mutex_destroy(&lock);
+  }
+#endif
+}//share_pool::~share_pool
+
+
+#ifdef THREADS
+/* Name:	worker
+ * Class:	share_pool
+ * Purpose:	Body of a thread of the pool.
+ * Parameters:	pool		- (i/o) the pool.
+ * Returns:	NULL.
+ * Remarks:	The thread waits for jobs until the pool is destroyed.
+ */
+void *
+share_pool::worker(void *pool)
+{
+  share_pool	*p = (share_pool *)pool;
+  build_scope	scope(p->context);
+  unsigned long	seen = 0;
+
+  build_arena->attach_thread();
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (p->generation == seen && !p->quit)
+      pthread_cond_wait(&p->work_ready, &p->lock);
+    if (p->quit)
+      break;
+    seen = p->generation;
+    pthread_mutex_unlock(&p->lock);
+    p->work();
+    pthread_mutex_lock(&p->lock);
+    if (--p->busy == 0)
+      pthread_cond_signal(&p->work_done);
+  }
+  pthread_mutex_unlock(&p->lock);
+  build_arena->detach_thread();
+  return NULL;
+}//share_pool::worker
+
+
+/* Name:	work
+ * Class:	share_pool
+ * Purpose:	Does chunks of the current job until there are none left.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	None.
+ */
+void
+share_pool::work(void)
+{
+  int	from;
+
+  while ((from = __atomic_fetch_add(&next, chunk, __ATOMIC_RELAXED)) < count)
+    fn(job, from, (from + chunk < count ? from + chunk : count));
+}//share_pool::work
+#endif
+
+
+/* Name:	run
+ * Class:	share_pool
+ * Purpose:	Does a job with all threads of the pool.
+ * Parameters:	f		- (i) function doing items of the job;
+ *		j		- (i/o) the job;
+ *		items		- (i) number of items;
+ *		chunk_size	- (i) number of items taken at a time.
+ * Returns:	Nothing.
+ * Remarks:	Small jobs are done by the calling thread.
+ */
+void
+share_pool::run(share_fn f, void *j, const int items, const int chunk_size)
+{
+#ifdef THREADS
+  if (jobs > 1 && items > chunk_size) {
+    pthread_mutex_lock(&lock);
+    fn = f;
+    job = j;
+    count = items;
+    chunk = chunk_size;
+    next = 0;
+    busy = started;
+    generation++;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+    work();
+    pthread_mutex_lock(&lock);
+    while (busy > 0)
+      pthread_cond_wait(&work_done, &lock);
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+#endif
+  if (items > 0)
+    f(j, 0, items);
+}//share_pool::run
+
+
 /* Name:	register_at_level
  * Class:	None.
  * Purpose:	Looks for an appropriate entry at the given level.
@@ -112,14 +976,13 @@ int
 cmp_nodes(const node *node1, const node *node2)
 {
   int		c;
-  long int	l;
   arc_node	*p1, *p2;
 
   // compare children
   p1 = node1->children; p2 = node2->children;
   for (int i = 0; i < node1->no_of_children; i++, p1++, p2++)
-    if ((l = ((long int)(p1->child) - (long int)(p2->child))) != 0)
-      return ((l < 0) ? -1 : 1);
+    if (node_id(p1->child) != node_id(p2->child))
+      return ((node_id(p1->child) < node_id(p2->child)) ? -1 : 1);
     else if ((c = p1->letter - p2->letter) != 0)
       return c;
     else if ((c = p1->is_final - p2->is_final) != 0)
@@ -154,6 +1017,7 @@ destroy_index(tree_index &index_root)
     delete [] tip1->down.indx;
   }
   delete [] index_root.down.indx;
+  index_root.down.indx = NULL;
   index_root.counter = 0;
 }//destroy_index
 
@@ -255,16 +1119,15 @@ find_or_register(node *n, const int index_root_name,
   tree_index	*index_root;
   unsigned char	uc = (unsigned char)' ';
 
+  if (index_root_name == PRIM_INDEX)
+    return get_register()->find_or_insert(n, register_it);
+
   index_root = get_index_by_name(index_root_name);
 
-  // searching for the number of children entry
+  // searching for the first letter entry
   if (n->get_no_of_kids())
     uc = n->get_children()->letter;
-  tip = (index_root_name ?
-	 // secondary index
-	 register_at_level(uc, *index_root, register_it, 255)
-	 // primary index
-	 : register_at_level(n->get_no_of_kids(), *index_root, register_it));
+  tip = register_at_level(uc, *index_root, register_it, 255);
   if (tip == NULL)
     return NULL;
 
@@ -283,12 +1146,9 @@ find_or_register(node *n, const int index_root_name,
   if (tip->down.leaf) {
     current_node = bsearch_reg(n, current_node,
 			       current_node + (tip->counter - 1),
-			       (index_root_name ? part_cmp_nodes :
-				                  a_cmp_nodes),
-			       -1, -1);
+			       part_cmp_nodes, -1, -1);
     not_found = !(current_node - tip->down.leaf < tip->counter &&
-                  (index_root_name ? part_cmp_nodes(n, *current_node)
-		                   : cmp_nodes(n, *current_node)) == 0);
+                  part_cmp_nodes(n, *current_node) == 0);
   }
   i = current_node - tip->down.leaf;
 
@@ -352,48 +1212,7 @@ find_or_register(node *n, const int index_root_name,
 int
 unregister_node(const node *n)
 {
-  tree_index	*tip;		// tree index pointer
-  node		**current_node;	// subsequent entry in the leaf table
-  int		not_found = TRUE;
-  int		i;
-  tree_index	*index_root;
-  unsigned char	uc = (unsigned char)' ';
-
-  index_root = get_index_by_name(0);
-
-  // searching for the number of children entry
-  if (n->get_no_of_kids())
-    uc = n->get_children()->letter;
-  tip = register_at_level(n->get_no_of_kids(), *index_root, FALSE);
-  if (tip == NULL)
-    return FALSE;
-
-  // searching according to hash function value
-  tip = register_at_level(n->hash(0, n->get_no_of_kids()), *tip, FALSE);
-  if (tip == NULL)
-    return FALSE;
-
-
-  // now we search the lowest level, which has entries pointing directly
-  // to end nodes
-  not_found = TRUE;
-  i = 0;
-  current_node = tip->down.leaf;
-
-  current_node = bsearch_reg(n, current_node,
-			     current_node + tip->counter - 1,
-			     a_cmp_nodes, -1, -1);
-  not_found = !(current_node - tip->down.leaf < tip->counter &&
-                cmp_nodes(n, *current_node) == 0);
-  i = current_node - tip->down.leaf;
-
-  if (not_found)
-    return FALSE;
-
-  if (--(tip->counter) - i > 0)
-    memmove(current_node, current_node + 1,
-	    (tip->counter - i) * sizeof(node *));
-  return TRUE;
+  return get_register()->remove(n);
 }//unregister_node
 
 
@@ -648,27 +1467,39 @@ get_pseudo_offset(const node *small_node, const node *big_node)
  *					of nodes in the automaton,
  *					kids_tab[0] - the biggest no of kids,
  *					kids_tab[1] - the second biggest,etc.;
- *		kids_no_no	- (i) number of entries in kids_tab.
+ *		kids_no_no	- (i) number of entries in kids_tab;
+ *		max_arcs	- (i) nodes with more arcs are not considered;
+ *		max_subset	- (i) maximal size of a subset;
+ *		found		- (o) if not NULL, the node that matches
+ *					is put there, and nodes are not
+ *					changed.
  * Returns:	True if a match found, false otherwise.
  * Remarks:	The arcs in all nodes are ordered in the same way,
  *		so it is sufficient to select arcs.
  *		We must allocate memory for arcs dynamically, as it is
- *		released by the destructor of node.
+ *		released by the destructor of node. The template node
+ *		is local, so that its arcs are released when it goes out
+ *		of scope.
+ *
+ *		When found is not NULL, nothing is changed, so many threads
+ *		may look for matches at the same time (see share_arcs).
  */
 int
-match_subset(node *n, const int kids_tab[], const int kids_no_no)
+match_subset(node *n, const int kids_tab[], const int kids_no_no,
+	     const int max_arcs, const int max_subset, node **found)
 {
-  if (n->no_of_children > MAX_ARCS_TO_SHUFFLE) {
+  if (n->no_of_children > max_arcs) {
     return false;
   }
-  static node		node_template;
+  node		node_template;
   arc_node *arc_template =  new arc_node[MAX_ARCS_PER_NODE];
   node_template.children = arc_template;
   for (int i = 1; i < kids_no_no; i++) {
     int subset_size = kids_tab[i];
-    if (subset_size <= MAX_SUBSET_SHUFFLE) {
+    if (subset_size <= max_subset) {
       node_template.no_of_children = subset_size;
-      if (match_part(n, &node_template, subset_size, 0, subset_size))
+      if (match_part(n, &node_template, subset_size, 0, subset_size, FIND,
+		     found))
 	return TRUE;
     }
   }
@@ -684,13 +1515,15 @@ match_subset(node *n, const int kids_tab[], const int kids_no_no)
  *		start_at	- (i) start selecting arcs from that arc;
  *		subset_size	- (i) number of arcs in the node
  *					to be created;
- *		reg_tails	- (i) TRUE if tails are to be registered.
+ *		reg_tails	- (i) TRUE if tails are to be registered;
+ *		found		- (o) if not NULL, the isomorphic node is put
+ *					there instead of linking it.
  * Returns:	TRUE if an isomorphic node found, FALSE otherwise.
  * Remarks:	None.
  */
 int
 match_part(node *n, node *nn, const int to_do, const int start_at,
-	   const int subset_size, const int reg_tails)
+	   const int subset_size, const int reg_tails, node **found)
 {
   node	*isomorphic;
 
@@ -701,22 +1534,10 @@ match_part(node *n, node *nn, const int to_do, const int start_at,
       if (isomorphic->big_brother ||
 	  isomorphic->free_end != isomorphic->no_of_children)
 	return FALSE;
-      // reorder arcs
-      int nk = n->no_of_children - subset_size;
-      for (int j = 0; j < isomorphic->no_of_children; j++) {
-	int k = 0;
-	while (n->children[k] != isomorphic->children[j]) k++;
-	if (k != nk + j) {
-	  // exchange arcs in n
-	  arc_node temp = n->children[nk + j];
-	  n->children[nk + j] = n->children[k];
-	  n->children[k] = temp;
-	}
-	k++;
-      }
-      // link nodes
-      isomorphic->set_link(n, nk);
-      // cerr << "A node linked!\n";
+      if (found)
+	*found = isomorphic;
+      else
+	link_subset(n, isomorphic);
       return TRUE;
     }
     return FALSE;
@@ -724,14 +1545,45 @@ match_part(node *n, node *nn, const int to_do, const int start_at,
   if (start_at >= n->no_of_children) return FALSE;
   for (int i = start_at; i <= n->no_of_children - to_do; i++) {
     // the arc must point to a node pointed to by another node
-    if (n->children[i].child && n->children[i].child->hit_node(0) > 1) {
+    if (n->children[i].child && n->children[i].child->hit_count > 1) {
       nn->children[subset_size - to_do] = n->children[i];
-      if (match_part(n, nn, to_do - 1, i + 1, subset_size, reg_tails))
+      if (match_part(n, nn, to_do - 1, i + 1, subset_size, reg_tails, found))
 	return TRUE;
     }
   }
   return FALSE;
 }//match_part
+
+/* Name:	link_subset
+ * Class:	None.
+ * Purpose:	Makes a node the big brother of a node consisting
+ *		of a subset of its arcs.
+ * Parameters:	n		- (i/o) the big node;
+ *		isomorphic	- (i/o) the smaller node.
+ * Returns:	Nothing.
+ * Remarks:	Arcs of n are reordered so that the arcs of the smaller node
+ *		are at the end.
+ */
+void
+link_subset(node *n, node *isomorphic)
+{
+  // reorder arcs
+  int nk = n->no_of_children - isomorphic->no_of_children;
+  for (int j = 0; j < isomorphic->no_of_children; j++) {
+    int k = 0;
+    while (n->children[k] != isomorphic->children[j]) k++;
+    if (k != nk + j) {
+      // exchange arcs in n
+      arc_node temp = n->children[nk + j];
+      n->children[nk + j] = n->children[k];
+      n->children[k] = temp;
+    }
+    k++;
+  }
+  // link nodes
+  isomorphic->set_link(n, nk);
+  // cerr << "A node linked!\n";
+}//link_subset
 #ifdef STOPBIT
 #ifdef TAILS
 /* Name:	match_tails
@@ -742,15 +1594,20 @@ match_part(node *n, node *nn, const int to_do, const int start_at,
  * Returns:	TRUE if the tail found, false otherwise.
  * Remarks:	Memory for arc_template has to allocated dynamically
  *		because it is disposed of by the destructor.
+ *		The template node is allocated (in the arena) once for
+ *		an automaton, and never destroyed, as it may be registered.
+ *		Its previous arcs are released here.
  */
 int
 match_tails(node *n, const int tail_size)
 {
-  static node	node_template;
+  if (build_ctx->tail_template == NULL)
+    build_ctx->tail_template = new node;
+  node *node_template = build_ctx->tail_template;
   arc_node *arc_template = new arc_node[MAX_ARCS_PER_NODE];
 
-  node_template.set_children(arc_template, tail_size);
-  return match_part(n, &node_template, tail_size, 0, tail_size, TRUE);
+  delete [] node_template->set_children(arc_template, tail_size);
+  return match_part(n, node_template, tail_size, 0, tail_size, TRUE, NULL);
 }//match_tails
 #endif
 #endif
@@ -817,26 +1674,20 @@ check_tails(node *n, const int tail_size)
  * Parameters:	n	- (i) number of children.
  * Returns:	TRUE if in the primary index there is more than 1 node
  *		that has n children, FALSE otherwise.
- * Remarks:	The primary register has 3 levels. Each level contains
- *		information on the subsequent level. The levels are:
- *		number of children, hash value, all. The top level has
- *		no information on the number of children in the whole index.
+ * Remarks:	The primary register is a hash table, so all its slots
+ *		must be inspected. This is done once per call of share_arcs.
  */
 int
 contains_many_nodes(int n)
 {
-  tree_index	*prim_index, *tip1;
-  int		count;
+  const reg_slot	*rs = build_ctx->primary.get_slots();
+  unsigned long		cap = build_ctx->primary.get_capacity();
+  int			count;
 
   count = 0;
-  prim_index = get_index_by_name(PRIM_INDEX);
-  tip1 = prim_index->down.indx + n;
-  for (int j = 0; j < tip1->counter; j++) {
-    if (tip1->down.indx[j].counter) {
-      count++;
-      if (count > 1)
-	return TRUE;
-      if (tip1->down.indx[j].counter > 1)
+  for (unsigned long j = 0; j < cap; j++) {
+    if (rs[j].used() && rs[j].n->get_no_of_kids() == n) {
+      if (++count > 1)
 	return TRUE;
     }
   }
@@ -847,43 +1698,194 @@ contains_many_nodes(int n)
 
 #endif
 
+/* A step of share_arcs for a group of nodes with equal number of children,
+   done by threads of a share_pool */
+struct share_step {
+  node		**nodes;	// the nodes
+  int		count;		// number of nodes
+  const char	*sizes;		// sizes of pseudonodes to be registered
+  pseudo_register *shards;	// pseudonodes divided on hash values
+  int		no_of_shards;	// number of shards
+  node		**found;	// nodes found for nodes[l]
+  int		*offsets;	// offsets of pseudonodes in found[l]
+  int		*first;		// first pseudonode of nodes[l] in entries
+  pseudo_slot	*entries;	// pseudonodes of the nodes
+#ifdef MORE_COMPR
+  const int	*kids_tab;	// parameters of match_subset
+  int		kids_no_no;
+  int		max_arcs;
+  int		max_subset;
+#endif
+};/*share_step*/
+
+/* Number of nodes taken at a time by a thread */
+const int	SHARE_CHUNK = 256;
+
+/* Name:	shard_of
+ * Class:	None.
+ * Purpose:	Selects the pseudo_register for a pseudonode.
+ * Parameters:	h		- (i) key of the pseudonode;
+ *		no_of_shards	- (i) number of registers.
+ * Returns:	Number of the register.
+ * Remarks:	The upper bits of the key are used, as the lower ones
+ *		select the slot in the register.
+ */
+static inline int
+shard_of(const uint32_t h, const int no_of_shards)
+{
+  return (int)(((uint64_t)h * (uint64_t)no_of_shards) >> 32);
+}//shard_of
+
+/* Name:	find_pseudo
+ * Class:	None.
+ * Purpose:	Looks for nodes among registered pseudonodes.
+ * Parameters:	job		- (i/o) the step of share_arcs;
+ *		from		- (i) the first node;
+ *		to		- (i) the node after the last one.
+ * Returns:	Nothing.
+ * Remarks:	Nodes are not linked here, so the registers are read only.
+ */
+static void
+find_pseudo(void *job, const int from, const int to)
+{
+  share_step	*st = (share_step *)job;
+  node		*n;
+  uint32_t	h;
+
+  for (int l = from; l < to; l++) {
+    n = st->nodes[l];
+    h = pseudo_key(pseudo_hash(n->get_children(), n->get_no_of_kids()));
+    st->found[l] = st->shards[shard_of(h, st->no_of_shards)].find(n, h,
+							    st->offsets[l]);
+  }
+}//find_pseudo
+
+/* Name:	list_pseudo
+ * Class:	None.
+ * Purpose:	Lists pseudonodes of nodes.
+ * Parameters:	job		- (i/o) the step of share_arcs;
+ *		from		- (i) the first node;
+ *		to		- (i) the node after the last one.
+ * Returns:	Nothing.
+ * Remarks:	Pseudonodes of nodes[l] go to entries from first[l] on.
+ */
+static void
+list_pseudo(void *job, const int from, const int to)
+{
+  share_step	*st = (share_step *)job;
+
+  for (int l = from; l < to; l++)
+    if (st->first[l + 1] > st->first[l])
+      pseudo_entries(st->nodes[l], st->sizes, st->entries + st->first[l]);
+}//list_pseudo
+
+/* Name:	insert_pseudo
+ * Class:	None.
+ * Purpose:	Registers pseudonodes.
+ * Parameters:	job		- (i/o) the step of share_arcs;
+ *		from		- (i) the first register;
+ *		to		- (i) the register after the last one.
+ * Returns:	Nothing.
+ * Remarks:	Each register is filled by one thread with its pseudonodes
+ *		in the order of the list, so the same pseudonodes
+ *		are registered first as with one thread.
+ */
+static void
+insert_pseudo(void *job, const int from, const int to)
+{
+  share_step	*st = (share_step *)job;
+  int		no_of_entries = st->first[st->count];
+
+  for (int r = from; r < to; r++)
+    for (int e = 0; e < no_of_entries; e++)
+      if (st->no_of_shards == 1 ||
+	  shard_of(st->entries[e].hash, st->no_of_shards) == r)
+	st->shards[r].insert(st->entries[e]);
+}//insert_pseudo
+
+#ifdef MORE_COMPR
+/* Name:	try_subsets
+ * Class:	None.
+ * Purpose:	Looks for nodes consisting of subsets of arcs of nodes.
+ * Parameters:	job		- (i/o) the step of share_arcs;
+ *		from		- (i) the first node;
+ *		to		- (i) the node after the last one.
+ * Returns:	Nothing.
+ * Remarks:	Nodes are not changed. The node found for nodes[l]
+ *		(or NULL) is put into found[l]; share_arcs links the nodes
+ *		in order later.
+ */
+static void
+try_subsets(void *job, const int from, const int to)
+{
+  share_step	*st = (share_step *)job;
+  node		*n;
+
+  for (int l = from; l < to; l++) {
+    n = st->nodes[l];
+    st->found[l] = NULL;
+    if (n->get_big_brother() == NULL && n->free_end == n->get_no_of_kids())
+      match_subset(n, st->kids_tab, st->kids_no_no, st->max_arcs,
+		   st->max_subset, st->found + l);
+  }
+}//try_subsets
+#endif
+
+
 /* Name:	share_arcs
  * Class:	None.
  * Purpose:	Tries to find if arcs of one node are a subset of another.
  *		If so, a reference to them is replaced by a reference
  *		to a part (a subset) of the other node.
- * Parameters:	root		- (i) root of the automaton.
+ * Parameters:	root		- (i) root of the automaton;
+ *		level		- (i) effort (SHARE_TAILS, SHARE_SUBSETS,
+ *				  or SHARE_MORE_SUBSETS);
+ *		jobs		- (i) number of threads.
  * Returns:	Number of suppressed arcs.
- * Remarks:	This must take A LOT of time!
+ * Remarks:	The algorithm:
+ *		Nodes are taken in groups of equal number of children,
+ *		beginning with the biggest ones. Each node is looked up
+ *		among pseudonodes (sequences of arcs, with STOPBIT tails)
+ *		of bigger nodes. If found, a link is set from the smaller
+ *		node to the bigger one. Then pseudonodes of all smaller sizes
+ *		of the nodes in the group that have not been linked
+ *		are registered. The first pseudonode registered wins,
+ *		so the result is the same as it was when the secondary index
+ *		was filled with pseudonodes of one size at a time,
+ *		but each node is hashed once, and each lookup takes O(1)
+ *		expected time.
+ *
+ *		With MORE_COMPR and level SHARE_SUBSETS or higher,
+ *		arcs of nodes are then reordered so that subsets of their arcs
+ *		can replace other nodes. SHARE_MORE_SUBSETS tries bigger nodes
+ *		and bigger subsets, which takes more time.
  *
- *		The algorithm:
- *		Let n1 be the second biggest number of children per node
- *		in the automaton.
- *		Take all consecutive sequences of n1 arcs from each of
- *		nodes with the biggest number of arcs and register them
- *		as nodes in the secondary index.
- *		For each node with n1 children, search for an isomorphic
- *		node in the secondary index. If found, set a link
- *		from the smaller node to the bigger one.
+ *		With more than one job, threads of a share_pool look up
+ *		the nodes of a group, list their pseudonodes, and register
+ *		them (each thread in its own part of the registers).
+ *		Subsets are looked for by threads too, but the nodes
+ *		are linked by the calling thread in the order of nodes
+ *		in the group. If the node found for a node has been linked
+ *		to an earlier one in the meantime, the search is repeated.
+ *		This way, the automaton is the same as with one thread.
  *
  *		IMPORTANT note or myself: with STOPBIT, sharing can be used
  *		together with numbering information, provided the nodes
  *		are not included entirely one in another.
  */
 int
-share_arcs(node *root)
+share_arcs(node *root, const int level, const int jobs)
 {
-  tree_index	*prim_index;
-  tree_index	*tip1, *tip2, *tip3;
-  node		**tip4;
-  node		*new_node;
-  int		nodes_knocked, arcs_knocked;
-  int		i, j, l, offset;
 #ifdef STOPBIT
 #ifdef TAILS
-  int		k;
+  tree_index	*tip3;
+  int		j, k;
 #endif
 #endif
+  node		**tip4;
+  node		*new_node;
+  int		nodes_knocked, arcs_knocked;
+  int		i, l;
   int		prime_kids_tab[MAX_ARCS_PER_NODE + 1];
   				/* [0] - biggest no of children per node in
   					 the automaton
@@ -893,7 +1895,7 @@ share_arcs(node *root)
   int		prime_kids;	/* number of different numbers of children
 				   per node in the automaton */
 #ifdef SORT_ON_FREQ
-  extern int	frequency_table[256];	// no of occurences of labels
+  int		*frequency_table = build_ctx->frequency_table;
 #endif
 
 
@@ -901,7 +1903,6 @@ share_arcs(node *root)
   cerr << "Sharing arcs" << endl;
 #endif
   nodes_knocked = 0; arcs_knocked = 0;
-  prim_index = get_index_by_name(PRIM_INDEX);
 
 #ifdef DEBUG
   cerr << "Primary index (before sorting on freq.)\n";
@@ -921,78 +1922,77 @@ share_arcs(node *root)
 #endif
 #endif
 
+  // Nodes in the primary register grouped on the number of children.
+  // Sorting on frequency (above) does not change the hash values.
+  kids_index	snap(root);
+
   prime_kids = 0;
   // start from nodes with the biggest number of children
-  tip1 = prim_index->down.indx + prim_index->counter - 1;
-
-  for (i = prim_index->counter - 1; i >= 0; --i, --tip1) {
-    if (tip1->counter) {
+  for (i = MAX_ARCS_PER_NODE; i >= 0; --i) {
+    if (snap.get_counter(i)) {
       prime_kids_tab[prime_kids++] = i;
     }
   }
 
-  for (i = 1; i < prime_kids; i++) {
-    tip1 = prim_index->down.indx + prime_kids_tab[i];
-
-
-    // Now register pseudonodes consisting of sets of `prime_kids_tab[i]' arcs
-    // taken from the nodes that have more than `prime_kids_tab[i]' arcs
-    for (j = 0; j < i; j++) {
-      tip2 = prim_index->down.indx + prime_kids_tab[j];
-
-      // We have passed # of children index, now go through hash function
-      tip3 = tip2->down.indx;
-      for (int k = 0; k < tip2->counter; k++, tip3++) {
-	if (tip3->counter == 0)
-	  continue;
-
-	// Now we register each set of tip->data arcs
-	tip4 = tip3->down.leaf;
-	for (l = 0; l < tip3->counter; l++, tip4++) {
-	  if ((*tip4)->get_big_brother() == NULL)
-	    register_subnodes(*tip4, prime_kids_tab[i]);
-	}
-      }
-    }
+  // sizes of pseudonodes to be registered
+  char		sizes[MAX_ARCS_PER_NODE + 1];
+  int		max_count = 0;
+  for (i = 0; i <= MAX_ARCS_PER_NODE; i++) {
+    sizes[i] = (i > 0 && snap.get_counter(i) != 0);
+    if (snap.get_counter(i) > max_count)
+      max_count = snap.get_counter(i);
+  }
 
-    // Secondary index created, now look for nodes in primary index
-#ifdef DEBUG
-    cerr << "Secondary index for " << prime_kids_tab[i] << " arcs\n";
-    show_index(SECOND_INDEX);
+  share_pool	pool(jobs);
+  share_step	st;
+  st.sizes = sizes;
+  st.no_of_shards = pool.get_jobs();
+  st.shards = new pseudo_register[st.no_of_shards];
+  st.found = new node *[max_count + 1];
+  st.offsets = new int[max_count + 1];
+  st.first = new int[max_count + 1];
+#ifdef PROGRESS
+  if (pool.get_jobs() > 1)
+    cerr << "Using " << pool.get_jobs() << " threads" << endl;
 #endif
-    tip3 = tip1->down.indx;
-    for (j = 0; j < tip1->counter; j++, tip3++) {
-      if (tip3->counter == 0)
-	continue;
-
-      tip4 = tip3->down.leaf;
-      for (l = 0; l < tip3->counter; l++, tip4++) {
-	if ((new_node = find_or_register(*tip4, SECOND_INDEX, FIND))) {
-	  // Node *tip4 (taken from primary index) was found in secondary
-	  // index (of subnodes), so it can be replaced by a reference
-	  // to a set of arcs of the node `new_node'. So we do that.
 
-	  if ((offset = get_pseudo_offset(*tip4, new_node)) >= 0) {
-	    (*tip4)->set_link(new_node, offset);
-	    nodes_knocked++;
-	    arcs_knocked += prime_kids_tab[i];
-	  }
-	  else {
-	    cerr << "Error in index\n";
-	    cerr << "While looking for " << (long)(*tip4) << " found "
-	      << (long)new_node << "\n";
-	    cerr << (long)(*tip4) << " has bb "
-	      << (long)((*tip4)->get_big_brother()) << "\n";
-	  }
+  for (i = 0; i < prime_kids && prime_kids_tab[i] > 0; i++) {
+    st.nodes = tip4 = snap.get_nodes(prime_kids_tab[i]);
+    st.count = snap.get_counter(prime_kids_tab[i]);
+    // Look for nodes with `prime_kids_tab[i]' arcs among pseudonodes
+    // of bigger nodes
+    if (i > 0) {
+      pool.run(find_pseudo, &st, st.count, SHARE_CHUNK);
+      for (l = 0; l < st.count; l++) {
+	if ((new_node = st.found[l])) {
+	  // Node tip4[l] can be replaced by a reference to a set of arcs
+	  // of the node `new_node'. So we do that.
+	  tip4[l]->set_link(new_node, st.offsets[l]);
+	  nodes_knocked++;
+	  arcs_knocked += prime_kids_tab[i];
 	}
       }
     }
-
-    // Now secondary index for tip1->data number of nodes is no longer needed
-    // Destroy the index to make room for other data
-    tip3 = get_index_by_name(SECOND_INDEX);
-    destroy_index(*tip3);
+    // Nodes that keep their arcs may be big brothers of smaller ones
+    if (i < prime_kids - 1) {
+      int per_node = pseudo_count(prime_kids_tab[i], sizes);
+      st.first[0] = 0;
+      for (l = 0; l < st.count; l++)
+	st.first[l + 1] = st.first[l]
+	  + (tip4[l]->get_big_brother() == NULL ? per_node : 0);
+      st.entries = new pseudo_slot[st.first[st.count] + 1];
+      pool.run(list_pseudo, &st, st.count, SHARE_CHUNK);
+      pool.run(insert_pseudo, &st, st.no_of_shards, 1);
+      delete [] st.entries;
+    }
   }
+#ifdef DEBUG
+  unsigned long registered = 0;
+  for (i = 0; i < st.no_of_shards; i++)
+    registered += st.shards[i].get_counter();
+  cerr << "Registered " << registered << " pseudonodes\n";
+#endif
+  delete [] st.shards;
 
 #ifdef MORE_COMPR
   // Take nodes from the primary index in groups of equal number of arcs.
@@ -1002,34 +2002,52 @@ share_arcs(node *root)
   // are isomorphic to those new nodes. If so, create links.
 
 #ifdef PROGRESS
-  cerr << "Changing the order of transitions" << endl;
+  if (level >= SHARE_SUBSETS)
+    cerr << "Changing the order of transitions" << endl;
 #endif
+  st.max_arcs = (level >= SHARE_MORE_SUBSETS ? MAX_ARCS_TO_SHUFFLE_O3
+		 : MAX_ARCS_TO_SHUFFLE);
+  st.max_subset = (level >= SHARE_MORE_SUBSETS ? MAX_SUBSET_SHUFFLE_O3
+		   : MAX_SUBSET_SHUFFLE);
 
   // Begin with the largest nodes, proceed to smaller
-  for (i = 0; i < prime_kids - 1; i++) {
+  for (i = 0; level >= SHARE_SUBSETS && i < prime_kids - 1; i++) {
 #ifdef PROGRESS
     cerr << "  Considering states with " << prime_kids_tab[i] << " states.\n";
 #endif
-    tip1 = prim_index->down.indx + prime_kids_tab[i];
-    // Go through hash level
-    tip3 = tip1->down.indx;
-    for (j = 0; j < tip1->counter; j++, tip3++) {
-      if (tip3->counter == 0)
-	continue;
-
-      tip4 = tip3->down.leaf;	// the leaf level
-      for (l = 0; l < tip3->counter; l++, tip4++) {
-	if ((*tip4)->get_big_brother() == NULL
-	    && (*tip4)->free_end == (*tip4)->get_no_of_kids()) {
-	  if (match_subset(*tip4, prime_kids_tab + i, prime_kids - i)) {
+    st.nodes = tip4 = snap.get_nodes(prime_kids_tab[i]);
+    st.count = snap.get_counter(prime_kids_tab[i]);
+    st.kids_tab = prime_kids_tab + i;
+    st.kids_no_no = prime_kids - i;
+    if (pool.get_jobs() > 1)
+      pool.run(try_subsets, &st, st.count, SHARE_CHUNK / 8);
+    for (l = 0; l < st.count; l++) {
+      if (tip4[l]->get_big_brother() == NULL
+	  && tip4[l]->free_end == tip4[l]->get_no_of_kids()) {
+	if (pool.get_jobs() > 1) {
+	  if ((new_node = st.found[l]) == NULL)
+	    continue;		// nothing found, nothing would be found now
+	  if (new_node->get_big_brother() == NULL &&
+	      new_node->free_end == new_node->get_no_of_kids()) {
+	    link_subset(tip4[l], new_node);
 	    nodes_knocked++;
 	    arcs_knocked += prime_kids_tab[i];
+	    continue;
 	  }
+	  // new_node has been linked to another node; search again
+	}
+	if (match_subset(tip4[l], st.kids_tab, st.kids_no_no,
+			 st.max_arcs, st.max_subset, NULL)) {
+	  nodes_knocked++;
+	  arcs_knocked += prime_kids_tab[i];
 	}
       }
     }
   }
 #endif
+  delete [] st.found;
+  delete [] st.offsets;
+  delete [] st.first;
 
 #ifdef STOPBIT
 #ifdef TAILS
@@ -1048,34 +2066,32 @@ share_arcs(node *root)
   // one arc smaller then the second largest one (we do not start with
   // the size of the second largest one, because that case should have been
   // handled above).
-  if (prime_kids > 1) {
+  // Only versions 6 and 7 of the automaton can have shared tails.
+  if (prime_kids > 1 &&
+      (build_ctx->version == 6 || build_ctx->version == 7)) {
     for (i = prime_kids_tab[(contains_many_nodes(prime_kids_tab[0])?0:1)] - 1;
 	 i > 0; --i) {
       // Now `i' is the current tail size.
       // Examine all nodes bigger than that size
       for (j = 0; prime_kids_tab[j] > i; j++) {
-	tip1 = prim_index->down.indx + prime_kids_tab[j];
-	// Go through the hash level
-	tip3 = tip1->down.indx;
-	for (k = 0; k < tip1->counter; k++, tip3++) {
-	  if (tip3->counter == 0)
-	    continue;
-
-	  tip4 = tip3->down.leaf;	// the leaf level
-	  for (l = 0; l < tip3->counter; l++, tip4++) {
-	    if ((*tip4)->free_beg == 0 && (*tip4)->get_big_brother() == NULL
+	tip4 = snap.get_nodes(prime_kids_tab[j]);
+	k = snap.get_counter(prime_kids_tab[j]);
+	for (l = 0; l < k; l++, tip4++) {
+	  if ((*tip4)->free_beg == 0 && (*tip4)->get_big_brother() == NULL
 #ifdef MORE_COMPR
-		&& (*tip4)->free_end >= i
+	      && (*tip4)->free_end >= i
 #endif
-		) {
+	      ) {
 #ifdef MORE_COMPR
-	      if (!check_tails(*tip4, i))
-		if ((*tip4)->get_brother_offset() != (unsigned char)-1)
-		  match_tails(*tip4, i);
+	    // match_tails reorders arcs, so it goes first; a tail registered
+	    // by check_tails must not change afterwards
+	    if (level >= SHARE_SUBSETS &&
+		(*tip4)->get_brother_offset() != (unsigned char)-1)
+	      match_tails(*tip4, i);
+	    check_tails(*tip4, i);
 #else
-	      check_tails(*tip4, i);
+	    check_tails(*tip4, i);
 #endif
-	    }
 	  }
 	}
       }
@@ -1322,20 +2338,13 @@ pair_registery::join_arcs(void)
 void
 pair_registery::merge_pairs(void)
 {
-  tree_index	*prim_index;
+  kids_index	snap;
   node		**tip3;
 
-  prim_index = get_index_by_name(PRIM_INDEX);
-  tree_index *tip1 = prim_index->down.indx + 2;
-  if (tip1 == NULL)
-    return;
-  tree_index *tip2 = tip1->down.indx;
-  for (int i = 0; i < tip1->counter; i++, tip2++) {
-    tip3 = tip2->down.leaf;
-    for (int j = 0; j < tip2->counter; j++, tip3++)
-      if ((*tip3)->big_brother == NULL)
-	reg((*tip3));
-  }
+  tip3 = snap.get_nodes(2);
+  for (int j = 0; j < snap.get_counter(2); j++, tip3++)
+    if ((*tip3)->big_brother == NULL)
+      reg((*tip3));
   prepare();
   join_arcs();
 }//pair_registery::merge_pairs
@@ -1363,6 +2372,34 @@ show_index(const int index_name)
   node		**tip2;
   arc_node	*tip3;
 
+  if (index_name == PRIM_INDEX) {
+    // The primary register is a hash table; show it grouped on children
+    kids_index	snap;
+    for (i = MAX_ARCS_PER_NODE; i >= 0; --i) {
+      c = snap.get_counter(i);
+      if (c == 0)
+	continue;
+      cerr << "+-children: " << dec << i << " (" << c
+	   << (c == 1 ? " entry)\n" : " entries)\n");
+      tip2 = snap.get_nodes(i);
+      for (k = 0; k < c; k++, tip2++) {
+	cerr << "  +-node: " << hex << (long)(*tip2);
+	if ((*tip2)->get_big_brother())
+	  cerr << "(->" << hex << (long)((*tip2)->get_big_brother()) << ")";
+	cerr << "\n";
+	tip3 = (*tip2)->get_children();
+	for (l = 0; l < (*tip2)->get_no_of_kids(); l++, tip3++) {
+	  cerr << "  " << (k < c - 1 ? "| " : "  ")
+	       << "+-" << tip3->letter << (tip3->is_final ? "!" : " ")
+	       << " " << hex << (long)(node *)(tip3->child)
+	       << "\n";
+	}
+      }
+      cerr << dec;
+    }
+    return;
+  }
+
   tree_index *index_root = get_index_by_name(index_name);
   kids = 0;
   for (i = 0; i < index_root->counter; i++)
@@ -1394,7 +2431,7 @@ show_index(const int index_name)
 	       << (j < hashes - 1 ? "| " : "  ")
 	       << (k < tip1->down.indx[hash_tab[j]].counter - 1 ? "| " : "  ")
 	       << "+-" << tip3->letter << (tip3->is_final ? "!" : " ")
-	       << " " << hex << (long)(tip3->child)
+	       << " " << hex << (long)(node *)(tip3->child)
 	       << "\n";
 	}
       }
@@ -14,6 +14,18 @@ enum { PRIM_INDEX, SECOND_INDEX };
 /* Max size of a subset in match_subset */
 #define MAX_SUBSET_SHUFFLE	10
 
+/* The same limits for the highest effort of share_arcs (-O3) */
+#define MAX_ARCS_TO_SHUFFLE_O3	48
+#define MAX_SUBSET_SHUFFLE_O3	12
+
+/* Effort of share_arcs:
+   SHARE_TAILS		- (-O1) only replace nodes with tails of bigger nodes;
+   SHARE_SUBSETS	- (-O2, -O) also reorder arcs to find subsets
+			  (with MORE_COMPR);
+   SHARE_MORE_SUBSETS	- (-O3) as SHARE_SUBSETS, but in bigger nodes,
+			  and with bigger subsets. */
+enum { SHARE_TAILS = 1, SHARE_SUBSETS, SHARE_MORE_SUBSETS };
+
 struct tree_index {
   union down_pointer {
     node	**leaf;		// to the table where each entry contains
@@ -30,6 +42,279 @@ struct tree_index {
 };//tree_index
 
 
+/* An entry in the primary register. The hash value is kept so that
+   it need not be recomputed when the table grows, or when entries
+   are moved during deletion. Its lower 32 bits are enough for that,
+   and with NODE_INDICES the entry takes only 8 bytes. */
+struct reg_slot {
+  uint32_t	hash;		// struct_hash() of the node at registration
+  node_ptr	n;		// registered node (NULL - empty slot)
+  int used(void) const { return node_id(n) != 0; }
+};//reg_slot
+
+/* Class name:	node_register
+ * Purpose:	Provide the primary register of nodes as an open-addressing
+ *		hash table keyed by node::struct_hash().
+ * Methods:	find		- find a node isomorphic to the argument;
+ *		find_or_insert	- find an isomorphic node, or insert the node;
+ *		remove		- remove a node from the register;
+ *		get_slots	- returns the table (for scanning);
+ *		get_capacity	- returns the size of the table;
+ *		get_counter	- returns the number of registered nodes;
+ *		reserve		- make room for a number of nodes;
+ *		find_or_insert_shared
+ *				- find_or_insert by many threads at once.
+ * Remarks:	Linear probing is used. The table is kept at most half full,
+ *		and it grows by doubling. Deletion moves subsequent entries
+ *		of the same cluster back, so no tombstones are needed.
+ *		Find, insert, and remove take O(1) expected time.
+ *
+ *		With THREADS, parts of the automaton built by different
+ *		threads are merged with find_or_insert_shared, which may be
+ *		called by several threads at the same time. An empty slot
+ *		is claimed with compare-and-swap. The table does not grow
+ *		then, so there must be enough room reserved beforehand.
+ *		No other method may be called at that time.
+ */
+class node_register {
+private:
+  reg_slot	*slots;		// the table
+  unsigned long	mask;		// size of the table - 1 (size is 2^n)
+  unsigned long	counter;	// number of registered nodes
+  void grow(void);
+public:
+  node_register(void) : slots(NULL), mask(0), counter(0) {}
+  ~node_register(void) { delete [] slots; }
+  node *find(const node *n, const uint32_t h) const;
+  node *find_or_insert(node *n, const int register_it);
+  int remove(const node *n);
+  const reg_slot *get_slots(void) const { return slots; }
+  unsigned long get_capacity(void) const { return (slots ? mask + 1 : 0); }
+  unsigned long get_counter(void) const { return counter; }
+  void reserve(const unsigned long n);
+#ifdef THREADS
+  node *find_or_insert_shared(node *n);
+#endif
+};//node_register
+
+
+/* An entry in the register of pseudonodes. A pseudonode is a sequence
+   of `size' arcs of node n beginning at arc `offset'. */
+struct pseudo_slot {
+  uint32_t	hash;		// pseudo_hash() of the arcs
+  node_ptr	n;		// node the arcs belong to (NULL - empty slot)
+  unsigned char	size;		// number of arcs
+  unsigned char	offset;		// number of the first arc
+  int used(void) const { return node_id(n) != 0; }
+};//pseudo_slot
+
+/* Class name:	pseudo_register
+ * Purpose:	Register pseudonodes (sequences of arcs of bigger nodes)
+ *		for share_arcs, so that a node with the same arcs can be found
+ *		in one lookup.
+ * Methods:	pseudo_register	- create an empty register;
+ *		~pseudo_register
+ *				- release memory (but not the nodes);
+ *		find		- find a pseudonode with the arcs of a node;
+ *		insert		- register a pseudonode unless an equal one
+ *				  is already there;
+ *		get_counter	- number of registered pseudonodes.
+ * Remarks:	This replaces the secondary index in share_arcs.
+ *		Instead of registering pseudonodes of one size at a time,
+ *		and searching them with part_cmp_nodes, the pseudonodes
+ *		of all sizes of a node are registered at once.
+ *		With STOPBIT, only the tails of nodes are pseudonodes,
+ *		and their hash values are computed in one pass from the last
+ *		arc backwards (see pseudo_hash).
+ *
+ *		It is an open-addressing hash table with linear probing,
+ *		like node_register. Entries are never removed.
+ *		With more than one thread, share_arcs divides pseudonodes
+ *		among several registers on their hash values,
+ *		and each register is filled by one thread.
+ */
+class pseudo_register {
+private:
+  pseudo_slot	*slots;		// the table
+  unsigned long	mask;		// size of the table - 1 (size is 2^n)
+  unsigned long	counter;	// number of registered pseudonodes
+  void grow(void);
+public:
+  pseudo_register(void) : slots(NULL), mask(0), counter(0) {}
+  ~pseudo_register(void) { delete [] slots; }
+  node *find(const node *n, const uint32_t h, int &offset) const;
+  void insert(const pseudo_slot &p);
+  unsigned long get_counter(void) const { return counter; }
+};//pseudo_register
+
+
+/* Class name:	kids_index
+ * Purpose:	Provide a snapshot of the primary register with nodes
+ *		grouped by their number of children.
+ * Methods:	kids_index	- collects the nodes;
+ *		~kids_index	- releases memory (but not the nodes);
+ *		get_counter	- number of nodes with given number of kids;
+ *		get_nodes	- vector of nodes with given number of kids.
+ * Remarks:	Nodes in a group are in the order of a depth-first
+ *		traversal from the root if it is given, so that it does not
+ *		depend on addresses of nodes, or else on their addresses.
+ *		Nodes registered after the snapshot has been taken
+ *		are not included in it. This is needed by share_arcs
+ *		and by JOIN_PAIRS, which used to go through the first level
+ *		of the tree index.
+ */
+class kids_index {
+private:
+  node		**nodes[MAX_ARCS_PER_NODE + 1];
+  int		counter[MAX_ARCS_PER_NODE + 1];
+public:
+  kids_index(node *root = NULL);
+  ~kids_index(void);
+  int get_counter(const int kids) const { return counter[kids]; }
+  node **get_nodes(const int kids) const { return nodes[kids]; }
+};//kids_index
+
+
+/* Class name:	build_context
+ * Purpose:	Keep everything that is needed to build one automaton.
+ * Methods:	build_context	- initialize;
+ *		~build_context	- release memory.
+ * Variables:	arena		- memory for nodes and vectors of arcs;
+ *		primary		- the primary register;
+ *		secondary	- the secondary index (pseudonodes);
+ *		annot_separator	- separates words from annotations;
+ *		frequency_table	- number of occurences of labels on arcs;
+ *		no_of_arcs	- number of arcs numbered so far;
+ *		arc_count	- number of arcs in the automaton;
+ *		node_count	- number of nodes in the automaton;
+ *		a_size		- size of an arc;
+ *		entryl		- size of the number of entries in a node;
+ *		gtl		- size of the goto field;
+ *		next_nodes	- number of arcs that lead to the next node;
+ *		tails		- number of nodes that share their tails;
+ *		version		- version (format) of the automaton
+ *				  to be written;
+ *		in_annotations	- nodes being numbered or written
+ *				  are in annotations (SPARSE);
+ *		deferred	- nodes whose numbering waited (MORE_COMPR),
+ *				  in the order in which they are numbered
+ *				  and written after other nodes;
+ *		reorder_time	- how many seconds may be spent on choosing
+ *				  the order of nodes (MORE_COMPR);
+ *		descendants	- scratch space for choosing the last arc
+ *				  of a node in node::number_arcs (MORE_COMPR);
+ *		tail_template	- node used for finding tails.
+ * Remarks:	Each automaton has its own context, so that several automata
+ *		can be built in one process, also at the same time by
+ *		different threads. The functions and methods that build
+ *		an automaton use the context pointed to by build_ctx.
+ *		It is set for the calling thread with build_scope.
+ *		Nodes still in the arena are not destroyed when the context
+ *		is destroyed; their memory is given back all at once.
+ */
+class build_context {
+public:
+  node_arena	arena;
+  node_register	primary;
+  tree_index	secondary;
+  char		annot_separator;
+  int		frequency_table[256];
+  int		no_of_arcs;
+  int		arc_count;
+  int		node_count;
+  int		a_size;
+  int		entryl;
+  int		gtl;
+  int		next_nodes;
+  int		tails;
+  int		version;
+#ifdef SPARSE
+  bool		in_annotations;
+#endif
+#ifdef MORE_COMPR
+  vector<node *> deferred;
+  int		reorder_time;
+  node		*descendants[MAX_ARCS_PER_NODE];
+#endif
+  node		*tail_template;
+  build_context(void);
+  ~build_context(void);
+};//build_context
+
+/* The context of the automaton the thread is building */
+extern THREAD_LOCAL build_context	*build_ctx;
+
+/* Class name:	build_scope
+ * Purpose:	Make the calling thread work on an automaton.
+ * Methods:	build_scope	- use the context (and its arena);
+ *		~build_scope	- use the previous ones again.
+ * Remarks:	Scopes may be nested, e.g. when one automaton is built
+ *		while another one is being built.
+ */
+class build_scope {
+private:
+  build_context	*old_ctx;
+  node_arena	*old_arena;
+public:
+  build_scope(build_context *c) {
+    old_ctx = build_ctx; old_arena = build_arena;
+    build_ctx = c; build_arena = &c->arena;
+  }
+  ~build_scope(void) { build_ctx = old_ctx; build_arena = old_arena; }
+};//build_scope
+
+
+/* A function that does items from `from' to `to' - 1 of a job */
+typedef void (*share_fn)(void *job, const int from, const int to);
+
+/* Class name:	share_pool
+ * Purpose:	Provide threads that do parts of share_arcs in parallel.
+ * Methods:	share_pool	- start threads;
+ *		~share_pool	- stop them;
+ *		get_jobs	- number of threads (with the calling one);
+ *		run		- do a job with all threads.
+ * Remarks:	The threads are started once for share_arcs, and they wait
+ *		for jobs. A job consists of a number of items. Threads take
+ *		chunks of consecutive items from a common counter until
+ *		there are no items left, so a thread that finishes early
+ *		takes work that would otherwise wait for a slower one.
+ *		The calling thread works too, and run() returns when
+ *		all items are done. Functions doing the items must not
+ *		depend on the order in which items are done.
+ *
+ *		The threads work in the build context of the calling one.
+ *		They have their own allocation state in the arena.
+ *		Without THREADS, or with one job, the items are done
+ *		by the calling thread.
+ */
+class share_pool {
+private:
+  int		jobs;		// number of threads (with the calling one)
+#ifdef THREADS
+  build_context	*context;	// context of the automaton
+  pthread_t	*threads;	// threads other than the calling one
+  int		started;	// number of threads started
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;	// a new job or the end
+  pthread_cond_t work_done;	// the last thread has finished its part
+  share_fn	fn;		// the current job
+  void		*job;
+  int		count;		// number of its items
+  int		chunk;		// number of items taken at a time
+  int		next;		// the first item not taken yet
+  unsigned long	generation;	// number of jobs so far
+  int		busy;		// threads still working on the job
+  int		quit;		// threads should end
+  static void *worker(void *pool);
+  void work(void);
+#endif
+public:
+  share_pool(const int n);
+  ~share_pool(void);
+  int get_jobs(void) const { return jobs; }
+  void run(share_fn f, void *j, const int items, const int chunk_size);
+};//share_pool
+
 
 
 /* Name:	get_index_by_name
@@ -37,13 +322,39 @@ struct tree_index {
  * Purpose:	Delivers appropriate index.
  * Parameters:	index_name	- (i) index number.
  * Returns:	Root of required index.
- * Remarks:	Currently two indices available: PRIM_INDEX and SECOND_INDEX.
- *		No parameter checking.
+ * Remarks:	Only SECOND_INDEX is a tree index. PRIM_INDEX is
+ *		a hash table (see get_register()); NULL is returned for it.
  */
 tree_index *
 get_index_by_name(const int index_name);
 
 
+/* Name:	get_register
+ * Class:	None
+ * Purpose:	Delivers the primary register.
+ * Parameters:	None.
+ * Returns:	The primary register.
+ * Remarks:	It is the register of the calling thread if it has been
+ *		set with set_thread_register(), or the register
+ *		of the automaton being built.
+ */
+node_register *
+get_register(void);
+
+
+/* Name:	set_thread_register
+ * Class:	None
+ * Purpose:	Makes the calling thread use its own primary register.
+ * Parameters:	r		- (i) the register, or NULL for the common one.
+ * Returns:	The register used before.
+ * Remarks:	This is used when parts of the automaton are built
+ *		in parallel. get_register() and find_or_register()
+ *		use the register of the thread.
+ */
+node_register *
+set_thread_register(node_register *r);
+
+
 /* Name:	register_at_level
  * Class:	None.
  * Purpose:	Looks for an appropriate entry at the given level.
@@ -184,8 +495,10 @@ bsearch_reg(const node *n, node **low, node **high,
  *		register_it	- (i) if TRUE, register the node,
  *					if FALSE, find an isomorphic node.
  * Returns:	Pointer to an isomorphic node or NULL.
- * Remarks:	The index has levels indexed for:
- *		number of children (primary index) / first letter (secondary)
+ * Remarks:	The primary index is a hash table keyed by a 64-bit hash
+ *		of all arcs of the node (node::struct_hash()).
+ *		The secondary index has levels indexed for:
+ *		first letter
  *		hash function
  *		all features of the node.
  *
@@ -268,12 +581,17 @@ destroy_index(tree_index &index_root);
  * Purpose:	Tries to find if arcs of one node are a subset of another.
  *		If so, a reference to them is replaced by a reference
  *		to a part (a subset) of the other node.
- * Parameters:	None.
+ * Parameters:	root		- (i) root of the automaton;
+ *		level		- (i) effort (SHARE_TAILS, SHARE_SUBSETS,
+ *				  or SHARE_MORE_SUBSETS);
+ *		jobs		- (i) number of threads.
  * Returns:	Number of suppressed arcs.
- * Remarks:	This must take A LOT of time!
+ * Remarks:	Nodes are looked up among pseudonodes of bigger nodes
+ *		in a hash table (pseudo_register). The result does not
+ *		depend on the number of threads.
  */
 int
-share_arcs(node *root);
+share_arcs(node *root, const int level = SHARE_SUBSETS, const int jobs = 1);
 
 
 #ifdef JOIN_PAIRS
@@ -0,0 +1,404 @@
+/***	ninput.cc	***/
+
+/*	Copyright (C) Jan Daciuk, 1996-2011	*/
+
+#include	<iostream>
+#include	<stddef.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	<sys/mman.h>
+#ifdef THREADS
+#include	<sched.h>
+#endif
+#include	"fsa.h"
+#include	"nnode.h"
+#include	"ninput.h"
+
+using namespace std;
+
+/* Indices of the queues are read by the other thread */
+#ifdef THREADS
+#define	LOAD_ACQUIRE(x)		__atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define	STORE_RELEASE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define	LOAD_ACQUIRE(x)		(x)
+#define	STORE_RELEASE(x, v)	((x) = (v))
+#endif
+
+
+/* Name:	common_length
+ * Class:	None.
+ * Purpose:	Computes the length of the common prefix of two strings.
+ * Parameters:	s1		- (i) the first string;
+ *		l1		- (i) its length;
+ *		s2		- (i) the second string;
+ *		l2		- (i) its length.
+ * Returns:	The length of the common prefix.
+ * Remarks:	Strings are compared a machine word at a time first.
+ */
+static inline int
+common_length(const char *s1, const int l1, const char *s2, const int l2)
+{
+  int		n = (l1 < l2 ? l1 : l2);
+  int		i = 0;
+  size_t	w1, w2;
+
+  while (i + (int)sizeof(size_t) <= n) {
+    memcpy(&w1, s1 + i, sizeof(size_t));
+    memcpy(&w2, s2 + i, sizeof(size_t));
+    if (w1 != w2)
+      break;
+    i += sizeof(size_t);
+  }
+  while (i < n && s1[i] == s2[i])
+    i++;
+  return i;
+}//common_length
+
+
+/* Name:	word_reader
+ * Class:	word_reader
+ * Purpose:	Initializes the reader.
+ * Parameters:	None.
+ * Returns:	Nothing (constructor).
+ * Remarks:	Nothing is read until open() is called.
+ */
+word_reader::word_reader(void)
+{
+  fd = -1; mapped = NULL; mapped_size = 0;
+  for (unsigned long i = 0; i < INPUT_BLOCKS; i++) {
+    blocks[i].data = NULL;
+    blocks[i].allocated = 0;
+  }
+  current = to_release = -1;
+  data = NULL; filled = pos = 0; at_eof = TRUE;
+  prev_text = NULL; prev_length = 0;
+  finished = FALSE; failed = FALSE; stop = FALSE;
+  q_head = q_tail = f_head = f_tail = 0;
+#ifdef THREADS
+  use_thread = thread_running = FALSE;
+#endif
+}//word_reader::word_reader
+
+
+/* Name:	~word_reader
+ * Class:	word_reader
+ * Purpose:	Stops reading, and frees memory.
+ * Parameters:	None.
+ * Returns:	Nothing (destructor).
+ * Remarks:	The producer thread may be waiting for room in the queue
+ *		if not all lines have been read.
+ */
+word_reader::~word_reader(void)
+{
+  STORE_RELEASE(stop, TRUE);
+#ifdef THREADS
+  if (thread_running)
+    pthread_join(producer, NULL);
+#endif
+  if (mapped)
+    munmap(mapped, mapped_size);
+  if (fd > 0)
+    close(fd);
+  for (unsigned long i = 0; i < INPUT_BLOCKS; i++)
+    delete [] blocks[i].data;
+}//word_reader::~word_reader
+
+
+/* Name:	open
+ * Class:	word_reader
+ * Purpose:	Prepares a file for reading, and starts reading it.
+ * Parameters:	file_name	- (i) name of the file,
+ *				  or NULL for standard input.
+ * Returns:	TRUE if the file could be opened, FALSE otherwise.
+ * Remarks:	A non-empty regular file is mapped into memory. If this is
+ *		not possible, the input is read in blocks.
+ *		With THREADS, the producer thread is started by the first
+ *		call to next(), so that get_text() can be used before.
+ */
+int
+word_reader::open(const char *file_name)
+{
+  struct stat	st;
+  void		*m;
+
+  if (file_name == NULL)
+    fd = 0;
+  else if ((fd = ::open(file_name, O_RDONLY)) < 0)
+    return FALSE;
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m != MAP_FAILED) {
+      mapped = (char *)m;
+      mapped_size = (size_t)st.st_size;
+      madvise(m, mapped_size, MADV_SEQUENTIAL);
+      data = mapped;
+      filled = mapped_size;
+    }
+  }
+  if (mapped == NULL) {
+    for (unsigned long i = 0; i < INPUT_BLOCKS; i++) {
+      blocks[i].data = new char[INPUT_BLOCK_SIZE];
+      blocks[i].allocated = INPUT_BLOCK_SIZE;
+    }
+    // block 0 is filled first, the others are free
+    for (unsigned long i = 1; i < INPUT_BLOCKS; i++)
+      free_blocks[i - 1] = i;
+    f_head = INPUT_BLOCKS - 1;
+    current = 0;
+    data = blocks[0].data;
+    filled = 0;
+    at_eof = FALSE;
+  }
+
+#ifdef THREADS
+  use_thread = TRUE;
+#endif
+  return TRUE;
+}//word_reader::open
+
+
+/* Name:	open_text
+ * Class:	word_reader
+ * Purpose:	Prepares lines that are already in memory for reading.
+ * Parameters:	text		- (i) the lines;
+ *		size		- (i) their size in bytes.
+ * Returns:	Nothing.
+ * Remarks:	The text is not copied. No thread is started.
+ */
+void
+word_reader::open_text(const char *text, const size_t size)
+{
+  data = text;
+  filled = size;
+  pos = 0;
+  at_eof = TRUE;
+}//word_reader::open_text
+
+
+/* Name:	next
+ * Class:	word_reader
+ * Purpose:	Delivers the next line of input.
+ * Parameters:	line		- (o) the line.
+ * Returns:	TRUE if there was a line, FALSE at the end of input.
+ * Remarks:	Blocks that are no longer needed are given back
+ *		to the producer on the way.
+ */
+int
+word_reader::next(input_line &line)
+{
+  unsigned long	t;
+
+#ifdef THREADS
+  if (use_thread) {
+    use_thread = FALSE;
+    thread_running =
+      (pthread_create(&producer, NULL, run_producer, this) == 0);
+  }
+#endif
+  for (;;) {
+    t = q_tail;
+    if (t == LOAD_ACQUIRE(q_head)) {
+      // queue empty
+#ifdef THREADS
+      if (thread_running) {
+	sched_yield();
+	continue;
+      }
+#endif
+      produce();
+      continue;
+    }
+    line = queue[t % INPUT_QUEUE_SIZE];
+    if (line.text == NULL) {
+      if (line.length < 0)
+	return FALSE;		// end of input (stays in the queue)
+      // the block is not needed any more
+      free_blocks[f_head % INPUT_BLOCKS] = line.length;
+      STORE_RELEASE(f_head, f_head + 1);
+      STORE_RELEASE(q_tail, t + 1);
+      continue;
+    }
+    STORE_RELEASE(q_tail, t + 1);
+    return TRUE;
+  }
+}//word_reader::next
+
+
+#ifdef THREADS
+/* Name:	run_producer
+ * Class:	word_reader (static).
+ * Purpose:	Body of the producer thread.
+ * Parameters:	reader		- (i/o) the reader.
+ * Returns:	NULL.
+ * Remarks:	The thread gives way when the queue is full, or there is
+ *		no free block to read into.
+ */
+void *
+word_reader::run_producer(void *reader)
+{
+  word_reader	*r = (word_reader *)reader;
+
+  while (!LOAD_ACQUIRE(r->stop) && r->produce())
+    sched_yield();
+  return NULL;
+}//word_reader::run_producer
+#endif
+
+
+/* Name:	produce
+ * Class:	word_reader
+ * Purpose:	Splits input into lines, and puts them into the queue.
+ * Parameters:	None.
+ * Returns:	TRUE if more lines can be produced later,
+ *		FALSE if the end of input has been put into the queue.
+ * Remarks:	Returns when the queue is full, or when a free block
+ *		is needed but there is none.
+ *		memchr is used to find the end of line; it is vectorized
+ *		in good C libraries.
+ *		After the first line that follows a change of block
+ *		(so that previous line is no longer needed), the old block
+ *		is put into the queue, so that the consumer gives it back
+ *		after it has read all lines from it.
+ */
+int
+word_reader::produce(void)
+{
+  const char	*nl;
+  const char	*text;
+  int		length;
+  int		lcp;
+
+  while (!finished) {
+    // room for a line and two blocks to be released
+    if (q_head - LOAD_ACQUIRE(q_tail) > INPUT_QUEUE_SIZE - 3)
+      return TRUE;
+    nl = (const char *)memchr(data + pos, '\n', filled - pos);
+    if (nl == NULL) {
+      if (!at_eof) {
+	if (!refill())
+	  return TRUE;		// no free block
+	continue;
+      }
+      if (pos == filled) {
+	// end of input
+	if (to_release >= 0) {
+	  push(NULL, to_release, 0, FALSE);
+	  to_release = -1;
+	}
+	push(NULL, -1, 0, FALSE);
+	finished = TRUE;
+	break;
+      }
+      nl = data + filled;	// the last line has no '\n'
+    }
+    text = data + pos;
+    length = nl - text;
+    pos = (nl < data + filled ? (nl - data) + 1 : filled);
+    if (length == 0)
+      continue;			// empty lines are ignored
+    lcp = common_length(text, length, prev_text, prev_length);
+    push(text, length, lcp,
+	 (lcp == length || lcp == prev_length) ? length >= prev_length :
+	 (unsigned char)text[lcp] > (unsigned char)prev_text[lcp]);
+    prev_text = text;
+    prev_length = length;
+    if (to_release >= 0) {
+      push(NULL, to_release, 0, FALSE);
+      to_release = -1;
+    }
+  }
+  return FALSE;
+}//word_reader::produce
+
+
+/* Name:	refill
+ * Class:	word_reader
+ * Purpose:	Reads more input.
+ * Parameters:	None.
+ * Returns:	TRUE if the input has been read (or end of file reached),
+ *		FALSE if a free block is needed and there is none.
+ * Remarks:	If the current block is full, the beginning of the line
+ *		that has not been completed is copied to a free block,
+ *		which becomes the current one. That block is made bigger
+ *		if the line is long.
+ */
+int
+word_reader::refill(void)
+{
+  input_block	*b = blocks + current;
+  size_t	rest = filled - pos;
+  int		nb;
+  ssize_t	n;
+
+  if (filled == b->allocated) {
+    // the current block is full
+    if (f_tail == LOAD_ACQUIRE(f_head))
+      return FALSE;
+    nb = free_blocks[f_tail % INPUT_BLOCKS];
+    STORE_RELEASE(f_tail, f_tail + 1);
+    if (blocks[nb].allocated < 2 * rest) {
+      delete [] blocks[nb].data;
+      blocks[nb].allocated = 2 * rest;
+      blocks[nb].data = new char[blocks[nb].allocated];
+    }
+    memcpy(blocks[nb].data, data + pos, rest);
+    if (to_release >= 0) {
+      // The current block holds only a part of a very long line;
+      // the previous line is in the block to be released.
+      push(NULL, current, 0, FALSE);
+    }
+    else
+      to_release = current;
+    current = nb;
+    b = blocks + current;
+    data = b->data;
+    filled = rest;
+    pos = 0;
+  }
+
+  n = read(fd, b->data + filled, b->allocated - filled);
+  if (n > 0)
+    filled += n;
+  else if (n == 0 || errno != EINTR) {
+    failed = (n < 0);
+    at_eof = TRUE;
+  }
+  return TRUE;
+}//word_reader::refill
+
+
+/* Name:	push
+ * Class:	word_reader
+ * Purpose:	Puts a line into the queue.
+ * Parameters:	text		- (i) the line, or NULL for a block
+ *				  to be released or end of input;
+ *		length		- (i) its length, or the number of the block,
+ *				  or -1 for end of input;
+ *		lcp		- (i) length of common prefix
+ *				  with the previous line;
+ *		ascending	- (i) whether the line is not smaller
+ *				  than the previous one.
+ * Returns:	TRUE.
+ * Remarks:	The caller checks whether there is room in the queue.
+ */
+int
+word_reader::push(const char *text, const int length, const int lcp,
+		  const int ascending)
+{
+  input_line	*l = queue + (q_head % INPUT_QUEUE_SIZE);
+
+  l->text = text;
+  l->length = length;
+  l->lcp = lcp;
+  l->ascending = ascending;
+  STORE_RELEASE(q_head, q_head + 1);
+  return TRUE;
+}//word_reader::push
+
+/***	EOF ninput.cc	***/
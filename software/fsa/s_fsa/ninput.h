@@ -0,0 +1,110 @@
+/***	ninput.h	***/
+
+/*	Copyright (C) Jan Daciuk, 1996-2011	*/
+
+#ifndef		NINPUT_H
+#define		NINPUT_H
+
+#include	<stddef.h>
+#ifdef THREADS
+#include	<pthread.h>
+#endif
+
+/* A line of input as seen by the builders */
+struct input_line {
+  const char	*text;		// the line (not terminated with '\0')
+  int		length;		// its length (without '\n')
+  int		lcp;		// length of common prefix with previous line
+  int		ascending;	// not smaller than previous line (byte order)
+};/*input_line*/
+
+/* Number of lines in the queue between the reader and the builder
+   (a power of 2) */
+const unsigned long	INPUT_QUEUE_SIZE = 4096;
+/* Size of a block of input when the input cannot be mapped into memory */
+const size_t	INPUT_BLOCK_SIZE = 1 << 20;
+/* Number of such blocks (a power of 2, at least 2) */
+const unsigned long	INPUT_BLOCKS = 4;
+
+/* Class name:	word_reader
+ * Purpose:	Split the input of fsa_build and fsa_ubuild into lines.
+ * Methods:	word_reader	- initialize;
+ *		~word_reader	- stop the reader, free memory;
+ *		open		- open a file (or standard input);
+ *		open_text	- read lines from memory;
+ *		get_text	- the whole input if it is in memory;
+ *		next		- get next line;
+ *		io_error	- tell whether reading failed.
+ * Remarks:	A regular file is mapped into memory, and lines are not
+ *		copied. Other input (e.g. a pipe) is read in big blocks;
+ *		a line that crosses the end of a block is copied
+ *		to the beginning of the next one. Empty lines are skipped.
+ *
+ *		For each line, the length of the common prefix with the previous
+ *		line is computed, and it is checked whether the line
+ *		is not smaller than the previous one (in byte order).
+ *
+ *		The lines are put into a queue with a single producer
+ *		and a single consumer. With THREADS, the producer is
+ *		a separate thread, so reading the input and splitting
+ *		it into lines is done while the automaton is being built.
+ *		Without THREADS, or when the lines are in memory
+ *		(open_text), the queue is filled by next() when it is empty.
+ *
+ *		The text of a line remains valid until the next call
+ *		to next().
+ */
+class word_reader {
+private:
+  struct input_block {
+    char	*data;
+    size_t	allocated;
+  };
+  int		fd;		// input file descriptor
+  char		*mapped;	// the input file mapped into memory
+  size_t	mapped_size;	// its size
+  input_block	blocks[INPUT_BLOCKS];
+  int		current;	// block being filled (-1 if mapped)
+  int		to_release;	// block to be given back after next line
+  const char	*data;		// text being split
+  size_t	filled;		// bytes in data
+  size_t	pos;		// beginning of next line in data
+  int		at_eof;		// no more data can be read
+  const char	*prev_text;	// previous line
+  int		prev_length;	// its length
+  int		finished;	// end of input has been queued
+  int		failed;		// reading failed
+  // queue of lines (producer -> consumer)
+  input_line	queue[INPUT_QUEUE_SIZE];
+  unsigned long	q_head;		// written by the producer
+  unsigned long	q_tail;		// written by the consumer
+  // queue of free blocks (consumer -> producer)
+  int		free_blocks[INPUT_BLOCKS];
+  unsigned long	f_head;		// written by the consumer
+  unsigned long	f_tail;		// written by the producer
+  volatile int	stop;		// the consumer is not interested any more
+#ifdef THREADS
+  pthread_t	producer;
+  int		use_thread;	// producer thread is wanted
+  int		thread_running;
+  static void *run_producer(void *reader);
+#endif
+  int produce(void);
+  int refill(void);
+  int push(const char *text, const int length, const int lcp,
+	   const int ascending);
+public:
+  word_reader(void);
+  ~word_reader(void);
+  int open(const char *file_name);
+  void open_text(const char *text, const size_t size);
+  const char *get_text(size_t &size) const {
+    size = mapped_size; return mapped;
+  }
+  int next(input_line &line);
+  int io_error(void) const { return failed; }
+};//word_reader
+
+#endif
+
+/***	EOF ninput.h	***/
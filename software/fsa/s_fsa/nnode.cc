@@ -21,29 +21,14 @@ This file implements methods of class node.
 #include	"nstr.h"
 #include	"nindex.h"
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#include	"ninput.h"
 #include	"build_fsa.h"
 #endif //FLEXIBLE&STOPBIT&SPARSE
 
 const int	INDEX_SIZE_STEP = 16;	// allocate chunks of 16 pointers
 
-int	node::no_of_arcs = 1;	// initially there is an empty arc #0
-
-int	frequency_table[256];	// no of occurences of labels on arcs
-
 using namespace std;
 
-#ifdef FLEXIBLE
-#ifdef NEXTBIT
-int	node::next_nodes = 0;
-#endif //NEXTBIT
-#if defined(STOPBIT) && defined(TAILS)
-int	node::tails = 0;
-arc_pointer curr_dict_address;
-#endif //STOPBIT&TAILS
-#endif //FLEXIBLE
-#ifdef SPARSE
-bool	node::in_annotations = false;
-#endif //SPARSE
 #ifdef STATISTICS
 
 int node::total_nodes = 0;	/* total number of nodes in the automaton */
@@ -124,12 +109,14 @@ node::fertile(void) const
  *		to a node. hit_count = 0 means the node is not registered yet.
  *		hit_count is also used to avoid deleting nodes that are
  *		pointed to somewhere else in the automaton.
+ *
+ *		The children of the last child are processed recursively
+ *		first, and then the last child itself by replace_or_register.
  */
 node *
 node::compress_or_register(void)
 {
   node		*c_node;		// current node
-  node		*new_node;
 
 #ifdef DEBUG
   cerr << "Compress_or_register with:\n"; // print();
@@ -137,6 +124,37 @@ node::compress_or_register(void)
 
   if (no_of_children) {
     c_node = children[no_of_children - 1].child;
+    if (c_node != NULL && c_node->hit_count == 0 && c_node->no_of_children)
+      // compress or register the children (i.e. the line of the youngest)
+      // NOTE: the node may have children, but this only means that there
+      //       are arcs going from that node; there is no guarrantee
+      //       there are nodes at the end of those arcs.
+      c_node->compress_or_register();
+  }
+  return replace_or_register();
+}//node::compress_or_register
+
+/* Name:	replace_or_register
+ * Class:	node
+ * Purpose:	Registers a child of this node, or replaces it
+ *		with an isomorphic node that is already registered.
+ * Parameters:	i		- (i) number of the arc that leads
+ *				  to the child (the last one if omitted).
+ * Returns:	the node.
+ * Remarks:	The child must not have unregistered children, i.e.
+ *		its own last child must have been processed before.
+ *		The sorted builder calls it for the nodes on the path
+ *		of the previous word, starting from the deepest one,
+ *		so no recursion is needed there.
+ */
+node *
+node::replace_or_register(const int i)
+{
+  node		*c_node;		// current node
+  node		*new_node;
+
+  if (i >= 0) {
+    c_node = children[i].child;
     if (c_node == NULL) {
       // Nothing to be registered. One letter has been previously added
       // to this node, which resulted only in creation of another arc,
@@ -146,12 +164,6 @@ node::compress_or_register(void)
     if (c_node->hit_count == 0) {
       // node has not been registered yet
       if (c_node->no_of_children) {
-	// compress or register the children (i.e. the line of the youngest)
-	// NOTE: the node may have children, but this only means that there
-	//       are arcs going from that node; there is no guarrantee
-	//       there are nodes at the end of those arcs.
-	c_node->compress_or_register();
-
 #ifdef GENERALIZE
 	// As new nodes are created as a merger of of other nodes
 	// the original order of arcs can no longer be preserved.
@@ -175,7 +187,7 @@ node::compress_or_register(void)
 	  delete_branch(c_node);
 
 	  // Link found node to parent
-	  children[no_of_children - 1].child = new_node;
+	  children[i].child = new_node;
 	}
 	else {
 	  // subgraph is unique, registered
@@ -202,7 +214,116 @@ node::compress_or_register(void)
   }//if there is a node to register
 
   return this;
-}//node::compress_or_register
+}//node::replace_or_register
+
+#ifdef THREADS
+/* Name:	merge_shared
+ * Class:	node
+ * Purpose:	Puts the subgraph that begins at this node into the common
+ *		register, replacing nodes by isomorphic ones found there.
+ * Parameters:	None.
+ * Returns:	The node in the common register that should be used
+ *		instead of this one (possibly this node).
+ * Remarks:	The subgraph has been built by one thread with its own
+ *		register. Other threads merge their subgraphs at the same time.
+ *		The answer is kept in big_brother (not used before share_arcs),
+ *		so that each node is merged only once. end_merge() clears it.
+ *		hit_count of nodes that get new arcs is changed atomically,
+ *		as the nodes may come from other threads. Nodes that are
+ *		replaced no longer count as parents of their children.
+ *
+ *		Nodes that have not been registered (hit_count = 0) are
+ *		on the paths shared with other parts of the input; only
+ *		their children are merged (see register_kids).
+ */
+node *
+node::merge_shared(void)
+{
+  node		*found;
+  node		*c_node;
+
+  if (node_id(big_brother) != 0)
+    return big_brother;		// already merged
+  merge_kids();
+  if (hit_count == 0)
+    return this;		// to be joined with nodes of another part
+  if ((found = get_register()->find_or_insert_shared(this)) != NULL) {
+    for (int i = 0; i < no_of_children; i++)
+      if ((c_node = children[i].child) != NULL)
+	__atomic_sub_fetch(&c_node->hit_count, 1, __ATOMIC_RELAXED);
+    big_brother = found;
+  }
+  else
+    big_brother = this;
+  return big_brother;
+}//node::merge_shared
+
+/* Name:	merge_kids
+ * Class:	node
+ * Purpose:	Merges children of the node into the common register,
+ *		and redirects arcs to nodes found there.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	See merge_shared.
+ */
+void
+node::merge_kids(void)
+{
+  node		*c_node;
+  node		*new_node;
+
+  for (int i = 0; i < no_of_children; i++) {
+    if ((c_node = children[i].child) != NULL) {
+      new_node = c_node->merge_shared();
+      if (new_node != c_node) {
+	children[i].child = new_node;
+	__atomic_add_fetch(&new_node->hit_count, 1, __ATOMIC_RELAXED);
+      }
+    }
+  }
+}//node::merge_kids
+
+/* Name:	register_kids
+ * Class:	node
+ * Purpose:	Registers the children of the node that have not been
+ *		registered yet, or replaces them with isomorphic nodes.
+ * Parameters:	None.
+ * Returns:	Nothing.
+ * Remarks:	Used after the automata for parts of the input have been
+ *		joined. Only the nodes on the paths shared by neighbouring
+ *		parts are not registered then; they are processed
+ *		from the deepest one up.
+ */
+void
+node::register_kids(void)
+{
+  node		*c_node;
+
+  for (int i = 0; i < no_of_children; i++) {
+    if ((c_node = children[i].child) != NULL && c_node->hit_count == 0) {
+      c_node->register_kids();
+      replace_or_register(i);
+    }
+  }
+}//node::register_kids
+
+/* Name:	end_merge
+ * Class:	node
+ * Purpose:	Tells whether the node has been replaced while merging,
+ *		and clears information left by merge_shared.
+ * Parameters:	None.
+ * Returns:	TRUE if the node should be deleted, FALSE otherwise.
+ * Remarks:	None.
+ */
+int
+node::end_merge(void)
+{
+  if ((node *)big_brother != this)
+    return TRUE;
+  big_brother = NULL;
+  return FALSE;
+}//node::end_merge
+#endif //THREADS
 
 /* Name:	hash
  * Class:	node
@@ -219,20 +340,48 @@ node::hash(const int start, const int how_many) const
   long	h = 0;
   int	finish = start + how_many;
   for (int i = start; i < finish; i++)
-    h = (((h * 17) ^ children[i].letter) ^ (long(children[i].child) >> 2));
+    h = (((h * 17) ^ children[i].letter) ^ (long(node_id(children[i].child)) >> 2));
   return (h & MAX_ARCS_PER_NODE);
 }//node::hash
 
+/* Name:	struct_hash
+ * Class:	node
+ * Purpose:	Computes a 64-bit hash function for the node to be used
+ *		in the primary register.
+ * Parameters:	None.
+ * Returns:	Hash function.
+ * Remarks:	Value of hash function depends on labels, finality,
+ *		and targets of all arcs going from this node.
+ *		Each arc is hashed separately, and the results are added,
+ *		so that the value does not change when the arcs are
+ *		reordered (e.g. sorted on frequency in share_arcs).
+ *		The mixing function is the finalizer of splitmix64.
+ */
+uint64_t
+node::struct_hash(void) const
+{
+  uint64_t	h = no_of_children;
+  uint64_t	a;
+  for (int i = 0; i < no_of_children; i++) {
+    a = ((uint64_t)node_id(children[i].child) << 9)
+      ^ ((uint64_t)(unsigned char)(children[i].letter) << 1)
+      ^ (uint64_t)(children[i].is_final ? 1 : 0);
+    a += 0x9e3779b97f4a7c15ULL;
+    a = (a ^ (a >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    a = (a ^ (a >> 27)) * 0x94d049bb133111ebULL;
+    h += a ^ (a >> 31);
+  }
+  return h;
+}//node::struct_hash
+
 
 /* Name:	number_arcs
  * Class:	node
  * Purpose:	Assign an index to each arc in the automaton.
-#ifdef NEXTBIT
- * Parameters:	gtl		- (i) length of the goto field
- *					or 0 meaning count arcs not bytes.
-#else
- * Parameters:	None.
-#endif
+ * Parameters:	E		- (t) format of arcs (arc_encoding);
+ *		gtl		- (i) length of the goto field
+ *					or 0 meaning count arcs not bytes
+ *					(used when E::in_bytes);
 #ifdef WEIGHTED
  *		weighted	- (i) TRUE if weights are used, FALSE if not.
 #endif
@@ -310,36 +459,31 @@ node::hash(const int start, const int how_many) const
  *			Set arc_no to no_of_arcs, add free_beg arcs and
  *			and gtl to no_of_arcs
  *		t2) The big brother is to be numbered
+ *
+ *		The version of the automaton (E) decides whether addresses
+ *		are in bytes, and in which order children are numbered.
  */
+template <class E>
 int
-#if defined(FLEXIBLE) && ((defined(STOPBIT) && defined(TAILS)) || defined(NEXTBIT))
 #ifdef WEIGHTED
 node::number_arcs(const int gtl, const int weighted)
 #else //!WEIGHTED
 node::number_arcs(const int gtl)
 #endif //!WEIGHTED
-#else //!WEIGHTED
-#ifdef WEIGHTED
-node::number_arcs(const int weighted)
-#else //!WEIGHTED
-node::number_arcs(void)
-#endif //!WEIGHTED
-#endif
 {
   node		*p, *pp;
   int		limit;
+  build_context	*ctx = build_ctx;
   // Set the offset for the goto field, i.e. how far the pointer is
   // from the beginning of the arc/transition
-#if defined(FLEXIBLE) && defined(NEXTBIT)
-#ifdef STOPBIT
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(NEXTBIT)
 #ifdef WEIGHTED
   int		goto_offset = 1 + weighted;
-#else //!WEIGHTED
-  const int	goto_offset = 1;
-#endif //!WEIGHTED
-#else //!STOPBIT
-#endif //!STOPBIT
-#endif //!(FLEXIBLE,NEXTBIT)
+#endif //WEIGHTED
+#endif //FLEXIBLE,STOPBIT,NEXTBIT
+#if defined(FLEXIBLE) && !defined(WEIGHTED)
+  const int	goto_offset = E::goto_offset;
+#endif //FLEXIBLE,!WEIGHTED
 // no conditionals
 #ifndef LARGE_DICTIONARIES
 #ifndef FLEXIBLE
@@ -397,12 +541,20 @@ node::number_arcs(void)
 // no conditionals
 
 #ifdef SPARSE
-  if (in_annotations) {
+  if (ctx->in_annotations) {
 #endif
 // Try to rearrange arcs for better compression
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(NEXTBIT) && defined(MORE_COMPR)
-  if (gtl == 0 && no_of_children > 1) {
-    static node  *descendants[MAX_ARCS_PER_NODE];
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(MORE_COMPR)
+  // When the tail of the node is kept in another node (free_beg),
+  // its last arcs are not written here, and they must stay where they are
+  if (E::nextbit && gtl == 0 && no_of_children > 1
+#ifdef TAILS
+      && free_beg == 0
+#endif //TAILS
+      ) {
+    // number_arcs calls itself for each letter of a word, so the array
+    // is kept in the context; it is not used after the recursive calls
+    node  **descendants = ctx->descendants;
     // try to rearrange arcs so that one that leads to nodes with more
     // children will be the last one
     int found = 0;
@@ -438,7 +590,7 @@ node::number_arcs(void)
       }
     }
   }
-#endif //FLEXIBLE & STOPBIT & NEXTBIT & MORE_COMPR
+#endif //FLEXIBLE & STOPBIT & MORE_COMPR
 #ifdef SPARSE
   }
 #endif //SPARSE
@@ -449,7 +601,7 @@ node::number_arcs(void)
     limit = no_of_children;
 
 #ifdef SPARSE
-    if (in_annotations) {
+    if (ctx->in_annotations) {
 #endif
     if (big_brother) {
       if (big_brother->arc_no != -1) {
@@ -465,9 +617,9 @@ node::number_arcs(void)
 	  // big brother has been numbered
 	  // Situations 2b, 4c, 4d.
 	  arc_no =
-#if defined(FLEXIBLE) && (defined(NEXTBIT) || (defined(STOPBIT) && defined(TAILS)))
-	    (goto_offset + gtl) *
-#endif //FLEXIBLE,(NEXTBIT|(STOPBIT,TAILS))
+#ifdef FLEXIBLE
+	    (E::in_bytes ? goto_offset + gtl : 1) *
+#endif //FLEXIBLE
 	    brother_offset + big_brother->arc_no;
 	  return arc_no;
 	  // Note: no need to number children (already numbered)
@@ -490,8 +642,9 @@ node::number_arcs(void)
 	  else
 	    // Situation 4a.
 	    p = big_brother->big_brother;
-	  p->big_brother->arc_no = no_of_arcs + p->big_brother->brother_offset;
-	  p->arc_no = no_of_arcs;	// we use it in the following line...
+	  p->big_brother->arc_no =
+	    ctx->no_of_arcs + p->big_brother->brother_offset;
+	  p->arc_no = ctx->no_of_arcs;	// we use it in the following line...
 	  arc_no = big_brother->arc_no + brother_offset;
 	  limit -= p->brother_offset;
 	  // Handled: 4a: Bn, An; 4b: Cn, An.
@@ -505,7 +658,8 @@ node::number_arcs(void)
 	  else
 	    // Situation 3a.
 	    p = this;
-	  p->big_brother->arc_no = no_of_arcs + p->big_brother->brother_offset;
+	  p->big_brother->arc_no =
+	    ctx->no_of_arcs + p->big_brother->brother_offset;
 	  limit -= p->brother_offset;
 	  // Handled: 3a: An; 3b: Bn.
 	  // Wait for: 3a: Bn, Bc, A[1]c; 3b: An, Ac, B[1]c.
@@ -522,10 +676,10 @@ node::number_arcs(void)
 	  // Situation 2a
 	  p = big_brother;
 	  arc_no =
-#if defined(FLEXIBLE) && (defined(NEXTBIT) || (defined(STOPBIT) && defined(TAILS)))
-	    (gtl ? (goto_offset + gtl) : 1) *
-#endif //FLEXIBLE,(NEXTBIT|(STOPBIT,TAILS))
-	    brother_offset + no_of_arcs;
+#ifdef FLEXIBLE
+	    (E::in_bytes && gtl ? (goto_offset + gtl) : 1) *
+#endif //FLEXIBLE
+	    brother_offset + ctx->no_of_arcs;
 	  limit = p->no_of_children;
 	  // handled: An.
 	  // Wait for: Bn, Bc.
@@ -541,13 +695,13 @@ node::number_arcs(void)
 // no conditionals
     }//if node has big brother
 
-    p->arc_no = no_of_arcs;
+    p->arc_no = ctx->no_of_arcs;
     // All Xn handled.
 #ifndef	LARGE_DICTIONARIES
 #ifndef FLEXIBLE
     // if two bytes is not enough to hold the number of arcs
-    if ((unsigned)no_of_arcs > (unsigned)(((1 << 16) - 1) - limit) &&
-	no_of_arcs > limit &&        // I cannot remember what it is for
+    if ((unsigned)ctx->no_of_arcs > (unsigned)(((1 << 16) - 1) - limit) &&
+	ctx->no_of_arcs > limit &&        // I cannot remember what it is for
 	not_yet_warned) {
       cerr << "Too many arcs in automaton.\n"
 	   << "Compile programs with flag LARGE_DICTIONARIES\n"
@@ -558,9 +712,9 @@ node::number_arcs(void)
 #endif //!FLEXIBLE
 // no conditionals
 #ifdef FLEXIBLE
-#if defined(NEXTBIT) && defined(MORE_COMPR)
-    if (gtl == 0 && (no_of_children &&
-		     !nis_next_node(
+#ifdef MORE_COMPR
+    if (E::nextbit && gtl == 0 && (no_of_children &&
+		     !p->nis_next_node(
 #if defined(STOPBIT) && defined(TAILS)
 				    free_beg ?
 				    children[free_beg - 1].child :
@@ -584,7 +738,7 @@ node::number_arcs(void)
 	      )
 #endif // STOPBIT&&TAILS
 	      ; --a) {
-	if (nis_next_node(p->children[a].child)) {
+	if (p->nis_next_node(p->children[a].child)) {
 	  // Exchange arcs
 	  arc_node temp_arc = p->children[a];
 	  p->children[a] = p->children[b];
@@ -593,51 +747,52 @@ node::number_arcs(void)
 	}
       }
     }
-#endif // MORE_COMPR&NEXTBIT
+#endif // MORE_COMPR
 
     // update the arc counter, so that new arcs receive proper numbers
-#if defined(TAILS) && defined (STOPBIT) || defined(NEXTBIT)
-    if (gtl) {
+    if (E::in_bytes && gtl) {
       // We recalculate the numbers taking variable arc length into account
-      no_of_arcs += limit * (goto_offset + gtl);
+      ctx->no_of_arcs += limit * (goto_offset + gtl);
 #if defined(STOPBIT) && defined(TAILS)
       if (free_beg)
-	no_of_arcs += gtl;
+	ctx->no_of_arcs += gtl;
 #endif
 #ifdef NUMBERS
-      if (entryl)
-	no_of_arcs += entryl;
+      if (ctx->entryl)
+	ctx->no_of_arcs += ctx->entryl;
+      if (E::ranked)
+	ctx->no_of_arcs += (limit - 1) * ctx->entryl; // ranks of arcs
 #endif // NUMBERS
-#ifdef NEXTBIT
-      if (gtl > 1 && no_of_children &&
-	  nis_next_node(p->children[
+      if (E::nextbit && gtl > 1 && no_of_children &&
+	  p->nis_next_node(p->children[
 #if defined (STOPBIT) && defined(TAILS)
 				    free_beg ? free_beg - 1 :
 #endif //STOPBIT&&TAILS
 				    p->no_of_children - 1].child)) {
-	no_of_arcs -= (gtl - 1);
+	ctx->no_of_arcs -= (gtl - 1);
       }
-#endif //NEXTBIT
     }
-    else {
-      no_of_arcs += limit;	// just counting arcs
+    else if (E::in_bytes) {
+      ctx->no_of_arcs += limit;	// just counting arcs
 #if defined(STOPBIT) && defined(TAILS)
       if (free_beg)
-	tails++;
+	ctx->tails++;
 #endif
     }
-#else //!NEXTBIT || !(STOPBIT&&TAILS)
+    else {
+      // Addresses are arc numbers, or bytes with NUMBERS and -N
 #ifdef NUMBERS
-    if (entryl)
-      no_of_arcs += limit * a_size + entryl;
-    else
-      no_of_arcs += limit;
+      if (ctx->entryl)
+	ctx->no_of_arcs += limit * ctx->a_size + ctx->entryl
+	  + (E::ranked ? (limit - 1) * ctx->entryl : 0);
+      else
+	ctx->no_of_arcs += limit;
 #else //!NUMBERS
-    no_of_arcs += limit;
+      ctx->no_of_arcs += limit;
 #endif //NUMBERS
-#endif //NEXTBIT
+    }
 #else //!FLEXIBLE
-    no_of_arcs += limit;
+    ctx->no_of_arcs += limit;
 #endif //!FLEXIBLE
 #ifdef SPARSE
     }
@@ -652,73 +807,80 @@ node::number_arcs(void)
 // no conditionals
 
     // Now start numbering the children
-#if defined(FLEXIBLE) && defined(NEXTBIT)
+    if (E::nextbit) {
 #ifdef SPARSE
-    bool current_in_annots = in_annotations;
+      bool current_in_annots = ctx->in_annotations;
 #endif //SPARSE
-    // We start from the last arc to have more compression
-    for (int j = limit - 1; j >= 0; --j) {
-      pp = p->children[j].child;
+      // We start from the last arc to have more compression
+      for (int j = limit - 1; j >= 0; --j) {
+	pp = p->children[j].child;
 #ifdef SPARSE
-      in_annotations = current_in_annots ||
-	(p->children[j].letter == ANNOT_SEPARATOR);
+	ctx->in_annotations = current_in_annots ||
+	  (p->children[j].letter == ctx->annot_separator);
 #endif //SPARSE
-      if (pp && pp->arc_no == -1) {
+#ifdef MORE_COMPR
+	if (pp && pp->arc_no == -1 && p->nis_deferred(pp, j == limit - 1)) {
+	  // it will be numbered as the next node of another node,
+	  // or after all other nodes
+	  ctx->deferred.push_back(pp);
+	  continue;
+	}
+#endif //MORE_COMPR
+	if (pp && pp->arc_no == -1) {
 #ifdef WEIGHTED
-	pp->number_arcs(gtl, weighted);
+	  pp->number_arcs<E>(gtl, weighted);
 #else //!WEIGHTED
-	pp->number_arcs(gtl);
+	  pp->number_arcs<E>(gtl);
 #endif //!WEIGHTED
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-	if (current_in_annots) {
+	  if (current_in_annots) {
 #endif
-#if defined(FLEXIBLE) && defined(NEXTBIT)
-	  if (no_of_children && j == limit - 1 &&
-	      nis_next_node(p->children[
+	    if (no_of_children && j == limit - 1 &&
+		p->nis_next_node(p->children[
 #if defined (STOPBIT) && defined(TAILS)
-					free_beg ? free_beg - 1 :
+					  free_beg ? free_beg - 1 :
 #endif //STOPBIT&&TAILS
-					p->no_of_children - 1].child)) {
-	    next_nodes++;
+					  p->no_of_children - 1].child)) {
+	      ctx->next_nodes++;
+	    }
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 	  }
 #endif
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 	}
-#endif
-      }
 #ifdef STATISTICS
-      if (pp == NULL) {
-	sink_count++;
-      }
+	if (pp == NULL) {
+	  sink_count++;
+	}
 #endif // STATISTICS
-    }
+      }
 #ifdef SPARSE
-    in_annotations = current_in_annots;
+      ctx->in_annotations = current_in_annots;
 #endif //SPARSE
-#else // !(NEXTBIT&&FLEXIBLE)
-    for (int i = 0; i < limit; i++) {
+    }
+    else {
+      for (int i = 0; i < limit; i++) {
 #ifndef STOPBIT
 #ifdef JOIN_PAIRS
-      if (i >= p->no_of_children)
-	pp = p->big_brother->children[1].child;
-      else
+	if (i >= p->no_of_children)
+	  pp = p->big_brother->children[1].child;
+	else
 #endif //JOIN_PAIRS
 #endif //!STOPBIT
-      pp = p->children[i].child;
-      if (pp && pp->arc_no == -1) {
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
-	pp->number_arcs(gtl);
-#else
-	pp->number_arcs();
-#endif
-      }
+	pp = p->children[i].child;
+	if (pp && pp->arc_no == -1) {
+#ifdef WEIGHTED
+	  pp->number_arcs<E>(gtl, weighted);
+#else //!WEIGHTED
+	  pp->number_arcs<E>(gtl);
+#endif //!WEIGHTED
+	}
 #ifdef STATISTICS
-      if (pp == NULL) {
-	sink_count++;
-      }
+	if (pp == NULL) {
+	  sink_count++;
+	}
 #endif //STATISTICS
+      }
     }
-#endif // !NEXTBIT
   }
   else
     arc_no = 0;
@@ -811,41 +973,98 @@ freq_cmp(const void *el1, const void *el2)
   c1 = unsigned(((arc_node *)(el1))->letter);
   c2 = unsigned(((arc_node *)(el2))->letter);
 #ifdef DESCENDING
-  return frequency_table[c1] - frequency_table[c2];
+  return build_ctx->frequency_table[c1] - build_ctx->frequency_table[c2];
 #else
-  return frequency_table[c2] - frequency_table[c1];
+  return build_ctx->frequency_table[c2] - build_ctx->frequency_table[c1];
 #endif
 }//freq_cmp
 #endif
 
 
+/* Name:	fsa_image
+ * Class:	fsa_image
+ * Purpose:	Allocates a buffer for the image of the automaton.
+ * Parameters:	image_size	- (i) size of the image in bytes.
+ * Returns:	Nothing.
+ * Remarks:	None.
+ */
+fsa_image::fsa_image(const long int image_size)
+  : size(image_size), used(0L)
+{
+  buffer = new char[size > 0 ? size : 1];
+}//fsa_image::fsa_image
+
+/* Name:	write
+ * Class:	fsa_image
+ * Purpose:	Writes the image of the automaton to a file.
+ * Parameters:	outfile		- (o) output file.
+ * Returns:	TRUE if the image written, FALSE otherwise.
+ * Remarks:	Only the bytes put into the image are written.
+ */
+int
+fsa_image::write(ostream &outfile) const
+{
+  return (outfile.write(buffer, used)) ? TRUE : FALSE;
+}//fsa_image::write
+
+#ifdef FLEXIBLE
+/* Name:	set_arc_flags
+ * Class:	None.
+ * Purpose:	Sets the flags of an arc that say where the node ends.
+ * Parameters:	E		- (t) format of arcs (arc_encoding);
+ *		arc		- (o) the arc;
+ *		goto_off	- (i) offset of the goto field;
+ *		final		- (i) whether the arc is final;
+ *		last		- (i) whether it is the last arc of the node;
+ *		kids		- (i) number of arcs of its target.
+ * Returns:	Nothing.
+ * Remarks:	With STOPBIT formats, the last arc of a node is marked;
+ *		otherwise, each arc has the number of arcs of its target.
+ *		The flags are set without the compile options, so that
+ *		versions 1 and 2 can be written with STOPBIT as well.
+ */
+template <class E>
+inline void
+set_arc_flags(char *arc, const int goto_off, const int final,
+	      const int last, const int kids)
+{
+  if (E::stopbit)
+    arc[goto_off] = (arc[goto_off] & ~3) | (last ? 2 : 0) | (final ? 1 : 0);
+  else
+    arc[0] = (final ? 0x80 : 0) | kids;
+}//set_arc_flags
+#endif //FLEXIBLE
+
 /* Name:	write_arcs
  * Class:	node
- * Purpose:	Writes arcs of a node and arcs of its descendants to a file.
- * Parameters:	outfile		- (o) output file.
+ * Purpose:	Puts arcs of a node and arcs of its descendants
+ *		into the image of the automaton.
+ * Parameters:	E		- (t) format of arcs (arc_encoding);
+ *		image		- (o) the image.
  * Returns:	TRUE if arcs written, FALSE otherwise.
  * Remarks:	It is assumed that arcs were numbered with node::number_arcs
- *		with root being #1. #0 is a dummy arc.
+ *		(for the same format) with root being #1. #0 is a dummy arc.
+ *		FALSE means that the arcs do not fit in the image,
+ *		i.e. that the numbering was wrong.
  */
+template <class E>
 int
 #ifdef WEIGHTED
-node::write_arcs(ostream &outfile, const int weighted)
+node::write_arcs(fsa_image &image, const int weighted)
 #else //!WEIGHTED
-node::write_arcs(ostream &outfile)
+node::write_arcs(fsa_image &image)
 #endif //!WEIGHTED
 {
 #ifdef FLEXIBLE
   char		output_arc[10];
   char		*oa = &output_arc[0];
-  fsa_arc_ptr	*dummy;
-#ifdef STOPBIT
-#else //!STOPBIT
 #ifdef WEIGHTED
+#ifndef STOPBIT
   int		goto_offset = 2 + weighted;
+#endif //!STOPBIT
 #else //!WEIGHTED
-  const int	goto_offset = 2;
+  const int	goto_offset = E::goto_offset;
 #endif //!WEIGHTED
-#endif //!STOPBIT
 #else //!FLEXIBLE
   fsa_arc	output_arc[1];
   fsa_arc	*oa = &output_arc[0];
@@ -855,6 +1074,12 @@ node::write_arcs(ostream &outfile)
   node		*p;
   arc_node	pp;
   int		limit = no_of_children;
+#if defined(FLEXIBLE) || defined(SPARSE)
+  build_context	*ctx = build_ctx;
+#endif
+#if defined(FLEXIBLE) && defined(NUMBERS)
+  int		rank = 0;	/* strings through arcs written so far */
+#endif
 
 #ifdef DEBUG
   cerr << "write_arcs with hit_count = " << hit_count
@@ -864,7 +1089,7 @@ node::write_arcs(ostream &outfile)
 
   // Establish the shape of the node and its arcs
 #ifdef FLEXIBLE
-  int gtl = dummy->gtl;
+  int gtl = ctx->gtl;
   int size = gtl + goto_offset;
 #endif
 
@@ -873,30 +1098,23 @@ node::write_arcs(ostream &outfile)
     hit_count = 0;		// mark the node as visited (written)
     if (no_of_children > 0) {
 #ifdef SPARSE
-      if (in_annotations) {
+      if (ctx->in_annotations) {
 #endif //SPARSE
 #ifdef WEIGHTED
       if (weighted)
 	flatten_weights(this);
 #endif //WEIGHTED
 #if defined(FLEXIBLE) && defined(NUMBERS)
-      if (entryl) {
+      if (ctx->entryl) {
 	// Write the number of strings in the subautomaton
 	// starting in this node
 	int r = entries;
-	for (int ix = 0; ix < dummy->entryl; ix++) {
+	for (int ix = 0; ix < ctx->entryl; ix++) {
 	  oa[ix] = r & 0xff;
 	  r >>= 8;
 	}
-#ifdef SPARSE
-	if (in_annotations) {
-	  memcpy(annot_buffer + ab_ptr, oa, dummy->entryl);
-	  ab_ptr += dummy->entryl;
-	}
-#else //!SPARSE
-	if (!(outfile.write((char *)oa, dummy->entryl)))
+	if (!image.put((char *)oa, ctx->entryl))
 	  return FALSE;
-#endif //!SPARSE
       }
 #endif // FLEXIBLE,NUMBERS
 #ifdef JOIN_PAIRS
@@ -950,11 +1168,7 @@ node::write_arcs(ostream &outfile)
 
 	// set the label
 #ifdef FLEXIBLE
-#ifdef STOPBIT
-	*oa = pp.letter;
-#else
-	oa[1] = pp.letter;
-#endif
+	oa[E::stopbit ? 0 : 1] = pp.letter;
 #else
 	oa->letter = pp.letter;
 #endif //FLEXIBLE
@@ -963,26 +1177,7 @@ node::write_arcs(ostream &outfile)
 	// Set goto field
 #ifdef FLEXIBLE
 	if (p) {
-	  int r = p->arc_no;
-#ifdef STOPBIT
-#ifdef NEXTBIT
-#ifdef TAILS
-	  r <<= 4;
-#else //!TAILS
-	  r <<= 3;
-#endif //!TAILS
-#else // !NEXTBIT
-#ifdef TAILS
-	  r <<= 3;
-#else //!TAILS
-	  r <<= 2;
-#endif //!TAILS
-#endif // !NEXTBIT
-#else // !STOPBIT
-#ifdef NEXTBIT
-	  r <<= 1;
-#endif //NEXTBIT
-#endif // !STOPBIT
+	  int r = p->arc_no << E::flag_bits;
 	  for (int i2 = 0; i2 < gtl;  i2++) {
 	    oa[goto_offset + i2] = r & 0xff;
 	    r >>= 8;
@@ -994,14 +1189,19 @@ node::write_arcs(ostream &outfile)
 	    oa[goto_offset + i3] = 0;
 	  }
 	}//if !p
-#ifdef NEXTBIT
-	// 
-	fsa_set_next(oa, i == limit - 1 && wis_next_node(p) ? 1 : 0);
-	if (wis_next_node(p) && i == limit - 1)
-	  oa[goto_offset] |= 0x80; // make sure goto != 0
-#endif // NEXTBIT
+	if (E::nextbit) {
+	  if (wis_next_node(p) && i == limit - 1)
+	    oa[goto_offset] |= E::next_flag | 0x80; // make sure goto != 0
+	  else
+	    oa[goto_offset] &= ~E::next_flag;
+	}
 #if defined(STOPBIT) && defined(TAILS)
-	fsa_set_tail(oa, free_beg && i == limit - 1);
+	if (E::tails) {
+	  if (free_beg && i == limit - 1)
+	    oa[goto_offset] |= E::tail_flag;
+	  else
+	    oa[goto_offset] &= ~E::tail_flag;
+	}
 #endif //STOPBIT,TAILS
 #endif // FLEXIBLE
 
@@ -1013,11 +1213,17 @@ node::write_arcs(ostream &outfile)
 #endif //FLEXIBLE
 
 	  // Set the number of arcs or the last arc marker
-#if defined(FLEXIBLE) && defined(STOPBIT)
-	  fsa_set_last(oa, i == limit - 1);
-#else //!(FLEXIBLE,STOPBIT)
+#ifdef FLEXIBLE
+	  if (!E::stopbit && p->no_of_children > 0x7f) {
+	    cerr << "Too many arcs leading from one node for version "
+		 << E::version << "\n";
+	    return FALSE;
+	  }
+	  set_arc_flags<E>(oa, goto_offset, pp.is_final, i == limit - 1,
+			   p->no_of_children);
+#else //!FLEXIBLE
 	  fsa_set_children(oa, p->no_of_children);
-#endif //!(FLEXIBLE,STOPBIT)
+#endif //!FLEXIBLE
 // no conditionals
 // This is exactly the opposite!!!!!
 #if MAX_ARCS_PER_NODE==255
@@ -1028,21 +1234,21 @@ node::write_arcs(ostream &outfile)
 	    exit(99);
 	  }
 #endif
+#ifndef FLEXIBLE
 	  // And the final bit
 	  fsa_set_final(oa, pp.is_final);
+#endif //!FLEXIBLE
 	}
 	else {//if !p
 
 	  // Set goto, number of arcs, and final fields
-#ifndef FLEXIBLE
+#ifdef FLEXIBLE
+	  set_arc_flags<E>(oa, goto_offset, TRUE, i == limit - 1, 0);
+#else //!FLEXIBLE
 	  oa->go_to = 0;
-#endif //FLEXIBLE
-#ifdef STOPBIT
-	  fsa_set_last(oa, i == limit - 1);
-#else //!STOPBIT
 	  fsa_set_children(oa, 0);
-#endif //!STOPBIT
 	  fsa_set_final(oa, TRUE);
+#endif //!FLEXIBLE
 	}//if !p
 #ifdef WEIGHTED
 	if (weighted) {
@@ -1054,21 +1260,30 @@ node::write_arcs(ostream &outfile)
 
 	// Write the result (the arc)
 #ifdef FLEXIBLE
-#ifdef NEXTBIT
-	int bytes_to_write = (p && i == limit - 1 && wis_next_node(p)) ?
+	int bytes_to_write =
+	  (E::nextbit && p && i == limit - 1 && wis_next_node(p)) ?
 	  goto_offset + 1 : size;
-#else //!NEXTBIT
-	int bytes_to_write = size;
-#endif // !NEXTBIT
-#ifdef SPARSE
-	memcpy(annot_buffer + ab_ptr, oa, bytes_to_write);
-	ab_ptr += bytes_to_write;
-#else //!SPARSE
-	if (!(outfile.write(oa, bytes_to_write)))
+	if (!image.put(oa, bytes_to_write))
 	  return FALSE;
-#endif
+#ifdef NUMBERS
+	if (E::ranked) {
+	  // Ranked arcs are followed by the number of strings
+	  // through them and the arcs before them (but the last one)
+	  rank += (pp.is_final ? 1 : 0) + (p ? p->entries : 0);
+	  if (i < limit - 1) {
+	    char rank_bytes[sizeof(int)];
+	    int r = rank;
+	    for (int ix = 0; ix < ctx->entryl; ix++) {
+	      rank_bytes[ix] = r & 0xff;
+	      r >>= 8;
+	    }
+	    if (!image.put(rank_bytes, ctx->entryl))
+	      return FALSE;
+	  }
+	}
+#endif //NUMBERS
 #else //!FLEXIBLE
-	if (!(outfile.write((char *)&output_arc[0], sizeof output_arc[0])))
+	if (!image.put((char *)&output_arc[0], sizeof output_arc[0]))
 	  return FALSE;
 #endif // !FLEXIBLE
       }//for i
@@ -1080,11 +1295,7 @@ node::write_arcs(ostream &outfile)
       // then we need to write a pointer to it here
       if (free_beg) {
 	int r1 = big_brother->arc_no + (brother_offset * (goto_offset + gtl));
-#ifdef NEXTBIT
-	r1 <<= 4;
-#else //!NEXTBIT
-	r1 <<= 3;
-#endif // !NEXTBIT
+	r1 <<= E::flag_bits;
 	for (int i5 = 0; i5 < gtl; i5++) {
 	  oa[i5] = r1 & 0xff;
 	  r1 >>= 8;
@@ -1092,7 +1303,7 @@ node::write_arcs(ostream &outfile)
 	// So we have the address part in oa, shifted appropriately.
 	// The various bits are not set, and this is OK.
 	// Now we write the arc
-	if (!(outfile.write((char *)&output_arc[0], gtl)))
+	if (!image.put((char *)&output_arc[0], gtl))
 	  return FALSE;
       }//if free_beg
 #endif //FLEXIBLE & STOPBIT & TAILS
@@ -1105,9 +1316,9 @@ node::write_arcs(ostream &outfile)
       // For all arcs of this node or its brother
       // write arcs of descendants
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-      bool current_in_annots = in_annotations;
+      bool current_in_annots = ctx->in_annotations;
 #ifdef NUMBERS
-      if (no_of_children && !in_annotations && entryl) {
+      if (no_of_children && !ctx->in_annotations && ctx->entryl) {
 	for (int j = 0; j < limit; j++) {
 	  unsigned long hv = children[j].is_final +
 	    (children[j].child ? children[j].child->entries : 0);
@@ -1129,15 +1340,14 @@ node::write_arcs(ostream &outfile)
       }
 #endif //NUMBERS
 #endif //FLEXIBLE&STOPBIT&SPARSE
-#if defined(FLEXIBLE) && defined(NEXTBIT)
-      for (i = limit - 1; i >= 0; --i) {
-#else
-      for (i = 0; i < limit; i++) {
-#endif
+      // With NEXTBIT, children are written from the last one,
+      // in the order in which they were numbered
+      for (int k = 0; k < limit; k++) {
+	i = (E::nextbit ? limit - 1 - k : k);
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 	if (!current_in_annots) {
-	  in_annotations = current_in_annots ||
-	    (children[i].letter == ANNOT_SEPARATOR);
+	  ctx->in_annotations = current_in_annots ||
+	    (children[i].letter == ctx->annot_separator);
 	  sparse_vector(arc_no,
 		       children[i].letter).set_target(children[i].child ?
 						      children[i].child->arc_no
@@ -1152,13 +1362,17 @@ node::write_arcs(ostream &outfile)
 #endif
 #endif
 	p = children[i].child;
+#ifdef MORE_COMPR
+	if (E::nextbit && p && wis_deferred(p, i == limit - 1))
+	  continue;		// written in the order of build_context::deferred
+#endif //MORE_COMPR
 	if (p) {
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
 	  if (p->free_beg == 0) {
 #endif
 	  if (p->big_brother
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-	      && in_annotations
+	      && ctx->in_annotations
 #endif
 #ifdef JOIN_PAIRS
 	      && p->brother_offset >= 0
@@ -1169,7 +1383,7 @@ node::write_arcs(ostream &outfile)
 	  // merged with another 2-arc node
 	  if (p->big_brother
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
-	      && in_annotations
+	      && ctx->in_annotations
 #endif
 #ifdef JOIN_PAIRS
 	      && p->brother_offset >= 0
@@ -1183,9 +1397,9 @@ node::write_arcs(ostream &outfile)
 	  cerr << "Writing " << i << "th child of <" << arc_no << ">\n";
 #endif
 #ifdef WEIGHTED
-	  if (!(p->write_arcs(outfile, weighted)))
+	  if (!(p->write_arcs<E>(image, weighted)))
 #else //!WEIGHTED
-	  if (!(p->write_arcs(outfile)))
+	  if (!(p->write_arcs<E>(image)))
 #endif
 	    return FALSE;
 	}//if p
@@ -1195,6 +1409,35 @@ node::write_arcs(ostream &outfile)
   return TRUE;
 }//node::write_arcs
 
+/* Number and write arcs in each format that can be written
+ * (see format_available and automaton::write_fsa).
+ */
+#ifdef WEIGHTED
+#define	ENCODE_FORMAT(v) \
+  template int node::number_arcs<arc_encoding<v> >(const int, const int); \
+  template int node::write_arcs<arc_encoding<v> >(fsa_image &, const int);
+#else //!WEIGHTED
+#define	ENCODE_FORMAT(v) \
+  template int node::number_arcs<arc_encoding<v> >(const int); \
+  template int node::write_arcs<arc_encoding<v> >(fsa_image &);
+#endif //!WEIGHTED
+#if defined(FLEXIBLE) && !defined(SPARSE) && !defined(WEIGHTED)
+#ifdef STOPBIT
+ENCODE_FORMAT(4)
+ENCODE_FORMAT(5)
+#ifdef NUMBERS
+ENCODE_FORMAT(RANKED_FORMAT | 4)
+ENCODE_FORMAT(RANKED_FORMAT | 5)
+#endif //NUMBERS
+ENCODE_FORMAT(6)
+ENCODE_FORMAT(7)
+#endif //STOPBIT
+ENCODE_FORMAT(1)
+ENCODE_FORMAT(2)
+#else //!FLEXIBLE|SPARSE|WEIGHTED
+ENCODE_FORMAT(BUILD_FORMAT)
+#endif //!FLEXIBLE|SPARSE|WEIGHTED
+
 /* Name:	delete_branch
  * Class:	None.
  * Purpose:	Deletes a subgraph beginning at the node.
@@ -1325,7 +1568,7 @@ node::set_link(node *big_guy, const int offset)
  *		an empty graph is 1.
  *		Initially, entries is -1, so it denotes a node that has not
  *		been visited yet.
- *		Additionally, arcs and nodes are counted in static variables.
+ *		Additionally, arcs and nodes are counted in the build context.
  */
 int
 number_entries(node *n)
@@ -1348,6 +1591,21 @@ number_entries(node *n)
 #endif //NUMBERS
 #endif //FLEXIBLE
 
+#ifdef NUMBERS
+/* Counters of nodes and arcs, and sizes of parts of arcs are kept
+ * in the build context of the automaton.
+ */
+int node::inc_arc_count(const int a) { return build_ctx->arc_count += a; }
+int node::set_arc_count(const int a) { return build_ctx->arc_count = a; }
+int node::get_arc_count(void) const { return build_ctx->arc_count; }
+int node::inc_node_count(void) { return build_ctx->node_count++; }
+int node::get_node_count(void) const { return build_ctx->node_count; }
+int node::set_a_size(const int a) { return build_ctx->a_size = a; }
+int node::get_a_size(void) const { return build_ctx->a_size; }
+int node::set_entryl(const int e) { return build_ctx->entryl = e; }
+int node::get_entryl(void) const { return build_ctx->entryl; }
+#endif //NUMBERS
+
 /* Name:	print_node
  * Class:	None.
  * Purpose:	Prints node details for debugging purposes.
@@ -1380,7 +1638,7 @@ print_node(const node *n)
   an = n->get_children();
   for (int i = 0; i < n->get_no_of_kids(); i++, an++) {
     cerr << " +- " << an->letter << (an->is_final ? "!" : " ")
-	 << hex << (long)(an->child) << dec << endl;
+	 << hex << (long)(node *)(an->child) << dec << endl;
   }
 }
 
@@ -1425,6 +1683,32 @@ mark_inner(node *n, const int no)
   return n;
 }
 
+#ifdef MORE_COMPR
+/* Name:	collect_nodes
+ * Class:	None.
+ * Purpose:	Puts all nodes reachable from a node into a vector.
+ * Parameters:	n	- (i) the node;
+ *		nodes	- (i/o) the vector.
+ * Returns:	Number of nodes in the vector.
+ * Remarks:	Nodes must not be numbered (arc_no = -1). A node gets
+ *		its index in the vector as arc_no, so that it is not put
+ *		there twice.
+ */
+int
+collect_nodes(node *n, vector<node *> &nodes)
+{
+  if (n->get_arc_no() == -1) {
+    n->set_arc_no(nodes.size());
+    nodes.push_back(n);
+    arc_node *an = n->get_children();
+    for (int i = 0; i < n->get_no_of_kids(); i++, an++)
+      if (an->child)
+	collect_nodes(an->child, nodes);
+  }
+  return nodes.size();
+}//collect_nodes
+#endif //MORE_COMPR
+
 #ifdef SUBAUT
 /* Name:	create_back_arcs
  * Class:	None.
@@ -6,6 +6,9 @@
 #define		NNODE_H
 
 #include	<vector>
+#include	<stdint.h>
+#include	<string.h>
+#include	"nalloc.h"
 
 
 enum {FIND, REGISTER};
@@ -20,11 +23,32 @@ const int	MAX_SPARSE_WAIT = 3; /* How many alphabet sizes should we wait
 					before we abandon a whole in sparse
 				        matrix */
 
+/* With NODE_INDICES, nodes and vectors of arcs are referred to
+ * by 32-bit indices in the arena (build_arena) instead of pointers.
+ */
+#ifdef NODE_INDICES
+typedef arena_ref<node>		node_ptr;
+#else
+typedef node			*node_ptr;
+#endif
+
+/* Node_id gives a number identifying a node for hash functions
+ * and comparisons; with NODE_INDICES, the index need not be decoded.
+ */
+#ifdef NODE_INDICES
+inline unsigned long node_id(const node_ptr &p) { return p.get_index(); }
+#else
+inline unsigned long node_id(const node *p) { return (unsigned long)p; }
+#endif
+
 /* Arc_node contains information describing an arc during building phase.
  * It is then enclosed in fsa_arc structure.
+ * Vectors of arcs are allocated in the arena of the automaton being built.
+ * Operator delete[] takes the size of the vector, so that it can be put
+ * on the right free list.
  */
 struct arc_node {
-  node		*child;		/* pointer to a child node (NULL - common
+  node_ptr	child;		/* pointer to a child node (NULL - common
 				   final node) */
 #ifdef WEIGHTED
   int		weight;		/* number of different sets of annotations
@@ -34,8 +58,18 @@ struct arc_node {
   char		is_final;	/* whether labels up to that contained
 				   in this arc form a word */
   char		letter;		/* label of this arc */
+  static void *operator new[](size_t size)
+    { return build_arena->allocate(size, ARENA_ARCS); }
+  static void operator delete[](void *p, size_t size)
+    { build_arena->deallocate(p, size, ARENA_ARCS); }
 };/*arc_node*/
 
+#ifdef NODE_INDICES
+typedef arena_ref<arc_node>	arcs_ptr;
+#else
+typedef arc_node		*arcs_ptr;
+#endif
+
 #ifdef MORE_COMPR
   inline int operator !=(arc_node &a1, arc_node &a2)
      { return (a1.child != a2.child || a1.letter != a2.letter ||
@@ -44,6 +78,145 @@ struct arc_node {
 
 class node;
 
+/* Class name:	fsa_image
+ * Purpose:	Hold the arcs of the automaton while they are being written.
+ * Methods:	fsa_image	- allocate a buffer of the given size;
+ *		~fsa_image	- free it;
+ *		put		- append bytes to the image;
+ *		get_size	- return the number of bytes put so far;
+ *		write		- write the image to a file.
+ * Remarks:	The size of the image is known after the arcs have been
+ *		numbered, so the buffer is allocated once, and the image
+ *		is written with a single call instead of one call per arc.
+ *		Put does not write past the end of the buffer; it returns
+ *		FALSE instead.
+ */
+class fsa_image {
+private:
+  char		*buffer;	// the image
+  long int	size;		// size of the buffer
+  long int	used;		// number of bytes in the image
+public:
+  fsa_image(const long int image_size);
+  ~fsa_image(void) { delete [] buffer; }
+  int put(const char *bytes, const int n) {
+    if (n > size - used)
+      return FALSE;
+    memcpy(buffer + used, bytes, n);
+    used += n;
+    return TRUE;
+  }
+  long int get_size(void) const { return used; }
+  int write(ostream &outfile) const;
+};//fsa_image
+
+/* The version of the automaton written by default,
+ * i.e. the one that follows from compile options.
+ */
+#ifdef FLEXIBLE
+#ifdef STOPBIT
+#ifdef NEXTBIT
+#ifdef TAILS
+#define BUILD_FORMAT	7
+#else //!TAILS
+#define BUILD_FORMAT	5
+#endif //!TAILS
+#else //!NEXTBIT
+#ifdef TAILS
+#define BUILD_FORMAT	6
+#else //!TAILS
+#define BUILD_FORMAT	4
+#endif //!TAILS
+#endif //!NEXTBIT
+#else //!STOPBIT
+#ifdef NEXTBIT
+#define BUILD_FORMAT	2
+#else //!NEXTBIT
+#define BUILD_FORMAT	1
+#endif //!NEXTBIT
+#endif //!STOPBIT
+#else //!FLEXIBLE
+#define BUILD_FORMAT	0
+#endif //!FLEXIBLE
+
+/* Class name:	arc_encoding
+ * Purpose:	Describe at compile time how arcs of a given version
+ *		are written.
+ * Constants:	version		- version in the signature;
+ *		stopbit		- the last arc of a node is marked;
+ *		nextbit		- the goto field of an arc leading
+ *				  to the next node is replaced by a flag;
+ *		tails		- nodes may share their last arcs;
+ *		flag_bits	- bits taken from the goto field by flags;
+ *		in_bytes	- addresses are in bytes, not in arcs;
+ *		next_flag	- mask of the NEXTBIT flag;
+ *		tail_flag	- mask of the tail flag;
+ *		goto_offset	- offset of the goto field in the arc
+ *				  (a label, and without STOPBIT,
+ *				  a counter of arcs before it);
+ *		ranked		- arcs but the last one in a node
+ *				  are followed by their ranks
+ *				  (RANKED_FORMAT, see fsa.h).
+ * Remarks:	node::number_arcs and node::write_arcs are instantiated
+ *		for each version that can be written (see format_available),
+ *		so the version can be chosen when the automaton is written.
+ *		SPARSE and WEIGHTED change the way the automaton is built,
+ *		so they remain compile options. So does STOPBIT: without it,
+ *		nodes can share arcs in ways that only versions 1 and 2
+ *		can express (JOIN_PAIRS).
+ */
+template <int VER>
+struct arc_encoding {
+  enum { version = VER,
+	 base = (VER & ~RANKED_FORMAT),
+	 ranked = ((VER & RANKED_FORMAT) != 0),
+	 stopbit = (base >= 4),
+	 nextbit = (base == 2 || base == 5 || base == 7 || base == 8),
+	 tails = (base == 6 || base == 7),
+	 flag_bits = (stopbit ? 2 + nextbit + tails : nextbit),
+	 in_bytes = (nextbit || tails),
+	 next_flag = (stopbit ? 4 : 1),
+	 tail_flag = (nextbit ? 8 : 4),
+	 goto_offset = (stopbit ? 1 : 2) };
+};//arc_encoding
+
+/* Name:	format_available
+ * Class:	None.
+ * Purpose:	Checks whether automata of the given version can be written.
+ * Parameters:	ver		- (i) version of the automaton.
+ * Returns:	TRUE if the builders can write that version, FALSE otherwise.
+ * Remarks:	Versions 4-7 need STOPBIT. Nodes share their tails
+ *		in versions 6 and 7 only with TAILS. Versions 1 and 2 can be
+ *		written with or without STOPBIT, but nodes with more than
+ *		127 arcs do not fit in them. Ranked versions 4 and 5
+ *		need also NUMBERS.
+ *		With SPARSE or WEIGHTED, only the default version is written.
+ *		With CFSA2, the CFSA2 format of morfologik, RCFSA2
+ *		(the same with relative addresses), and SCFSA2 (RCFSA2
+ *		with string arcs) can be written as well.
+ */
+inline int
+format_available(const int ver)
+{
+#ifdef CFSA2
+  if (cfsa2_format(ver))
+    return TRUE;
+#endif //CFSA2
+#if defined(FLEXIBLE) && !defined(SPARSE) && !defined(WEIGHTED)
+#ifdef STOPBIT
+#ifdef NUMBERS
+  if (ver == (RANKED_FORMAT | 4) || ver == (RANKED_FORMAT | 5))
+    return TRUE;
+#endif //NUMBERS
+  return (ver == 1 || ver == 2 || (ver >= 4 && ver <= 7));
+#else //!STOPBIT
+  return (ver == 1 || ver == 2);
+#endif //!STOPBIT
+#else //!FLEXIBLE|SPARSE|WEIGHTED
+  return (ver == BUILD_FORMAT);
+#endif //!FLEXIBLE|SPARSE|WEIGHTED
+}//format_available
+
 #if defined(A_TERGO) && defined(GENERALIZE)
 typedef struct {
  public:
@@ -60,12 +233,12 @@ typedef struct {
  */
 class node {
 private:
-  arc_node	*children;		/* arcs leading from node */
+  arcs_ptr	children;		/* arcs leading from node */
   int		arc_no;			/* number of the first arc of the
 					   node in all nodes of the automaton
 					   */
   int		hit_count;		/* number of arcs leading to node */
-  node		*big_brother;		/* node containing all arcs of this
+  node_ptr	big_brother;		/* node containing all arcs of this
 					   node (and some others), or - in
 					   case of JOIN_PAIRS - a two-arc
 					   node sharing one arc with this node
@@ -102,12 +275,6 @@ private:
 					   that is the first arc in this node
 					   */
 #endif
-#ifdef NUMBERS
-  static int	arc_count;		/* number of arcs in automaton */
-  static int	node_count;		/* number of nodes in the automaton */
-  static int	a_size;			/* arc size */
-  static int	entryl;			/* bytes per entries count */
-#endif
 #ifdef STATISTICS
   static int	total_arcs;		/* number of arcs in the automaton
 					   (includes arcs stored in other
@@ -131,17 +298,6 @@ private:
 #endif
 
 public:
-#ifdef FLEXIBLE
-#ifdef NEXTBIT
-  static int	next_nodes;
-#endif
-#if defined(STOPBIT) && defined(TAILS)
-  static int	tails;
-#endif
-#endif
-#ifdef SPARSE
-  static bool in_annotations;
-#endif //SPARSE
 #ifdef MORE_COMPR
   unsigned char	free_end; 	/* the order of arcs can change in
 					   the big brother in free_end
@@ -152,19 +308,34 @@ public:
   unsigned char free_beg;	/* arcs from free_beg are
 				   in a different node */
 #endif
+#ifdef MORE_COMPR
+  node_ptr	put_after;	/* the node is put only right after
+				   that node (its last arc leads here
+				   or to a node with brother_offset 0),
+				   or after all other nodes;
+				   NULL - anywhere
+				   (see automaton::reorder_states) */
+#endif
 #if defined(A_TERGO) && defined(GENERALIZE)
   int nannots;			/* number of annotations */
   ann_inf *annots;		/* annotations (possibly with weights) */
 #endif //A_TERGO,GENERALIZE
 
-#ifdef FLEXIBLE
-#ifdef NEXTBIT
   /* in write_arcs: is the node the next node in the automaton */
   int wis_next_node(const node *n) const
      {return (n != NULL &&
 	      (n->big_brother ?
-	       (n->brother_offset == 0 && n->big_brother->hit_count != 0)
-	       : n->hit_count != 0)); }
+	       (n->brother_offset == 0 && n->big_brother->hit_count != 0
+#ifdef MORE_COMPR
+		&& (n->big_brother->put_after == NULL
+		    || n->big_brother->put_after == this)
+#endif
+		)
+	       : n->hit_count != 0
+#ifdef MORE_COMPR
+	       && (n->put_after == NULL || n->put_after == this)
+#endif
+	       )); }
   /* in number_arcs: is the node n the next node in the automaton
      after the current node;
      if it does not have a big brother, and it has not been numbered yet
@@ -173,20 +344,51 @@ public:
      then the brother offset must be 0 for n to be the next node,
      because otherwise the first arc of n will not be the first arc
      of its big brother, so it will not be the next arc after the last arc
-     of the current node.
+     of the current node;
+     with MORE_COMPR, n (or its big brother) may have to be put
+     after another node (put_after).
   */
   int nis_next_node(const node *n) const
     {return (n != NULL &&
 	     (n->big_brother ?
-	      (n->brother_offset == 0 && n->big_brother->arc_no == -1)
-	      : n->arc_no == -1));}
+	      (n->brother_offset == 0 && n->big_brother->arc_no == -1
+#ifdef MORE_COMPR
+	       && (n->big_brother->put_after == NULL
+		   || n->big_brother->put_after == this)
 #endif
+	       )
+	      : n->arc_no == -1
+#ifdef MORE_COMPR
+	      && (n->put_after == NULL || n->put_after == this)
 #endif
+	      ));}
+#ifdef MORE_COMPR
+  /* in number_arcs: whether numbering of the node n should wait,
+     because it (or its big brother) is to be put right after a node,
+     and it is not the next node after the current node (whose arcs
+     are numbered; last is TRUE for the last arc of the current node)
+  */
+  int nis_deferred(const node *n, const int last) const
+    {const node *b = (n->big_brother ? n->big_brother : n);
+     return (b->put_after != NULL && b->arc_no == -1 &&
+	     !(last && nis_next_node(n)));}
+  /* in write_arcs: the same as nis_deferred */
+  int wis_deferred(const node *n, const int last) const
+    {const node *b = (n->big_brother ? n->big_brother : n);
+     return (b->put_after != NULL && b->hit_count != 0 &&
+	     !(last && wis_next_node(n)));}
+#endif
+  static void *operator new(size_t size)
+    { return build_arena->allocate(size, ARENA_NODES); }
+  static void operator delete(void *p, size_t size)
+    { build_arena->deallocate(p, size, ARENA_NODES); }
   int hash(const int start, const int how_many) const;
+  uint64_t struct_hash(void) const;
   node(void) { children = NULL; no_of_children = 0; arc_no = -1; hit_count = 0;
 	       big_brother = NULL; brother_offset = 0;
 #ifdef MORE_COMPR
 		  free_end = no_of_children;
+		  put_after = NULL;
 #endif
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
 		  free_beg = 0; 
@@ -211,6 +413,7 @@ public:
 #endif
 #ifdef MORE_COMPR
 		  free_end = n->free_end;
+		  put_after = NULL;
 #endif
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(TAILS)
 		  free_beg = n->free_beg; 
@@ -264,27 +467,28 @@ public:
   int fertile(void) const;
   int hit_node(int h = 1) { return hit_count += h; }
   node *compress_or_register(void);
+  node *replace_or_register(void)
+    { return replace_or_register(no_of_children - 1); }
+  node *replace_or_register(const int i);
+#ifdef THREADS
+  node *merge_shared(void);
+  void merge_kids(void);
+  void register_kids(void);
+  int end_merge(void);
+#endif
   /*  friend int find_common_prefix(node *start_node, const char *word,
       prefix *common_prefix, const int length);*/
-  int
-#if defined(FLEXIBLE) && ((defined(STOPBIT) && defined(TAILS)) || defined(NEXTBIT))
+  template <class E> int
 #ifdef WEIGHTED
   number_arcs(const int gtl, const int weighted);
 #else //!WEIGHTED
   number_arcs(const int gtl);
 #endif //!WEIGHTED
-#else //!WEIGHTED
-#ifdef WEIGHTED
-  number_arcs(const int weighted);
-#else //!WEIGHTED
-  number_arcs(void);
-#endif //!WEIGHTED
-#endif
-  int
+  template <class E> int
 #ifdef WEIGHTED
-  write_arcs(ostream &outfile, const int weighted);
+  write_arcs(fsa_image &image, const int weighted);
 #else //!WEIGHTED
-  write_arcs(ostream &outfile);
+  write_arcs(fsa_image &image);
 #endif //!WEIGHTED
   node *set_link(node *big_guy, const int offset);
 #if defined(FLEXIBLE) && ((defined(STOPBIT) && defined(TAILS)) || defined(NEXTBIT))
@@ -303,15 +507,16 @@ public:
 #ifdef NUMBERS
   int get_entries(void) const { return entries; }
   void set_entries(const int e) { entries = e; }
-  int inc_arc_count(const int a) { return arc_count += a; }
-  int set_arc_count(const int a) { return arc_count = a; }
-  int get_arc_count(void) const { return arc_count; }
-  int inc_node_count(void) { return node_count++; }
-  int get_node_count(void) const { return node_count; }
-  int set_a_size(const int a) { return a_size = a; }
-  int get_a_size(void) const { return a_size; }
-  int set_entryl(const int e) { return entryl = e; }
-  int get_entryl(void) const { return entryl; }
+  /* the counters are kept in the build context of the automaton */
+  int inc_arc_count(const int a);
+  int set_arc_count(const int a);
+  int get_arc_count(void) const;
+  int inc_node_count(void);
+  int get_node_count(void) const;
+  int set_a_size(const int a);
+  int get_a_size(void) const;
+  int set_entryl(const int e);
+  int get_entryl(void) const;
 #endif
 #ifdef STATISTICS
   void print_statistics(const node *n) {
@@ -359,14 +564,14 @@ public:
   }
 #endif
 #ifdef MORE_COMPR
-  friend int match_subset(node *n, const int kids_tab[], const int kids_no_no);
+  friend int match_subset(node *n, const int kids_tab[], const int kids_no_no,
+			  const int max_arcs, const int max_subset,
+			  node **found);
   friend int match_part(node *n, node *nn, const int to_do, const int start_at,
-			const int subset_size, const int reg_tails=FIND);
+			const int subset_size, const int reg_tails,
+			node **found);
+  friend void link_subset(node *n, node *isomorphic);
 #endif
-
-
-public:
-  static int	no_of_arcs;	/* number of arcs generated */
 };/*node*/
 
 
@@ -447,7 +652,7 @@ freq_cmp(const void *el1, const void *el2);
  *		an empty graph is 1.
  *		Initially, entries is -1, so it denotes a node that has not
  *		been visited yet.
- *		Additionally, arcs and nodes are counted in static variables.
+ *		Additionally, arcs and nodes are counted in the build context.
  */
 int
 number_entries(node *n);
@@ -466,6 +671,20 @@ number_entries(node *n);
 node *
 mark_inner(node *n, const int no);
 
+#ifdef MORE_COMPR
+/* Name:	collect_nodes
+ * Class:	None.
+ * Purpose:	Puts all nodes reachable from a node into a vector.
+ * Parameters:	n	- (i) the node;
+ *		nodes	- (i/o) the vector.
+ * Returns:	Number of nodes in the vector.
+ * Remarks:	Nodes must not be numbered (arc_no = -1). A node gets
+ *		its index in the vector as arc_no.
+ */
+int
+collect_nodes(node *n, vector<node *> &nodes);
+#endif //MORE_COMPR
+
 
 #ifdef SPARSE
 class SparseTrans {
@@ -742,8 +961,6 @@ public:
 
 //extern unsigned char min_label, max_label;
 extern SparseVect sparse_vector;
-extern char *annot_buffer;		// buffer for annotations
-extern long int ab_ptr;		// index in that buffer
 
 /* Name:	add_labels_to_alphabet
  * Class:	None.
@@ -40,6 +40,7 @@ tr_io::tr_io(istream *in_file, ostream &out_file, const int max_line_length,
   input = in_file;
   inp_buf_len = max_line_length;
   proc_state = stream_state = 1;
+  echo = TRUE;
 }//tr_io::tr_io
 
 
@@ -64,6 +65,7 @@ tr_io::~tr_io(void)
  * Returns	in_file.
  * Remarks:	One word per line is assumed. Lines longer than Max_word_len
  *		are truncated.
+ *		The word is not echoed after set_echo(FALSE).
  */
 tr_io &
 tr_io::operator>>(char *s)
@@ -75,14 +77,46 @@ tr_io::operator>>(char *s)
   if (read_more) {
     junk = '\0';
     input->clear();		// Stroustrup just forgot to mention that
-    output << s;
-  }
-  else {
-    output << s << ":";
   }
+  if (echo)
+    print_word(s, !read_more);
   return *this;
 }//tr_io::operator>>
 
+/* Name:	set_echo
+ * Class:	tr_io
+ * Purpose:	Says whether operator>> should echo words.
+ * Parameters:	e		- (i) TRUE if words are to be echoed.
+ * Returns:	TRUE (words can be echoed later with print_word).
+ * Remarks:	Words are not echoed when they are read in batches
+ *		(LOOKUP_BATCH); they are echoed before their results.
+ */
+int
+tr_io::set_echo(const int e)
+{
+  echo = e;
+  return TRUE;
+}//tr_io::set_echo
+
+/* Name:	print_word
+ * Class:	tr_io
+ * Purpose:	Echoes a word that has been read.
+ * Parameters:	s		- (i) the word;
+ *		whole		- (i) FALSE if the rest of the line
+ *					is still to be read.
+ * Returns:	this.
+ * Remarks:	A colon follows the whole line.
+ */
+tr_io &
+tr_io::print_word(const char *s, const int whole)
+{
+  if (whole)
+    output << s << ":";
+  else
+    output << s;
+  return *this;
+}//tr_io::print_word
+
 /* Name:	print_OK
  * Class:	tr_io
  * Purpose:	Prints OK on output.
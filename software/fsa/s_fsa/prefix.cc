@@ -16,13 +16,20 @@
  * Class:	prefix_fsa
  * Purpose:	Initialize class (constructor).
  * Parameters:	dict_list       - (i) list of dictionary (fsa) names;
- *		language_file	- (i) file with character set info.
+ *		language_file	- (i) file with character set info;
+ *		skip		- (i) number of completions of each prefix
+ *					not to be printed;
+ *		max		- (i) most completions of each prefix
+ *					to be printed (-1 - all).
  * Returns:     Nothing (constructor).
- * Remarks:     Only to launch fsa contructor.
+ * Remarks:     Skip and max let the completions be printed in pages.
  */
-prefix_fsa::prefix_fsa(word_list *dict_list, const char *language_file)
-: fsa(dict_list, language_file)
+prefix_fsa::prefix_fsa(word_list *dict_list, const char *language_file,
+		       const int skip, const int max)
+: fsa(dict_list, language_file, TRUE)
 {
+  skip_words = to_skip = skip;
+  max_words = to_print = max;
 }//prefix_fsa::prefix_fsa
 
 
@@ -35,57 +42,202 @@ prefix_fsa::prefix_fsa(word_list *dict_list, const char *language_file)
  * Remarks:     The format of output is:
  *              surface_form WORD_SEP lexical_form
  *              where lexical form contains annotations.
+ *		A prefix whose completions are all skipped (-k) gets
+ *		an empty line.
  */
 int
 prefix_fsa::complete_file_words(tr_io &io_obj)
 {
   char          *word;
   int		allocated;	// memory allocated for word
+  int		found;
 
   word = new char[allocated=Max_word_len];
   while (get_word(io_obj, word, allocated, Max_word_len)) {
-    if (!complete_prefix(word, io_obj))
+    if (!(found = complete_prefix(word, io_obj)))
       io_obj.print_not_found();
+    else if (found == skip_words - to_skip)
+      io_obj.print_repls(&replacements); // all skipped, end the line
   }
   return state;
 }//prefix_fsa::complete_file_words
 
 
 
+#ifdef MULTI_FORMAT
+/* Class name:	prefix_kernel
+ * Purpose:	Find completions of a prefix in an automaton with arcs
+ *		of the class made for its format.
+ * Methods:	prefix_kernel	- remembers the prefix and where to print;
+ *		operator()	- finds completions from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct prefix_kernel {
+  prefix_fsa	*completer;	/* who finds completions */
+  const char	*word_prefix;	/* prefix to complete */
+  tr_io		*io_obj;	/* where to print them */
+  prefix_kernel(prefix_fsa *c, const char *w, tr_io &io) {
+    completer = c; word_prefix = w; io_obj = &io;
+  }
+  template <class A>
+  int operator()(A root) {
+    return completer->compl_prefix(word_prefix, *io_obj, 0,
+				   root.set_next_node());
+  }
+};/* struct prefix_kernel */
+
+/* Class name:	from_kernel
+ * Purpose:	List words not less than a given one in an automaton
+ *		with arcs of the class made for its format.
+ * Methods:	from_kernel	- remembers the word and where to print;
+ *		operator()	- lists the words from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct from_kernel {
+  prefix_fsa	*completer;	/* who lists the words */
+  const char	*word;		/* the first word (or where it would be) */
+  tr_io		*io_obj;	/* where to print them */
+  from_kernel(prefix_fsa *c, const char *w, tr_io &io) {
+    completer = c; word = w; io_obj = &io;
+  }
+  template <class A>
+  int operator()(A root) {
+    return completer->list_from_word(word, *io_obj, root.set_next_node());
+  }
+};/* struct from_kernel */
+#endif
+
 /* Name:	complete_prefix
  * Class:	prefix_fsa
  * Purpose:	Finds all words that begin with a given prefix
  *		in all dictionaries.
  * Parameters:	word_prefix	- (i) prefix of the word;
  *		io_obj		- (o) where to print results.
- * Returns:	Number of completions found.
+ * Returns:	Number of completions printed or skipped.
  * Remarks:	Empty prefix ("") lists contents of all automata.
+ *		The first skip_words completions are not printed,
+ *		and no more than max_words are printed (if not -1).
  */
 int
 prefix_fsa::complete_prefix(const char *word_prefix, tr_io &io_obj)
 {
   dict_list	*dict;
   int		compl_found = 0;
-#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
-  fsa_arc_ptr	*dummy = NULL;
-#endif
 
+  to_skip = skip_words;
+  to_print = max_words;
   dictionary.reset();
   for (dict = &dictionary; dict->item(); dict->next()) {
     set_dictionary(dict->item());
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+    if (sparse_vect == NULL) {
+      prefix_kernel kernel(this, word_prefix, io_obj);
+      compl_found += with_format(current_format, kernel);
+      continue;
+    }
+#endif
     compl_found += sparse_compl_prefix(word_prefix, io_obj, 0,
 				       sparse_vect->get_first());
 #else
-    fsa_arc_ptr nxtnode = dummy->first_node(current_dict);
+#ifdef MULTI_FORMAT
+    prefix_kernel kernel(this, word_prefix, io_obj);
+    compl_found += with_format(current_format, kernel);
+#else
+    fsa_arc_ptr nxtnode = first_node();
     compl_found +=
       compl_prefix(word_prefix, io_obj, 0,
-		   nxtnode.set_next_node(current_dict));
+		   nxtnode.set_next_node());
+#endif
 #endif
   }
-  return compl_found;
+  // skipped completions were found too
+  return compl_found + skip_words - to_skip;
 }//prefix_fsa::complete_prefix
 
+/* Name:	list_from
+ * Class:	prefix_fsa
+ * Purpose:	Lists words not less than a given word in all dictionaries.
+ * Parameters:	word		- (i) the first word to be listed, or where
+ *					it would be;
+ *		io_obj		- (o) where to print results.
+ * Returns:	Number of words printed.
+ * Remarks:	Words are listed in the order of bytes (as by sort with
+ *		LC_ALL=C), from each dictionary in turn. The first
+ *		skip_words words are not printed, and no more than max_words
+ *		are printed (if not -1), so that the words can be listed
+ *		in pages. Automata with a sparse vector are not supported.
+ */
+int
+prefix_fsa::list_from(const char *word, tr_io &io_obj)
+{
+  dict_list	*dict;
+  int		found = 0;
+
+  to_skip = skip_words;
+  to_print = max_words;
+  dictionary.reset();
+  for (dict = &dictionary; dict->item(); dict->next()) {
+    set_dictionary(dict->item());
+#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+    if (sparse_vect != NULL) {
+      cerr << "Words cannot be listed from a word in automata with"
+	   << " a sparse vector" << endl;
+      continue;
+    }
+#endif
+#ifdef MULTI_FORMAT
+    from_kernel kernel(this, word, io_obj);
+    found += with_format(current_format, kernel);
+#else
+    fsa_arc_ptr nxtnode = first_node();
+    found += list_from_word(word, io_obj, nxtnode.set_next_node());
+#endif
+  }
+  return found;
+}//prefix_fsa::list_from
+
+/* Name:	take_completion
+ * Class:	prefix_fsa
+ * Purpose:	Decides whether the next completion is to be printed.
+ * Parameters:	None.
+ * Returns:	TRUE if it is to be printed, FALSE if it is skipped.
+ * Remarks:	Counts skipped and printed completions (see complete_prefix).
+ */
+int
+prefix_fsa::take_completion(void)
+{
+  if (to_skip > 0) {
+    to_skip--;
+    return FALSE;
+  }
+  if (to_print == 0)
+    return FALSE;
+  if (to_print > 0)
+    to_print--;
+  return TRUE;
+}//prefix_fsa::take_completion
+
+/* Name:	print_completion
+ * Class:	prefix_fsa
+ * Purpose:	Prints a completion.
+ * Parameters:	io_obj		- (o) where to print it;
+ *		word		- (i) the completion.
+ * Returns:	Nothing.
+ * Remarks:	With DUMP_ALL, the whole word is printed on its own line.
+ */
+void
+prefix_fsa::print_completion(tr_io &io_obj, const char *word)
+{
+#ifdef DUMP_ALL
+  io_obj.print_line(word);
+#else
+  replacements.insert(word);
+  io_obj.print_repls(&replacements);
+  replacements.empty_list();
+#endif
+}//prefix_fsa::print_completion
+
 
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
 /* Name:	sparse_compl_prefix
@@ -108,7 +260,6 @@ prefix_fsa::sparse_compl_prefix(const char *word_prefix, tr_io &io_obj,
   bool 		found = false;
   long 		current = start;
   long		next;
-  fsa_arc_ptr	*dummy;
 
   do {
     found = false;
@@ -135,7 +286,7 @@ prefix_fsa::sparse_compl_prefix(const char *word_prefix, tr_io &io_obj,
 #endif
 	    candidate[curr_depth++] = cc;
 	  if (word_prefix[1] == '\0') {
-	    if (sparse_vect->is_final(current, cc)) {
+	    if (sparse_vect->is_final(current, cc) && take_completion()) {
 	      replacements.insert(candidate);
 	      io_obj.print_repls(&replacements);
 	      replacements.empty_list();
@@ -145,11 +296,11 @@ prefix_fsa::sparse_compl_prefix(const char *word_prefix, tr_io &io_obj,
 	      // Move to annotations
 	      compl_found +=
 		compl_rest(io_obj, curr_depth,
-			   current_dict + next
+			   node_at(next
 #ifdef NUMBERS
-			   + dummy->entryl
+			   + current_format->entryl
 #endif
-			   );
+			   ));
 	    }
 	    else {
 	      // Stay in sparse vector
@@ -188,13 +339,14 @@ prefix_fsa::sparse_compl_prefix(const char *word_prefix, tr_io &io_obj,
  * Returns:	Number of completions found.
  * Remarks:	None.
  */
+template <class A>
 int
 prefix_fsa::compl_prefix(const char *word_prefix, tr_io &io_obj,
-			 const int depth, fsa_arc_ptr start)
+			 const int depth, A start)
 {
   int		curr_depth  = depth;
   int		compl_found = 0;
-  fsa_arc_ptr	next_node = start;
+  A		next_node = start;
   bool found = false;
   do {
     found = false;
@@ -207,7 +359,7 @@ prefix_fsa::compl_prefix(const char *word_prefix, tr_io &io_obj,
     if (depth + 1 >= cand_alloc)
       grow_string(candidate, cand_alloc, Max_word_len);
 
-    forallnodes(i) {
+    forallarcs(i) {
       candidate[curr_depth + 1] = '\0';
       if (*word_prefix == next_node.get_letter()) {
 #ifndef SHOW_FILLERS
@@ -215,14 +367,14 @@ prefix_fsa::compl_prefix(const char *word_prefix, tr_io &io_obj,
 #endif
 	  candidate[curr_depth++] = next_node.get_letter();
 	if (word_prefix[1] == '\0') {
-	  if (next_node.is_final()) {
+	  if (next_node.is_final() && take_completion()) {
 	    replacements.insert(candidate);
 	    io_obj.print_repls(&replacements);
 	    replacements.empty_list();
 	    compl_found++;
 	  }
 	  compl_found += compl_rest(io_obj, curr_depth,
-				    next_node.set_next_node(current_dict));
+				    next_node.set_next_node());
 	}
 	else {
 	  found = true;
@@ -234,14 +386,14 @@ prefix_fsa::compl_prefix(const char *word_prefix, tr_io &io_obj,
       else {
 	if (next_node.get_letter() == FILLER) {
 	  compl_found += compl_prefix(word_prefix + 1, io_obj, curr_depth,
-				      next_node.set_next_node(current_dict));
+				      next_node.set_next_node());
 // 	  found = true;
 // 	  start = next_node;
 // 	  break;
 	}
       }
     }
-    next_node = start.set_next_node(current_dict);
+    next_node = start.set_next_node();
   } while (found);
   return compl_found;
 }//prefix_fsa::compl_prefix
@@ -262,9 +414,8 @@ prefix_fsa::sparse_compl_rest(tr_io &io_obj, const int depth, const long start)
   int		curr_depth;
   int		compl_found = 0;
   long		next;
-  fsa_arc_ptr	*dummy;
 
-  if (start == 0L)
+  if (start == 0L || to_print == 0)
     return 0;
 
   if (depth > MAX_NOT_CYCLE) {
@@ -287,23 +438,17 @@ prefix_fsa::sparse_compl_rest(tr_io &io_obj, const int depth, const long start)
 #endif
 	candidate[curr_depth++] = cc;
       candidate[curr_depth] = '\0';
-      if (sparse_vect->is_final(start, cc)) {
-#ifdef DUMP_ALL
-	io_obj.print_line(candidate);
-#else
-	replacements.insert(candidate);
-	io_obj.print_repls(&replacements);
-	replacements.empty_list();
-#endif
+      if (sparse_vect->is_final(start, cc) && take_completion()) {
+	print_completion(io_obj, candidate);
 	compl_found++;
       }
       if (cc == ANNOT_SEPARATOR) {
 	// Move to annotations
-	compl_found += compl_rest(io_obj, curr_depth, current_dict + next
+	compl_found += compl_rest(io_obj, curr_depth, node_at(next
 #ifdef NUMBERS
-				  + dummy->entryl
+				  + current_format->entryl
 #endif
-				  );
+				  ));
       }
       else {
 	// Stay in sparse vector
@@ -320,55 +465,95 @@ prefix_fsa::sparse_compl_rest(tr_io &io_obj, const int depth, const long start)
  * Purpose:	Finds all completions of a given prefix.
  * Parameters:	depth		- (i) number of characters already in form;
  *		start		- (i) look at children of that node.
- * Returns:	Number of completions found.
+ * Returns:	Number of completions printed.
  * Remarks:	This is invoked from comp_prefix, when prefix has been found.
+ *		A cursor (word_cursor) goes through the words of the node.
+ *		Completions to be skipped are passed with it at once
+ *		if the automaton has numbers of words in nodes (fsa_build -N),
+ *		and the walk stops when no more are to be printed.
  */
+template <class A>
 int
-prefix_fsa::compl_rest(tr_io &io_obj, const int depth, fsa_arc_ptr start)
+prefix_fsa::compl_rest(tr_io &io_obj, const int depth, A start)
 {
-  fsa_arc_ptr	next_node = start;
-  int		curr_depth;
   int		compl_found = 0;
-#ifdef NUMBERS
-  fsa_arc_ptr	*dummy;
-#endif
 
   if (start.arc == current_dict
-#ifdef NUMBERS
-      + dummy->entryl
+#if defined(NUMBERS) || defined(MULTI_FORMAT)
+      + current_format->entryl
 #endif
       )	// the NULL state
     return 0;
+  if (to_print == 0)
+    return 0;
 
-  if (depth > MAX_NOT_CYCLE) {
-    cerr << "Possible cycle detected. Exiting." << endl;
-    exit(5);
+  word_cursor<A> cursor(start, FALSE, candidate, depth,
+#ifdef SHOW_FILLERS
+			'\0'
+#else
+			FILLER
+#endif
+			);
+  if (to_skip > 0)
+    to_skip -= cursor.skip(to_skip);
+  for (; cursor.word() != NULL && take_completion(); cursor.next()) {
+    if (cursor.length() > MAX_NOT_CYCLE) {
+      cerr << "Possible cycle detected. Exiting." << endl;
+      exit(5);
+    }
+    print_completion(io_obj, cursor.word());
+    compl_found++;
   }
-  if (depth + 1 >= cand_alloc)
-    grow_string(candidate, cand_alloc, Max_word_len);
+  return compl_found;
+}//prefix_fsa::compl_rest
 
-  forallnodes(i) {
-    curr_depth = depth;
-#ifndef SHOW_FILLERS
-    if (next_node.get_letter() != FILLER)
+/* Name:	list_from_word
+ * Class:	prefix_fsa
+ * Purpose:	Lists words not less than a given word in the current
+ *		automaton.
+ * Parameters:	word		- (i) the first word to be listed, or where
+ *					it would be;
+ *		io_obj		- (o) where to print results;
+ *		start		- (i) the root node.
+ * Returns:	Number of words printed.
+ * Remarks:	A cursor (word_cursor) visits arcs of nodes in the order
+ *		of labels, and goes to the first word at once (seek).
+ */
+template <class A>
+int
+prefix_fsa::list_from_word(const char *word, tr_io &io_obj, A start)
+{
+  int		found = 0;
+
+  if (start.arc == current_dict
+#if defined(NUMBERS) || defined(MULTI_FORMAT)
+      + current_format->entryl
 #endif
-      candidate[curr_depth++] = next_node.get_letter();
-    candidate[curr_depth] = '\0';
-    if (next_node.is_final()) {
-#ifdef DUMP_ALL
-      io_obj.print_line(candidate);
+      )	// the NULL state
+    return 0;
+  if (to_print == 0 || start.get_goto() == 0)
+    return 0;
+
+  word_cursor<A> cursor(start, TRUE, "", 0,
+#ifdef SHOW_FILLERS
+			'\0'
 #else
-      replacements.insert(candidate);
-      io_obj.print_repls(&replacements);
-      replacements.empty_list();
+			FILLER
 #endif
-      compl_found++;
+			);
+  cursor.seek(word);
+  if (to_skip > 0)
+    to_skip -= cursor.skip(to_skip);
+  for (; cursor.word() != NULL && take_completion(); cursor.next()) {
+    if (cursor.length() > MAX_NOT_CYCLE) {
+      cerr << "Possible cycle detected. Exiting." << endl;
+      exit(5);
     }
-    compl_found += compl_rest(io_obj, curr_depth,
-			      next_node.set_next_node(current_dict));
+    print_completion(io_obj, cursor.word());
+    found++;
   }
-  return compl_found;
-}//prefix_fsa::compl_rest
+  return found;
+}//prefix_fsa::list_from_word
 
 
 /***	EOF prefix.cc	***/
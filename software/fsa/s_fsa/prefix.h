@@ -3,19 +3,31 @@
 /*	Copyright (C) Jan Daciuk, 1996-2004	*/
 
 class prefix_fsa : public fsa {
+  int		skip_words;	/* completions not printed (-k) */
+  int		max_words;	/* most completions printed (-n), -1 - all */
+  int		to_skip;	/* completions still to be skipped */
+  int		to_print;	/* completions still to be printed */
 public:
-  prefix_fsa(word_list *dict_names, const char *language_file = NULL);
+  prefix_fsa(word_list *dict_names, const char *language_file = NULL,
+	     const int skip = 0, const int max = -1);
   virtual ~prefix_fsa(void) {}
   int complete_file_words(tr_io &io_obj);
   int complete_prefix(const char *word_prefix, tr_io &io_obj);
+  int list_from(const char *word, tr_io &io_obj);
+  int take_completion(void);
+  void print_completion(tr_io &io_obj, const char *word);
 #if defined(FLEXIBLE) && defined(STOPBIT) &&defined(SPARSE)
   int sparse_compl_prefix(const char *word_prefix, tr_io &io_obj,
 			  const int depth, const long start);
   int sparse_compl_rest(tr_io &io_obj, const int depth, const long start);
 #endif
+  template <class A>
   int compl_prefix(const char *word_prefix, tr_io &io_obj, const int depth,
-                  fsa_arc_ptr start);
-  int compl_rest(tr_io &io_obj, const int depth, fsa_arc_ptr start);
+                  A start);
+  template <class A>
+  int compl_rest(tr_io &io_obj, const int depth, A start);
+  template <class A>
+  int list_from_word(const char *word, tr_io &io_obj, A start);
 };/*class prefix_fsa*/
 
 
@@ -7,7 +7,8 @@
 This program display contents of a dictionary.
 
 Synopsis:
-fsa_prefix [-a] -d dictionary [-d dictionary]...
+fsa_prefix [-a] [-k n] [-n n] -d dictionary [-d dictionary]...
+fsa_prefix -s word [-k n] [-n n] -d dictionary [-d dictionary]...
 fsa_prefix -v
 
 where dictionary is a file containing the dictionary in a form of a binary
@@ -15,6 +16,7 @@ automaton. At least one dictionay must be specified.
 
 Words are read from standard input, and contents written to standard
 output.
+With -s, nothing is read; words not less than word are listed instead.
 */
 
 #include	<iostream>
@@ -74,6 +76,9 @@ main(const int argc, const char *argv[])
   word_list	inputs;		// names of input files (if any)
   const char	*lang_file = NULL; // name of file with character set
   bool		dump_all = false;
+  const char	*from_word = NULL; // list words from that one (-s)
+  int		skip = 0;	// completions not printed (-k)
+  int		max = -1;	// most completions printed (-n)
 
   set_new_handler(&not_enough_memory);
 
@@ -103,6 +108,32 @@ main(const int argc, const char *argv[])
       // dump All contents
       dump_all = true;
     }
+    else if (argv[arg_index][1] == 's') {
+      // liSt words from a word
+      if (++arg_index >= argc)
+	return usage(argv[0]);
+      from_word = argv[arg_index];
+    }
+    else if (argv[arg_index][1] == 'k') {
+      // sKip completions
+      if (++arg_index >= argc)
+	return usage(argv[0]);
+      skip = atoi(argv[arg_index]);
+      if (skip < 0) {
+	cerr << argv[0] << ": invalid number of completions to skip\n";
+	return usage(argv[0]);
+      }
+    }
+    else if (argv[arg_index][1] == 'n') {
+      // Number of completions
+      if (++arg_index >= argc)
+	return usage(argv[0]);
+      max = atoi(argv[arg_index]);
+      if (max < 0) {
+	cerr << argv[0] << ": invalid number of completions\n";
+	return usage(argv[0]);
+      }
+    }
     else if (argv[arg_index][1] == 'v') {
       // details of version
 #include "compile_options.h"
@@ -119,8 +150,17 @@ main(const int argc, const char *argv[])
     return usage(argv[0]);
   }
 
-  prefix_fsa fsa_dict(&dict, lang_file);
+  prefix_fsa fsa_dict(&dict, lang_file, skip, max);
   if (!fsa_dict) {
+    if (from_word != NULL) {
+      tr_io io_obj(&cin, cout, MAX_LINE_LEN, "",
+#ifdef UTF8
+		   (word_syntax_type *)
+#endif
+		   fsa_dict.get_syntax());
+      fsa_dict.list_from(from_word, io_obj);
+      return 0;
+    }
     if (inputs.how_many()) {
       inputs.reset();
       do {
@@ -175,6 +215,11 @@ usage(const char *prog_name)
        << "-l language_file\t- file that defines characters allowed in words\n"
        << "\tand case conversions\n"
        << "\t[default: ASCII letters, standard conversions]\n"
+       << "-a\tlist all words\n"
+       << "-s word\t- list words not less than word in the order of bytes\n"
+       << "\tinstead of reading prefixes\n"
+       << "-k n\t- do not print the first n completions of each prefix\n"
+       << "-n n\t- print at most n completions of each prefix\n"
        << "-v\tversion details\n"
        << "Standard output used for displaying results.\n"
        << "At least one dictionary must be present.\n";
@@ -171,7 +171,7 @@ H_matrix::set(const int i, const int j, const int val)
 spell_fsa::spell_fsa(word_list *dict_names, const int distance,
 		     const char *chclass_file,
 		     const char *language_file)
-: fsa(dict_names, language_file), H(distance, Max_word_len)
+: fsa(dict_names, language_file, TRUE), H(distance, Max_word_len)
 {
   edit_dist = distance;
 #ifdef CHCLASS
@@ -190,6 +190,8 @@ spell_fsa::spell_fsa(word_list *dict_names, const int distance,
  * Returns:	Exit code.
  * Remarks:	Edit distance is reduced for shorter words.
  *		No attempt is being made to correct one-letter words.
+ *		Words are only checked in batches (check_file)
+ *		when no replacements are needed, and the automaton is large.
  */
 int
 spell_fsa::spell_file(const int distance, const bool force, tr_io &io_obj)
@@ -198,6 +200,8 @@ spell_fsa::spell_file(const int distance, const bool force, tr_io &io_obj)
   char		*word = &word_buffer[0];
 
   edit_dist = distance;
+  if (distance == 0 && !force && batch_pays() && io_obj.set_echo(FALSE))
+    return check_file(io_obj);
   while (io_obj >> word) {
     if (io_obj.get_junk() != '\n') {
       cerr << "Word too long" << endl;
@@ -221,6 +225,55 @@ spell_fsa::spell_file(const int distance, const bool force, tr_io &io_obj)
   return state;
 }//spell_fsa::spell_file
 
+/* Name:	check_file
+ * Class:	spell_fsa
+ * Purpose:	Checks words from a file without looking for replacements.
+ * Parameters:	io_obj		- (i/o) where to read words,
+ *					and where to print them.
+ * Returns:	Exit code.
+ * Remarks:	Up to LOOKUP_BATCH words are read, and looked for at once
+ *		(words_in_dictionaries). Then they are echoed
+ *		with the results in the order they were read, as in spell_file.
+ *		A word that is too long or too short ends a batch.
+ *		io_obj must not echo words when they are read (set_echo).
+ */
+int
+spell_fsa::check_file(tr_io &io_obj)
+{
+  char		words[LOOKUP_BATCH][Max_word_len];
+  const char	*batch[LOOKUP_BATCH];
+  int		found[LOOKUP_BATCH];
+  int		n;
+  int		whole = TRUE;
+  int		more = TRUE;
+
+  while (more) {
+    for (n = 0; n < LOOKUP_BATCH && (more = (io_obj >> words[n])); n++) {
+      whole = (io_obj.get_junk() == '\n');
+      if (!whole || words[n][0] == '\0')
+	break;
+      batch[n] = words[n];
+    }
+    words_in_dictionaries(batch, n, found);
+    for (int i = 0; i < n; i++) {
+      io_obj.print_word(words[i]);
+      if (found[i])
+	io_obj.print_OK();
+      else
+	io_obj.print_not_found();
+    }
+    if (more && n < LOOKUP_BATCH) {
+      // the word that ended the batch
+      io_obj.print_word(words[n], whole);
+      if (!whole)
+	cerr << "Word too long" << endl;
+      else
+	cerr << " not checked (too short)\n";
+    }
+  }
+  return state;
+}//spell_fsa::check_file
+
 
 /* Name:	spell_word
  * Class:	spell_fsa
@@ -290,6 +343,29 @@ spell_fsa::spell_word(const char * word, const bool force)
   return FALSE;
 }//spell_fsa::spell_word
 
+#ifdef MULTI_FORMAT
+/* Class name:	repl_kernel
+ * Purpose:	Find replacements for a word in an automaton with arcs
+ *		of the class made for its format.
+ * Methods:	repl_kernel	- remembers the speller;
+ *		operator()	- finds replacements from the root.
+ * Remarks:	Passed to with_format. The word is in word_ff.
+ */
+struct repl_kernel {
+  spell_fsa	*speller;	/* who looks for replacements */
+  repl_kernel(spell_fsa *s) { speller = s; }
+  template <class A>
+  int operator()(A root) {
+#ifdef CHCLASS
+    speller->find_repl(0, root, 0, 0);
+#else
+    speller->find_repl(0, root);
+#endif
+    return 0;
+  }
+};/* struct repl_kernel */
+#endif
+
 /* Name:	find_repl_all_dicts
  * Class:	spell_fsa
  * Purpose:	Finds replacements for a word in all dictionaries.
@@ -303,26 +379,35 @@ void
 spell_fsa::find_repl_all_dicts(void)
 {
   dict_list		*dict;
-#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
-  fsa_arc_ptr		*dummy = NULL;		/* to get to static fields */
-#endif
 
   dictionary.reset();
   for (dict = &dictionary; dict->item(); dict->next()) {
     set_dictionary(dict->item());
-#ifdef CHCLASS
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#ifdef MULTI_FORMAT
+    if (sparse_vect == NULL) {
+      repl_kernel kernel(this);
+      with_format(current_format, kernel);
+      continue;
+    }
+#endif
+#ifdef CHCLASS
     sparse_find_repl(0, sparse_vect->get_first(), 0, 0);
-#else //!(FLEXIBLE&STOPBIT&SPARSE)
-    find_repl(0, dummy->first_node(current_dict), 0, 0);
-#endif //!(FLEXIBLE&STOPBIT&SPARSE)
-#else //!CHCLASS
-#if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
+#else
     find_repl(0, sparse_vect->get_first());
+#endif
+#else //!(FLEXIBLE&STOPBIT&SPARSE)
+#ifdef MULTI_FORMAT
+    repl_kernel kernel(this);
+    with_format(current_format, kernel);
 #else
-    find_repl(0, dummy->first_node(current_dict));
+#ifdef CHCLASS
+    find_repl(0, first_node(), 0, 0);
+#else
+    find_repl(0, first_node());
+#endif
+#endif
 #endif //!(FLEXIBLE&STOPBIT&SPARSE)
-#endif //!CHCLASS
   }
 }//spell_fsa::find_repl_all_dicts
 
@@ -370,6 +455,27 @@ spell_fsa::find_runon(const char *word)
 
 #else //!(FLEXIBLE&STOPBIT&SPARSE)
 
+#ifdef MULTI_FORMAT
+/* Class name:	runon_kernel
+ * Purpose:	Find run-on words in an automaton with arcs of the class
+ *		made for its format.
+ * Methods:	runon_kernel	- remembers the speller, the word,
+ *				  and the dictionary;
+ *		operator()	- looks for run-on words from the root.
+ * Remarks:	Passed to with_format.
+ */
+struct runon_kernel {
+  spell_fsa	*speller;	/* who looks for run-on words */
+  const char	*word;		/* the word to be split */
+  dict_desc	*d;		/* the dictionary of the root */
+  runon_kernel(spell_fsa *s, const char *w, dict_desc *dd) {
+    speller = s; word = w; d = dd;
+  }
+  template <class A>
+  int operator()(A root) { speller->find_runon_dict(word, root, d); return 0; }
+};/* struct runon_kernel */
+#endif
+
 /* Name:	find_runon
  * Class:	spell_fsa
  * Purpose:	Split the word in two, and check if the resulting words
@@ -383,14 +489,7 @@ spell_fsa::find_runon(const char *word)
 hit_list *
 spell_fsa::find_runon(const char *word)
 {
-  ranked_hits	word_found;
-  fsa_arc_ptr	start;
-  fsa_arc_ptr	next_node;
   dict_desc	*d;
-  fsa_arc_ptr	*dummy = NULL;		// to get to static fields
-  arc_pointer	local_dict;	// local to this function,
-  				// as word_in_dictionary could change it
-  int		last_letter_found;
 
 
   if (word_length > 1 && e_d > 0) {
@@ -405,42 +504,69 @@ spell_fsa::find_runon(const char *word)
 	dictionary.next();
       d = dictionary.item();
       set_dictionary(d);
-      local_dict = current_dict;
-      // Prepare words
-      strcpy(candidate + 1, word);
-      *candidate = *word;
-      candidate[1] = ' ';
-      start = dummy->first_node(local_dict);
-      for (int j = 2; j < word_length; j++) {
-	set_dictionary(d);
-	next_node = start.set_next_node(local_dict);
-	last_letter_found = FALSE;
-	// Find last letter of the first word
-	forallnodes(k) {
-	  if (next_node.get_letter() == candidate[j - 2]) {
-	    last_letter_found = TRUE;
-	    start = next_node;
-	    break;
-	  }
-	}
-	// Find if the second word is in the dictionaries
-	if (last_letter_found && next_node.is_final() &&
-	    word_in_dictionaries(candidate + j)) {
-	  word_found.list_item = nstrdup(candidate);
-	  word_found.dist = 1;
-	  word_found.cost = 1;		// for the moment
-	  results.insert_sorted(&word_found);
-	}
-	if (last_letter_found)
-	  break;
-	// Prepare new pair
-	candidate[j - 1] = candidate[j];
-	candidate[j] = ' ';
-      }
+#ifdef MULTI_FORMAT
+      runon_kernel kernel(this, word, d);
+      with_format(current_format, kernel);
+#else
+      find_runon_dict(word, first_node(), d);
+#endif
     }
   }
   return &results;
 }//spell_fsa::find_runon
+
+/* Name:	find_runon_dict
+ * Class:	spell_fsa
+ * Purpose:	Split the word in two so that the first part is
+ *		in the given dictionary, and check if the second part
+ *		is in the dictionaries.
+ * Parameters:	word		- (i) the word to be checked;
+ *		start		- (i) the first arc of the dictionary;
+ *		d		- (i) the dictionary.
+ * Returns:	Nothing.
+ * Remarks:	Run-on words are added to results.
+ *		The dictionary is set again after each check, because
+ *		word_in_dictionaries changes it.
+ */
+template <class A>
+void
+spell_fsa::find_runon_dict(const char *word, A start, dict_desc *d)
+{
+  ranked_hits	word_found;
+  A		next_node;
+  int		last_letter_found;
+
+  // Prepare words
+  strcpy(candidate + 1, word);
+  *candidate = *word;
+  candidate[1] = ' ';
+  for (int j = 2; j < word_length; j++) {
+    set_dictionary(d);
+    next_node = start.set_next_node();
+    last_letter_found = FALSE;
+    // Find last letter of the first word
+    forallarcs(k) {
+      if (next_node.get_letter() == candidate[j - 2]) {
+	last_letter_found = TRUE;
+	start = next_node;
+	break;
+      }
+    }
+    // Find if the second word is in the dictionaries
+    if (last_letter_found && next_node.is_final() &&
+	word_in_dictionaries(candidate + j)) {
+      word_found.list_item = nstrdup(candidate);
+      word_found.dist = 1;
+      word_found.cost = 1;		// for the moment
+      results.insert_sorted(&word_found);
+    }
+    if (last_letter_found)
+      break;
+    // Prepare new pair
+    candidate[j - 1] = candidate[j];
+    candidate[j] = ' ';
+  }
+}//spell_fsa::find_runon_dict
 #endif
 #endif
 
@@ -661,7 +787,6 @@ spell_fsa::sparse_find_repl(const int depth, const long int start,
   int		dist = 0;
   ranked_hits	word_found;
   long int 	next;
-  fsa_arc_ptr 	*dummy;
 
   if (depth + 1 >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
@@ -679,7 +804,7 @@ spell_fsa::sparse_find_repl(const int depth, const long int start,
 	// from word_ff match
 	if (cc == ANNOT_SEPARATOR) {
 	  // Move to annotations
-	  find_repl(depth, dummy->first_node(current_dict) + next,
+	  find_repl(depth, fsa_arc_ptr(first_node().arc + next, current_format),
 		    word_index, cand_index + 1);
 	}
 	else {
@@ -700,7 +825,7 @@ spell_fsa::sparse_find_repl(const int depth, const long int start,
       if (cuted(depth, word_index, cand_index) <= e_d) {
 	if (cc == ANNOT_SEPARATOR) {
 	  // Move to annotations
-	  find_repl(depth + 1, dummy->first_node(current_dict) + next,
+	  find_repl(depth + 1, fsa_arc_ptr(first_node().arc + next, current_format),
 		    word_index + 1, cand_index + 1);
 	}
 	else {
@@ -710,7 +835,7 @@ spell_fsa::sparse_find_repl(const int depth, const long int start,
 	if (match_word(word_index, cand_index)) {
 	  if (cc == ANNOT_SEPARATOR) {
 	    // Move to annotations
-	    find_repl(depth + 1, dummy->first_node(current_dict) + next,
+	    find_repl(depth + 1, fsa_arc_ptr(first_node().arc + next, current_format),
 		      word_index + 2, cand_index + 1);
 	  }
 	  else {
@@ -773,18 +898,19 @@ spell_fsa::sparse_find_repl(const int depth, const long int start,
  *		increases, this type of errors must be taken into
  *		consideration.
  */
+template <class A>
 hit_list *
-spell_fsa::find_repl(const int depth, fsa_arc_ptr start,
+spell_fsa::find_repl(const int depth, A start,
 		     const int word_index, const int cand_index)
 {
-  fsa_arc_ptr	next_node = start.set_next_node(current_dict);
+  A		next_node = start.set_next_node();
   int		dist = 0;
   ranked_hits	word_found;
 
   if (depth + 1 >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
 
-  forallnodes(i) {
+  forallarcs(i) {
     candidate[cand_index] = next_node.get_letter();
     if (match_candidate(word_index, cand_index)) {
       // The last two letters from candidate, and the previous letter
@@ -932,7 +1058,6 @@ spell_fsa::sparse_find_repl(const int depth, const long int start)
 {
   int		dist = 0;
   ranked_hits	word_found;
-  fsa_arc_ptr 	*dummy;
 
   if (depth + 1 >= cand_alloc)
     grow_string(candidate, cand_alloc, Max_word_len);
@@ -948,7 +1073,7 @@ spell_fsa::sparse_find_repl(const int depth, const long int start)
       if (cuted(depth) <= e_d) {
 	if (cc == ANNOT_SEPARATOR) {
 	  // Move to annotations
-	  find_repl(depth + 1, dummy->first_node(current_dict) + next);
+	  find_repl(depth + 1, fsa_arc_ptr(first_node().arc + next, current_format));
 	}
 	else {
 	  // Stay in the sparse vector
@@ -982,10 +1107,11 @@ spell_fsa::sparse_find_repl(const int depth, const long int start)
  *		with Applications to Morphological Analysis and Spelling
  *		Correction", cmp-lg/9504031. Modified.
  */
+template <class A>
 hit_list *
-spell_fsa::find_repl(const int depth, fsa_arc_ptr start)
+spell_fsa::find_repl(const int depth, A start)
 {
-  fsa_arc_ptr	next_node = start.set_next_node(current_dict);
+  A		next_node = start.set_next_node();
   int		dist = 0;
   ranked_hits	word_found;
 //  int		kids = fsa_children(start);
@@ -994,7 +1120,7 @@ spell_fsa::find_repl(const int depth, fsa_arc_ptr start)
     grow_string(candidate, cand_alloc, Max_word_len);
 
 //  for (int i = 0; i < kids; i++, inc_next_node(next_node)) {
-  forallnodes(i) {
+  forallarcs(i) {
     candidate[depth] = next_node.get_letter();
     if (cuted(depth) <= e_d) {
       find_repl(depth + 1, next_node);
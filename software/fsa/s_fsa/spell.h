@@ -113,6 +113,10 @@ public:
   int spell_word(const char * word, const bool force);
 #ifdef RUNON_WORDS
   hit_list *find_runon(const char *word);
+#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
+  template <class A>
+  void find_runon_dict(const char *word, A start, dict_desc *d);
+#endif
 #endif
 #ifdef CHCLASS
   int read_character_class_tables(const char *file_name);
@@ -122,16 +126,19 @@ public:
   hit_list *sparse_find_repl(const int depth, const long start,
 			     const int word_index, const int cand_index);
 #endif
-  hit_list *find_repl(const int depth, fsa_arc_ptr start, const int word_index,
+  template <class A>
+  hit_list *find_repl(const int depth, A start, const int word_index,
 		      const int cand_index);
 #else //!CHCLASS
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
   hit_list *find_repl(const int depth, const long start);
 #endif
-  hit_list *find_repl(const int depth, fsa_arc_ptr start);
+  template <class A>
+  hit_list *find_repl(const int depth, A start);
 #endif
   void find_repl_all_dicts(void);
   int spell_file(const int distance, const bool force, tr_io &io_obj);
+  int check_file(tr_io &io_obj);
 };/*class spell_fsa*/
 
 
@@ -136,9 +136,6 @@ int
 synth_fsa::synth_word(const char *word, const char *tags)
 {
   dict_list		*dict;
-#if !(defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE))
-  fsa_arc_ptr		*dummy = NULL;
-#endif
   char			converted = '\0';
 
   dictionary.reset();
@@ -149,7 +146,7 @@ synth_fsa::synth_word(const char *word, const char *tags)
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
     sparse_synth_next_char(word, 0, sparse_vect->get_first(), tags);
 #else
-    synth_next_char(word, 0, dummy->first_node(current_dict), tags);
+    synth_next_char(word, 0, first_node(), tags);
 #endif
 #ifdef CASECONV
     if (is_downcaseable(word)) {
@@ -161,18 +158,17 @@ synth_fsa::synth_word(const char *word, const char *tags)
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
     sparse_synth_next_char(word, 0, sparse_vect->get_first(), tags);
 #else
-    synth_next_char(word, 0, dummy->first_node(current_dict), tags);
+    synth_next_char(word, 0, first_node(), tags);
 #endif
 #ifdef CASECONV
     if (converted) {
       // convert back to uppercase
       myflipcase((char *)word, 1);
       //*((char *)word) = casetab[(unsigned char)*word];
-      fsa_arc_ptr xnt_node = dummy->first_node(current_dict);
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
       sparse_synth_next_char(word, 0, sparse_vect->get_first(), tags);
 #else
-      synth_next_char(word, 0, dummy->first_node(current_dict), tags);
+      synth_next_char(word, 0, first_node(), tags);
 #endif
     }
 #endif
@@ -670,31 +666,30 @@ synth_fsa::sparse_synth_next_char(const char *word, const int level,
   int lev = level;
   long current = start;
   long next;
-  fsa_arc_ptr *dummy;
   do {
     found = false;
     if (*word == '\0') {
       if ((next = sparse_vect->get_target(current, ANNOT_SEPARATOR)) != -1L) {
 	if (useREs) {
-	  synth_RE(lev, current_dict + next
+	  synth_RE(lev, node_at(next
 #ifdef NUMBERS
-		   + dummy->entryl
+		   + current_format->entryl
 #endif //NUMBERS
-		   );
+		   ));
 	}
 	else if (gen_all_forms) {
-	  skip_tags(lev, current_dict + next
+	  skip_tags(lev, node_at(next
 #ifdef NUMBERS
-		    + dummy->entryl
+		    + current_format->entryl
 #endif //NUMBERS
-		    );
+		    ));
 	}
 	else {
-	  synth_tags(lev, current_dict + next
+	  synth_tags(lev, node_at(next
 #ifdef NUMBERS
-		     + dummy->entryl
+		     + current_format->entryl
 #endif //NUMBERS
-		     , tags);
+		     ), tags);
 	}
       }
     }
@@ -764,7 +759,7 @@ synth_fsa::synth_next_char(const char *word, const int level,
   int lev = level;
   do {
     found = false;
-    fsa_arc_ptr next_node = start.set_next_node(current_dict);
+    fsa_arc_ptr next_node = start.set_next_node();
     if (*word == '\0') {
       forallnodes(i) {
 	if (next_node.get_letter() == ANNOT_SEPARATOR) {
@@ -825,11 +820,11 @@ int
 synth_fsa::synth_tags(const int level, fsa_arc_ptr start, const char *tags)
 {
   const char *t = tags;
-  fsa_arc_ptr next_node = start.set_next_node(current_dict);
+  fsa_arc_ptr next_node = start.set_next_node();
   if (*t == '\0') {
     forallnodes(i) {
       if (next_node.get_letter() == ANNOT_SEPARATOR) {
-	fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	fsa_arc_ptr nxt_node = next_node.set_next_node();
 #ifdef MORPH_INFIXES
 	if (morph_infixes || morph_infixes) {
 	  synth_prefix(level, 0, nxt_node);
@@ -866,10 +861,10 @@ synth_fsa::synth_tags(const int level, fsa_arc_ptr start, const char *tags)
 int
 synth_fsa::skip_tags(const int level, fsa_arc_ptr start)
 {
-  fsa_arc_ptr next_node = start.set_next_node(current_dict);
+  fsa_arc_ptr next_node = start.set_next_node();
   forallnodes(i) {
     if (next_node.get_letter() == ANNOT_SEPARATOR) {
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      fsa_arc_ptr nxt_node = next_node.set_next_node();
 #ifdef MORPH_INFIXES
       if (morph_infixes || morph_infixes) {
 	synth_prefix(level, 0, nxt_node);
@@ -905,12 +900,12 @@ synth_fsa::skip_tags(const int level, fsa_arc_ptr start)
 int
 synth_fsa::synth_RE(const int level, fsa_arc_ptr start, const int dstate)
 {
-  fsa_arc_ptr next_node = start.set_next_node(current_dict);
+  fsa_arc_ptr next_node = start.set_next_node();
   int	ns = -1;		// next DFA state
   forallnodes(i) {
     if (next_node.get_letter() == ANNOT_SEPARATOR) {
       if (dfa.is_final(dstate)) {
-	fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+	fsa_arc_ptr nxt_node = next_node.set_next_node();
 #ifdef MORPH_INFIXES
 	if (morph_infixes || morph_infixes) {
 	  synth_prefix(level, 0, nxt_node);
@@ -966,7 +961,7 @@ synth_fsa::synth_prefix(const int level, const int plen,
 
   forallnodes(i) {
     if ((c = next_node.get_letter()) == ANNOT_SEPARATOR) {
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      fsa_arc_ptr nxt_node = next_node.set_next_node();
       if (morph_infixes) {
 	synth_infix(level, plen, nxt_node);
       }
@@ -981,7 +976,7 @@ synth_fsa::synth_prefix(const int level, const int plen,
     /*
     if ((delete_length = (next_node.get_letter() - 'A')) >= 0 &&
 	delete_length < word_length) {
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      fsa_arc_ptr nxt_node = next_node.set_next_node();
       synth_stem(delete_length, delete_position, level, nxt_node);
     }
     */
@@ -1079,7 +1074,7 @@ synth_fsa::synth_stem(const int level, const int plen,
 	candidate[rest_start] = '\0';
 	replacements.insert_sorted(candidate);
       }
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      fsa_arc_ptr nxt_node = next_node.set_next_node();
       synth_rest(rest_start, nxt_node);
     }
   }
@@ -1115,7 +1110,7 @@ synth_fsa::synth_rest(const int level, fsa_arc_ptr start)
 	candidate[level + 1] = '\0';
 	replacements.insert_sorted(candidate);
       }
-      fsa_arc_ptr nxt_node = next_node.set_next_node(current_dict);
+      fsa_arc_ptr nxt_node = next_node.set_next_node();
       synth_rest(level + 1, nxt_node);
     }
   }
@@ -49,7 +49,6 @@ int
 visual_fsa::create_graphs(void)
 {
   dict_list	*dict;
-  fsa_arc_ptr	*dummy = NULL;
   fsa_arc_ptr	start_node, next_node;
   int		g;
 
@@ -79,35 +78,35 @@ visual_fsa::create_graphs(void)
     cout << "  node: {" << endl
 	 << "    title: \"n0\"" << endl
 	 << "  }" << endl << endl;
-    start_node = dummy->first_node(current_dict);
-    next_node = start_node.set_next_node(current_dict);
+    start_node = first_node();
+    next_node = start_node.set_next_node();
     current_offset = next_node.arc - current_dict;
 #if defined(FLEXIBLE) && defined(STOPBIT) && defined(SPARSE)
     sparse_create_nodes();
     for (unsigned int k = 0; k < start_states.size(); k++) {
-      create_node(current_dict + start_states[k]
+      create_node(node_at(start_states[k]
 #ifdef NUMBERS
-		  + dummy->entryl
+		  + current_format->entryl
 #endif
-		  );
+		  ));
     }
     if (compressed)
       memset(visited, 0, no_of_arcs / 8 + 1); // clear marks
     current_offset = next_node.arc - current_dict;
     sparse_create_edges();
     for (unsigned int kk = 0; kk < start_states.size(); kk++) {
-      create_edges(current_dict + start_states[kk]
+      create_edges(node_at(start_states[kk]
 #ifdef NUMBERS
-		   + dummy->entryl
+		   + current_format->entryl
 #endif
-		   );
+		   ));
     }
 #else //!(FLEXIBLE&STOPBIT&SPARSE)
-    create_node(start_node.set_next_node(current_dict));
+    create_node(start_node.set_next_node());
     if (compressed)
       memset(visited, 0, no_of_arcs / 8 + 1); // clear marks
     current_offset = next_node.arc - current_dict;
-    create_edges(start_node.set_next_node(current_dict));
+    create_edges(start_node.set_next_node());
 #endif
     cout << "}" << endl;
     if (compressed)
@@ -130,11 +129,11 @@ visual_fsa::create_graphs(void)
 int
 visual_fsa::words_in_node(fsa_arc_ptr start)
 {
-  fsa_arc_ptr next_node = start.set_next_node(current_dict);
+  fsa_arc_ptr next_node = start.set_next_node();
 
   return (start.get_goto() ?
-    bytes2int((unsigned char *)next_node.arc - next_node.entryl,
-	      next_node.entryl)
+    bytes2int((unsigned char *)next_node.arc - next_node.format->entryl,
+	      next_node.format->entryl)
       : 0);
 }//visual_fsa::words_in_node
 #endif
@@ -152,13 +151,10 @@ visual_fsa::create_node(fsa_arc_ptr start)
 {
   fsa_arc_ptr	next_node = start;
   fsa_arc_ptr	next_start;
-#ifdef NUMBERS
-  fsa_arc_ptr	*dummy;
-#endif
 
   if (start.get_goto() == 0 || start.arc == current_dict
 #ifdef NUMBERS
-      + dummy->entryl
+      + current_format->entryl
 #endif
       )
     return 0;
@@ -173,7 +169,7 @@ visual_fsa::create_node(fsa_arc_ptr start)
     cout << " node: {" << endl
 	 << "   title: \"n" << next_node.arc - current_dict << "\"" << endl;
 #ifdef NUMBERS
-    if (dummy->entryl) {
+    if (current_format->entryl) {
       // print the cardinality of the right language
       cout << "   info1: \"" << words_in_node(start) << "\"" << endl;
     }
@@ -182,7 +178,7 @@ visual_fsa::create_node(fsa_arc_ptr start)
 
     // Increase current offset
     next_start = next_node;
-    next_node = start.set_next_node(current_dict);
+    next_node = start.set_next_node();
 //    for (int i = 0; i < kids; i++, ++next_start)
     forallnodes(i)
       ;
@@ -194,7 +190,7 @@ visual_fsa::create_node(fsa_arc_ptr start)
     // Print child nodes
 //    for (int i = 0; i < kids; i++, ++next_node) {
     forallnodes(j) {
-      create_node(next_node.set_next_node(current_dict));
+      create_node(next_node.set_next_node());
     }
   }
   return TRUE;
@@ -212,13 +208,10 @@ visual_fsa::create_edges(fsa_arc_ptr start)
 {
   fsa_arc_ptr	next_node = start;
   fsa_arc_ptr	start_node;
-#ifdef NUMBERS
-  fsa_arc_ptr	*dummy;
-#endif
 
   if (start.get_goto() == 0 || start.arc == current_dict
 #ifdef NUMBERS
-      + dummy->entryl
+      + current_format->entryl
 #endif
       )
     return 0;
@@ -235,7 +228,7 @@ visual_fsa::create_edges(fsa_arc_ptr start)
 	   << endl
 	   << "    targetname: \"n"
 	   << (next_node.get_goto() ?
-	       next_node.set_next_node(current_dict) - current_dict
+	       next_node.target() - current_dict
 	       : 0) << "\""
 	   << endl
 	   << "    label: \"" << next_node.get_letter()
@@ -252,9 +245,9 @@ visual_fsa::create_edges(fsa_arc_ptr start)
       set_bit((start_node.arc - current_dict) / arc_size, visited);
 
     // Print edges of children
-    next_node = start.set_next_node(current_dict);
+    next_node = start.set_next_node();
     forallnodes(j) {
-      create_edges(next_node.set_next_node(current_dict));
+      create_edges(next_node.set_next_node());
     }
   }
   return TRUE;